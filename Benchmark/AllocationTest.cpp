@@ -0,0 +1,379 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host test that the light sample path does not
+//    allocate. It runs the parts of the path that are built for the host
+//    against Isl29018Model, the way the driver runs them for every sample:
+//
+//    - the beat's status read with BusExecutor::ReadAsync and the interrupt's
+//      with BusExecutor::Read, the threshold window written as one list and
+//      range switches written to COMMAND2
+//    - SamplePipeline's decimation, conversion, filter, auto-ranging and
+//      threshold test, with the extra conversions of oversampling read from
+//      the data registers
+//    - the hand-off through SampleRing, the batching SampleFifo, the
+//      SampleHistory, the SamplePublisher section and the SampleRecorder
+//      recording
+//    - the latency histograms, the sample counters and the beat scheduler
+//
+//    The light changes fast enough for the range to switch back and forth.
+//    After a warmup that lets every lazily initialized part of the host
+//    runtime settle, the test counts the allocations of the process, see
+//    HostAllocations.h, and fails on any.
+//
+//    Usage: AllocationTest [-samples N]
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "HostAllocations.h"
+#include "HostTest.h"
+#include "BusExecutor.h"
+#include "Isl29018Model.h"
+#include "SamplePipeline.h"
+#include "SampleFifo.h"
+#include "SampleHistory.h"
+#include "SamplePublisher.h"
+#include "SampleRecorder.h"
+#include "SampleCounters.h"
+#include "LatencyHistogram.h"
+#include "BeatScheduler.h"
+#include "ThresholdWindow.h"
+
+#define ARRAYSIZE(A)                        (sizeof(A) / sizeof((A)[0]))
+
+#define AllocationTest_Chip                 (ISL29018_CHIP_29018)
+#define AllocationTest_DefaultSamples       (100000)
+#define AllocationTest_WarmupSamples        (1000)
+#define AllocationTest_IrCoefficient        (0.25f)
+#define AllocationTest_IntervalMs           (ISL29018_CONV_TIME_MS)
+#define AllocationTest_RecordCapacity       (1024)
+
+// Samples an oversampled beat averages, and how often a beat is oversampled
+#define AllocationTest_Oversample           (4)
+#define AllocationTest_OversamplePeriod     (8)
+
+// 100ns per unit of time
+#define AllocationTest_Millisecond          (10000ULL)
+#define AllocationTest_Second               (1000ULL * AllocationTest_Millisecond)
+
+// From the dark to the sun and back within a minute, so the range switches
+static const ISL29018_LIGHT_POINT g_Light[] =
+{
+    { 0 * AllocationTest_Second,            0.5f,       0.0f,       0.0f },
+    { 20 * AllocationTest_Second,           30000.0f,   15000.0f,   0.0f },
+    { 40 * AllocationTest_Second,           200.0f,     50.0f,      0.0f },
+    { 60 * AllocationTest_Second,           0.5f,       0.0f,       0.0f },
+};
+
+// Storage the driver maps from files and sections
+static BYTE g_Recording[sizeof(SAMPLE_RECORD_HEADER) + AllocationTest_RecordCapacity * sizeof(SAMPLE_RECORD)];
+static ISL29018_SHARED_SAMPLE g_SharedSample;
+
+// The light sample path of AlsDevice without the framework
+typedef class _HotPath : public SamplePipeline
+{
+private:
+    PIsl29018Model          m_pModel;
+    BusExecutor             m_Bus;
+    SampleRing              m_Ring;
+    SampleFifo              m_Fifo;
+    SampleHistory           m_History;
+    SamplePublisher         m_Publisher;
+    SampleRecorder          m_Recorder;
+    SampleCounters          m_Counters;
+    LatencyHistogram        m_Latency;
+    BeatScheduler           m_Beat;
+    BYTE                    m_SampleBuffer[ISL29018_STATUS_SIZE_BYTES];
+    NTSTATUS                m_ReadStatus;
+    ULONGLONG               m_Now;
+    ULONG                   m_Beats;
+    ULONG                   m_Errors;
+
+    static FILETIME GetFileTime(_In_ ULONGLONG Time)
+    {
+        return { static_cast<ULONG>(Time), static_cast<ULONG>(Time >> 32) };
+    }
+
+    static VOID OnSampleRead(
+        _In_ PVOID Context,
+        _In_ NTSTATUS Status)
+    {
+        static_cast<_HotPath*>(Context)->m_ReadStatus = Status;
+    }
+
+    // See AlsDevice::IsrOn
+    NTSTATUS WriteThresholdWindow()
+    {
+        THRESHOLD_WINDOW Window = GetThresholdWindow(AllocationTest_IrCoefficient);
+
+        BYTE Bytes[] =
+        {
+            static_cast<BYTE>(Window.LowCount & 0xFF), static_cast<BYTE>(Window.LowCount >> 8),
+            static_cast<BYTE>(Window.HighCount & 0xFF), static_cast<BYTE>(Window.HighCount >> 8),
+        };
+        BUS_OPERATION Operations[ARRAYSIZE(Bytes)];
+
+        for (ULONG i = 0; i < ARRAYSIZE(Bytes); i++)
+        {
+            Operations[i] = { BusOperation_Write, static_cast<BYTE>(ISL29018_REG_ADD_INT_LT_LSB + i), &Bytes[i], 1 };
+        }
+
+        return m_Bus.Execute(Operations, ARRAYSIZE(Operations));
+    }
+
+    // See AlsDevice::GetOversample
+    VOID ReadOversample()
+    {
+        BYTE DataBuffer[ISL290185_DATA_SIZE_BYTES];
+        FILETIME Now = GetFileTime(m_Now);
+
+        if (NT_SUCCESS(m_Bus.Read(ISL29018_REG_ADD_DATA_LSB, DataBuffer, sizeof(DataBuffer))))
+        {
+            ULONG RawCount = (static_cast<ULONG>(DataBuffer[1]) << 8) | DataBuffer[0];
+            m_Decimator.Add(RawCount);
+            m_Recorder.Append(SampleRecord_Oversample, &Now, RawCount, GetCommand2());
+        }
+        else
+        {
+            m_Errors++;
+        }
+    }
+
+    // See AlsDevice::ProcessData and the delivery work item
+    VOID ProcessData(
+        _In_ ULONGLONG Start)
+    {
+        FILETIME CaptureTime = GetFileTime(Start);
+
+        m_Counters.OnSample();
+        if (!NT_SUCCESS(m_ReadStatus) || m_SampleBuffer[ISL29018_STATUS_COMMAND2] != GetCommand2())
+        {
+            m_Counters.OnError();
+            m_Errors++;
+            return;
+        }
+
+        ULONG RawCount = GetStatusRawCount(m_SampleBuffer);
+        m_Recorder.Append(SampleRecord_Als, &CaptureTime, RawCount, m_SampleBuffer[ISL29018_STATUS_COMMAND2]);
+
+        if (DiscardSample())
+        {
+            return;
+        }
+
+        ULONG Range = m_AutoRange.GetRange();
+        ULONG Resolution = m_AutoRange.GetResolution();
+        ULONG Conversions = ConvertSample(RawCount, AllocationTest_IrCoefficient);
+
+        ULONG PreviousRange = m_AutoRange.GetRange();
+        if (m_AutoRange.Evaluate(RawCount) &&
+            !NT_SUCCESS(m_Bus.Write(ISL29018_REG_ADD_COMMAND2, GetCommand2())))
+        {
+            m_AutoRange.SetRange(PreviousRange);
+            m_AutoRange.ConsumeDiscard();
+            m_Errors++;
+        }
+
+        m_History.Add(&CaptureTime, m_CachedData, RawCount, m_IrInterleave.GetIrCount(),
+                      Range, Resolution, Conversions, 0);
+
+        RING_SAMPLE Sample;
+        if (TakeReport(&CaptureTime, RawCount, &Sample))
+        {
+            m_Ring.Enqueue(Sample);
+        }
+
+        // Delivery: batch, report and publish
+        while (m_Ring.Dequeue(&Sample))
+        {
+            m_Fifo.Push(Sample.Sample);
+
+            FIFO_SAMPLE Reported;
+            while (m_Fifo.Pop(&Reported))
+            {
+                m_Counters.OnReport();
+                m_Publisher.Publish(&Reported.Timestamp, Reported.Lux, Sample.RawCount, Range, Resolution);
+            }
+        }
+
+        m_Latency.RecordSince(LatencyStage_Sample, Start, m_Now);
+
+        SAMPLE_COUNTS Counts;
+        m_Counters.TakeIfDue(m_Now, &Counts);
+    }
+
+public:
+    NTSTATUS Initialize(
+        _In_ PIsl29018Model pModel)
+    {
+        ULONG Resolution = Isl29018SelectResolution(AllocationTest_Chip, AllocationTest_IntervalMs);
+
+        m_pModel = pModel;
+        m_AutoRange.Reset(ISL29018_RANGE_4K, Resolution);
+        m_IrInterleave.Reset();
+        m_Filter.Reset(NoiseFilter_Kalman);
+        m_LastRawCount = 0;
+        m_Decimator.Reset();
+        m_FirstSample = true;
+        m_CachedThresholds.LuxPct = 0.01f;
+        m_CachedThresholds.LuxAbs = 0.5f;
+        m_CachedData = 1.0f;
+        m_LastSample = 0.0f;
+        m_Now = 0;
+        m_Beats = 0;
+        m_Errors = 0;
+
+        m_Ring.Reset();
+        m_Fifo.Reset();
+        m_Fifo.ResetCounters();
+        m_Counters.Reset(0);
+        m_Latency.Reset(0);
+        m_Beat.Reset(CatchUpPolicy_Coalesce);
+        m_Beat.Start(0, AllocationTest_IntervalMs);
+        m_Publisher.Attach(&g_SharedSample);
+        if (!m_Recorder.Attach(g_Recording, sizeof(g_Recording), AllocationTest_IrCoefficient))
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        NTSTATUS Status = m_Bus.Initialize(NULL, &m_Latency);
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Connect(pModel);
+        }
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Write(ISL29018_REG_ADDR_TEST, 0x00);
+        }
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Write(ISL29018_REG_ADD_COMMAND2, GetCommand2());
+        }
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Write(ISL29018_REG_ADD_COMMAND1, ISL29018_CMD1_OPMODE_ALS_CONT << ISL29018_CMD1_OPMODE_SHIFT);
+        }
+
+        return Status;
+    }
+
+    VOID Deinitialize()
+    {
+        m_Bus.Deinitialize();
+        m_Publisher.Detach();
+        m_Recorder.Detach();
+    }
+
+    // One beat: a polled sample, every so often oversampled, and in between
+    // the interrupt path
+    VOID Beat()
+    {
+        ULONGLONG Interval = AllocationTest_IntervalMs * AllocationTest_Millisecond;
+        ULONGLONG ConversionTime = m_pModel->GetIntegrationTime(m_AutoRange.GetResolution());
+
+        m_Beats++;
+        if (0 == m_Beats % AllocationTest_OversamplePeriod)
+        {
+            m_Decimator.Reset();
+            for (ULONG i = 1; i < AllocationTest_Oversample; i++)
+            {
+                m_pModel->AdvanceTo(m_Now + i * ConversionTime);
+                ReadOversample();
+            }
+        }
+
+        m_Now += Interval;
+        m_pModel->AdvanceTo(m_Now);
+        m_Beat.OnBeat(m_Now);
+
+        m_Bus.ReadAsync(ISL29018_REG_ADD_COMMAND1, m_SampleBuffer, sizeof(m_SampleBuffer), OnSampleRead, this);
+        m_Bus.WaitForAsync();
+        ProcessData(m_Now);
+
+        // The interrupt's read and the window it arms
+        m_Counters.OnInterrupt();
+        m_ReadStatus = m_Bus.Read(ISL29018_REG_ADD_COMMAND1, m_SampleBuffer, sizeof(m_SampleBuffer));
+        ProcessData(m_Now);
+        if (!NT_SUCCESS(WriteThresholdWindow()))
+        {
+            m_Errors++;
+        }
+    }
+
+    ULONG GetErrors() const { return m_Errors; }
+    ULONG GetRangeSwitches() const { return m_AutoRange.GetSwitchCount(); }
+    ULONGLONG GetPublished() const { return m_Publisher.GetSequence(); }
+
+} HotPath, *PHotPath;
+
+int main(
+    _In_ int argc,
+    _In_reads_(argc) char** argv)
+{
+    ULONG Samples = AllocationTest_DefaultSamples;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-samples") && i + 1 < argc)
+        {
+            Samples = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else
+        {
+            fprintf(stderr, "Usage: AllocationTest [-samples N]\n");
+            return 1;
+        }
+    }
+
+    static Isl29018Model Model;
+    static HotPath Path;
+
+    Model.Reset(AllocationTest_Chip);
+    Model.SetLightScript(g_Light, ARRAYSIZE(g_Light), 60 * AllocationTest_Second);
+    Model.SetNoise(0.02f, 0.5f);
+
+    NTSTATUS Status = Path.Initialize(&Model);
+    if (!NT_SUCCESS(Status))
+    {
+        fprintf(stderr, "The sample path cannot be initialized 0x%08x\n", Status);
+        return 1;
+    }
+
+    for (ULONG i = 0; i < AllocationTest_WarmupSamples; i++)
+    {
+        Path.Beat();
+    }
+
+    ULONG SwitchesBefore = Path.GetRangeSwitches();
+    ULONGLONG PublishedBefore = Path.GetPublished();
+    LONG AllocationsBefore = GetHostAllocations();
+
+    for (ULONG i = 0; i < Samples; i++)
+    {
+        Path.Beat();
+    }
+
+    LONG Allocations = GetHostAllocations() - AllocationsBefore;
+
+    Path.Deinitialize();
+
+    HOST_EXPECT(0 == Allocations, "%d allocations in %u samples", Allocations, Samples);
+    HOST_EXPECT(0 == Path.GetErrors(), "%u samples or bus operations failed", Path.GetErrors());
+
+    // The run must have gone through the whole path for the count to matter
+    HOST_EXPECT(Path.GetRangeSwitches() > SwitchesBefore, "the range never switched");
+    HOST_EXPECT(Path.GetPublished() > PublishedBefore, "nothing was reported");
+
+    printf("samples,allocations,range_switches,reports\n");
+    printf("%u,%d,%u,%llu\n", Samples, Allocations, Path.GetRangeSwitches() - SwitchesBefore,
+           static_cast<unsigned long long>(Path.GetPublished() - PublishedBefore));
+
+    return HostTestResult("AllocationTest");
+}
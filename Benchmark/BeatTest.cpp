@@ -0,0 +1,327 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host test of BeatScheduler.h on a virtual clock
+//    that starts at 100 days of uptime, past the 49.7 days a 32-bit
+//    millisecond count wraps at:
+//
+//    - beats on multiples of the interval since the epoch, a first sample
+//      after a start that does not use up the beat, the same deadline for a
+//      restart and for a second chip, and the phase across interval changes
+//    - 100k beats at 100 ms and then 250 ms with a timer latency of 0-2 ms,
+//      against the mean and largest deadline error
+//    - the missed beats and the samples taken back to back after a stall,
+//      for each catch-up policy
+//    - the same 100k beats with a 350 ms stall every 5000 samples, where
+//      every beat is either sampled or counted as missed
+//
+//    Usage: BeatTest
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <cstdio>
+
+#include "HostTest.h"
+#include "BeatScheduler.h"
+
+#define BeatTest_Uptime                     (100ULL * 24 * 60 * 60 * 1000 * BeatScheduler_TicksPerMs)
+
+// Keeps the start off every beat
+#define BeatTest_StartOffset                (12345678ULL)
+
+#define BeatTest_Beats                      (100000)
+#define BeatTest_StallEvery                 (5000)
+#define BeatTest_Stall                      (350 * BeatScheduler_TicksPerMs)
+
+static const char* const BeatTest_PolicyNames[CatchUpPolicy_Count] = { "skip", "coalesce", "burst" };
+
+// The clock and the samples of a run
+typedef struct _BEAT_RUN
+{
+    ULONGLONG   Now;
+    ULONGLONG   Samples;
+    ULONGLONG   BackToBack;     // Samples taken without a wait, because their beat passed already
+    ULONGLONG   OffGrid;        // Deadlines that are not a multiple of the interval
+} BEAT_RUN, *PBEAT_RUN;
+
+// 0-2 ms in steps of 0.1 ms, a mean of 1 ms, and 1.3 ms at most from one sample to the next
+static ULONGLONG TimerLatency(
+    _In_ ULONGLONG Sample)
+{
+    return ((Sample * 8) % 21) * BeatScheduler_TicksPerMs / 10;
+}
+
+// The beat the next sample is due on, which the scheduler does not expose
+static ULONGLONG GetDeadline(
+    _In_ const BeatScheduler& Beat,
+    _In_ ULONGLONG Now)
+{
+    ULONGLONG Wait = Beat.GetWait(Now);
+    return (Wait != 0) ? (Now + Wait) : (Now - Beat.GetDeadlineError(Now));
+}
+
+// Take Count samples the way the polling timer does: wait until the next
+// beat, or not at all if it passed, and sample after the timer latency. Every
+// StallEvery-th sample is Stall later still.
+static VOID RunBeats(
+    _Inout_ BeatScheduler& Beat,
+    _Inout_ PBEAT_RUN pRun,
+    _In_ ULONG IntervalMs,
+    _In_ ULONG Count,
+    _In_ bool Latency,
+    _In_ ULONG StallEvery,
+    _In_ ULONGLONG Stall)
+{
+    ULONGLONG Period = IntervalMs * BeatScheduler_TicksPerMs;
+
+    for (ULONG i = 0; i < Count; i++)
+    {
+        ULONGLONG Wait = Beat.GetWait(pRun->Now);
+        if (Wait == 0)
+        {
+            pRun->BackToBack++;
+        }
+
+        pRun->Now += Wait;
+        if (Latency)
+        {
+            pRun->Now += TimerLatency(pRun->Samples);
+        }
+        if ((StallEvery != 0) && ((pRun->Samples % StallEvery) == (StallEvery - 1)))
+        {
+            pRun->Now += Stall;
+        }
+
+        Beat.OnBeat(pRun->Now);
+        pRun->Samples++;
+
+        if ((GetDeadline(Beat, pRun->Now) % Period) != 0)
+        {
+            pRun->OffGrid++;
+        }
+    }
+}
+
+static VOID TestPhase()
+{
+    static BeatScheduler Beat;
+    static BeatScheduler Second;
+    const ULONGLONG Period = 100 * BeatScheduler_TicksPerMs;
+    const ULONGLONG Start = BeatTest_Uptime + BeatTest_StartOffset;
+
+    HOST_EXPECT(BeatTest_Uptime / BeatScheduler_TicksPerMs > 0xFFFFFFFFULL,
+                "100 days of uptime do not wrap a 32-bit millisecond count");
+
+    Beat.Reset(CatchUpPolicy_Coalesce);
+    Beat.Start(Start, 100);
+
+    ULONGLONG Deadline = GetDeadline(Beat, Start);
+    HOST_EXPECT((Deadline % Period) == 0 && Deadline > Start && Deadline <= Start + Period,
+                "start at %llu: first beat at %llu is not the next multiple of 100 ms",
+                static_cast<unsigned long long>(Start), static_cast<unsigned long long>(Deadline));
+
+    // The sample taken on the start is early and leaves the beat alone
+    Beat.OnBeat(Start);
+    HOST_EXPECT(0 == Beat.GetBeats() && Deadline == GetDeadline(Beat, Start),
+                "the first sample took beat %llu, %llu beats",
+                static_cast<unsigned long long>(Deadline), static_cast<unsigned long long>(Beat.GetBeats()));
+
+    // Half an interval early, it is the beat already
+    Beat.OnBeat(Deadline - Period / 2);
+    HOST_EXPECT(1 == Beat.GetBeats() && Deadline + Period == GetDeadline(Beat, Deadline),
+                "a sample half an interval early: %llu beats",
+                static_cast<unsigned long long>(Beat.GetBeats()));
+
+    // A restart between beats, and a second chip started later, land on the same beat
+    ULONGLONG Now = Deadline + 37 * BeatScheduler_TicksPerMs;
+    Beat.Start(Now, 100);
+    Second.Reset(CatchUpPolicy_Coalesce);
+    Second.Start(Now + 21 * BeatScheduler_TicksPerMs, 100);
+    HOST_EXPECT(Deadline + Period == GetDeadline(Beat, Now),
+                "a restart moved the beat by %lld ticks",
+                static_cast<long long>(GetDeadline(Beat, Now) - (Deadline + Period)));
+    HOST_EXPECT(GetDeadline(Beat, Now) == GetDeadline(Second, Now),
+                "two chips started 21 ms apart are %lld ticks apart",
+                static_cast<long long>(GetDeadline(Second, Now) - GetDeadline(Beat, Now)));
+
+    // Interval changes land on multiples of the new interval, not on the time of the change
+    static const ULONG Intervals[] = { 250, 100, 30, 1000, 100 };
+    for (ULONG IntervalMs : Intervals)
+    {
+        ULONGLONG NewPeriod = IntervalMs * BeatScheduler_TicksPerMs;
+        Now += 7 * BeatScheduler_TicksPerMs;
+        Beat.Start(Now, IntervalMs);
+
+        Deadline = GetDeadline(Beat, Now);
+        HOST_EXPECT((Deadline % NewPeriod) == 0 && Deadline > Now && Deadline <= Now + NewPeriod,
+                    "%u ms at %llu: first beat at %llu is not the next multiple of the interval",
+                    IntervalMs, static_cast<unsigned long long>(Now), static_cast<unsigned long long>(Deadline));
+
+        Now = Deadline;
+    }
+
+    Beat.Start(Now, 0);
+    HOST_EXPECT(GetDeadline(Beat, Now) == Now + BeatScheduler_TicksPerMs,
+                "an interval of 0 is not 1 ms");
+
+    Beat.Reset(CatchUpPolicy_Count);
+    HOST_EXPECT(CatchUpPolicy_Coalesce == Beat.GetPolicy(), "policy %u is not coalesce", Beat.GetPolicy());
+    Beat.Reset(0xFFFFFFFF);
+    HOST_EXPECT(CatchUpPolicy_Coalesce == Beat.GetPolicy(), "policy %u is not coalesce", Beat.GetPolicy());
+}
+
+static VOID TestLatency()
+{
+    static const ULONG Intervals[] = { 100, 250 };
+    static BeatScheduler Beat;
+    BEAT_RUN Run = {};
+
+    Run.Now = BeatTest_Uptime + BeatTest_StartOffset;
+    Beat.Reset(CatchUpPolicy_Coalesce);
+
+    for (ULONG IntervalMs : Intervals)
+    {
+        Beat.Start(Run.Now, IntervalMs);
+        RunBeats(Beat, &Run, IntervalMs, BeatTest_Beats / 2, true, 0, 0);
+    }
+
+    // The latency is the error, the beat does not drift with it
+    HOST_EXPECT(BeatTest_Beats == Beat.GetBeats() && 0 == Beat.GetMissedBeats(),
+                "%llu beats, %llu missed",
+                static_cast<unsigned long long>(Beat.GetBeats()), static_cast<unsigned long long>(Beat.GetMissedBeats()));
+    HOST_EXPECT(0 == Run.OffGrid && 0 == Run.BackToBack,
+                "%llu deadlines off the beat, %llu samples back to back",
+                static_cast<unsigned long long>(Run.OffGrid), static_cast<unsigned long long>(Run.BackToBack));
+    HOST_EXPECT(Beat.GetMeanError() >= 9 * BeatScheduler_TicksPerMs / 10 &&
+                Beat.GetMeanError() <= 11 * BeatScheduler_TicksPerMs / 10,
+                "mean deadline error %llu ticks, expected 1 ms",
+                static_cast<unsigned long long>(Beat.GetMeanError()));
+    HOST_EXPECT(2 * BeatScheduler_TicksPerMs == Beat.GetMaxError() &&
+                13 * BeatScheduler_TicksPerMs / 10 == Beat.GetMaxJitter(),
+                "largest deadline error %llu ticks and jitter %llu ticks, expected 2 ms and 1.3 ms",
+                static_cast<unsigned long long>(Beat.GetMaxError()), static_cast<unsigned long long>(Beat.GetMaxJitter()));
+}
+
+static VOID TestStall()
+{
+    typedef struct _STALL_CASE
+    {
+        ULONG       StallMs;
+        ULONGLONG   Missed[CatchUpPolicy_Count];
+        ULONGLONG   BackToBack[CatchUpPolicy_Count];
+        ULONG       NextBeat;       // Beats after the stalled one the next waited for sample is on
+    } STALL_CASE;
+
+    // A sample 350 ms late passed 3 beats, 750 ms late 7. Burst takes at most 4 of them.
+    static const STALL_CASE Cases[] =
+    {
+        { 350, { 3, 2, 0 }, { 0, 1, 3 }, 4 },
+        { 750, { 7, 6, 3 }, { 0, 1, 4 }, 8 },
+    };
+    static BeatScheduler Beat;
+    const ULONGLONG Period = 100 * BeatScheduler_TicksPerMs;
+
+    for (const STALL_CASE& Case : Cases)
+    {
+        for (ULONG Policy = CatchUpPolicy_Skip; Policy < CatchUpPolicy_Count; Policy++)
+        {
+            BEAT_RUN Run = {};
+
+            Run.Now = BeatTest_Uptime + BeatTest_StartOffset;
+            Beat.Reset(Policy);
+            Beat.Start(Run.Now, 100);
+            ULONGLONG Stalled = GetDeadline(Beat, Run.Now);
+
+            // The first sample stalls, the ones after it catch up until a wait
+            RunBeats(Beat, &Run, 100, 1, false, 1, Case.StallMs * BeatScheduler_TicksPerMs);
+            while (Beat.GetWait(Run.Now) == 0)
+            {
+                RunBeats(Beat, &Run, 100, 1, false, 0, 0);
+            }
+
+            ULONGLONG Next = GetDeadline(Beat, Run.Now);
+            HOST_EXPECT(Case.Missed[Policy] == Beat.GetMissedBeats(),
+                        "%s, %u ms stall: %llu missed beats, expected %llu",
+                        BeatTest_PolicyNames[Policy], Case.StallMs,
+                        static_cast<unsigned long long>(Beat.GetMissedBeats()),
+                        static_cast<unsigned long long>(Case.Missed[Policy]));
+            HOST_EXPECT(Case.BackToBack[Policy] == Run.BackToBack,
+                        "%s, %u ms stall: %llu samples back to back, expected %llu",
+                        BeatTest_PolicyNames[Policy], Case.StallMs,
+                        static_cast<unsigned long long>(Run.BackToBack),
+                        static_cast<unsigned long long>(Case.BackToBack[Policy]));
+            HOST_EXPECT(Stalled + Case.NextBeat * Period == Next,
+                        "%s, %u ms stall: next beat %lld ticks off the one %u beats after the stall",
+                        BeatTest_PolicyNames[Policy], Case.StallMs,
+                        static_cast<long long>(Next - (Stalled + Case.NextBeat * Period)), Case.NextBeat);
+            HOST_EXPECT(Beat.GetBeats() + Beat.GetMissedBeats() == Case.NextBeat,
+                        "%s, %u ms stall: %llu beats and %llu missed for %u beats",
+                        BeatTest_PolicyNames[Policy], Case.StallMs,
+                        static_cast<unsigned long long>(Beat.GetBeats()),
+                        static_cast<unsigned long long>(Beat.GetMissedBeats()), Case.NextBeat);
+        }
+    }
+}
+
+static VOID TestStalledRun()
+{
+    // At 100 ms a 350 ms stall passes 3 beats, at 250 ms 1, with 10 stalls at each
+    static const ULONG Intervals[] = { 100, 250 };
+    static const ULONGLONG Missed[CatchUpPolicy_Count] = { 10 * 3 + 10 * 1, 10 * 2 + 10 * 0, 0 };
+    static BeatScheduler Beat;
+
+    for (ULONG Policy = CatchUpPolicy_Skip; Policy < CatchUpPolicy_Count; Policy++)
+    {
+        BEAT_RUN Run = {};
+        ULONGLONG Accounted = 0;
+
+        Run.Now = BeatTest_Uptime + BeatTest_StartOffset;
+        Beat.Reset(Policy);
+
+        for (ULONG IntervalMs : Intervals)
+        {
+            ULONGLONG Period = IntervalMs * BeatScheduler_TicksPerMs;
+
+            Beat.Start(Run.Now, IntervalMs);
+            ULONGLONG First = GetDeadline(Beat, Run.Now);
+            ULONGLONG Before = Beat.GetBeats() + Beat.GetMissedBeats();
+
+            RunBeats(Beat, &Run, IntervalMs, BeatTest_Beats / 2, true, BeatTest_StallEvery, BeatTest_Stall);
+
+            // Every beat up to the next one was sampled or missed
+            ULONGLONG Beats = (GetDeadline(Beat, Run.Now) - First) / Period;
+            ULONGLONG Counted = Beat.GetBeats() + Beat.GetMissedBeats() - Before;
+            HOST_EXPECT(Beats == Counted,
+                        "%s at %u ms: %llu beats passed, %llu sampled or missed",
+                        BeatTest_PolicyNames[Policy], IntervalMs,
+                        static_cast<unsigned long long>(Beats), static_cast<unsigned long long>(Counted));
+            Accounted += Counted;
+        }
+
+        HOST_EXPECT(BeatTest_Beats == Beat.GetBeats() && Missed[Policy] == Beat.GetMissedBeats(),
+                    "%s: %llu beats and %llu missed, expected %u and %llu",
+                    BeatTest_PolicyNames[Policy],
+                    static_cast<unsigned long long>(Beat.GetBeats()),
+                    static_cast<unsigned long long>(Beat.GetMissedBeats()),
+                    BeatTest_Beats, static_cast<unsigned long long>(Missed[Policy]));
+        HOST_EXPECT(BeatTest_Beats + Missed[Policy] == Accounted,
+                    "%s: %llu beats accounted for", BeatTest_PolicyNames[Policy],
+                    static_cast<unsigned long long>(Accounted));
+        HOST_EXPECT(0 == Run.OffGrid,
+                    "%s: %llu deadlines off the beat", BeatTest_PolicyNames[Policy],
+                    static_cast<unsigned long long>(Run.OffGrid));
+    }
+}
+
+int main()
+{
+    TestPhase();
+    TestLatency();
+    TestStall();
+    TestStalledRun();
+
+    return HostTestResult("BeatTest");
+}
@@ -0,0 +1,514 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host simulation of the light sensor's acquisition
+//    against Isl29018Model. The driver's BusExecutor, built with
+//    ISL29018_BUS_MODEL, carries every register access to the model, and
+//    SamplePipeline and AcquisitionScheduler make the same decisions they
+//    make in the driver. Time is the model's virtual clock, so the runs take
+//    a fraction of the simulated time.
+//
+//    The light follows a scripted day that repeats for the simulated hours.
+//    Every acquisition strategy runs with every threshold setting; for each
+//    run the tool prints one CSV row of throughput, bus and latency figures.
+//
+//    Usage: BusSimulation [-hours N] [-interval MS] [-noise R]
+//                         [-record FILE [-capacity N]]
+//
+//    With -noise the conversions are noisy, with a standard deviation of R
+//    times the count plus Simulation_NoiseCounts. With -record the samples
+//    read in every run are recorded to FILE, see SampleRecorder.h, keeping
+//    the last N records. SampleReplay and FilterBench replay them.
+//
+//    The tool fails if a bus transfer failed or a sample read back another
+//    configuration than the one programmed, neither of which the model does
+//    unless the driver's bus access is broken.
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "BusExecutor.h"
+#include "Isl29018Model.h"
+#include "SamplePipeline.h"
+#include "SampleRecorder.h"
+#include "AcquisitionScheduler.h"
+#include "ThresholdWindow.h"
+
+#define ARRAYSIZE(A)                        (sizeof(A) / sizeof((A)[0]))
+
+// 100ns per unit of time
+#define Simulation_Millisecond              (10000ULL)
+#define Simulation_Hour                     (3600ULL * 1000ULL * Simulation_Millisecond)
+
+#define Simulation_Chip                     (ISL29018_CHIP_29018)
+#define Simulation_Initial_Range            (ISL29018_RANGE_4K)
+#define Simulation_IrCoefficient            (0.25f)
+#define Simulation_DefaultHours             (100)
+#define Simulation_DefaultIntervalMs        (ISL29018_CONV_TIME_MS)
+
+// Constant part of the noise with -noise, the chip's dark noise
+#define Simulation_NoiseCounts              (0.5f)
+
+// A day in an office with a window: night, dawn, the lights on, clouds
+// passing, the blinds down for a meeting, dusk and a desk lamp
+static const ISL29018_LIGHT_POINT g_Day[] =
+{
+    { 0 * Simulation_Hour,                              0.1f,       0.0f,       0.0f },
+    { 5 * Simulation_Hour,                              0.1f,       0.0f,       0.0f },
+    { 7 * Simulation_Hour,                              800.0f,     400.0f,     0.0f },
+    { 8 * Simulation_Hour,                              1200.0f,    500.0f,     0.0f },
+    { 10 * Simulation_Hour,                             9000.0f,    5000.0f,    0.0f },
+    { 10 * Simulation_Hour + 600000000ULL,              2500.0f,    1200.0f,    0.0f },
+    { 10 * Simulation_Hour + 1200000000ULL,             11000.0f,   6000.0f,    0.0f },
+    { 13 * Simulation_Hour,                             14000.0f,   8000.0f,    0.0f },
+    { 13 * Simulation_Hour + 10000000ULL,               350.0f,     30.0f,      0.0f },
+    { 14 * Simulation_Hour,                             350.0f,     30.0f,      0.0f },
+    { 14 * Simulation_Hour + 10000000ULL,               12000.0f,   7000.0f,    0.0f },
+    { 18 * Simulation_Hour,                             600.0f,     300.0f,     0.0f },
+    { 19 * Simulation_Hour,                             60.0f,      10.0f,      0.0f },
+    { 23 * Simulation_Hour,                             60.0f,      10.0f,      0.0f },
+    { 23 * Simulation_Hour + 10000000ULL,               0.1f,       0.0f,       0.0f },
+    { 24 * Simulation_Hour,                             0.1f,       0.0f,       0.0f },
+};
+
+typedef struct _SIMULATION_STATS
+{
+    ULONGLONG   Samples;            // Status blocks read and processed
+    ULONGLONG   FreshSamples;       // Samples holding a conversion not read before
+    ULONGLONG   Reports;
+    ULONGLONG   Errors;             // Failed reads and configuration mismatches
+    ULONGLONG   Isrs;               // Interrupts serviced
+    ULONGLONG   AgeSum;             // 100ns from the conversion to its read
+    ULONGLONG   AgeMax;
+} SIMULATION_STATS;
+
+// The light sensor's acquisition without the framework: polling beats and
+// interrupts are driven by the simulation loop instead of timers and the ISR
+typedef class _SimDevice : public SamplePipeline
+{
+private:
+    PIsl29018Model          m_pModel;
+    BusExecutor             m_Bus;
+    ULONG                   m_IntervalMs;
+    BYTE                    m_SampleBuffer[ISL29018_STATUS_SIZE_BYTES];
+    NTSTATUS                m_ReadStatus;
+    ULONGLONG               m_LastConversionRead;
+    SIMULATION_STATS        m_Stats;
+    SampleRecorder          m_Recorder;
+
+    static ULONG GetMs(_In_ ULONGLONG Time) { return static_cast<ULONG>(Time / Simulation_Millisecond); }
+
+    // Virtual time as a sample timestamp
+    static FILETIME GetFileTime(_In_ ULONGLONG Time)
+    {
+        return { static_cast<ULONG>(Time), static_cast<ULONG>(Time >> 32) };
+    }
+
+    static VOID OnSampleRead(
+        _In_ PVOID Context,
+        _In_ NTSTATUS Status)
+    {
+        static_cast<_SimDevice*>(Context)->m_ReadStatus = Status;
+    }
+
+    NTSTATUS WriteThresholdWindow(
+        _In_ USHORT LowCount,
+        _In_ USHORT HighCount)
+    {
+        BYTE Window[] =
+        {
+            static_cast<BYTE>(LowCount & 0xFF), static_cast<BYTE>(LowCount >> 8),
+            static_cast<BYTE>(HighCount & 0xFF), static_cast<BYTE>(HighCount >> 8),
+        };
+        BUS_OPERATION Operations[ARRAYSIZE(Window)];
+
+        for (ULONG i = 0; i < ARRAYSIZE(Window); i++)
+        {
+            Operations[i] = { BusOperation_Write, static_cast<BYTE>(ISL29018_REG_ADD_INT_LT_LSB + i), &Window[i], 1 };
+        }
+
+        return m_Bus.Execute(Operations, ARRAYSIZE(Operations));
+    }
+
+    // See AlsDevice::IsrOn
+    NTSTATUS IsrOn()
+    {
+        THRESHOLD_WINDOW Window = GetThresholdWindow(Simulation_IrCoefficient);
+        return WriteThresholdWindow(Window.LowCount, Window.HighCount);
+    }
+
+    NTSTATUS IsrOff()
+    {
+        return WriteThresholdWindow(0, ISL29018_MAX_COUNT);
+    }
+
+    // See AlsDevice::ProcessData. Returns true if the sample was reported.
+    bool ProcessData(
+        _In_ ULONGLONG Now)
+    {
+        FILETIME CaptureTime = GetFileTime(Now);
+
+        m_Stats.Samples++;
+
+        if (NT_SUCCESS(m_ReadStatus))
+        {
+            m_Recorder.Append(SampleRecord_Als, &CaptureTime, GetStatusRawCount(m_SampleBuffer),
+                              m_SampleBuffer[ISL29018_STATUS_COMMAND2]);
+        }
+        else
+        {
+            m_Recorder.Append(SampleRecord_ReadError, &CaptureTime, 0, GetCommand2());
+        }
+
+        if (!NT_SUCCESS(m_ReadStatus) || m_SampleBuffer[ISL29018_STATUS_COMMAND2] != GetCommand2())
+        {
+            m_Stats.Errors++;
+            return false;
+        }
+
+        ULONGLONG Conversion = m_pModel->GetLastConversion();
+        if (Conversion != m_LastConversionRead)
+        {
+            ULONGLONG Age = Now - Conversion;
+            m_LastConversionRead = Conversion;
+            m_Stats.FreshSamples++;
+            m_Stats.AgeSum += Age;
+            m_Stats.AgeMax = (Age > m_Stats.AgeMax) ? Age : m_Stats.AgeMax;
+        }
+
+        ULONG RawCount = GetStatusRawCount(m_SampleBuffer);
+        if (DiscardSample())
+        {
+            return false;
+        }
+
+        ConvertSample(RawCount, Simulation_IrCoefficient);
+
+        ULONG PreviousRange = m_AutoRange.GetRange();
+        if (m_AutoRange.Evaluate(RawCount) &&
+            !NT_SUCCESS(m_Bus.Write(ISL29018_REG_ADD_COMMAND2, GetCommand2())))
+        {
+            m_AutoRange.SetRange(PreviousRange);
+            m_AutoRange.ConsumeDiscard();
+        }
+
+        RING_SAMPLE Sample;
+        if (!TakeReport(&CaptureTime, RawCount, &Sample))
+        {
+            return false;
+        }
+
+        m_Stats.Reports++;
+        return true;
+    }
+
+public:
+    NTSTATUS Initialize(
+        _In_ PIsl29018Model pModel,
+        _In_ bool InterruptAvailable,
+        _In_ ULONG IntervalMs,
+        _In_ FLOAT LuxPct,
+        _In_ FLOAT LuxAbs)
+    {
+        ULONG Resolution = Isl29018SelectResolution(Simulation_Chip, IntervalMs);
+
+        m_pModel = pModel;
+        m_IntervalMs = IntervalMs;
+        m_AutoRange.Reset(Simulation_Initial_Range, Resolution);
+        m_IrInterleave.Reset();
+        m_Filter.Reset(NoiseFilter_None);
+        m_LastRawCount = 0;
+        m_Decimator.Reset();
+        m_FirstSample = true;
+        m_CachedThresholds.LuxPct = LuxPct;
+        m_CachedThresholds.LuxAbs = LuxAbs;
+        m_CachedData = 1.0f;
+        m_LastSample = 0.0f;
+        m_LastConversionRead = 0;
+        m_Stats = {};
+
+        m_Scheduler.ResetCounters();
+        m_Scheduler.Reset(0, InterruptAvailable, IntervalMs, LuxPct, LuxAbs,
+                          Isl29018ConversionTimeMs(Simulation_Chip, Resolution), false);
+
+        NTSTATUS Status = m_Bus.Initialize(NULL, nullptr);
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Connect(pModel);
+        }
+
+        // See g_ConfigurationSettings and AlsDevice::PowerOn
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Write(ISL29018_REG_ADDR_TEST, 0x00);
+        }
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Write(ISL29018_REG_ADD_COMMAND2, GetCommand2());
+        }
+        if (NT_SUCCESS(Status))
+        {
+            Status = IsrOff();
+        }
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Write(ISL29018_REG_ADD_COMMAND1, ISL29018_CMD1_OPMODE_ALS_CONT << ISL29018_CMD1_OPMODE_SHIFT);
+        }
+
+        FILETIME StartTime = GetFileTime(pModel->GetNow());
+        m_Recorder.Append(SampleRecord_Start, &StartTime, 0, GetCommand2());
+
+        return Status;
+    }
+
+    // Record the samples of the following runs into a mapped recording
+    bool AttachRecorder(
+        _Inout_updates_bytes_(Size) PVOID pView,
+        _In_ ULONGLONG Size)
+    {
+        return m_Recorder.Attach(pView, Size, Simulation_IrCoefficient);
+    }
+
+    VOID Deinitialize()
+    {
+        m_Bus.Deinitialize();
+    }
+
+    // Run the acquisition until the virtual clock reaches End
+    VOID Run(
+        _In_ ULONGLONG End)
+    {
+        ULONGLONG Interval = m_IntervalMs * Simulation_Millisecond;
+        ULONGLONG NextBeat = Interval;
+
+        // As in the driver the timer takes the first sample after a start
+        // whatever the scheduler's mode, and it stops once the window is armed
+        bool Polling = true;
+
+        while (m_pModel->GetNow() < End)
+        {
+            if (Polling)
+            {
+                m_pModel->AdvanceTo(NextBeat);
+
+                m_Bus.ReadAsync(ISL29018_REG_ADD_COMMAND1, m_SampleBuffer, sizeof(m_SampleBuffer), OnSampleRead, this);
+                m_Bus.WaitForAsync();
+
+                bool Reported = ProcessData(NextBeat);
+                if (AcquisitionMode_Interrupt == m_Scheduler.OnPolledSample(GetMs(NextBeat), Reported))
+                {
+                    IsrOn();
+                    Polling = false;
+                }
+
+                NextBeat += Interval;
+            }
+            else
+            {
+                // Sleep until the next conversion raises the interrupt
+                ULONGLONG Next = m_pModel->GetNextEvent();
+                if (0 == Next)
+                {
+                    break;
+                }
+                if (!m_pModel->AdvanceTo(Next))
+                {
+                    continue;
+                }
+
+                ULONGLONG Now = m_pModel->GetNow();
+                m_Stats.Isrs++;
+                m_ReadStatus = m_Bus.Read(ISL29018_REG_ADD_COMMAND1, m_SampleBuffer, sizeof(m_SampleBuffer));
+                ProcessData(Now);
+
+                if (AcquisitionMode_Interrupt == m_Scheduler.OnInterrupt(GetMs(Now)))
+                {
+                    IsrOn();
+                }
+                else
+                {
+                    IsrOff();
+                    NextBeat = Now + Interval;
+                    Polling = true;
+                }
+            }
+        }
+    }
+
+    const SIMULATION_STATS& GetStats() const { return m_Stats; }
+    ULONGLONG GetBusSubmissions() const { return m_Bus.GetSubmissions(); }
+    ULONGLONG GetBusFailures() const { return m_Bus.GetFailures(); }
+    ULONG GetRangeSwitches() const { return m_AutoRange.GetSwitchCount(); }
+    ULONG GetSwitchesToPolling() const { return m_Scheduler.GetSwitchesToPolling(); }
+
+} SimDevice, *PSimDevice;
+
+typedef struct _STRATEGY
+{
+    const char*         Name;
+    bool                InterruptAvailable;
+} STRATEGY;
+
+static const STRATEGY g_Strategies[] =
+{
+    { "poll", false },
+    { "hybrid", true },             // Interrupts, polling while the light changes fast
+};
+
+typedef struct _THRESHOLDS
+{
+    const char*         Name;
+    FLOAT               LuxPct;
+    FLOAT               LuxAbs;
+} THRESHOLDS;
+
+static const THRESHOLDS g_Thresholds[] =
+{
+    { "default", 1.0f, 0.0f },      // Als_Initial_Lux_Threshold_Pct and _Abs
+    { "fine", 0.01f, 0.5f },
+};
+
+int main(
+    _In_ int argc,
+    _In_reads_(argc) char** argv)
+{
+    ULONG Hours = Simulation_DefaultHours;
+    ULONG IntervalMs = Simulation_DefaultIntervalMs;
+    FLOAT Noise = 0.0f;
+    const char* pRecordPath = nullptr;
+    ULONG RecordCapacity = SampleRecord_DefaultCapacity;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-hours") && i + 1 < argc)
+        {
+            Hours = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (0 == strcmp(argv[i], "-interval") && i + 1 < argc)
+        {
+            IntervalMs = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (0 == strcmp(argv[i], "-noise") && i + 1 < argc)
+        {
+            Noise = strtof(argv[++i], nullptr);
+        }
+        else if (0 == strcmp(argv[i], "-record") && i + 1 < argc)
+        {
+            pRecordPath = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-capacity") && i + 1 < argc)
+        {
+            RecordCapacity = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else
+        {
+            fprintf(stderr, "Usage: BusSimulation [-hours N] [-interval MS] [-noise R] [-record FILE [-capacity N]]\n");
+            return 1;
+        }
+    }
+
+    if (0 == Hours || 0 == IntervalMs || 0 == RecordCapacity || Noise < 0.0f)
+    {
+        fprintf(stderr, "The hours, the interval and the capacity must not be 0, the noise not negative\n");
+        return 1;
+    }
+
+    static Isl29018Model Model;
+    static SimDevice Device;
+    int Result = 0;
+
+    // A new recording, mapped the way the driver maps it
+    PVOID pRecordView = MAP_FAILED;
+    ULONGLONG RecordSize = SampleRecordFileSize(RecordCapacity);
+    if (nullptr != pRecordPath)
+    {
+        int File = open(pRecordPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (File >= 0 && 0 == ftruncate(File, static_cast<off_t>(RecordSize)))
+        {
+            pRecordView = mmap(nullptr, RecordSize, PROT_READ | PROT_WRITE, MAP_SHARED, File, 0);
+        }
+        if (File >= 0)
+        {
+            close(File);
+        }
+        if (MAP_FAILED == pRecordView || !Device.AttachRecorder(pRecordView, RecordSize))
+        {
+            fprintf(stderr, "Cannot create the recording %s\n", pRecordPath);
+            return 1;
+        }
+    }
+
+    printf("strategy,thresholds,interval_ms,simulated_hours,samples,fresh_samples,reports,interrupts,"
+           "conversions,bus_submissions,range_switches,switches_to_polling,mean_age_ms,max_age_ms,"
+           "wall_s,simulated_hours_per_s\n");
+
+    for (const STRATEGY& Strategy : g_Strategies)
+    {
+        for (const THRESHOLDS& Thresholds : g_Thresholds)
+        {
+            Model.Reset(Simulation_Chip);
+            Model.SetLightScript(g_Day, ARRAYSIZE(g_Day), 24 * Simulation_Hour);
+            if (Noise > 0.0f)
+            {
+                Model.SetNoise(Noise, Simulation_NoiseCounts);
+            }
+
+            NTSTATUS Status = Device.Initialize(&Model, Strategy.InterruptAvailable, IntervalMs,
+                                                Thresholds.LuxPct, Thresholds.LuxAbs);
+            if (!NT_SUCCESS(Status))
+            {
+                fprintf(stderr, "%s/%s: initialization failed 0x%08x\n", Strategy.Name, Thresholds.Name, Status);
+                return 1;
+            }
+
+            auto Start = std::chrono::steady_clock::now();
+            Device.Run(Hours * Simulation_Hour);
+            double Wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+            const SIMULATION_STATS& Stats = Device.GetStats();
+            printf("%s,%s,%lu,%lu,%llu,%llu,%llu,%llu,%llu,%llu,%lu,%lu,%.3f,%.3f,%.3f,%.0f\n",
+                   Strategy.Name, Thresholds.Name,
+                   static_cast<unsigned long>(IntervalMs), static_cast<unsigned long>(Hours),
+                   static_cast<unsigned long long>(Stats.Samples),
+                   static_cast<unsigned long long>(Stats.FreshSamples),
+                   static_cast<unsigned long long>(Stats.Reports),
+                   static_cast<unsigned long long>(Stats.Isrs),
+                   static_cast<unsigned long long>(Model.GetConversions()),
+                   static_cast<unsigned long long>(Device.GetBusSubmissions()),
+                   static_cast<unsigned long>(Device.GetRangeSwitches()),
+                   static_cast<unsigned long>(Device.GetSwitchesToPolling()),
+                   (Stats.FreshSamples == 0) ? 0.0 :
+                       static_cast<double>(Stats.AgeSum) / Stats.FreshSamples / Simulation_Millisecond,
+                   static_cast<double>(Stats.AgeMax) / Simulation_Millisecond,
+                   Wall, Hours / Wall);
+
+            if (Stats.Errors != 0 || Device.GetBusFailures() != 0)
+            {
+                fprintf(stderr, "%s/%s: %llu sample errors, %llu bus failures\n", Strategy.Name, Thresholds.Name,
+                        static_cast<unsigned long long>(Stats.Errors),
+                        static_cast<unsigned long long>(Device.GetBusFailures()));
+                Result = 1;
+            }
+
+            Device.Deinitialize();
+        }
+    }
+
+    if (MAP_FAILED != pRecordView)
+    {
+        munmap(pRecordView, RecordSize);
+    }
+
+    return Result;
+}
@@ -0,0 +1,685 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host stress test of BusExecutor.h, built with
+//    ISL29018_BUS_MODEL so the transfers go to Isl29018Model. Threads submit
+//    to one executor at the same time, as the driver's timer, interrupt work
+//    item and configuration callbacks do:
+//
+//    - window threads run operation lists that write the four threshold
+//      registers one by one and read them back. A list that reads back
+//      another thread's bytes was not run without interruption.
+//    - a register thread writes and reads COMMAND2 with Write and Read
+//    - an asynchronous reader reads the status block with ReadAsync, as the
+//      timer does, and reads the data registers synchronously from its
+//      completion, which the executor allows
+//
+//    The model is not thread safe, so transfers the executor let overlap
+//    show up as lost transfer counts as well. The chip stays powered down
+//    and converts nothing.
+//
+//    The test checks that no list was torn, no operation failed and every
+//    submission and transfer was counted. It prints the submissions per
+//    second, the deepest queue for the bus and the mean and longest time the
+//    bus was held.
+//
+//    A second executor then runs the ADC schedule the two sensors share, the
+//    way client.cpp does: a timer thread takes the schedule's turns under the
+//    control lock without waiting for it, while a light and a proximity
+//    thread start and stop their sensors under it, stopping the timer and
+//    restarting the schedule when they let go. The test checks that the
+//    schedule never had two owners, that every conversion read back the
+//    OPMODE it was started with, that no stopped channel was left in flight,
+//    that the schedule runs both channels once the threads are done, and
+//    that the chip ends up powered down. A lock the timer waited for would
+//    hang the test.
+//
+//    Usage: BusStressTest [-threads N] [-iterations N]
+//
+//    -threads        window threads, 3 by default
+//    -iterations     lists, operations, reads, starts or stops per thread,
+//                    20000 by default
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "HostTest.h"
+#include "BusExecutor.h"
+#include "AdcArbiter.h"
+#include "DeviceLifecycle.h"
+
+#define BusStressTest_DefaultThreads        (3)
+#define BusStressTest_DefaultIterations     (20000)
+
+// Bytes of the threshold window, INT_LT_LSB through INT_HT_MSB
+#define BusStressTest_WindowSize            (4)
+
+// Transfers of a window list: a write per register and one read
+#define BusStressTest_WindowTransfers       (BusStressTest_WindowSize + 1)
+
+typedef struct _WINDOW_STATS
+{
+    ULONG       Torn;               // Lists that read back bytes they did not write
+    ULONG       Failures;
+} WINDOW_STATS;
+
+typedef struct _ASYNC_CONTEXT
+{
+    PBusExecutor    pBus;
+    BYTE            StatusBuffer[ISL29018_STATUS_SIZE_BYTES];
+    ULONG           Completions;
+    ULONG           Failures;
+} ASYNC_CONTEXT;
+
+// Data intervals of the shared schedule, in turns of the timer thread
+#define BusStressTest_AlsIntervalMs         (4)
+#define BusStressTest_ProxIntervalMs        (3)
+
+// Conversions of each channel the schedule has to run once the threads are done
+#define BusStressTest_FinalConversions      (16)
+#define BusStressTest_FinalTimeoutMs        (5000)
+
+// The WDF timer the schedule runs on. It fires as soon as it is started.
+// Stop waits for the turn in progress like WdfTimerStop(Timer, TRUE), a
+// turn that started the timer again leaves it started.
+typedef struct _HOST_TIMER
+{
+    std::mutex              Lock;
+    std::condition_variable Changed;
+    bool                    Armed;
+    bool                    Running;
+    ULONG                   Completed;          // Turns run to the end
+    bool                    Done;
+} HOST_TIMER;
+
+// The shared ADC of client.cpp: ControlLock stands in for m_ControlLock. The
+// schedule's state is only touched with it held, by one owner at a time. The
+// conversion counts are read while the schedule runs, without the lock.
+typedef struct _CONTROL_CONTEXT
+{
+    PBusExecutor        pBus;
+    std::mutex          ControlLock;
+    HOST_TIMER          Timer;
+    AdcArbiter          Arbiter;
+    DeviceLifecycle     Als;
+    ULONG               NowMs;              // A millisecond per turn
+    ULONG               Turns;
+    ULONG               SkippedTurns;       // Turns that found the lock held
+    std::atomic<ULONG>  Conversions[AdcChannel_Count];
+    std::atomic<ULONG>  Owners;
+    std::atomic<ULONG>  Overlaps;           // Owners that found another one
+    ULONG               Overwritten;        // Conversions whose OPMODE another write replaced
+    ULONG               Inconsistent;       // Stopped channels left in flight
+    ULONG               Failures;
+} CONTROL_CONTEXT;
+
+static VOID RunWindowThread(
+    _In_ PBusExecutor pBus,
+    _In_ ULONG Thread,
+    _In_ ULONG Iterations,
+    _Out_ WINDOW_STATS* pStats)
+{
+    WINDOW_STATS Stats = {};
+
+    for (ULONG Iteration = 0; Iteration < Iterations; Iteration++)
+    {
+        BYTE Window[BusStressTest_WindowSize];
+        BYTE ReadBack[BusStressTest_WindowSize] = {};
+        BUS_OPERATION Operations[BusStressTest_WindowSize + 1];
+
+        // The bytes tell the thread and the iteration apart
+        for (ULONG i = 0; i < BusStressTest_WindowSize; i++)
+        {
+            Window[i] = static_cast<BYTE>((Thread << 5) ^ (Iteration << 2) ^ i);
+            Operations[i] = { BusOperation_Write, static_cast<BYTE>(ISL29018_REG_ADD_INT_LT_LSB + i), &Window[i], 1 };
+        }
+        Operations[BusStressTest_WindowSize] = { BusOperation_Read, ISL29018_REG_ADD_INT_LT_LSB, ReadBack, sizeof(ReadBack) };
+
+        if (!NT_SUCCESS(pBus->Execute(Operations, BusStressTest_WindowSize + 1)))
+        {
+            Stats.Failures++;
+        }
+        else if (0 != memcmp(Window, ReadBack, sizeof(Window)))
+        {
+            Stats.Torn++;
+        }
+    }
+
+    *pStats = Stats;
+}
+
+static VOID RunRegisterThread(
+    _In_ PBusExecutor pBus,
+    _In_ ULONG Iterations,
+    _Out_ PULONG pFailures)
+{
+    ULONG Failures = 0;
+
+    for (ULONG Iteration = 0; Iteration < Iterations; Iteration++)
+    {
+        NTSTATUS Status = STATUS_SUCCESS;
+
+        if (0 == (Iteration & 1))
+        {
+            Status = pBus->Write(ISL29018_REG_ADD_COMMAND2, static_cast<BYTE>(Iteration));
+        }
+        else
+        {
+            BYTE Command2 = 0;
+            Status = pBus->Read(ISL29018_REG_ADD_COMMAND2, &Command2, sizeof(Command2));
+        }
+
+        Failures += NT_SUCCESS(Status) ? 0 : 1;
+    }
+
+    *pFailures = Failures;
+}
+
+static VOID OnStatusRead(
+    _In_ PVOID Context,
+    _In_ NTSTATUS Status)
+{
+    ASYNC_CONTEXT* pContext = static_cast<ASYNC_CONTEXT*>(Context);
+    BYTE DataBuffer[ISL290185_DATA_SIZE_BYTES];
+
+    pContext->Completions++;
+    if (!NT_SUCCESS(Status) ||
+        !NT_SUCCESS(pContext->pBus->Read(ISL29018_REG_ADD_DATA_LSB, DataBuffer, sizeof(DataBuffer))))
+    {
+        pContext->Failures++;
+    }
+}
+
+static VOID RunAsyncThread(
+    _Inout_ ASYNC_CONTEXT* pContext,
+    _In_ ULONG Iterations)
+{
+    for (ULONG Iteration = 0; Iteration < Iterations; Iteration++)
+    {
+        pContext->pBus->ReadAsync(ISL29018_REG_ADD_COMMAND1, pContext->StatusBuffer,
+                                  sizeof(pContext->StatusBuffer), OnStatusRead, pContext);
+        pContext->pBus->WaitForAsync();
+    }
+}
+
+static VOID StartTimer(
+    _Inout_ HOST_TIMER* pTimer)
+{
+    std::lock_guard<std::mutex> Guard(pTimer->Lock);
+    pTimer->Armed = true;
+    pTimer->Changed.notify_all();
+}
+
+static VOID StopTimer(
+    _Inout_ HOST_TIMER* pTimer)
+{
+    std::unique_lock<std::mutex> Guard(pTimer->Lock);
+    ULONG Completed = pTimer->Completed;
+
+    pTimer->Armed = false;
+    pTimer->Changed.wait(Guard, [pTimer, Completed] { return !pTimer->Running || Completed != pTimer->Completed; });
+}
+
+static BYTE GetOpMode(
+    _In_ ADC_CHANNEL Channel)
+{
+    return (AdcChannel_Prox == Channel) ? ISL29018_CMD1_OPMODE_PROX_ONCE : ISL29018_CMD1_OPMODE_ALS_ONCE;
+}
+
+static VOID WriteOpMode(
+    _Inout_ CONTROL_CONTEXT* pContext,
+    _In_ BYTE OpMode)
+{
+    if (!NT_SUCCESS(pContext->pBus->Write(ISL29018_REG_ADD_COMMAND1,
+                                          static_cast<BYTE>(OpMode << ISL29018_CMD1_OPMODE_SHIFT))))
+    {
+        pContext->Failures++;
+    }
+}
+
+// Called once the lock is taken
+static VOID EnterOwner(
+    _Inout_ CONTROL_CONTEXT* pContext)
+{
+    if (1 != ++pContext->Owners)
+    {
+        pContext->Overlaps++;
+    }
+}
+
+// Called with the lock held, before it is released
+static VOID LeaveOwner(
+    _Inout_ CONTROL_CONTEXT* pContext)
+{
+    pContext->Owners--;
+}
+
+// Called with the lock held, before it is released
+static VOID CheckArbiter(
+    _Inout_ CONTROL_CONTEXT* pContext)
+{
+    ADC_CHANNEL InFlight = pContext->Arbiter.GetInFlight();
+
+    if (AdcChannel_None != InFlight && !pContext->Arbiter.IsActive(InFlight))
+    {
+        pContext->Inconsistent++;
+    }
+}
+
+// See ServeSharedAdc: read the conversion that completed and start the next one
+static VOID ServeTurn(
+    _Inout_ CONTROL_CONTEXT* pContext)
+{
+    if (!pContext->ControlLock.try_lock())
+    {
+        pContext->SkippedTurns++;
+        return;
+    }
+
+    EnterOwner(pContext);
+
+    if (!pContext->Arbiter.IsActive(AdcChannel_Prox))
+    {
+        LeaveOwner(pContext);
+        pContext->ControlLock.unlock();
+        return;
+    }
+
+    ULONG NowMs = ++pContext->NowMs;
+    ADC_CHANNEL InFlight = pContext->Arbiter.GetInFlight();
+
+    if (AdcChannel_None != InFlight)
+    {
+        BYTE Command1 = 0;
+
+        if (!NT_SUCCESS(pContext->pBus->Read(ISL29018_REG_ADD_COMMAND1, &Command1, sizeof(Command1))))
+        {
+            pContext->Failures++;
+        }
+        else if (GetOpMode(InFlight) != ((Command1 & ISL29018_CMD1_OPMODE_MASK) >> ISL29018_CMD1_OPMODE_SHIFT))
+        {
+            pContext->Overwritten++;
+        }
+
+        pContext->Conversions[InFlight]++;
+        pContext->Arbiter.CompleteConversion(NowMs);
+    }
+
+    ADC_CHANNEL Channel = pContext->Arbiter.PickNext(NowMs, 0);
+    if (AdcChannel_None != Channel)
+    {
+        WriteOpMode(pContext, GetOpMode(Channel));
+        pContext->Arbiter.StartConversion(Channel);
+    }
+
+    pContext->Turns++;
+    CheckArbiter(pContext);
+    LeaveOwner(pContext);
+    pContext->ControlLock.unlock();
+
+    StartTimer(&pContext->Timer);
+}
+
+static VOID RunTimerThread(
+    _Inout_ CONTROL_CONTEXT* pContext)
+{
+    HOST_TIMER* pTimer = &pContext->Timer;
+    std::unique_lock<std::mutex> Guard(pTimer->Lock);
+
+    for (;;)
+    {
+        pTimer->Changed.wait(Guard, [pTimer] { return pTimer->Armed || pTimer->Done; });
+        if (pTimer->Done)
+        {
+            break;
+        }
+
+        pTimer->Armed = false;
+        pTimer->Running = true;
+        Guard.unlock();
+
+        ServeTurn(pContext);
+
+        Guard.lock();
+        pTimer->Running = false;
+        pTimer->Completed++;
+        pTimer->Changed.notify_all();
+    }
+}
+
+// See AcquireControl
+static VOID AcquireControl(
+    _Inout_ CONTROL_CONTEXT* pContext)
+{
+    pContext->ControlLock.lock();
+    EnterOwner(pContext);
+}
+
+// See ReleaseControl: the schedule starts over once the lock is free
+static VOID ReleaseControl(
+    _Inout_ CONTROL_CONTEXT* pContext)
+{
+    bool Shared = pContext->Arbiter.IsActive(AdcChannel_Prox);
+
+    if (Shared)
+    {
+        pContext->Arbiter.CancelConversion();
+    }
+
+    CheckArbiter(pContext);
+    LeaveOwner(pContext);
+    pContext->ControlLock.unlock();
+
+    if (Shared)
+    {
+        StartTimer(&pContext->Timer);
+    }
+}
+
+// See OnStart and OnStop of the light sensor
+static VOID SetAlsStarted(
+    _Inout_ CONTROL_CONTEXT* pContext,
+    _In_ bool Start)
+{
+    AcquireControl(pContext);
+
+    if (Start && pContext->Als.Transition(Lifecycle_Idle, Lifecycle_Starting))
+    {
+        if (pContext->Arbiter.IsActive(AdcChannel_Prox))
+        {
+            StopTimer(&pContext->Timer);
+            pContext->Arbiter.SetChannel(AdcChannel_Als, true, BusStressTest_AlsIntervalMs, pContext->NowMs);
+        }
+        else
+        {
+            WriteOpMode(pContext, ISL29018_CMD1_OPMODE_ALS_CONT);
+        }
+        pContext->Als.Transition(Lifecycle_Starting, Lifecycle_Running);
+    }
+    else if (!Start && pContext->Als.Transition(Lifecycle_Running, Lifecycle_Stopping))
+    {
+        StopTimer(&pContext->Timer);
+        if (pContext->Arbiter.IsActive(AdcChannel_Prox))
+        {
+            pContext->Arbiter.SetChannel(AdcChannel_Als, false, BusStressTest_AlsIntervalMs, pContext->NowMs);
+        }
+        else
+        {
+            WriteOpMode(pContext, ISL29018_CMD1_OPMODE_POWER_DOWN);
+        }
+        pContext->Als.Transition(Lifecycle_Stopping, Lifecycle_Idle);
+    }
+
+    ReleaseControl(pContext);
+}
+
+// See UpdateProximity
+static VOID UpdateProximity(
+    _Inout_ CONTROL_CONTEXT* pContext,
+    _In_ bool Active,
+    _In_ ULONG IntervalMs)
+{
+    AcquireControl(pContext);
+
+    bool Started = pContext->Als.Transition(Lifecycle_Running, Lifecycle_Starting);
+    StopTimer(&pContext->Timer);
+
+    pContext->Arbiter.SetChannel(AdcChannel_Prox, Active, IntervalMs, pContext->NowMs);
+
+    if (Started)
+    {
+        pContext->Arbiter.SetChannel(AdcChannel_Als, Active, BusStressTest_AlsIntervalMs, pContext->NowMs);
+        if (!Active)
+        {
+            WriteOpMode(pContext, ISL29018_CMD1_OPMODE_ALS_CONT);
+        }
+        pContext->Als.Transition(Lifecycle_Starting, Lifecycle_Running);
+    }
+    else if (!Active)
+    {
+        pContext->Arbiter.CancelConversion();
+        WriteOpMode(pContext, ISL29018_CMD1_OPMODE_POWER_DOWN);
+    }
+
+    ReleaseControl(pContext);
+}
+
+static VOID RunAlsThread(
+    _Inout_ CONTROL_CONTEXT* pContext,
+    _In_ ULONG Iterations)
+{
+    for (ULONG Iteration = 0; Iteration < Iterations; Iteration++)
+    {
+        SetAlsStarted(pContext, 0 == (Iteration & 1));
+    }
+}
+
+// Starts the proximity sensor, changes its interval and stops it
+static VOID RunProxThread(
+    _Inout_ CONTROL_CONTEXT* pContext,
+    _In_ ULONG Iterations)
+{
+    for (ULONG Iteration = 0; Iteration < Iterations; Iteration++)
+    {
+        ULONG IntervalMs = BusStressTest_ProxIntervalMs + (Iteration % 5);
+        UpdateProximity(pContext, 2 != (Iteration % 3), IntervalMs);
+    }
+}
+
+// Both sensors are started, wait for the schedule to convert on both channels
+static bool WaitForConversions(
+    _Inout_ CONTROL_CONTEXT* pContext)
+{
+    auto Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(BusStressTest_FinalTimeoutMs);
+    ULONG Start[AdcChannel_Count];
+
+    for (ULONG i = 0; i < AdcChannel_Count; i++)
+    {
+        Start[i] = pContext->Conversions[i];
+    }
+
+    // Holding the lock to read the counts would skip the turns being waited for
+    while (std::chrono::steady_clock::now() < Deadline)
+    {
+        if (pContext->Conversions[AdcChannel_Als] - Start[AdcChannel_Als] >= BusStressTest_FinalConversions &&
+            pContext->Conversions[AdcChannel_Prox] - Start[AdcChannel_Prox] >= BusStressTest_FinalConversions)
+        {
+            return true;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return false;
+}
+
+static VOID RunControlRace(
+    _In_ ULONG Iterations)
+{
+    static Isl29018Model Model;
+    static BusExecutor Bus;
+    static CONTROL_CONTEXT Context;
+
+    Model.Reset(ISL29018_CHIP_29018);
+
+    NTSTATUS Status = Bus.Initialize(NULL, nullptr);
+    if (NT_SUCCESS(Status))
+    {
+        Status = Bus.Connect(&Model);
+    }
+    HOST_EXPECT(NT_SUCCESS(Status), "the control executor cannot be initialized 0x%08x", Status);
+    if (!NT_SUCCESS(Status))
+    {
+        return;
+    }
+
+    Context.pBus = &Bus;
+    Context.Arbiter.Reset();
+    Context.Als.Reset(Lifecycle_Idle);
+
+    auto Start = std::chrono::steady_clock::now();
+    std::thread TimerThread(RunTimerThread, &Context);
+    std::thread AlsThread(RunAlsThread, &Context, Iterations);
+    std::thread ProxThread(RunProxThread, &Context, Iterations);
+
+    AlsThread.join();
+    ProxThread.join();
+
+    // The skipped turns must not have ended the schedule
+    UpdateProximity(&Context, true, BusStressTest_ProxIntervalMs);
+    SetAlsStarted(&Context, true);
+    bool Converting = WaitForConversions(&Context);
+
+    SetAlsStarted(&Context, false);
+    UpdateProximity(&Context, false, BusStressTest_ProxIntervalMs);
+    double Wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    {
+        std::lock_guard<std::mutex> Guard(Context.Timer.Lock);
+        Context.Timer.Done = true;
+        Context.Timer.Changed.notify_all();
+    }
+    TimerThread.join();
+
+    BYTE Command1 = 0;
+    Status = Bus.Read(ISL29018_REG_ADD_COMMAND1, &Command1, sizeof(Command1));
+    Bus.Deinitialize();
+
+    HOST_EXPECT(Converting, "the schedule ran %u light and %u proximity conversions after the race, %u each expected",
+                Context.Conversions[AdcChannel_Als].load(), Context.Conversions[AdcChannel_Prox].load(),
+                BusStressTest_FinalConversions);
+    HOST_EXPECT(0 == Context.Overlaps, "the schedule had more than one owner %u times", Context.Overlaps.load());
+    HOST_EXPECT(0 == Context.Overwritten, "%u conversions read back another OPMODE than they were started with",
+                Context.Overwritten);
+    HOST_EXPECT(0 == Context.Inconsistent, "a stopped channel was left in flight %u times", Context.Inconsistent);
+    HOST_EXPECT(0 == Context.Failures, "%u transfers of the schedule failed", Context.Failures);
+    HOST_EXPECT(!Context.Arbiter.IsActive(AdcChannel_Als) && !Context.Arbiter.IsActive(AdcChannel_Prox) &&
+                AdcChannel_None == Context.Arbiter.GetInFlight(),
+                "the schedule did not stop with both sensors");
+    HOST_EXPECT(NT_SUCCESS(Status) &&
+                ISL29018_CMD1_OPMODE_POWER_DOWN == ((Command1 & ISL29018_CMD1_OPMODE_MASK) >> ISL29018_CMD1_OPMODE_SHIFT),
+                "COMMAND1 is 0x%02x with both sensors stopped", Command1);
+
+    printf("control_iterations,wall_s,turns,skipped_turns,als_conversions,prox_conversions\n");
+    printf("%u,%.3f,%u,%u,%u,%u\n",
+           Iterations, Wall, Context.Turns, Context.SkippedTurns,
+           Context.Conversions[AdcChannel_Als].load(), Context.Conversions[AdcChannel_Prox].load());
+}
+
+int main(
+    _In_ int argc,
+    _In_reads_(argc) char** argv)
+{
+    ULONG Threads = BusStressTest_DefaultThreads;
+    ULONG Iterations = BusStressTest_DefaultIterations;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-threads") && i + 1 < argc)
+        {
+            Threads = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (0 == strcmp(argv[i], "-iterations") && i + 1 < argc)
+        {
+            Iterations = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else
+        {
+            fprintf(stderr, "Usage: BusStressTest [-threads N] [-iterations N]\n");
+            return 1;
+        }
+    }
+
+    static Isl29018Model Model;
+    static BusExecutor Bus;
+
+    Model.Reset(ISL29018_CHIP_29018);
+
+    NTSTATUS Status = Bus.Initialize(NULL, nullptr);
+    if (NT_SUCCESS(Status))
+    {
+        Status = Bus.Connect(&Model);
+    }
+    if (!NT_SUCCESS(Status))
+    {
+        fprintf(stderr, "The executor cannot be initialized 0x%08x\n", Status);
+        return 1;
+    }
+
+    std::vector<WINDOW_STATS> WindowStats(Threads);
+    std::vector<std::thread> WindowThreads;
+    ULONG RegisterFailures = 0;
+    ASYNC_CONTEXT Async = {};
+    Async.pBus = &Bus;
+
+    auto Start = std::chrono::steady_clock::now();
+    for (ULONG i = 0; i < Threads; i++)
+    {
+        WindowThreads.emplace_back(RunWindowThread, &Bus, i, Iterations, &WindowStats[i]);
+    }
+    std::thread RegisterThread(RunRegisterThread, &Bus, Iterations, &RegisterFailures);
+    std::thread AsyncThread(RunAsyncThread, &Async, Iterations);
+
+    for (std::thread& Thread : WindowThreads)
+    {
+        Thread.join();
+    }
+    RegisterThread.join();
+    AsyncThread.join();
+    double Wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    Bus.Deinitialize();
+
+    // A window list is one submission, every register access and every
+    // asynchronous read with the read of its completion are one each
+    ULONGLONG Lists = static_cast<ULONGLONG>(Threads) * Iterations;
+    ULONGLONG Submissions = Lists + Iterations + 2ULL * Iterations;
+    ULONGLONG Transfers = Lists * BusStressTest_WindowTransfers + Iterations + 2ULL * Iterations;
+
+    for (ULONG i = 0; i < Threads; i++)
+    {
+        HOST_EXPECT(0 == WindowStats[i].Torn, "window thread %u: %u of %u lists torn",
+                    i, WindowStats[i].Torn, Iterations);
+        HOST_EXPECT(0 == WindowStats[i].Failures, "window thread %u: %u lists failed",
+                    i, WindowStats[i].Failures);
+    }
+    HOST_EXPECT(0 == RegisterFailures, "register thread: %u operations failed", RegisterFailures);
+    HOST_EXPECT(Iterations == Async.Completions, "%u of %u asynchronous reads completed",
+                Async.Completions, Iterations);
+    HOST_EXPECT(0 == Async.Failures, "%u asynchronous reads failed", Async.Failures);
+    HOST_EXPECT(0 == Bus.GetFailures(), "the executor counted %llu failures",
+                static_cast<unsigned long long>(Bus.GetFailures()));
+    HOST_EXPECT(Submissions == Bus.GetSubmissions(), "%llu submissions counted, %llu made",
+                static_cast<unsigned long long>(Bus.GetSubmissions()),
+                static_cast<unsigned long long>(Submissions));
+    HOST_EXPECT(Transfers == Model.GetTransfers(), "%llu transfers reached the model, %llu made",
+                static_cast<unsigned long long>(Model.GetTransfers()),
+                static_cast<unsigned long long>(Transfers));
+    HOST_EXPECT(Bus.GetMaxDepth() <= Threads + 2, "%u submitters queued for the bus, there are %u threads",
+                Bus.GetMaxDepth(), Threads + 2);
+
+    printf("threads,iterations,wall_s,submissions,submissions_per_s,max_depth,mean_hold_us,max_hold_us\n");
+    printf("%u,%u,%.3f,%llu,%.0f,%u,%.1f,%.1f\n",
+           Threads + 2, Iterations, Wall,
+           static_cast<unsigned long long>(Bus.GetSubmissions()),
+           Bus.GetSubmissions() / Wall,
+           Bus.GetMaxDepth(),
+           Bus.GetMeanHoldTime() / 10.0,
+           Bus.GetMaxHoldTime() / 10.0);
+
+    RunControlRace(Iterations);
+
+    return HostTestResult("BusStressTest");
+}
@@ -0,0 +1,271 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host benchmark of the noise filters of
+//    NoiseFilter.h and the decimator of Decimator.h, and a test of how much
+//    each filter lowers the report rate.
+//
+//    The benchmark runs every filter on its own over noisy readings and
+//    prints one CSV row per stage with the time per reading. The decimator
+//    is timed per conversion it averages, at Oversample_MaxConversions
+//    conversions per sample.
+//
+//    Each recording given, written by the driver's SampleRecorder or by
+//    BusSimulation -noise -record, is then replayed through ReplayPipeline.h
+//    with every filter. The tool prints one CSV row per recording and filter
+//    with the reports and the share of reports the filter saved against no
+//    filter. It fails if a filter does not lower the report rate of a noisy
+//    recording, which is what the filters are for.
+//
+//    Usage: FilterBench [-samples N] [-pct P] [-abs A] [FILE...]
+//
+//    -samples    readings per stage in the benchmark, 1000000 by default
+//    -pct, -abs  thresholds of the replays, 0.01 and 0.5 by default, the
+//                fine thresholds of BusSimulation. Coarse thresholds hide
+//                the noise the filters remove.
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Decimator.h"
+#include "ReplayPipeline.h"
+
+#define FilterBench_DefaultSamples          (1000000)
+#define FilterBench_DefaultLuxPct           (0.01f)
+#define FilterBench_DefaultLuxAbs           (0.5f)
+
+// Readings the benchmark cycles through, a power of two
+#define FilterBench_Readings                (4096)
+
+// Level and relative noise of the benchmark's readings, with a step halfway
+// so the filters also track a change
+#define FilterBench_Lux                     (500.0f)
+#define FilterBench_Noise                   (0.05f)
+
+static const char* const g_FilterNames[NoiseFilter_Count] =
+{
+    "none",
+    "median",
+    "ema",
+    "kalman",
+};
+
+static FLOAT g_Readings[FilterBench_Readings];
+static USHORT g_Counts[FilterBench_Readings];
+
+// Noisy readings from a fixed seed, so runs are comparable
+static VOID MakeReadings()
+{
+    ULONG State = 0x29018;
+
+    for (ULONG i = 0; i < FilterBench_Readings; i++)
+    {
+        FLOAT Gaussian = -6.0f;
+        for (ULONG j = 0; j < 12; j++)
+        {
+            State ^= State << 13;
+            State ^= State >> 17;
+            State ^= State << 5;
+            Gaussian += static_cast<FLOAT>(State >> 8) / static_cast<FLOAT>(1UL << 24);
+        }
+
+        FLOAT Level = (i < FilterBench_Readings / 2) ? FilterBench_Lux : 2.0f * FilterBench_Lux;
+        FLOAT Lux = Level * (1.0f + FilterBench_Noise * Gaussian);
+
+        g_Readings[i] = Lux;
+        g_Counts[i] = static_cast<USHORT>((Lux > 0.0f) ? Lux : 0.0f);
+    }
+}
+
+static double BenchFilter(
+    _In_ ULONG Type,
+    _In_ ULONGLONG Samples,
+    _Out_ FLOAT* pSum)
+{
+    static NoiseFilter Filter;
+    FLOAT Sum = 0.0f;
+
+    Filter.Reset(Type);
+
+    auto Start = std::chrono::steady_clock::now();
+    for (ULONGLONG i = 0; i < Samples; i++)
+    {
+        Sum += Filter.Apply(g_Readings[i & (FilterBench_Readings - 1)]);
+    }
+    double Wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    *pSum = Sum;
+    return Wall * 1e9 / Samples;
+}
+
+// Time per conversion added, read out every Oversample_MaxConversions
+static double BenchDecimator(
+    _In_ ULONGLONG Samples,
+    _Out_ FLOAT* pSum)
+{
+    static Decimator Box;
+    FLOAT Sum = 0.0f;
+
+    auto Start = std::chrono::steady_clock::now();
+    for (ULONGLONG i = 0; i < Samples; i += Oversample_MaxConversions)
+    {
+        Box.Reset();
+        for (ULONG j = 0; j < Oversample_MaxConversions; j++)
+        {
+            Box.Add(g_Counts[(i + j) & (FilterBench_Readings - 1)]);
+        }
+        Sum += Box.GetMean();
+    }
+    double Wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    *pSum = Sum;
+    return Wall * 1e9 / Samples;
+}
+
+// Replay a recording with every filter. Returns false if it cannot be read or
+// a filter did not lower the reports.
+static bool ReplayWithFilters(
+    _In_ const char* pPath,
+    _In_ FLOAT LuxPct,
+    _In_ FLOAT LuxAbs)
+{
+    ULONGLONG Size = 0;
+    PVOID pView = ReplayMapRecording(pPath, &Size);
+    SampleRecording Recording;
+
+    if (nullptr == pView || !Recording.Open(pView, Size))
+    {
+        fprintf(stderr, "%s is not a sample recording\n", pPath);
+        if (nullptr != pView)
+        {
+            ReplayUnmapRecording(pView, Size);
+        }
+        return false;
+    }
+
+    static ReplayPipeline Pipeline;
+    ULONGLONG Reports[NoiseFilter_Count];
+    bool Lowered = true;
+
+    for (ULONG Type = 0; Type < NoiseFilter_Count; Type++)
+    {
+        Pipeline.Reset(LuxPct, LuxAbs, Type, Recording.GetIrCoefficient(), nullptr);
+        ReplayRecording(&Pipeline, Recording);
+
+        const REPLAY_STATS& Stats = Pipeline.GetStats();
+        Reports[Type] = Stats.Reports;
+
+        double Saved = (0 == Reports[NoiseFilter_None]) ? 0.0 :
+                       100.0 * (1.0 - static_cast<double>(Reports[Type]) / Reports[NoiseFilter_None]);
+
+        printf("%s,%s,%llu,%llu,%.1f\n", pPath, g_FilterNames[Type],
+               static_cast<unsigned long long>(Stats.Samples),
+               static_cast<unsigned long long>(Stats.Reports),
+               Saved);
+
+        if (std::isnan(Pipeline.GetLuxSum()))
+        {
+            fprintf(stderr, "%s, %s: lux is not a number\n", pPath, g_FilterNames[Type]);
+            Lowered = false;
+        }
+        else if (NoiseFilter_None != Type && Reports[Type] >= Reports[NoiseFilter_None])
+        {
+            fprintf(stderr, "%s, %s: %llu reports, no fewer than the %llu without a filter\n",
+                    pPath, g_FilterNames[Type],
+                    static_cast<unsigned long long>(Reports[Type]),
+                    static_cast<unsigned long long>(Reports[NoiseFilter_None]));
+            Lowered = false;
+        }
+    }
+
+    ReplayUnmapRecording(pView, Size);
+    return Lowered;
+}
+
+static VOID PrintUsage()
+{
+    fprintf(stderr, "Usage: FilterBench [-samples N] [-pct P] [-abs A] [FILE...]\n");
+}
+
+int main(
+    _In_ int argc,
+    _In_reads_(argc) char** argv)
+{
+    ULONGLONG Samples = FilterBench_DefaultSamples;
+    FLOAT LuxPct = FilterBench_DefaultLuxPct;
+    FLOAT LuxAbs = FilterBench_DefaultLuxAbs;
+    int FirstPath = argc;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-samples") && i + 1 < argc)
+        {
+            Samples = strtoull(argv[++i], nullptr, 0);
+        }
+        else if (0 == strcmp(argv[i], "-pct") && i + 1 < argc)
+        {
+            LuxPct = strtof(argv[++i], nullptr);
+        }
+        else if (0 == strcmp(argv[i], "-abs") && i + 1 < argc)
+        {
+            LuxAbs = strtof(argv[++i], nullptr);
+        }
+        else if ('-' != argv[i][0])
+        {
+            FirstPath = i;
+            break;
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (Samples < Oversample_MaxConversions)
+    {
+        fprintf(stderr, "There must be at least %d samples\n", Oversample_MaxConversions);
+        return 1;
+    }
+
+    MakeReadings();
+
+    // The sums keep the filters from being optimized out
+    printf("stage,samples,ns_per_sample,sum\n");
+    for (ULONG Type = 0; Type < NoiseFilter_Count; Type++)
+    {
+        FLOAT Sum;
+        double Ns = BenchFilter(Type, Samples, &Sum);
+        printf("%s,%llu,%.2f,%.0f\n", g_FilterNames[Type], static_cast<unsigned long long>(Samples), Ns, Sum);
+    }
+
+    FLOAT Sum;
+    double Ns = BenchDecimator(Samples, &Sum);
+    printf("decimator,%llu,%.2f,%.0f\n", static_cast<unsigned long long>(Samples), Ns, Sum);
+
+    if (FirstPath == argc)
+    {
+        return 0;
+    }
+
+    int Result = 0;
+
+    printf("recording,filter,samples,reports,saved_pct\n");
+    for (int i = FirstPath; i < argc; i++)
+    {
+        if (!ReplayWithFilters(argv[i], LuxPct, LuxAbs))
+        {
+            Result = 2;
+        }
+    }
+
+    return Result;
+}
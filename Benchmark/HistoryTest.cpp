@@ -0,0 +1,310 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host test of SampleHistory.h. Every sample the
+//    test adds is made from its sequence number, so a sample read back with
+//    a field of another sample was torn.
+//
+//    - reads of an empty and of a partly filled history, continued from
+//      NextSequence, limited by the caller's buffer and by a start time, and
+//      of a history that wrapped
+//    - the writer run in the middle of a read, right after a slot's stamp
+//      was checked and before the slot is copied. Read is built with a
+//      ReadAcquire64 that runs it, so this does not depend on the scheduler.
+//      A slot overwritten during its copy is caught by the stamp check after
+//      the copy and skipped, and so are the slots the writer lapped.
+//    - a writer thread adding 5M samples while a reader follows it with
+//      NextSequence, against torn and out of order samples
+//
+//    Usage: HistoryTest
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include "HostTest.h"
+#include "Isl29018Ioctl.h"
+
+static LONG64 HistoryTest_ReadAcquire64(
+    _In_ const volatile LONG64* Source);
+
+#define ReadAcquire64 HistoryTest_ReadAcquire64
+#include "SampleHistory.h"
+#undef ReadAcquire64
+
+#define HistoryTest_StartTime               (1000ULL)
+#define HistoryTest_TicksPerSample          (10ULL)
+
+#define HistoryTest_ThreadSamples           (5000000ULL)
+
+// A history and the sequence number of the next sample added to it
+typedef struct _HISTORY_WRITER
+{
+    SampleHistory   History;
+    ULONGLONG       Next;
+} HISTORY_WRITER, *PHISTORY_WRITER;
+
+// Writer to run in the middle of a read, after the Load-th ReadAcquire64 of Read
+static PHISTORY_WRITER g_pOverwriter;
+static ULONG g_OverwriteLoad;
+static ULONG g_OverwriteCount;
+static ULONG g_Loads;
+
+static ISL29018_HISTORY_SAMPLE g_Samples[ISL29018_HISTORY_SIZE];
+
+static ULONGLONG GetSampleTime(
+    _In_ ULONGLONG Sequence)
+{
+    return HistoryTest_StartTime + Sequence * HistoryTest_TicksPerSample;
+}
+
+static FILETIME ToFileTime(
+    _In_ ULONGLONG Time)
+{
+    FILETIME FileTime;
+    FileTime.dwLowDateTime = static_cast<ULONG>(Time);
+    FileTime.dwHighDateTime = static_cast<ULONG>(Time >> 32);
+    return FileTime;
+}
+
+static VOID AddSamples(
+    _Inout_ PHISTORY_WRITER pWriter,
+    _In_ ULONGLONG Count)
+{
+    for (ULONGLONG i = 0; i < Count; i++)
+    {
+        ULONGLONG Sequence = pWriter->Next++;
+        FILETIME Timestamp = ToFileTime(GetSampleTime(Sequence));
+
+        pWriter->History.Add(&Timestamp,
+                             static_cast<FLOAT>(Sequence),
+                             static_cast<ULONG>(Sequence & 0xFFFF),
+                             static_cast<ULONG>(~Sequence & 0xFFFF),
+                             static_cast<ULONG>(Sequence & 3),
+                             static_cast<ULONG>((Sequence >> 2) & 3),
+                             static_cast<ULONG>(Sequence % 300),
+                             static_cast<BYTE>(Sequence & (ISL29018_HISTORY_FLAG_REPORTED | ISL29018_HISTORY_FLAG_FIRST)));
+    }
+}
+
+// Whether every field of the sample is the one AddSamples made for its sequence number
+static bool IsWhole(
+    _In_ const ISL29018_HISTORY_SAMPLE& Sample)
+{
+    ULONGLONG Sequence = Sample.Sequence;
+    ULONGLONG Time = (static_cast<ULONGLONG>(Sample.Timestamp.dwHighDateTime) << 32) | Sample.Timestamp.dwLowDateTime;
+
+    return Time == GetSampleTime(Sequence) &&
+           Sample.Lux == static_cast<FLOAT>(Sequence) &&
+           Sample.RawCount == (Sequence & 0xFFFF) &&
+           Sample.IrCount == (~Sequence & 0xFFFF) &&
+           Sample.Range == (Sequence & 3) &&
+           Sample.Resolution == ((Sequence >> 2) & 3) &&
+           Sample.Conversions == (((Sequence % 300) > MAXUCHAR) ? MAXUCHAR : (Sequence % 300)) &&
+           Sample.Flags == (Sequence & (ISL29018_HISTORY_FLAG_REPORTED | ISL29018_HISTORY_FLAG_FIRST)) &&
+           Sample.Reserved == 0;
+}
+
+static LONG64 HistoryTest_ReadAcquire64(
+    _In_ const volatile LONG64* Source)
+{
+    LONG64 Value = ReadAcquire64(Source);
+
+    if (g_pOverwriter != nullptr && ++g_Loads == g_OverwriteLoad)
+    {
+        AddSamples(g_pOverwriter, g_OverwriteCount);
+    }
+
+    return Value;
+}
+
+static ULONG ReadHistory(
+    _Inout_ PHISTORY_WRITER pWriter,
+    _In_ ULONGLONG FirstSequence,
+    _In_ ULONGLONG StartTime,
+    _In_ ULONG MaxCount,
+    _Out_ PISL29018_HISTORY_HEADER pHeader)
+{
+    ISL29018_HISTORY_REQUEST Request;
+    Request.FirstSequence = FirstSequence;
+    Request.StartTime = ToFileTime(StartTime);
+
+    return pWriter->History.Read(&Request, pHeader, g_Samples, MaxCount);
+}
+
+// Whether the samples read are whole and run from First on without a gap
+static bool IsRun(
+    _In_ ULONG Count,
+    _In_ ULONGLONG First)
+{
+    for (ULONG i = 0; i < Count; i++)
+    {
+        if (g_Samples[i].Sequence != First + i || !IsWhole(g_Samples[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static VOID TestRead()
+{
+    static HISTORY_WRITER Writer;
+    ISL29018_HISTORY_HEADER Header;
+
+    ULONG Count = ReadHistory(&Writer, 0, 0, ISL29018_HISTORY_SIZE, &Header);
+    HOST_EXPECT(0 == Count && 0 == Header.Count && 0 == Header.OldestSequence && 0 == Header.NextSequence,
+                "empty history: %u samples, oldest %llu, next %llu", Count,
+                static_cast<unsigned long long>(Header.OldestSequence),
+                static_cast<unsigned long long>(Header.NextSequence));
+    HOST_EXPECT(ISL29018_HISTORY_VERSION == Header.Version &&
+                sizeof(ISL29018_HISTORY_SAMPLE) == Header.SampleSize &&
+                ISL29018_HISTORY_SIZE == Header.Capacity,
+                "header version %u, sample size %u, capacity %u",
+                Header.Version, Header.SampleSize, Header.Capacity);
+
+    AddSamples(&Writer, 100);
+    Count = ReadHistory(&Writer, 0, 0, ISL29018_HISTORY_SIZE, &Header);
+    HOST_EXPECT(100 == Count && IsRun(Count, 0) && 100 == Header.NextSequence,
+                "100 samples: read %u, next %llu", Count, static_cast<unsigned long long>(Header.NextSequence));
+
+    // A buffer for 30, continued from NextSequence
+    Count = ReadHistory(&Writer, 0, 0, 30, &Header);
+    HOST_EXPECT(30 == Count && IsRun(Count, 0) && 30 == Header.NextSequence,
+                "30 of 100: read %u, next %llu", Count, static_cast<unsigned long long>(Header.NextSequence));
+    Count = ReadHistory(&Writer, Header.NextSequence, 0, 30, &Header);
+    HOST_EXPECT(30 == Count && IsRun(Count, 30) && 60 == Header.NextSequence,
+                "30 from 30: read %u, next %llu", Count, static_cast<unsigned long long>(Header.NextSequence));
+
+    Count = ReadHistory(&Writer, 0, GetSampleTime(50), ISL29018_HISTORY_SIZE, &Header);
+    HOST_EXPECT(50 == Count && IsRun(Count, 50), "from the time of sample 50: read %u", Count);
+
+    Count = ReadHistory(&Writer, 100, 0, ISL29018_HISTORY_SIZE, &Header);
+    HOST_EXPECT(0 == Count && 100 == Header.NextSequence, "from the next sample: read %u", Count);
+
+    // Wrapped, the oldest samples are gone
+    AddSamples(&Writer, 4900);
+    Count = ReadHistory(&Writer, 0, 0, ISL29018_HISTORY_SIZE, &Header);
+    HOST_EXPECT(ISL29018_HISTORY_SIZE == Count && IsRun(Count, 5000 - ISL29018_HISTORY_SIZE) &&
+                5000 - ISL29018_HISTORY_SIZE == Header.OldestSequence && 5000 == Header.NextSequence,
+                "5000 samples: read %u, oldest %llu, next %llu", Count,
+                static_cast<unsigned long long>(Header.OldestSequence),
+                static_cast<unsigned long long>(Header.NextSequence));
+
+    Count = ReadHistory(&Writer, 4000, 0, ISL29018_HISTORY_SIZE, &Header);
+    HOST_EXPECT(1000 == Count && IsRun(Count, 4000), "from 4000 of 5000: read %u", Count);
+}
+
+static VOID TestOverwrittenDuringCopy()
+{
+    static HISTORY_WRITER Writer;
+    ISL29018_HISTORY_HEADER Header;
+
+    AddSamples(&Writer, 3000);
+    ULONGLONG Oldest = 3000 - ISL29018_HISTORY_SIZE;
+
+    // Load 1 is the next sequence number, load 2 the stamp of the oldest
+    // slot. The sample added after it goes into that slot.
+    g_pOverwriter = &Writer;
+    g_OverwriteLoad = 2;
+    g_OverwriteCount = 1;
+    g_Loads = 0;
+
+    ULONG Count = ReadHistory(&Writer, 0, 0, ISL29018_HISTORY_SIZE, &Header);
+    HOST_EXPECT(ISL29018_HISTORY_SIZE - 1 == Count && IsRun(Count, Oldest + 1),
+                "oldest slot overwritten during its copy: read %u from %llu, expected %u from %llu",
+                Count, static_cast<unsigned long long>(g_Samples[0].Sequence),
+                ISL29018_HISTORY_SIZE - 1, static_cast<unsigned long long>(Oldest + 1));
+    HOST_EXPECT(Oldest == Header.OldestSequence && 3000 == Header.NextSequence,
+                "oldest %llu, next %llu", static_cast<unsigned long long>(Header.OldestSequence),
+                static_cast<unsigned long long>(Header.NextSequence));
+
+    // The writer laps the ring during the copy of the 101st slot. That slot
+    // and every later one hold a sample newer than the read.
+    Oldest = Writer.Next - ISL29018_HISTORY_SIZE;
+    g_OverwriteLoad = 102;
+    g_OverwriteCount = ISL29018_HISTORY_SIZE;
+    g_Loads = 0;
+
+    Count = ReadHistory(&Writer, 0, 0, ISL29018_HISTORY_SIZE, &Header);
+    HOST_EXPECT(100 == Count && IsRun(Count, Oldest),
+                "ring lapped during a copy: read %u, expected 100", Count);
+
+    g_pOverwriter = nullptr;
+
+    // The read after it has the new samples
+    Count = ReadHistory(&Writer, Header.NextSequence, 0, ISL29018_HISTORY_SIZE, &Header);
+    HOST_EXPECT(ISL29018_HISTORY_SIZE == Count && IsRun(Count, Writer.Next - ISL29018_HISTORY_SIZE),
+                "after the lap: read %u", Count);
+}
+
+static VOID WriteSamples(
+    _Inout_ PHISTORY_WRITER pWriter,
+    _Inout_ std::atomic<bool>* pDone)
+{
+    AddSamples(pWriter, HistoryTest_ThreadSamples);
+    pDone->store(true);
+}
+
+static VOID TestConcurrentReader()
+{
+    static HISTORY_WRITER Writer;
+    std::atomic<bool> Done(false);
+    ISL29018_HISTORY_HEADER Header = {};
+    ULONGLONG Read = 0;
+    ULONGLONG Torn = 0;
+    ULONGLONG OutOfOrder = 0;
+    ULONGLONG Last = 0;
+
+    std::thread WriterThread(WriteSamples, &Writer, &Done);
+
+    for (;;)
+    {
+        bool Final = Done.load();
+        ULONG Count = ReadHistory(&Writer, Header.NextSequence, 0, ISL29018_HISTORY_SIZE, &Header);
+
+        for (ULONG i = 0; i < Count; i++)
+        {
+            if (!IsWhole(g_Samples[i]))
+            {
+                Torn++;
+            }
+            if (Read != 0 && g_Samples[i].Sequence <= Last)
+            {
+                OutOfOrder++;
+            }
+
+            Last = g_Samples[i].Sequence;
+            Read++;
+        }
+
+        if (Final && Header.NextSequence == HistoryTest_ThreadSamples)
+        {
+            break;
+        }
+    }
+
+    WriterThread.join();
+
+    HOST_EXPECT(0 == Torn && 0 == OutOfOrder, "%llu torn and %llu out of order of %llu samples read",
+                static_cast<unsigned long long>(Torn), static_cast<unsigned long long>(OutOfOrder),
+                static_cast<unsigned long long>(Read));
+    HOST_EXPECT(Read != 0 && HistoryTest_ThreadSamples - 1 == Last,
+                "%llu samples read, the last %llu", static_cast<unsigned long long>(Read),
+                static_cast<unsigned long long>(Last));
+}
+
+int main()
+{
+    TestRead();
+    TestOverwrittenDuringCopy();
+    TestConcurrentReader();
+
+    return HostTestResult("HistoryTest");
+}
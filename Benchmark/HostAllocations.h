@@ -0,0 +1,63 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module counts the heap allocations of a host tool. The tool is
+//    linked with malloc, calloc and realloc wrapped, see LDFLAGS in the
+//    Makefile, and operator new is routed through malloc, so every allocation
+//    of the process passes through the counters below. A tool includes this
+//    header from its only source file, as it defines the wrappers.
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#pragma once
+
+#include <cstdlib>
+#include <new>
+
+#include <windows.h>
+
+// Heap allocations made by the process, counted by the wrappers below
+static volatile LONG g_Allocations = 0;
+
+extern "C" void* __real_malloc(size_t Size);
+extern "C" void* __real_calloc(size_t Count, size_t Size);
+extern "C" void* __real_realloc(void* Pointer, size_t Size);
+
+extern "C" void* __wrap_malloc(size_t Size)
+{
+    InterlockedIncrement(&g_Allocations);
+    return __real_malloc(Size);
+}
+
+extern "C" void* __wrap_calloc(size_t Count, size_t Size)
+{
+    InterlockedIncrement(&g_Allocations);
+    return __real_calloc(Count, Size);
+}
+
+extern "C" void* __wrap_realloc(void* Pointer, size_t Size)
+{
+    InterlockedIncrement(&g_Allocations);
+    return __real_realloc(Pointer, Size);
+}
+
+void* operator new(size_t Size)
+{
+    void* Pointer = malloc(Size);
+    if (nullptr == Pointer)
+    {
+        throw std::bad_alloc();
+    }
+    return Pointer;
+}
+
+void operator delete(void* Pointer) noexcept { free(Pointer); }
+void operator delete(void* Pointer, size_t) noexcept { free(Pointer); }
+
+inline LONG GetHostAllocations()
+{
+    return ReadAcquire(&g_Allocations);
+}
@@ -0,0 +1,44 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the checks of the host tests. A failed check prints
+//    where and why it failed and the test goes on, so one run lists every
+//    failure. A test returns HostTestResult from main, which fails the make
+//    target if any check failed.
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#pragma once
+
+#include <cstdio>
+
+#include <windows.h>
+
+static ULONG g_HostTestChecks = 0;
+static ULONG g_HostTestFailures = 0;
+
+#define HOST_EXPECT(Condition, ...)                                                 \
+    do                                                                              \
+    {                                                                               \
+        g_HostTestChecks++;                                                         \
+        if (!(Condition))                                                           \
+        {                                                                           \
+            g_HostTestFailures++;                                                   \
+            fprintf(stderr, "%s(%d): ", __FILE__, __LINE__);                        \
+            fprintf(stderr, __VA_ARGS__);                                           \
+            fprintf(stderr, "\n");                                                  \
+        }                                                                           \
+    } while (0)
+
+inline int HostTestResult(
+    _In_ const char* pName)
+{
+    printf("%s: %lu checks, %lu failed\n", pName,
+           static_cast<unsigned long>(g_HostTestChecks),
+           static_cast<unsigned long>(g_HostTestFailures));
+
+    return (0 == g_HostTestFailures) ? 0 : 1;
+}
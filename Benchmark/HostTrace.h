@@ -0,0 +1,132 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module stands in for the code the WPP preprocessor generates from
+//    SensorsTrace.h, for the hot path trace points only. Each trace point
+//    tests the enable condition SensorsTrace.h defines for it, against a
+//    control block the benchmark sets in place of a trace session, and writes
+//    a record to an in-memory ring the way the WPP recorder does: the
+//    timestamp, the function, the format and the arguments, which are only
+//    formatted when the ring is read.
+//
+//    Build with ISL29018_HOT_PATH_TRACING 0 or 1 to compile the trace points
+//    out or in, as in the driver.
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#pragma once
+
+#include <windows.h>
+
+// Bits in the order of WPP_CONTROL_GUIDS in SensorsTrace.h
+enum
+{
+    WPP_BIT_EntryExit = 0,
+    WPP_BIT_DataFlow,
+    WPP_BIT_Verbose,
+    WPP_BIT_Information,
+    WPP_BIT_Warning,
+    WPP_BIT_Error,
+    WPP_BIT_Fatal,
+    WPP_BIT_DriverStatus,
+};
+
+#define HostTrace_AllFlags                  ((1UL << (WPP_BIT_DriverStatus + 1)) - 1)
+
+// What a trace session enabled, written by the session and read by every
+// trace point, so the compiler cannot hoist the test out of a loop
+typedef struct _HOST_TRACE_CONTROL
+{
+    ULONG       Flags;
+    BYTE        Level;
+} HOST_TRACE_CONTROL;
+
+inline volatile HOST_TRACE_CONTROL g_HostTraceControl = {};
+
+#define WPP_CONTROL(Bit)                    (g_HostTraceControl)
+#define WPP_LEVEL_ENABLED(Flag)             (0 != (g_HostTraceControl.Flags & (1UL << WPP_BIT_ ## Flag)))
+
+#include "SensorsTrace.h"
+
+// Records in the ring, a power of two, and arguments kept per record
+#define HostTrace_Records                   (4096)
+#define HostTrace_MaxArguments              (4)
+
+typedef struct _HOST_TRACE_RECORD
+{
+    ULONGLONG       Time;
+    const char*     pFunction;
+    const char*     pFormat;
+    ULONG           Arguments;
+    ULONGLONG       Values[HostTrace_MaxArguments];
+} HOST_TRACE_RECORD;
+
+typedef struct _HOST_TRACE_RING
+{
+    HOST_TRACE_RECORD   Records[HostTrace_Records];
+    ULONGLONG           Written;
+} HOST_TRACE_RING;
+
+inline HOST_TRACE_RING g_HostTraceRing = {};
+
+// Turn the trace points of a level and below on, or every one off with 0
+inline VOID HostTraceEnable(
+    _In_ BYTE Level)
+{
+    g_HostTraceControl.Flags = (TRACE_LEVEL_NONE != Level) ? HostTrace_AllFlags : 0;
+    g_HostTraceControl.Level = Level;
+}
+
+inline ULONGLONG GetHostTraceRecords()
+{
+    return g_HostTraceRing.Written;
+}
+
+template <typename... ARGUMENTS>
+inline VOID HostTraceWrite(
+    _In_ const char* pFunction,
+    _In_ const char* pFormat,
+    _In_ ARGUMENTS... Arguments)
+{
+    static_assert(sizeof...(Arguments) <= HostTrace_MaxArguments, "Too many trace arguments");
+
+    HOST_TRACE_RECORD* pRecord = &g_HostTraceRing.Records[g_HostTraceRing.Written & (HostTrace_Records - 1)];
+    ULONGLONG Values[] = { 0, static_cast<ULONGLONG>(Arguments)... };
+
+    QueryInterruptTimePrecise(&pRecord->Time);
+    pRecord->pFunction = pFunction;
+    pRecord->pFormat = pFormat;
+    pRecord->Arguments = sizeof...(Arguments);
+    for (ULONG i = 0; i < sizeof...(Arguments); i++)
+    {
+        pRecord->Values[i] = Values[i + 1];
+    }
+
+    g_HostTraceRing.Written++;
+}
+
+#define HOST_TRACE(Enabled, ...)                                                    \
+    do                                                                              \
+    {                                                                               \
+        if (Enabled)                                                                \
+        {                                                                           \
+            HostTraceWrite(__FUNCTION__, __VA_ARGS__);                              \
+        }                                                                           \
+    } while (0)
+
+#define TraceHotVerbose(...)                                                        \
+    HOST_TRACE(WPP_HOTPATH_LEVEL_FLAGS_ENABLED(ON, TRACE_LEVEL_VERBOSE, Verbose), __VA_ARGS__)
+
+#define TraceHotInformation(...)                                                    \
+    HOST_TRACE(WPP_HOTPATH_LEVEL_FLAGS_ENABLED(ON, TRACE_LEVEL_INFORMATION, Information), __VA_ARGS__)
+
+#define SENSOR_HotPathEnter()                                                       \
+    HOST_TRACE(WPP_HOTPATH_LEVEL_FLAGS_ENABLED(ON, TRACE_LEVEL_VERBOSE, EntryExit), \
+               "%!STDPREFIX! SENSOR %!FUNC! FunctionEnter")
+
+#define SENSOR_HotPathExit(status)                                                  \
+    HOST_TRACE(WPP_HOTPATH_LEVEL_FLAGS_SENSOREXIT_ENABLED(ON, TRACE_LEVEL_VERBOSE, EntryExit, status), \
+               "%!STDPREFIX! SENSOR %!FUNC! FunctionExit: %!STATUS!", (status))
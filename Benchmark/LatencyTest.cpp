@@ -0,0 +1,204 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host test of LatencyHistogram.h:
+//
+//    - the bucket edges of ISL29018_LATENCY_BUCKETS, a duration one tick
+//      under an edge and one on it, from 1us up to the last bucket at about
+//      4.19s, which also takes everything longer
+//    - the count, sum and max of a stage, RecordSince with a start after the
+//      end, an unknown stage, the snapshot header and a reset
+//    - threads recording into one stage at the same time, as the ISR, the
+//      bus completion routines and the work items do, against lost counts
+//
+//    Usage: LatencyTest
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "HostTest.h"
+#include "LatencyHistogram.h"
+
+#define LatencyTest_TicksPerUs              (10ULL)
+
+#define LatencyTest_Threads                 (8)
+#define LatencyTest_Records                 (200000)
+
+static LatencyHistogram g_Histogram;
+static ISL29018_LATENCY_SNAPSHOT g_Snapshot;
+
+// The bucket a single duration lands in, or ISL29018_LATENCY_BUCKETS if it
+// did not land in exactly one
+static ULONG GetBucket(
+    _In_ ULONGLONG Ticks)
+{
+    ULONG Bucket = ISL29018_LATENCY_BUCKETS;
+    ULONGLONG Total = 0;
+
+    g_Histogram.Reset(0);
+    g_Histogram.Record(LatencyStage_Sample, Ticks);
+    g_Histogram.GetSnapshot(&g_Snapshot, 0);
+
+    for (ULONG i = 0; i < ISL29018_LATENCY_BUCKETS; i++)
+    {
+        Total += g_Snapshot.Stages[LatencyStage_Sample].Buckets[i];
+        if (g_Snapshot.Stages[LatencyStage_Sample].Buckets[i] != 0)
+        {
+            Bucket = i;
+        }
+    }
+
+    return (Total == 1) ? Bucket : ISL29018_LATENCY_BUCKETS;
+}
+
+static VOID TestBucketEdges()
+{
+    HOST_EXPECT(0 == GetBucket(0), "0 ticks in bucket %u", GetBucket(0));
+
+    // Bucket i starts at 2^(i-1) us
+    for (ULONG i = 1; i < ISL29018_LATENCY_BUCKETS; i++)
+    {
+        ULONGLONG Edge = (1ULL << (i - 1)) * LatencyTest_TicksPerUs;
+
+        HOST_EXPECT(i - 1 == GetBucket(Edge - 1), "%llu ticks in bucket %u, expected %u",
+                    static_cast<unsigned long long>(Edge - 1), GetBucket(Edge - 1), i - 1);
+        HOST_EXPECT(i == GetBucket(Edge), "%llu ticks in bucket %u, expected %u",
+                    static_cast<unsigned long long>(Edge), GetBucket(Edge), i);
+    }
+
+    // 1, 2 and 4us, and about 4.19s
+    HOST_EXPECT(1 == GetBucket(10) && 2 == GetBucket(20) && 3 == GetBucket(40),
+                "1, 2 and 4us in buckets %u, %u and %u", GetBucket(10), GetBucket(20), GetBucket(40));
+    HOST_EXPECT(ISL29018_LATENCY_BUCKETS - 2 == GetBucket(41943039) &&
+                ISL29018_LATENCY_BUCKETS - 1 == GetBucket(41943040),
+                "the last bucket does not start at 4194304us");
+
+    // Everything longer goes to the last bucket
+    static const ULONGLONG Long[] = { 10ULL * 1000 * 1000 * LatencyTest_TicksPerUs, 0x7FFFFFFFFFFFFFFFULL };
+    for (ULONGLONG Ticks : Long)
+    {
+        HOST_EXPECT(ISL29018_LATENCY_BUCKETS - 1 == GetBucket(Ticks), "%llu ticks in bucket %u",
+                    static_cast<unsigned long long>(Ticks), GetBucket(Ticks));
+    }
+}
+
+static VOID TestCounters()
+{
+    static const ULONGLONG Durations[] = { 5, 120, 3, 9000, 120 };
+    const ISL29018_LATENCY_HISTOGRAM& Bus = g_Snapshot.Stages[LatencyStage_Bus];
+    const ISL29018_LATENCY_HISTOGRAM& Sample = g_Snapshot.Stages[LatencyStage_Sample];
+
+    g_Histogram.Reset(1000);
+    for (ULONGLONG Ticks : Durations)
+    {
+        g_Histogram.Record(LatencyStage_Bus, Ticks);
+    }
+
+    // A start after the end is 0, an unknown stage is ignored
+    g_Histogram.RecordSince(LatencyStage_Sample, 700, 500);
+    g_Histogram.RecordSince(LatencyStage_Sample, 500, 700);
+    g_Histogram.Record(LatencyStage_Count, 50);
+    g_Histogram.GetSnapshot(&g_Snapshot, 5000);
+
+    HOST_EXPECT(ISL29018_LATENCY_VERSION == g_Snapshot.Version && sizeof(g_Snapshot) == g_Snapshot.Size &&
+                LatencyStage_Count == g_Snapshot.StageCount && ISL29018_LATENCY_BUCKETS == g_Snapshot.BucketCount,
+                "snapshot version %u, size %u, %u stages, %u buckets", g_Snapshot.Version, g_Snapshot.Size,
+                g_Snapshot.StageCount, g_Snapshot.BucketCount);
+    HOST_EXPECT(4000 == g_Snapshot.Elapsed, "elapsed %llu, expected 4000",
+                static_cast<unsigned long long>(g_Snapshot.Elapsed));
+    HOST_EXPECT(5 == Bus.Count && 9248 == Bus.Sum && 9000 == Bus.Max,
+                "bus count %llu, sum %llu, max %llu", static_cast<unsigned long long>(Bus.Count),
+                static_cast<unsigned long long>(Bus.Sum), static_cast<unsigned long long>(Bus.Max));
+    HOST_EXPECT(2 == Bus.Buckets[0] && 2 == Bus.Buckets[4] && 1 == Bus.Buckets[10],
+                "bus buckets 0, 4 and 10 hold %llu, %llu and %llu",
+                static_cast<unsigned long long>(Bus.Buckets[0]), static_cast<unsigned long long>(Bus.Buckets[4]),
+                static_cast<unsigned long long>(Bus.Buckets[10]));
+    HOST_EXPECT(2 == Sample.Count && 200 == Sample.Sum && 200 == Sample.Max && 1 == Sample.Buckets[0],
+                "sample count %llu, sum %llu, max %llu", static_cast<unsigned long long>(Sample.Count),
+                static_cast<unsigned long long>(Sample.Sum), static_cast<unsigned long long>(Sample.Max));
+
+    // A reset clears every counter and restarts the elapsed time
+    g_Histogram.Reset(6000);
+    g_Histogram.GetSnapshot(&g_Snapshot, 5000);
+
+    ULONGLONG Left = g_Snapshot.Elapsed;
+    for (ULONG i = 0; i < LatencyStage_Count; i++)
+    {
+        Left += g_Snapshot.Stages[i].Count + g_Snapshot.Stages[i].Sum + g_Snapshot.Stages[i].Max;
+        for (ULONG j = 0; j < ISL29018_LATENCY_BUCKETS; j++)
+        {
+            Left += g_Snapshot.Stages[i].Buckets[j];
+        }
+    }
+    HOST_EXPECT(0 == Left, "%llu left after a reset", static_cast<unsigned long long>(Left));
+}
+
+// Durations from under 1us to about 0.4s, different for every thread
+static VOID RecordDurations(
+    _In_ ULONG Thread,
+    _Out_ ULONGLONG* pSum)
+{
+    ULONGLONG Sum = 0;
+
+    for (ULONG i = 0; i < LatencyTest_Records; i++)
+    {
+        ULONGLONG Ticks = ((i * 2654435761ULL) + Thread) % (1ULL << (i % 23));
+        g_Histogram.Record(LatencyStage_Bus, Ticks);
+        Sum += Ticks;
+    }
+
+    *pSum = Sum;
+}
+
+static VOID TestConcurrentRecords()
+{
+    std::vector<std::thread> Threads;
+    ULONGLONG Sums[LatencyTest_Threads] = {};
+    ULONGLONG Sum = 0;
+
+    g_Histogram.Reset(0);
+    for (ULONG i = 0; i < LatencyTest_Threads; i++)
+    {
+        Threads.emplace_back(RecordDurations, i, &Sums[i]);
+    }
+    for (ULONG i = 0; i < LatencyTest_Threads; i++)
+    {
+        Threads[i].join();
+        Sum += Sums[i];
+    }
+
+    g_Histogram.GetSnapshot(&g_Snapshot, 0);
+
+    const ISL29018_LATENCY_HISTOGRAM& Bus = g_Snapshot.Stages[LatencyStage_Bus];
+    const ULONGLONG Records = LatencyTest_Threads * LatencyTest_Records;
+    ULONGLONG Bucketed = 0;
+
+    for (ULONG j = 0; j < ISL29018_LATENCY_BUCKETS; j++)
+    {
+        Bucketed += Bus.Buckets[j];
+    }
+
+    HOST_EXPECT(Records == Bus.Count && Records == Bucketed,
+                "%llu records counted and %llu bucketed, expected %llu",
+                static_cast<unsigned long long>(Bus.Count), static_cast<unsigned long long>(Bucketed),
+                static_cast<unsigned long long>(Records));
+    HOST_EXPECT(Sum == Bus.Sum, "sum %llu, expected %llu",
+                static_cast<unsigned long long>(Bus.Sum), static_cast<unsigned long long>(Sum));
+    HOST_EXPECT(Bus.Max < (1ULL << 22) && Bus.Max >= (1ULL << 21),
+                "max %llu ticks", static_cast<unsigned long long>(Bus.Max));
+}
+
+int main()
+{
+    TestBucketEdges();
+    TestCounters();
+    TestConcurrentRecords();
+
+    return HostTestResult("LatencyTest");
+}
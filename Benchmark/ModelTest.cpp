@@ -0,0 +1,1426 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host test of the acquisition sequences of the
+//    light sensor against Isl29018Model, on the model's virtual clock. The
+//    register writes and reads are the driver's, see ModelDevice, and the
+//    window and the sequencing of the beats are SamplePipeline's:
+//
+//    - the threshold window of ThresholdWindow.h over a sweep of samples,
+//      thresholds and resolutions, and in a closed loop with the model: the
+//      window is armed around the first polled sample, stable light raises
+//      no interrupt, light leaving the window raises one, and the interrupt
+//      work item's read clears it and re-arms the window around the new
+//      sample. Light leaving the range raises one too when the thresholds
+//      are wider than the range.
+//    - the policy of AcquisitionScheduler.h on a virtual clock in
+//      milliseconds: the interval cutoff at every resolution's conversion
+//      time, the interrupt budget, the return to interrupts once polled
+//      samples settle, a clock that wraps, and the switch counters
+//    - the scheduler in a closed loop with the model: light flickering at
+//      the conversion rate raises interrupts over the budget, the scheduler
+//      falls back to polling and hands back to the window once the light is
+//      stable again. Reads that fail keep it polling until the chip
+//      answers and the light settled.
+//    - one-shot conversions: the scheduler picks them for polling from ten
+//      conversion times on, every beat of the timer converts once and the
+//      chip is powered down in between, the sample read is the light after
+//      the beat started the conversion, and continuous conversions resume
+//      once the window is armed again
+//    - IR compensation: the compensated lux and the window offset, the
+//      interleave cadence of IR conversions while polling with continuous
+//      and one-shot conversions, and a window re-armed with the IR offset
+//      that holds the raw ALS count of stable light
+//    - the shared ADC of AdcArbiter.h: the earliest due channel goes first
+//      and ties go to the channel not served last, a conversion completed
+//      late drops the missed beats, and the wait for the next one holds
+//      across a wrap of the clock. In a loop with the model, as
+//      ServeSharedAdc runs it, the light and the proximity channel at
+//      different intervals get a conversion per interval each without a
+//      missed beat, never two conversions at once, and each reads its own
+//      channel. With conversions too long for both intervals, the channels
+//      take turns rather than one starving the other.
+//
+//    Usage: ModelTest
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <cmath>
+#include <cstdio>
+
+#include "HostTest.h"
+#include "AcquisitionScheduler.h"
+#include "AdcArbiter.h"
+#include "Isl29018Model.h"
+#include "SamplePipeline.h"
+#include "ThresholdWindow.h"
+
+#define ARRAYSIZE(A)                        (sizeof(A) / sizeof((A)[0]))
+
+#define ModelTest_Chip                      (ISL29018_CHIP_29018)
+#define ModelTest_Resolution                (ISL29018_INT_TIME_16)
+#define ModelTest_IrCoefficient             (0.25f)
+
+// 100ns per unit of time
+#define ModelTest_Millisecond               (10000ULL)
+#define ModelTest_Second                    (1000ULL * ModelTest_Millisecond)
+
+// Thresholds of the closed loop, a window of 10% around the last sample
+#define ModelTest_LuxPct                    (0.1f)
+#define ModelTest_LuxAbs                    (1.0f)
+
+// Data interval of the closed loop, a little longer than a conversion at
+// ModelTest_Resolution so the scheduler prefers interrupts
+#define ModelTest_IntervalMs                (100)
+
+// Relative error of a reported sample against the light, the truncation of
+// the converter included
+#define ModelTest_LuxTolerance              (0.01f)
+
+// The light sensor's sample path as AlsDevice runs it against the chip,
+// without the framework and the bus executor. The transfers are the ones the
+// executor makes; what they are, and when, is decided by SamplePipeline as in
+// the driver.
+typedef class _ModelDevice : public SamplePipeline
+{
+private:
+    PIsl29018Model          m_pModel;
+    ULONG                   m_Reports;
+    ULONG                   m_IrSamples;
+
+    ULONG GetNowMs() const
+    {
+        return static_cast<ULONG>(m_pModel->GetNow() / ModelTest_Millisecond);
+    }
+
+    bool WriteRegister(
+        _In_ BYTE Register,
+        _In_ BYTE Value)
+    {
+        BYTE Buffer[] = { Register, Value };
+        return sizeof(Buffer) == m_pModel->Write(Buffer, sizeof(Buffer));
+    }
+
+    bool ReadRegisters(
+        _In_ BYTE Register,
+        _Out_writes_(Length) BYTE* pBuffer,
+        _In_ ULONG Length)
+    {
+        return 1 + Length == m_pModel->WriteRead(&Register, 1, pBuffer, Length);
+    }
+
+    // See AlsDevice::WriteOpMode
+    bool WriteOpMode(
+        _In_ BYTE OpMode)
+    {
+        return WriteRegister(ISL29018_REG_ADD_COMMAND1, static_cast<BYTE>(OpMode << ISL29018_CMD1_OPMODE_SHIFT));
+    }
+
+    // See AlsDevice::StartConversions
+    bool StartConversions()
+    {
+        m_IrPending = false;
+
+        if (m_Scheduler.UseOneShot())
+        {
+            m_ConversionPending = WriteOpMode(ISL29018_CMD1_OPMODE_ALS_ONCE);
+            return m_ConversionPending;
+        }
+
+        m_ConversionPending = false;
+        return WriteOpMode(ISL29018_CMD1_OPMODE_ALS_CONT);
+    }
+
+    // See AlsDevice::StartIrConversion
+    bool StartIrConversion()
+    {
+        m_IrPending = WriteOpMode(ISL29018_CMD1_OPMODE_IR_ONCE);
+        return m_IrPending;
+    }
+
+    // See AlsDevice::GetIrData
+    bool GetIrData()
+    {
+        BYTE DataBuffer[ISL290185_DATA_SIZE_BYTES];
+
+        if (!ReadRegisters(ISL29018_REG_ADD_DATA_LSB, DataBuffer, sizeof(DataBuffer)))
+        {
+            return false;
+        }
+
+        m_IrInterleave.OnIrSample((static_cast<ULONG>(DataBuffer[1]) << 8) | DataBuffer[0], m_AutoRange.GetLuxPerCount());
+        m_IrSamples++;
+        return true;
+    }
+
+public:
+    // See AlsDevice::ResetScheduler and RestartAcquisition. One-shot
+    // conversions are allowed as long as the oversampling is off.
+    bool Initialize(
+        _In_ PIsl29018Model pModel,
+        _In_ ULONG Range,
+        _In_ FLOAT LuxPct,
+        _In_ FLOAT LuxAbs,
+        _In_ ULONG IntervalMs,
+        _In_ bool OneShotAllowed)
+    {
+        m_pModel = pModel;
+        m_Reports = 0;
+        m_IrSamples = 0;
+        m_AutoRange.Reset(Range, ModelTest_Resolution);
+        m_IrInterleave.Reset();
+        m_Filter.Reset(NoiseFilter_None);
+        m_LastRawCount = 0;
+        m_Decimator.Reset();
+        m_FirstSample = true;
+        m_CachedThresholds.LuxPct = LuxPct;
+        m_CachedThresholds.LuxAbs = LuxAbs;
+        m_CachedData = 0.0f;
+        m_LastSample = 0.0f;
+
+        m_Scheduler.Reset(GetNowMs(), true, IntervalMs, LuxPct, LuxAbs,
+                          Isl29018ConversionTimeMs(ModelTest_Chip, ModelTest_Resolution), OneShotAllowed);
+        m_Scheduler.ResetCounters();
+
+        return WriteRegister(ISL29018_REG_ADDR_TEST, 0x00) &&
+               WriteRegister(ISL29018_REG_ADD_COMMAND2, GetCommand2()) &&
+               StartConversions();
+    }
+
+    // See AlsDevice::ProcessData
+    SAMPLE_OUTCOME ProcessStatus(
+        _In_reads_(ISL29018_STATUS_SIZE_BYTES) const BYTE* pStatusBuffer)
+    {
+        FILETIME CaptureTime = { static_cast<ULONG>(m_pModel->GetNow()), static_cast<ULONG>(m_pModel->GetNow() >> 32) };
+        ULONG RawCount = 0;
+        ULONG Conversions = 0;
+        bool RangeChanged = false;
+
+        ULONG ConvertedRange = m_AutoRange.GetRange();
+        SAMPLE_OUTCOME Outcome = ConvertStatus(pStatusBuffer, ModelTest_IrCoefficient, &RawCount, &Conversions, &RangeChanged);
+        if (SampleOutcome_Failed == Outcome)
+        {
+            WriteRegister(ISL29018_REG_ADD_COMMAND2, GetCommand2());
+            return Outcome;
+        }
+
+        if (SampleOutcome_Discarded == Outcome)
+        {
+            return Outcome;
+        }
+
+        if (RangeChanged && !WriteRegister(ISL29018_REG_ADD_COMMAND2, GetCommand2()))
+        {
+            RestoreRange(ConvertedRange);
+        }
+
+        RING_SAMPLE Sample;
+        if (!TakeReport(&CaptureTime, RawCount, &Sample))
+        {
+            return SampleOutcome_Quiet;
+        }
+
+        m_Reports++;
+        return SampleOutcome_Reported;
+    }
+
+    // A polled sample, see AlsDevice::OnSampleRead. Returns true if the
+    // sample was reported.
+    bool Poll()
+    {
+        BYTE StatusBuffer[ISL29018_STATUS_SIZE_BYTES];
+        SAMPLE_OUTCOME Outcome = ReadRegisters(ISL29018_REG_ADD_COMMAND1, StatusBuffer, sizeof(StatusBuffer)) ?
+                                 ProcessStatus(StatusBuffer) : SampleOutcome_Failed;
+
+        POLL_ACTION Action = OnPolledSample(GetNowMs(), Outcome);
+        if (PollAction_ArmWindow == Action || PollAction_ResumeAndArmWindow == Action)
+        {
+            if ((PollAction_ArmWindow == Action || WriteOpMode(ISL29018_CMD1_OPMODE_ALS_CONT)) && ArmWindow())
+            {
+                return SampleOutcome_Reported == Outcome;
+            }
+
+            Action = OnArmWindowFailed();
+        }
+
+        if (PollAction_StartIr == Action)
+        {
+            StartIrConversion();
+        }
+
+        return SampleOutcome_Reported == Outcome;
+    }
+
+    // A beat of the timer, see AlsDevice::OnTimerExpire. Returns true if the
+    // beat started a single conversion, the next beat reads it once the
+    // conversion time elapsed.
+    bool Beat()
+    {
+        BEAT_ACTION Action = GetBeatAction(false);
+        if (BeatAction_StartAls == Action || BeatAction_StartIr == Action)
+        {
+            if ((BeatAction_StartIr == Action) ? StartIrConversion() : WriteOpMode(ISL29018_CMD1_OPMODE_ALS_ONCE))
+            {
+                return true;
+            }
+
+            Action = GetBeatAction(true);
+        }
+
+        if (BeatAction_ReadIr == Action || BeatAction_ReadIrAndResume == Action)
+        {
+            GetIrData();
+
+            if (BeatAction_ReadIrAndResume == Action)
+            {
+                WriteOpMode(ISL29018_CMD1_OPMODE_ALS_CONT);
+            }
+
+            return false;
+        }
+
+        Poll();
+        return false;
+    }
+
+    // See AlsDevice::IsrOn and WriteThresholdWindow
+    bool ArmWindow()
+    {
+        THRESHOLD_WINDOW Window = GetThresholdWindow(ModelTest_IrCoefficient);
+
+        return WriteRegister(ISL29018_REG_ADD_INT_LT_LSB, static_cast<BYTE>(Window.LowCount & 0xFF)) &&
+               WriteRegister(ISL29018_REG_ADD_INT_LT_MSB, static_cast<BYTE>(Window.LowCount >> 8)) &&
+               WriteRegister(ISL29018_REG_ADD_INT_HT_LSB, static_cast<BYTE>(Window.HighCount & 0xFF)) &&
+               WriteRegister(ISL29018_REG_ADD_INT_HT_MSB, static_cast<BYTE>(Window.HighCount >> 8));
+    }
+
+    // See AlsDevice::IsrOff and StartPolling. The chip keeps converting
+    // continuously until the first beat.
+    bool CloseWindow()
+    {
+        m_ConversionPending = false;
+        m_IrPending = false;
+
+        return WriteRegister(ISL29018_REG_ADD_INT_LT_LSB, 0x00) &&
+               WriteRegister(ISL29018_REG_ADD_INT_LT_MSB, 0x00) &&
+               WriteRegister(ISL29018_REG_ADD_INT_HT_LSB, ISL29018_MAX_COUNT & 0xFF) &&
+               WriteRegister(ISL29018_REG_ADD_INT_HT_MSB, ISL29018_MAX_COUNT >> 8);
+    }
+
+    // The interrupt: the ISR's read, then the work item processes the sample
+    // and re-arms the window, or closes it if the interrupt rate is over
+    // budget. Returns false if the chip did not raise it.
+    bool OnInterrupt()
+    {
+        BYTE StatusBuffer[ISL29018_STATUS_SIZE_BYTES];
+
+        if (!ReadRegisters(ISL29018_REG_ADD_COMMAND1, StatusBuffer, sizeof(StatusBuffer)) ||
+            (StatusBuffer[ISL29018_STATUS_COMMAND1] & ISL29018_CMD1_ISR_MASK) == 0)
+        {
+            return false;
+        }
+
+        ProcessStatus(StatusBuffer);
+        return (AcquisitionMode_Interrupt == m_Scheduler.OnInterrupt(GetNowMs())) ? ArmWindow() : CloseWindow();
+    }
+
+    // See AlsDevice::OnSetDataThresholds
+    bool SetThresholds(
+        _In_ FLOAT LuxPct,
+        _In_ FLOAT LuxAbs)
+    {
+        m_CachedThresholds.LuxPct = LuxPct;
+        m_CachedThresholds.LuxAbs = LuxAbs;
+        return ArmWindow();
+    }
+
+    // The window programmed into INT_LT/INT_HT
+    THRESHOLD_WINDOW ReadWindow()
+    {
+        BYTE Buffer[4] = {};
+        ReadRegisters(ISL29018_REG_ADD_INT_LT_LSB, Buffer, sizeof(Buffer));
+        return { static_cast<USHORT>(Buffer[0] | (Buffer[1] << 8)), static_cast<USHORT>(Buffer[2] | (Buffer[3] << 8)) };
+    }
+
+    ACQUISITION_MODE GetMode() const { return m_Scheduler.GetMode(); }
+    bool UseOneShot() const { return m_Scheduler.UseOneShot(); }
+    ULONG GetSwitchesToPolling() const { return m_Scheduler.GetSwitchesToPolling(); }
+    ULONG GetSwitchesToInterrupt() const { return m_Scheduler.GetSwitchesToInterrupt(); }
+    ULONG GetRange() const { return m_AutoRange.GetRange(); }
+    ULONG GetReports() const { return m_Reports; }
+    ULONG GetIrSamples() const { return m_IrSamples; }
+    FLOAT GetIrLux() const { return m_IrInterleave.GetIrLux(); }
+    FLOAT GetLastSample() const { return m_LastSample; }
+    FLOAT GetLuxPerCount() const { return m_AutoRange.GetLuxPerCount(); }
+    ULONG GetSaturationCount() const { return m_AutoRange.GetSaturationCount(); }
+
+} ModelDevice, *PModelDevice;
+
+// A beat of the timer, and the beat that reads the single conversion it may
+// have started, see ModelDevice::Beat
+static VOID Beat(
+    _Inout_ PIsl29018Model pModel,
+    _Inout_ PModelDevice pDevice)
+{
+    if (pDevice->Beat())
+    {
+        pModel->AdvanceTo(pModel->GetNow() + pModel->GetIntegrationTime(ModelTest_Resolution));
+        pDevice->Beat();
+    }
+}
+
+// Advance the model one conversion at a time until the INT pin is asserted or
+// Until passed. Returns the time it was asserted, 0 if it was not.
+static ULONGLONG AdvanceToInterrupt(
+    _Inout_ PIsl29018Model pModel,
+    _In_ ULONGLONG Until)
+{
+    while (pModel->GetNow() < Until)
+    {
+        ULONGLONG Next = pModel->GetNextEvent();
+        if (0 == Next || Next > Until)
+        {
+            Next = Until;
+        }
+
+        if (pModel->AdvanceTo(Next))
+        {
+            return pModel->GetNow();
+        }
+    }
+
+    return 0;
+}
+
+static bool IsNear(
+    _In_ FLOAT Lux,
+    _In_ FLOAT Expected)
+{
+    return std::fabs(Lux - Expected) <= Expected * ModelTest_LuxTolerance;
+}
+
+// The window holds exactly the counts whose lux is within the thresholds of
+// the last sample, rounded outwards to whole counts
+static VOID TestWindowMath()
+{
+    static const FLOAT Samples[] = { 0.0f, 0.5f, 10.0f, 200.0f, 3000.0f, 60000.0f };
+    static const FLOAT Percentages[] = { 0.0f, 0.01f, 0.1f, 1.0f };
+    static const FLOAT Absolutes[] = { 0.0f, 0.5f, 10.0f };
+
+    for (FLOAT Last : Samples)
+    {
+        for (FLOAT Pct : Percentages)
+        {
+            for (FLOAT Abs : Absolutes)
+            {
+                for (ULONG Resolution = ISL29018_INT_TIME_16; Resolution <= ISL29018_INT_TIME_4; Resolution++)
+                {
+                    for (ULONG Range = 0; Range < ISL29018_RANGE_COUNT; Range++)
+                    {
+                        FLOAT LuxPerCount = Isl29018LuxPerCount(Resolution, Range);
+                        THRESHOLD_WINDOW Window = ComputeThresholdWindow(Last, Pct, Abs, LuxPerCount);
+                        FLOAT Delta = (Last * Pct > Abs) ? (Last * Pct) : Abs;
+                        FLOAT Low = (Last - Delta) / LuxPerCount;
+                        FLOAT High = (Last + Delta) / LuxPerCount;
+
+                        HOST_EXPECT(Window.LowCount <= Window.HighCount,
+                                    "%.1f lux %.2f/%.1f: window [%u, %u] is empty",
+                                    Last, Pct, Abs, Window.LowCount, Window.HighCount);
+
+                        if (Low <= 0.0f)
+                        {
+                            HOST_EXPECT(0 == Window.LowCount, "%.1f lux %.2f/%.1f: low count %u, expected 0",
+                                        Last, Pct, Abs, Window.LowCount);
+                        }
+                        else if (Low < ISL29018_MAX_COUNT)
+                        {
+                            HOST_EXPECT(Window.LowCount <= Low && Low < Window.LowCount + 1.0f,
+                                        "%.1f lux %.2f/%.1f at %.4f lux per count: low count %u for %.2f",
+                                        Last, Pct, Abs, LuxPerCount, Window.LowCount, Low);
+                        }
+
+                        if (High >= ISL29018_MAX_COUNT)
+                        {
+                            HOST_EXPECT(ISL29018_MAX_COUNT == Window.HighCount,
+                                        "%.1f lux %.2f/%.1f: high count %u, expected the maximum",
+                                        Last, Pct, Abs, Window.HighCount);
+                        }
+                        else
+                        {
+                            HOST_EXPECT(Window.HighCount >= High && Window.HighCount < High + 1.0f,
+                                        "%.1f lux %.2f/%.1f at %.4f lux per count: high count %u for %.2f",
+                                        Last, Pct, Abs, LuxPerCount, Window.HighCount, High);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    THRESHOLD_WINDOW Window = ComputeThresholdWindow(200.0f, ModelTest_LuxPct, ModelTest_LuxAbs, 0.0f);
+    HOST_EXPECT(0 == Window.LowCount && ISL29018_MAX_COUNT == Window.HighCount,
+                "without a resolution the window is [%u, %u]", Window.LowCount, Window.HighCount);
+}
+
+// Steady light, a change inside the thresholds, a step out of the window and
+// a step out of the range
+static const ISL29018_LIGHT_POINT g_WindowLight[] =
+{
+    { 0,                                    200.0f,     0.0f,       0.0f },
+    { 10 * ModelTest_Second,                200.0f,     0.0f,       0.0f },
+    { 10 * ModelTest_Second + 1,            205.0f,     0.0f,       0.0f },
+    { 20 * ModelTest_Second,                205.0f,     0.0f,       0.0f },
+    { 20 * ModelTest_Second + 1,            300.0f,     0.0f,       0.0f },
+    { 30 * ModelTest_Second,                300.0f,     0.0f,       0.0f },
+    { 30 * ModelTest_Second + 1,            990.0f,     0.0f,       0.0f },
+};
+
+static VOID TestWindowRearm()
+{
+    static Isl29018Model Model;
+    static ModelDevice Device;
+
+    Model.Reset(ModelTest_Chip);
+    Model.SetLightScript(g_WindowLight, ARRAYSIZE(g_WindowLight), 0);
+
+    HOST_EXPECT(Device.Initialize(&Model, ISL29018_RANGE_1K, ModelTest_LuxPct, ModelTest_LuxAbs,
+                                  ModelTest_IntervalMs, false),
+                "the chip did not take the configuration");
+
+    ULONGLONG ConversionTime = Model.GetIntegrationTime(ModelTest_Resolution);
+
+    // The first sample is polled, then the window is armed around it
+    Model.AdvanceTo(ConversionTime);
+    HOST_EXPECT(Device.Poll(), "the first sample was not reported");
+    HOST_EXPECT(AcquisitionMode_Interrupt == Device.GetMode(), "the first sample did not arm the window");
+
+    THRESHOLD_WINDOW Window = Device.ReadWindow();
+    FLOAT Low = Window.LowCount * Device.GetLuxPerCount();
+    FLOAT High = Window.HighCount * Device.GetLuxPerCount();
+    HOST_EXPECT(Low > 179.0f && Low < 181.0f && High > 219.0f && High < 221.0f,
+                "window [%.1f, %.1f] lux around 200 lux", Low, High);
+
+    // The window is not armed before the first sample, so the conversions
+    // before it may have raised the flag the poll cleared
+    ULONGLONG Interrupts = Model.GetInterrupts();
+
+    // Stable light and a change inside the thresholds do not interrupt
+    ULONGLONG Asserted = AdvanceToInterrupt(&Model, 20 * ModelTest_Second);
+    HOST_EXPECT(0 == Asserted, "interrupt at %llu ms inside the window",
+                static_cast<unsigned long long>(Asserted / ModelTest_Millisecond));
+    HOST_EXPECT(Model.GetConversions() >= 20 * ModelTest_Second / ConversionTime - 1,
+                "%llu conversions in 20 s", static_cast<unsigned long long>(Model.GetConversions()));
+
+    // A step out of the window interrupts on the next conversion
+    Asserted = AdvanceToInterrupt(&Model, 30 * ModelTest_Second);
+    HOST_EXPECT(Asserted > 20 * ModelTest_Second && Asserted <= 20 * ModelTest_Second + ConversionTime,
+                "the step at 20000 ms interrupted at %llu ms",
+                static_cast<unsigned long long>(Asserted / ModelTest_Millisecond));
+
+    HOST_EXPECT(Device.OnInterrupt(), "the interrupt was not recognized");
+    HOST_EXPECT(!Model.IsInterruptAsserted(), "the status read did not clear the interrupt");
+    HOST_EXPECT(2 == Device.GetReports(), "%u reports after the step, expected 2", Device.GetReports());
+    HOST_EXPECT(IsNear(Device.GetLastSample(), 300.0f), "reported %.1f lux for 300 lux", Device.GetLastSample());
+
+    // The window was re-armed around the new sample
+    Window = Device.ReadWindow();
+    Low = Window.LowCount * Device.GetLuxPerCount();
+    High = Window.HighCount * Device.GetLuxPerCount();
+    HOST_EXPECT(Low < 300.0f * (1.0f - ModelTest_LuxPct) + 1.0f && High > 300.0f * (1.0f + ModelTest_LuxPct) - 1.0f &&
+                Low > 250.0f && High < 350.0f,
+                "window [%.1f, %.1f] lux re-armed around 300 lux", Low, High);
+
+    Asserted = AdvanceToInterrupt(&Model, 30 * ModelTest_Second);
+    HOST_EXPECT(0 == Asserted, "interrupt at %llu ms after re-arming",
+                static_cast<unsigned long long>(Asserted / ModelTest_Millisecond));
+    HOST_EXPECT(Interrupts + 1 == Model.GetInterrupts(), "%llu interrupts raised, expected 1",
+                static_cast<unsigned long long>(Model.GetInterrupts() - Interrupts));
+
+    // Thresholds wider than the range: the window ends where the range does,
+    // so light that saturates the range interrupts although it is reported
+    // as unchanged
+    HOST_EXPECT(Device.SetThresholds(10.0f, 0.0f), "the window was not written");
+    Window = Device.ReadWindow();
+    HOST_EXPECT(Device.GetSaturationCount() == Window.HighCount, "high count %u, the range saturates at %u",
+                Window.HighCount, Device.GetSaturationCount());
+
+    Asserted = AdvanceToInterrupt(&Model, 31 * ModelTest_Second);
+    HOST_EXPECT(Asserted > 30 * ModelTest_Second, "light out of the range did not interrupt");
+    HOST_EXPECT(Device.OnInterrupt(), "the interrupt was not recognized");
+    HOST_EXPECT(ISL29018_RANGE_4K == Device.GetRange(), "range %u after saturating the 1K range", Device.GetRange());
+    HOST_EXPECT(2 == Device.GetReports(), "%u reports, a change inside the thresholds was reported", Device.GetReports());
+
+    // The conversion in flight across the range switch may interrupt once
+    // more, it is discarded. Then the new range holds the light.
+    Interrupts = Model.GetInterrupts();
+    if (0 != AdvanceToInterrupt(&Model, 32 * ModelTest_Second))
+    {
+        HOST_EXPECT(Device.OnInterrupt(), "the interrupt was not recognized");
+        Interrupts = Model.GetInterrupts();
+    }
+
+    Asserted = AdvanceToInterrupt(&Model, 40 * ModelTest_Second);
+    HOST_EXPECT(0 == Asserted, "interrupt at %llu ms in the new range",
+                static_cast<unsigned long long>(Asserted / ModelTest_Millisecond));
+    HOST_EXPECT(Interrupts == Model.GetInterrupts(), "%llu interrupts raised in the new range",
+                static_cast<unsigned long long>(Model.GetInterrupts() - Interrupts));
+}
+
+// Interrupts arriving every Period ms from Start, returns the mode after
+// the last one
+static ACQUISITION_MODE Interrupt(
+    _Inout_ PAcquisitionScheduler pScheduler,
+    _In_ ULONG Start,
+    _In_ ULONG Period,
+    _In_ ULONG Count)
+{
+    ACQUISITION_MODE Mode = pScheduler->GetMode();
+
+    for (ULONG i = 0; i < Count; i++)
+    {
+        Mode = pScheduler->OnInterrupt(Start + i * Period);
+    }
+
+    return Mode;
+}
+
+static VOID TestSchedulerPolicy()
+{
+    static AcquisitionScheduler Scheduler;
+
+    Scheduler.ResetCounters();
+
+    // Interrupts are preferred from one conversion time of the resolution on
+    for (ULONG Resolution = ISL29018_INT_TIME_16; Resolution <= ISL29018_INT_TIME_4; Resolution++)
+    {
+        ULONG ConversionTimeMs = Isl29018ConversionTimeMs(ModelTest_Chip, Resolution);
+
+        Scheduler.Reset(0, true, ConversionTimeMs - 1, ModelTest_LuxPct, ModelTest_LuxAbs, ConversionTimeMs, false);
+        HOST_EXPECT(AcquisitionMode_Polling == Scheduler.GetMode(),
+                    "resolution %u: interrupts at %u ms, shorter than a conversion", Resolution, ConversionTimeMs - 1);
+
+        Scheduler.Reset(0, true, ConversionTimeMs, ModelTest_LuxPct, ModelTest_LuxAbs, ConversionTimeMs, false);
+        HOST_EXPECT(AcquisitionMode_Interrupt == Scheduler.GetMode(),
+                    "resolution %u: polling at %u ms, a conversion long", Resolution, ConversionTimeMs);
+    }
+
+    // Without an interrupt or a threshold there is nothing for the window to do
+    Scheduler.Reset(0, false, ModelTest_IntervalMs, ModelTest_LuxPct, ModelTest_LuxAbs, ISL29018_CONV_TIME_MS, false);
+    HOST_EXPECT(AcquisitionMode_Polling == Scheduler.GetMode(), "interrupts without an interrupt");
+    Scheduler.Reset(0, true, ModelTest_IntervalMs, 0.0f, 0.0f, ISL29018_CONV_TIME_MS, false);
+    HOST_EXPECT(AcquisitionMode_Polling == Scheduler.GetMode(), "interrupts without thresholds");
+    for (ULONG i = 0; i < 2 * Scheduler_SettleSamples; i++)
+    {
+        Scheduler.OnPolledSample(i * ModelTest_IntervalMs, false);
+    }
+    HOST_EXPECT(AcquisitionMode_Polling == Scheduler.GetMode(), "quiet samples without thresholds switched to interrupts");
+
+    // An interrupt per interval is within the budget, also across a wrap of
+    // the clock
+    ULONG Start = 0xFFFFFFFF - 10 * ModelTest_IntervalMs;
+    Scheduler.Reset(Start, true, ModelTest_IntervalMs, ModelTest_LuxPct, ModelTest_LuxAbs, ISL29018_CONV_TIME_MS, false);
+    HOST_EXPECT(AcquisitionMode_Interrupt == Interrupt(&Scheduler, Start, ModelTest_IntervalMs, 100),
+                "an interrupt per interval is over the budget");
+
+    // A storm is a storm across the wrap as well
+    Start = 0xFFFFFFFF - 4 * 10;
+    Scheduler.Reset(Start, true, ModelTest_IntervalMs, ModelTest_LuxPct, ModelTest_LuxAbs, ISL29018_CONV_TIME_MS, false);
+    HOST_EXPECT(AcquisitionMode_Polling == Interrupt(&Scheduler, Start + 10, 10, Scheduler_StormWindowIntervals + 1),
+                "%u interrupts across the wrap are within the budget", Scheduler_StormWindowIntervals + 1);
+    Scheduler.ResetCounters();
+
+    // Eight interrupts in a window of eight intervals are, the ninth is not
+    Scheduler.Reset(0, true, ModelTest_IntervalMs, ModelTest_LuxPct, ModelTest_LuxAbs, ISL29018_CONV_TIME_MS, false);
+    HOST_EXPECT(AcquisitionMode_Interrupt == Interrupt(&Scheduler, 10, 10, Scheduler_StormWindowIntervals),
+                "%u interrupts in a window are over the budget", Scheduler_StormWindowIntervals);
+    HOST_EXPECT(AcquisitionMode_Polling == Interrupt(&Scheduler, 90, 10, 1),
+                "%u interrupts in a window are within the budget", Scheduler_StormWindowIntervals + 1);
+    HOST_EXPECT(1 == Scheduler.GetSwitchesToPolling(), "%u switches to polling", Scheduler.GetSwitchesToPolling());
+    HOST_EXPECT(!Scheduler.UseOneShot(), "one-shot conversions were not allowed");
+
+    // Polled samples must stay inside the thresholds for the settle count in
+    // a row, a reported sample starts over
+    ULONG Now = 100;
+    for (ULONG i = 1; i < Scheduler_SettleSamples; i++)
+    {
+        Scheduler.OnPolledSample(Now += ModelTest_IntervalMs, false);
+    }
+    HOST_EXPECT(AcquisitionMode_Polling == Scheduler.OnPolledSample(Now += ModelTest_IntervalMs, true),
+                "a reported sample switched to interrupts");
+    for (ULONG i = 1; i < Scheduler_SettleSamples; i++)
+    {
+        Scheduler.OnPolledSample(Now += ModelTest_IntervalMs, false);
+    }
+    HOST_EXPECT(AcquisitionMode_Polling == Scheduler.GetMode(), "%u quiet samples switched to interrupts",
+                Scheduler_SettleSamples - 1);
+
+    // A sample that was not converted starts over as well, it says nothing
+    // about the light
+    HOST_EXPECT(AcquisitionMode_Polling == Scheduler.OnFailedSample(), "a failed sample switched to interrupts");
+    for (ULONG i = 1; i < Scheduler_SettleSamples; i++)
+    {
+        Scheduler.OnPolledSample(Now += ModelTest_IntervalMs, false);
+    }
+    HOST_EXPECT(AcquisitionMode_Polling == Scheduler.GetMode(), "%u quiet samples after a failed one switched to interrupts",
+                Scheduler_SettleSamples - 1);
+    HOST_EXPECT(AcquisitionMode_Interrupt == Scheduler.OnPolledSample(Now += ModelTest_IntervalMs, false),
+                "%u quiet samples did not switch to interrupts", Scheduler_SettleSamples);
+    HOST_EXPECT(1 == Scheduler.GetSwitchesToInterrupt(), "%u switches to interrupts", Scheduler.GetSwitchesToInterrupt());
+
+    // The budget starts over with the switch
+    HOST_EXPECT(AcquisitionMode_Interrupt == Interrupt(&Scheduler, Now, 1, Scheduler_StormWindowIntervals),
+                "the interrupts before the switch were counted");
+
+    // A failed interrupt path polls until the next reset, counters are kept
+    Scheduler.DisableInterrupt();
+    for (ULONG i = 0; i < 2 * Scheduler_SettleSamples; i++)
+    {
+        Scheduler.OnPolledSample(Now += ModelTest_IntervalMs, false);
+    }
+    HOST_EXPECT(AcquisitionMode_Polling == Scheduler.GetMode(), "switched back to a disabled interrupt");
+    HOST_EXPECT(2 == Scheduler.GetSwitchesToPolling(), "%u switches to polling", Scheduler.GetSwitchesToPolling());
+
+    Scheduler.Reset(Now, true, ModelTest_IntervalMs, ModelTest_LuxPct, ModelTest_LuxAbs, ISL29018_CONV_TIME_MS, false);
+    HOST_EXPECT(AcquisitionMode_Interrupt == Scheduler.GetMode(), "the reset did not re-enable interrupts");
+    HOST_EXPECT(2 == Scheduler.GetSwitchesToPolling() && 1 == Scheduler.GetSwitchesToInterrupt(),
+                "the reset cleared the counters");
+}
+
+// Light flickering between two levels 30% apart from ModelTest_FlickerStart
+// to ModelTest_FlickerEnd. The level changes halfway between two conversion
+// ends, so every conversion sees the other level, as mains flicker aliased
+// into the conversion rate does. The IR light is steady.
+#define ModelTest_FlickerStart              (10 * ModelTest_Second)
+#define ModelTest_FlickerEnd                (20 * ModelTest_Second)
+#define ModelTest_FlickerEdges              ((ModelTest_FlickerEnd - ModelTest_FlickerStart) / (90 * ModelTest_Millisecond))
+
+static ISL29018_LIGHT_POINT g_FlickerLight[2 * ModelTest_FlickerEdges + 4];
+
+static ULONG MakeFlickerLight(
+    _In_ ULONGLONG ConversionTime,
+    _In_ FLOAT IrLux)
+{
+    ULONG Count = 0;
+    ULONGLONG Edge = (ModelTest_FlickerStart / ConversionTime) * ConversionTime + ConversionTime / 2;
+    FLOAT Lux = 200.0f;
+
+    g_FlickerLight[Count++] = { 0, Lux, IrLux, 0.0f };
+    for (; Edge < ModelTest_FlickerEnd && Count + 3 < ARRAYSIZE(g_FlickerLight); Edge += ConversionTime)
+    {
+        g_FlickerLight[Count++] = { Edge, Lux, IrLux, 0.0f };
+        Lux = (200.0f == Lux) ? 260.0f : 200.0f;
+        g_FlickerLight[Count++] = { Edge + 1, Lux, IrLux, 0.0f };
+    }
+    g_FlickerLight[Count++] = { Edge, Lux, IrLux, 0.0f };
+    g_FlickerLight[Count++] = { Edge + 1, 200.0f, IrLux, 0.0f };
+
+    return Count;
+}
+
+// What a closed loop of the driver's two paths against the model went
+// through, see RunClosedLoop
+typedef struct _CLOSED_LOOP
+{
+    ULONGLONG   PollingAt;              // First switch to polling, 0 if none
+    ULONGLONG   InterruptAt;            // Last switch to interrupts, 0 if none
+    ULONGLONG   Interrupts;             // Interrupts raised up to InterruptAt
+    ULONGLONG   PolledConversions;      // Conversions while polling
+    ULONG       Beats;                  // Beats of the timer while polling
+    ULONG       AwakeBeats;             // One-shot beats that left the chip converting
+} CLOSED_LOOP;
+
+// The driver's two paths on the model's clock until End: the interrupt work
+// item while the window is armed, the timer every IntervalMs while polling.
+// The first sample is read by the timer once a conversion completed.
+static VOID RunClosedLoop(
+    _Inout_ PIsl29018Model pModel,
+    _Inout_ PModelDevice pDevice,
+    _In_ ULONG IntervalMs,
+    _In_ ULONGLONG End,
+    _Out_ CLOSED_LOOP* pLoop)
+{
+    ULONGLONG Interval = IntervalMs * ModelTest_Millisecond;
+
+    *pLoop = {};
+
+    pModel->AdvanceTo(pModel->GetNow() + pModel->GetIntegrationTime(ModelTest_Resolution));
+    Beat(pModel, pDevice);
+    pLoop->Interrupts = pModel->GetInterrupts();
+
+    while (pModel->GetNow() < End)
+    {
+        if (AcquisitionMode_Interrupt == pDevice->GetMode())
+        {
+            if (0 == AdvanceToInterrupt(pModel, End))
+            {
+                break;
+            }
+
+            HOST_EXPECT(pDevice->OnInterrupt(), "the interrupt at %llu ms was not recognized",
+                        static_cast<unsigned long long>(pModel->GetNow() / ModelTest_Millisecond));
+            if (AcquisitionMode_Polling == pDevice->GetMode() && 0 == pLoop->PollingAt)
+            {
+                pLoop->PollingAt = pModel->GetNow();
+            }
+        }
+        else
+        {
+            ULONGLONG Conversions = pModel->GetConversions();
+
+            pModel->AdvanceTo(pModel->GetNow() + Interval);
+            Beat(pModel, pDevice);
+            pLoop->PolledConversions += pModel->GetConversions() - Conversions;
+            pLoop->Beats++;
+
+            if (pDevice->UseOneShot() && 0 != pModel->GetNextEvent())
+            {
+                pLoop->AwakeBeats++;
+            }
+
+            if (AcquisitionMode_Interrupt == pDevice->GetMode())
+            {
+                pLoop->InterruptAt = pModel->GetNow();
+                pLoop->Interrupts = pModel->GetInterrupts();
+            }
+        }
+    }
+}
+
+// Flicker for the budget, then stable light for the settle count, checks
+// common to continuous and one-shot polling
+static VOID ExpectStormAndSettle(
+    _In_ PIsl29018Model pModel,
+    _In_ PModelDevice pDevice,
+    _In_ ULONG IntervalMs,
+    _In_ const CLOSED_LOOP* pLoop)
+{
+    ULONGLONG Interval = IntervalMs * ModelTest_Millisecond;
+
+    // IR conversions take the place of polled samples in the settle count
+    ULONG SettleBeats = Scheduler_SettleSamples + Scheduler_SettleSamples / IrInterleave_AlsSamplesPerIr + 2;
+    ULONGLONG StormLimit = ModelTest_FlickerStart + (Scheduler_StormWindowIntervals + 2) * Interval;
+    ULONGLONG SettleLimit = ModelTest_FlickerEnd + SettleBeats * Interval;
+
+    HOST_EXPECT(pLoop->PollingAt > ModelTest_FlickerStart && pLoop->PollingAt <= StormLimit,
+                "%u ms: fell back to polling at %llu ms, the flicker started at %llu ms", IntervalMs,
+                static_cast<unsigned long long>(pLoop->PollingAt / ModelTest_Millisecond),
+                static_cast<unsigned long long>(ModelTest_FlickerStart / ModelTest_Millisecond));
+    HOST_EXPECT(pLoop->InterruptAt > ModelTest_FlickerEnd && pLoop->InterruptAt <= SettleLimit,
+                "%u ms: went back to interrupts at %llu ms, the flicker ended at %llu ms", IntervalMs,
+                static_cast<unsigned long long>(pLoop->InterruptAt / ModelTest_Millisecond),
+                static_cast<unsigned long long>(ModelTest_FlickerEnd / ModelTest_Millisecond));
+    HOST_EXPECT(AcquisitionMode_Interrupt == pDevice->GetMode(), "%u ms: polling in stable light", IntervalMs);
+    HOST_EXPECT(1 == pDevice->GetSwitchesToPolling() && 1 == pDevice->GetSwitchesToInterrupt(),
+                "%u ms: %u switches to polling and %u to interrupts, expected one each", IntervalMs,
+                pDevice->GetSwitchesToPolling(), pDevice->GetSwitchesToInterrupt());
+    HOST_EXPECT(pLoop->Interrupts == pModel->GetInterrupts(),
+                "%u ms: %llu interrupts in stable light after the window was armed", IntervalMs,
+                static_cast<unsigned long long>(pModel->GetInterrupts() - pLoop->Interrupts));
+
+    // Polling covers the flicker and the settling, nothing else
+    ULONG MaxBeats = static_cast<ULONG>((SettleLimit - ModelTest_FlickerStart) / Interval);
+    HOST_EXPECT(pLoop->Beats <= MaxBeats, "%u ms: %u beats polled, expected at most %u",
+                IntervalMs, pLoop->Beats, MaxBeats);
+}
+
+static VOID TestSchedulerClosedLoop()
+{
+    static Isl29018Model Model;
+    static ModelDevice Device;
+    CLOSED_LOOP Loop;
+
+    Model.Reset(ModelTest_Chip);
+    Model.SetLightScript(g_FlickerLight, MakeFlickerLight(Model.GetIntegrationTime(ModelTest_Resolution), 0.0f), 0);
+    HOST_EXPECT(Device.Initialize(&Model, ISL29018_RANGE_1K, ModelTest_LuxPct, ModelTest_LuxAbs,
+                                  ModelTest_IntervalMs, false),
+                "the chip did not take the configuration");
+
+    RunClosedLoop(&Model, &Device, ModelTest_IntervalMs, 40 * ModelTest_Second, &Loop);
+    ExpectStormAndSettle(&Model, &Device, ModelTest_IntervalMs, &Loop);
+}
+
+// Reads that fail while polling are no quiet samples: the scheduler keeps
+// polling while the chip does not answer, rather than arming a window it
+// cannot write, and goes back to interrupts once the light settled again
+static VOID TestSchedulerFailedReads()
+{
+    static Isl29018Model Model;
+    static ModelDevice Device;
+    CLOSED_LOOP Loop;
+
+    ULONGLONG Interval = ModelTest_IntervalMs * ModelTest_Millisecond;
+    ULONG SettleBeats = Scheduler_SettleSamples + Scheduler_SettleSamples / IrInterleave_AlsSamplesPerIr + 2;
+
+    Model.Reset(ModelTest_Chip);
+    Model.SetLightScript(g_FlickerLight, MakeFlickerLight(Model.GetIntegrationTime(ModelTest_Resolution), 0.0f), 0);
+    HOST_EXPECT(Device.Initialize(&Model, ISL29018_RANGE_1K, ModelTest_LuxPct, ModelTest_LuxAbs,
+                                  ModelTest_IntervalMs, false),
+                "the chip did not take the configuration");
+
+    // The flicker forces polling, which lasts until it ends
+    RunClosedLoop(&Model, &Device, ModelTest_IntervalMs, ModelTest_FlickerEnd, &Loop);
+    HOST_EXPECT(AcquisitionMode_Polling == Device.GetMode(), "interrupts at the end of the flicker");
+
+    Model.SetOffline(true);
+    for (ULONG i = 0; i < 4 * Scheduler_SettleSamples; i++)
+    {
+        Model.AdvanceTo(Model.GetNow() + Interval);
+        Beat(&Model, &Device);
+    }
+    HOST_EXPECT(AcquisitionMode_Polling == Device.GetMode() && 0 == Device.GetSwitchesToInterrupt(),
+                "%u beats of failed reads switched to interrupts", 4 * Scheduler_SettleSamples);
+
+    Model.SetOffline(false);
+    ULONG Beats = 0;
+    while (AcquisitionMode_Polling == Device.GetMode() && Beats <= SettleBeats)
+    {
+        Model.AdvanceTo(Model.GetNow() + Interval);
+        Beat(&Model, &Device);
+        Beats++;
+    }
+    HOST_EXPECT(AcquisitionMode_Interrupt == Device.GetMode() && Beats >= Scheduler_SettleSamples,
+                "back to interrupts %u beats after the reads recovered, expected %u to %u",
+                Beats, Scheduler_SettleSamples, SettleBeats);
+    HOST_EXPECT(1 == Device.GetSwitchesToPolling() && 1 == Device.GetSwitchesToInterrupt(),
+                "%u switches to polling and %u to interrupts, expected one each",
+                Device.GetSwitchesToPolling(), Device.GetSwitchesToInterrupt());
+}
+
+// One-shot conversions are picked from ten conversion times on, and only
+// for polling
+static VOID TestOneShotPolicy()
+{
+    static AcquisitionScheduler Scheduler;
+
+    Scheduler.ResetCounters();
+
+    for (ULONG Resolution = ISL29018_INT_TIME_16; Resolution <= ISL29018_INT_TIME_4; Resolution++)
+    {
+        ULONG ConversionTimeMs = Isl29018ConversionTimeMs(ModelTest_Chip, Resolution);
+        ULONG IntervalMs = ConversionTimeMs * Scheduler_OneShotIntervalFactor;
+
+        Scheduler.Reset(0, false, IntervalMs - 1, ModelTest_LuxPct, ModelTest_LuxAbs, ConversionTimeMs, true);
+        HOST_EXPECT(!Scheduler.UseOneShot(), "resolution %u: one-shot at %u ms", Resolution, IntervalMs - 1);
+
+        Scheduler.Reset(0, false, IntervalMs, ModelTest_LuxPct, ModelTest_LuxAbs, ConversionTimeMs, true);
+        HOST_EXPECT(Scheduler.UseOneShot(), "resolution %u: continuous at %u ms", Resolution, IntervalMs);
+
+        Scheduler.Reset(0, false, IntervalMs, ModelTest_LuxPct, ModelTest_LuxAbs, ConversionTimeMs, false);
+        HOST_EXPECT(!Scheduler.UseOneShot(), "resolution %u: one-shot while oversampling", Resolution);
+
+        // The window is only evaluated on continuous conversions
+        Scheduler.Reset(0, true, IntervalMs, ModelTest_LuxPct, ModelTest_LuxAbs, ConversionTimeMs, true);
+        HOST_EXPECT(!Scheduler.UseOneShot(), "resolution %u: one-shot with the window armed", Resolution);
+
+        Scheduler.DisableInterrupt();
+        HOST_EXPECT(Scheduler.UseOneShot(), "resolution %u: continuous after interrupts failed", Resolution);
+    }
+
+    // The interval overflows neither
+    Scheduler.Reset(0, false, 0xFFFFFFFF, ModelTest_LuxPct, ModelTest_LuxAbs, 0xFFFFFFFF / 2, true);
+    HOST_EXPECT(!Scheduler.UseOneShot(), "one-shot at two conversion times, the interval times the factor overflowed");
+}
+
+// A step of the light, with no IR light so the IR conversions read 0
+static const ISL29018_LIGHT_POINT g_StepLight[] =
+{
+    { 0,                                    200.0f,     0.0f,       0.0f },
+    { 5 * ModelTest_Second,                 200.0f,     0.0f,       0.0f },
+    { 5 * ModelTest_Second + 1,             500.0f,     0.0f,       0.0f },
+};
+
+// Every beat converts once and the chip is powered down in between. The
+// sample a beat reads was converted after the beat started it.
+static VOID TestOneShotBeats()
+{
+    static Isl29018Model Model;
+    static ModelDevice Device;
+
+    ULONGLONG ConversionTime = Model.GetIntegrationTime(ModelTest_Resolution);
+    ULONG IntervalMs = Isl29018ConversionTimeMs(ModelTest_Chip, ModelTest_Resolution) * Scheduler_OneShotIntervalFactor;
+    ULONGLONG Interval = IntervalMs * ModelTest_Millisecond;
+
+    Model.Reset(ModelTest_Chip);
+    Model.SetLightScript(g_StepLight, ARRAYSIZE(g_StepLight), 0);
+
+    // Without thresholds every sample is polled
+    HOST_EXPECT(Device.Initialize(&Model, ISL29018_RANGE_1K, 0.0f, 0.0f, IntervalMs, true),
+                "the chip did not take the configuration");
+    HOST_EXPECT(Device.UseOneShot(), "continuous conversions at %u ms", IntervalMs);
+    HOST_EXPECT(ConversionTime == Model.GetNextEvent(), "the first conversion ends at %llu ms",
+                static_cast<unsigned long long>(Model.GetNextEvent() / ModelTest_Millisecond));
+
+    // The chip powers itself down after ALS_ONCE
+    Model.AdvanceTo(Interval);
+    HOST_EXPECT(1 == Model.GetConversions(), "%llu conversions after ALS_ONCE",
+                static_cast<unsigned long long>(Model.GetConversions()));
+    HOST_EXPECT(0 == Model.GetNextEvent(), "the chip kept converting after ALS_ONCE");
+    HOST_EXPECT(!Device.Beat(), "the first beat did not read the pending conversion");
+    HOST_EXPECT(IsNear(Device.GetLastSample(), 200.0f), "reported %.1f lux for 200 lux", Device.GetLastSample());
+
+    ULONG Beats = 0;
+    ULONG AwakeBeats = 0;
+    while (Model.GetNow() + Interval < 10 * ModelTest_Second)
+    {
+        Model.AdvanceTo(Model.GetNow() + Interval);
+        Beat(&Model, &Device);
+        Beats++;
+
+        AwakeBeats += (0 != Model.GetNextEvent()) ? 1 : 0;
+    }
+
+    HOST_EXPECT(0 == AwakeBeats, "the chip kept converting after %u of %u beats", AwakeBeats, Beats);
+    HOST_EXPECT(1 + Beats == Model.GetConversions(), "%llu conversions for %u beats",
+                static_cast<unsigned long long>(Model.GetConversions()), Beats);
+    HOST_EXPECT(IsNear(Device.GetLastSample(), 500.0f), "reported %.1f lux for 500 lux", Device.GetLastSample());
+}
+
+// The flicker at an interval that picks one-shot conversions for polling:
+// the chip converts once per beat while polling and continuously again once
+// the window is armed
+static VOID TestOneShotClosedLoop()
+{
+    static Isl29018Model Model;
+    static ModelDevice Device;
+    CLOSED_LOOP Loop;
+
+    ULONGLONG ConversionTime = Model.GetIntegrationTime(ModelTest_Resolution);
+    ULONG IntervalMs = Isl29018ConversionTimeMs(ModelTest_Chip, ModelTest_Resolution) * Scheduler_OneShotIntervalFactor;
+    ULONGLONG Interval = IntervalMs * ModelTest_Millisecond;
+
+    Model.Reset(ModelTest_Chip);
+    Model.SetLightScript(g_FlickerLight, MakeFlickerLight(ConversionTime, 0.0f), 0);
+    HOST_EXPECT(Device.Initialize(&Model, ISL29018_RANGE_1K, ModelTest_LuxPct, ModelTest_LuxAbs, IntervalMs, true),
+                "the chip did not take the configuration");
+    HOST_EXPECT(!Device.UseOneShot(), "one-shot conversions with the window armed");
+
+    RunClosedLoop(&Model, &Device, IntervalMs, 60 * ModelTest_Second, &Loop);
+    ExpectStormAndSettle(&Model, &Device, IntervalMs, &Loop);
+
+    // The conversions before the first beat after the switch are continuous
+    HOST_EXPECT(0 == Loop.AwakeBeats, "the chip kept converting after %u of %u beats", Loop.AwakeBeats, Loop.Beats);
+    HOST_EXPECT(Loop.PolledConversions <= Loop.Beats + Interval / ConversionTime,
+                "%llu conversions for %u beats",
+                static_cast<unsigned long long>(Loop.PolledConversions), Loop.Beats);
+    HOST_EXPECT(0 != Model.GetNextEvent(), "the chip is not converting with the window armed");
+}
+
+// The compensation subtracts the IR share and stops at 0, the offset moves a
+// compensated window back to raw ALS counts
+static VOID TestIrCompensation()
+{
+    static const FLOAT IrLuxes[] = { 0.0f, 1.0f, 80.0f, 1000.0f };
+    static const FLOAT AlsLuxes[] = { 0.0f, 10.0f, 200.0f, 3000.0f };
+
+    for (FLOAT IrLux : IrLuxes)
+    {
+        for (FLOAT AlsLux : AlsLuxes)
+        {
+            FLOAT Expected = AlsLux - ModelTest_IrCoefficient * IrLux;
+            FLOAT Lux = IrCompensatedLux(AlsLux, IrLux, ModelTest_IrCoefficient);
+
+            HOST_EXPECT((Expected <= 0.0f) ? (0.0f == Lux) : IsNear(Lux, Expected),
+                        "%.1f lux with %.1f IR lux compensated to %.2f", AlsLux, IrLux, Lux);
+            HOST_EXPECT(AlsLux == IrCompensatedLux(AlsLux, IrLux, 0.0f),
+                        "%.1f lux compensated without a coefficient", AlsLux);
+        }
+
+        for (ULONG Range = 0; Range < ISL29018_RANGE_COUNT; Range++)
+        {
+            FLOAT LuxPerCount = Isl29018LuxPerCount(ModelTest_Resolution, Range);
+            USHORT Offset = IrCompensationOffsetCount(IrLux, ModelTest_IrCoefficient, LuxPerCount);
+            FLOAT Counts = ModelTest_IrCoefficient * IrLux / LuxPerCount;
+
+            HOST_EXPECT(Offset <= Counts && Counts < Offset + 1.0f,
+                        "%.1f IR lux in range %u: offset %u counts for %.2f", IrLux, Range, Offset, Counts);
+        }
+    }
+
+    HOST_EXPECT(0 == IrCompensationOffsetCount(80.0f, ModelTest_IrCoefficient, 0.0f), "an offset without a resolution");
+    HOST_EXPECT(0xFFFF == IrCompensationOffsetCount(1.0e9f, ModelTest_IrCoefficient, 1.0f), "the offset wrapped");
+}
+
+// IR is converted first and then once every IrInterleave_AlsSamplesPerIr ALS
+// samples, its lux is kept across range switches
+static VOID TestIrInterleave()
+{
+    static IrInterleave Interleave;
+
+    Interleave.Reset();
+    HOST_EXPECT(Interleave.IsIrDue(), "no IR conversion due without an IR sample");
+    HOST_EXPECT(0.0f == Interleave.GetIrLux(), "%.2f IR lux without an IR sample", Interleave.GetIrLux());
+
+    for (ULONG Cycle = 0; Cycle < 3; Cycle++)
+    {
+        Interleave.OnIrSample(1000 + Cycle, 0.5f);
+        HOST_EXPECT(1000 + Cycle == Interleave.GetIrCount() && 0.5f * (1000 + Cycle) == Interleave.GetIrLux(),
+                    "IR sample %u: count %u, %.1f lux", Cycle, Interleave.GetIrCount(), Interleave.GetIrLux());
+
+        for (ULONG i = 1; i <= IrInterleave_AlsSamplesPerIr; i++)
+        {
+            HOST_EXPECT(!Interleave.IsIrDue(), "IR conversion due after %u ALS samples", i - 1);
+            Interleave.OnAlsSample();
+        }
+        HOST_EXPECT(Interleave.IsIrDue(), "no IR conversion due after %u ALS samples", IrInterleave_AlsSamplesPerIr);
+    }
+}
+
+// IR light on top of the visible light, 20 lux of it leaks into the ALS
+// channel
+#define ModelTest_IrLux                     (80.0f)
+#define ModelTest_CompensatedLux            (200.0f - ModelTest_IrCoefficient * ModelTest_IrLux)
+
+static const ISL29018_LIGHT_POINT g_IrLight[] =
+{
+    { 0,                                    200.0f,     ModelTest_IrLux, 0.0f },
+};
+
+// Polling with continuous and one-shot conversions: one beat in
+// IrInterleave_AlsSamplesPerIr + 1 reads an IR conversion, and the samples
+// reported are compensated with it
+static VOID TestIrPolling()
+{
+    static Isl29018Model Model;
+    static ModelDevice Device;
+    static const ULONG IntervalsMs[] =
+    {
+        ModelTest_IntervalMs,
+        Isl29018ConversionTimeMs(ModelTest_Chip, ModelTest_Resolution) * Scheduler_OneShotIntervalFactor,
+    };
+
+    for (ULONG IntervalMs : IntervalsMs)
+    {
+        ULONGLONG Interval = IntervalMs * ModelTest_Millisecond;
+        ULONG Beats = 10 * (IrInterleave_AlsSamplesPerIr + 1);
+
+        Model.Reset(ModelTest_Chip);
+        Model.SetLightScript(g_IrLight, ARRAYSIZE(g_IrLight), 0);
+
+        // Without thresholds every sample is polled
+        HOST_EXPECT(Device.Initialize(&Model, ISL29018_RANGE_1K, 0.0f, 0.0f, IntervalMs, true),
+                    "the chip did not take the configuration");
+
+        Model.AdvanceTo(Model.GetIntegrationTime(ModelTest_Resolution));
+        Beat(&Model, &Device);
+        HOST_EXPECT(IsNear(Device.GetLastSample(), 200.0f), "%u ms: reported %.1f lux before the first IR sample",
+                    IntervalMs, Device.GetLastSample());
+
+        for (ULONG i = 0; i < Beats; i++)
+        {
+            Model.AdvanceTo(Model.GetNow() + Interval);
+            Beat(&Model, &Device);
+        }
+
+        HOST_EXPECT(Beats / (IrInterleave_AlsSamplesPerIr + 1) == Device.GetIrSamples(),
+                    "%u ms: %u IR samples in %u beats", IntervalMs, Device.GetIrSamples(), Beats);
+        HOST_EXPECT(IsNear(Device.GetIrLux(), ModelTest_IrLux), "%u ms: %.1f IR lux for %.1f",
+                    IntervalMs, Device.GetIrLux(), ModelTest_IrLux);
+        HOST_EXPECT(IsNear(Device.GetLastSample(), ModelTest_CompensatedLux), "%u ms: reported %.1f lux for %.1f",
+                    IntervalMs, Device.GetLastSample(), ModelTest_CompensatedLux);
+    }
+}
+
+// The flicker with IR light: the IR samples taken while polling move the
+// window the scheduler re-arms by the IR share, so it holds the raw ALS
+// count of the stable light and raises no interrupt
+static VOID TestIrWindow()
+{
+    static Isl29018Model Model;
+    static ModelDevice Device;
+    CLOSED_LOOP Loop;
+
+    Model.Reset(ModelTest_Chip);
+    Model.SetLightScript(g_FlickerLight, MakeFlickerLight(Model.GetIntegrationTime(ModelTest_Resolution), ModelTest_IrLux), 0);
+    HOST_EXPECT(Device.Initialize(&Model, ISL29018_RANGE_1K, ModelTest_LuxPct, ModelTest_LuxAbs,
+                                  ModelTest_IntervalMs, false),
+                "the chip did not take the configuration");
+
+    RunClosedLoop(&Model, &Device, ModelTest_IntervalMs, 40 * ModelTest_Second, &Loop);
+    ExpectStormAndSettle(&Model, &Device, ModelTest_IntervalMs, &Loop);
+
+    HOST_EXPECT(Device.GetIrSamples() > 0, "no IR sample while polling");
+    HOST_EXPECT(IsNear(Device.GetLastSample(), ModelTest_CompensatedLux), "reported %.1f lux for %.1f",
+                Device.GetLastSample(), ModelTest_CompensatedLux);
+
+    THRESHOLD_WINDOW Window = Device.ReadWindow();
+    ULONG RawCount = static_cast<ULONG>(200.0f / Device.GetLuxPerCount());
+    HOST_EXPECT(Window.LowCount < RawCount && RawCount < Window.HighCount,
+                "window [%u, %u] without the raw count %u", Window.LowCount, Window.HighCount, RawCount);
+}
+
+// Arbiter intervals, with a conversion time well below either
+#define ModelTest_AdcAlsIntervalMs          (100)
+#define ModelTest_AdcProxIntervalMs         (30)
+#define ModelTest_AdcConversionMs           (6)
+
+static VOID TestArbiterPolicy()
+{
+    static AdcArbiter Arbiter;
+
+    Arbiter.Reset();
+    HOST_EXPECT(AdcChannel_None == Arbiter.PickNext(0, ModelTest_AdcConversionMs), "picked a channel with none started");
+    HOST_EXPECT(0 == Arbiter.GetWaitMs(0, ModelTest_AdcConversionMs), "waits with no channel started");
+
+    // A started channel is due right away, and nothing else starts while
+    // its conversion is in flight
+    Arbiter.SetChannel(AdcChannel_Als, true, ModelTest_AdcAlsIntervalMs, 0);
+    HOST_EXPECT(AdcChannel_Als == Arbiter.PickNext(0, ModelTest_AdcConversionMs), "the started channel is not due");
+    Arbiter.StartConversion(AdcChannel_Als);
+    Arbiter.SetChannel(AdcChannel_Prox, true, ModelTest_AdcProxIntervalMs, 0);
+    HOST_EXPECT(AdcChannel_None == Arbiter.PickNext(0, ModelTest_AdcConversionMs),
+                "a second conversion started while one is in flight");
+
+    // The proximity channel is due earlier than the next light conversion
+    Arbiter.CompleteConversion(ModelTest_AdcConversionMs);
+    HOST_EXPECT(1 == Arbiter.GetConversions(AdcChannel_Als) && 0 == Arbiter.GetMissedBeats(AdcChannel_Als),
+                "%u light conversions, %u missed", Arbiter.GetConversions(AdcChannel_Als), Arbiter.GetMissedBeats(AdcChannel_Als));
+    HOST_EXPECT(AdcChannel_Prox == Arbiter.PickNext(ModelTest_AdcConversionMs, ModelTest_AdcConversionMs),
+                "the earliest due channel did not go first");
+
+    // A conversion starts one conversion time ahead of its due time, not earlier
+    Arbiter.StartConversion(AdcChannel_Prox);
+    Arbiter.CompleteConversion(2 * ModelTest_AdcConversionMs);
+    ULONG DueMs = ModelTest_AdcProxIntervalMs;
+    HOST_EXPECT(AdcChannel_None == Arbiter.PickNext(DueMs - ModelTest_AdcConversionMs - 1, ModelTest_AdcConversionMs),
+                "picked a conversion more than a conversion time ahead");
+    HOST_EXPECT(ModelTest_AdcProxIntervalMs - ModelTest_AdcConversionMs - 2 * ModelTest_AdcConversionMs ==
+                Arbiter.GetWaitMs(2 * ModelTest_AdcConversionMs, ModelTest_AdcConversionMs),
+                "waits %u ms for the proximity conversion", Arbiter.GetWaitMs(2 * ModelTest_AdcConversionMs, ModelTest_AdcConversionMs));
+    HOST_EXPECT(AdcChannel_Prox == Arbiter.PickNext(DueMs - ModelTest_AdcConversionMs, ModelTest_AdcConversionMs),
+                "did not pick the conversion a conversion time ahead");
+
+    // Ties go to the channel not served last, so equal intervals alternate
+    Arbiter.Reset();
+    Arbiter.SetChannel(AdcChannel_Als, true, ModelTest_AdcProxIntervalMs, 0);
+    Arbiter.SetChannel(AdcChannel_Prox, true, ModelTest_AdcProxIntervalMs, 0);
+    ULONG Served[AdcChannel_Count] = {};
+    ADC_CHANNEL Last = AdcChannel_None;
+    ULONG Repeats = 0;
+    for (ULONG NowMs = 0; NowMs < 100 * ModelTest_AdcProxIntervalMs; NowMs++)
+    {
+        ADC_CHANNEL Channel = Arbiter.PickNext(NowMs, 0);
+        if (AdcChannel_None != Channel)
+        {
+            Repeats += (Channel == Last) ? 1 : 0;
+            Served[Channel]++;
+            Last = Channel;
+            Arbiter.StartConversion(Channel);
+            Arbiter.CompleteConversion(NowMs);
+        }
+    }
+    HOST_EXPECT(0 == Repeats, "a channel was served twice in a row %u times at equal intervals", Repeats);
+    HOST_EXPECT(100 == Served[AdcChannel_Als] && 100 == Served[AdcChannel_Prox], "served %u light and %u proximity turns",
+                Served[AdcChannel_Als], Served[AdcChannel_Prox]);
+
+    // A conversion due at one interval that completes at three and a half
+    // drops the two beats it missed and is due an interval after it completed
+    Arbiter.Reset();
+    Arbiter.SetChannel(AdcChannel_Als, true, ModelTest_AdcAlsIntervalMs, 0);
+    Arbiter.StartConversion(Arbiter.PickNext(0, 0));
+    Arbiter.CompleteConversion(0);
+    Arbiter.StartConversion(Arbiter.PickNext(ModelTest_AdcAlsIntervalMs, 0));
+    Arbiter.CompleteConversion(ModelTest_AdcAlsIntervalMs * 7 / 2);
+    HOST_EXPECT(2 == Arbiter.GetMissedBeats(AdcChannel_Als), "%u beats missed", Arbiter.GetMissedBeats(AdcChannel_Als));
+    HOST_EXPECT(ModelTest_AdcAlsIntervalMs == Arbiter.GetWaitMs(ModelTest_AdcAlsIntervalMs * 7 / 2, 0),
+                "due %u ms after the late conversion", Arbiter.GetWaitMs(ModelTest_AdcAlsIntervalMs * 7 / 2, 0));
+
+    // A conversion completed on its due time misses nothing, and completing
+    // with none in flight counts nothing
+    Arbiter.StartConversion(AdcChannel_Als);
+    Arbiter.CompleteConversion(ModelTest_AdcAlsIntervalMs * 9 / 2);
+    Arbiter.CompleteConversion(ModelTest_AdcAlsIntervalMs * 9 / 2);
+    HOST_EXPECT(3 == Arbiter.GetConversions(AdcChannel_Als) && 2 == Arbiter.GetMissedBeats(AdcChannel_Als),
+                "%u conversions, %u missed", Arbiter.GetConversions(AdcChannel_Als), Arbiter.GetMissedBeats(AdcChannel_Als));
+
+    // Stopping the channel in flight drops its conversion, starting it again
+    // starts its counts over. An interval of 0 is taken as 1 ms.
+    Arbiter.StartConversion(AdcChannel_Als);
+    Arbiter.SetChannel(AdcChannel_Als, false, ModelTest_AdcAlsIntervalMs, 0);
+    HOST_EXPECT(AdcChannel_None == Arbiter.GetInFlight(), "the stopped channel is still in flight");
+    Arbiter.SetChannel(AdcChannel_Als, true, 0, 0);
+    HOST_EXPECT(0 == Arbiter.GetConversions(AdcChannel_Als) && 0 == Arbiter.GetMissedBeats(AdcChannel_Als),
+                "the restarted channel kept its counts");
+    HOST_EXPECT(1 == Arbiter.GetIntervalMs(AdcChannel_Als), "an interval of 0 is %u ms", Arbiter.GetIntervalMs(AdcChannel_Als));
+
+    // The wait holds across a wrap of the clock, and nothing is picked early
+    ULONG StartMs = 0xFFFFFFFF - ModelTest_AdcProxIntervalMs / 2;
+    Arbiter.Reset();
+    Arbiter.SetChannel(AdcChannel_Prox, true, ModelTest_AdcProxIntervalMs, StartMs);
+    Arbiter.StartConversion(Arbiter.PickNext(StartMs, ModelTest_AdcConversionMs));
+    Arbiter.CompleteConversion(StartMs);
+    HOST_EXPECT(ModelTest_AdcProxIntervalMs - ModelTest_AdcConversionMs == Arbiter.GetWaitMs(StartMs, ModelTest_AdcConversionMs),
+                "waits %u ms across the wrap", Arbiter.GetWaitMs(StartMs, ModelTest_AdcConversionMs));
+    HOST_EXPECT(AdcChannel_None == Arbiter.PickNext(StartMs + 1, ModelTest_AdcConversionMs),
+                "picked a conversion that is not due across the wrap");
+    HOST_EXPECT(AdcChannel_Prox == Arbiter.PickNext(StartMs + ModelTest_AdcProxIntervalMs - ModelTest_AdcConversionMs,
+                                                    ModelTest_AdcConversionMs),
+                "did not pick the conversion due across the wrap");
+}
+
+// Visible light and the proximity reflection the shared ADC reads
+#define ModelTest_AdcProximityLux           (50.0f)
+
+static const ISL29018_LIGHT_POINT g_AdcLight[] =
+{
+    { 0,                                    200.0f,     0.0f,   ModelTest_AdcProximityLux },
+};
+
+typedef struct _SHARED_ADC_RUN
+{
+    ULONG       Conversions[AdcChannel_Count];
+    ULONG       Misread;            // Conversions that were not complete or read the other channel
+    ULONG       Overlaps;           // Conversions started while the chip was converting
+} SHARED_ADC_RUN;
+
+static bool WriteModelRegister(
+    _Inout_ PIsl29018Model pModel,
+    _In_ BYTE Register,
+    _In_ BYTE Value)
+{
+    BYTE Buffer[] = { Register, Value };
+    return sizeof(Buffer) == pModel->Write(Buffer, sizeof(Buffer));
+}
+
+// The turns of ServeSharedAdc against the model for Duration ms, on an
+// arbiter clock that starts at StartMs: read the conversion that completed,
+// start the one due next and sleep until it completed or the next is due
+static VOID RunSharedAdc(
+    _Inout_ PIsl29018Model pModel,
+    _Inout_ PAdcArbiter pArbiter,
+    _In_ ULONG Resolution,
+    _In_ ULONG StartMs,
+    _In_ ULONG DurationMs,
+    _Out_ SHARED_ADC_RUN* pRun)
+{
+    ULONG ConversionTimeMs = Isl29018ConversionTimeMs(ModelTest_Chip, Resolution);
+    FLOAT LuxPerCount = Isl29018LuxPerCount(Resolution, ISL29018_RANGE_1K);
+    ULONG Counts[AdcChannel_Count] =
+    {
+        static_cast<ULONG>(g_AdcLight[0].Lux / LuxPerCount),
+        static_cast<ULONG>(ModelTest_AdcProximityLux / LuxPerCount),
+    };
+    static const BYTE OpModes[AdcChannel_Count] = { ISL29018_CMD1_OPMODE_ALS_ONCE, ISL29018_CMD1_OPMODE_PROX_ONCE };
+
+    *pRun = {};
+    pModel->Reset(ModelTest_Chip);
+    pModel->SetLightScript(g_AdcLight, ARRAYSIZE(g_AdcLight), 0);
+    WriteModelRegister(pModel, ISL29018_REG_ADD_COMMAND2,
+                       static_cast<BYTE>((ISL29018_RANGE_1K << ISL29018_CMD2_RANGE_SHIFT) |
+                                         (Resolution << ISL29018_CMD2_RESOLUTION_SHIFT)));
+
+    pArbiter->Reset();
+    pArbiter->SetChannel(AdcChannel_Als, true, ModelTest_AdcAlsIntervalMs, StartMs);
+    pArbiter->SetChannel(AdcChannel_Prox, true, ModelTest_AdcProxIntervalMs, StartMs);
+
+    for (ULONG ElapsedMs = 0; ElapsedMs < DurationMs;)
+    {
+        ULONG NowMs = StartMs + ElapsedMs;
+        ADC_CHANNEL InFlight = pArbiter->GetInFlight();
+
+        pModel->AdvanceTo(ElapsedMs * ModelTest_Millisecond);
+
+        if (AdcChannel_None != InFlight)
+        {
+            BYTE Register = ISL29018_REG_ADD_DATA_LSB;
+            BYTE Data[ISL290185_DATA_SIZE_BYTES] = {};
+
+            pModel->WriteRead(&Register, 1, Data, sizeof(Data));
+            if (0 != pModel->GetNextEvent() ||
+                Counts[InFlight] != ((static_cast<ULONG>(Data[1]) << 8) | Data[0]))
+            {
+                pRun->Misread++;
+            }
+
+            pRun->Conversions[InFlight]++;
+            pArbiter->CompleteConversion(NowMs);
+        }
+
+        ULONG WaitMs = 0;
+        ADC_CHANNEL Channel = pArbiter->PickNext(NowMs, ConversionTimeMs);
+        if (AdcChannel_None != Channel)
+        {
+            pRun->Overlaps += (0 != pModel->GetNextEvent()) ? 1 : 0;
+            WriteModelRegister(pModel, ISL29018_REG_ADD_COMMAND1,
+                               static_cast<BYTE>(OpModes[Channel] << ISL29018_CMD1_OPMODE_SHIFT));
+            pArbiter->StartConversion(Channel);
+            WaitMs = ConversionTimeMs;
+        }
+        else
+        {
+            WaitMs = pArbiter->GetWaitMs(NowMs, ConversionTimeMs);
+        }
+
+        ElapsedMs += (0 == WaitMs) ? 1 : WaitMs;
+    }
+}
+
+// Simulated time of a shared ADC run
+#define ModelTest_AdcDurationMs             (60 * 1000)
+
+static VOID TestArbiterSchedule()
+{
+    static Isl29018Model Model;
+    static AdcArbiter Arbiter;
+    static const ULONG StartsMs[] = { 0, 0xFFFFFFFF - ModelTest_AdcDurationMs / 2 };
+    SHARED_ADC_RUN Run;
+
+    // The resolution ApplyResolution picks: a conversion of each channel fits
+    // into the shorter interval
+    ULONG Resolution = Isl29018SelectResolution(ModelTest_Chip, ModelTest_AdcProxIntervalMs / AdcChannel_Count);
+
+    for (ULONG StartMs : StartsMs)
+    {
+        RunSharedAdc(&Model, &Arbiter, Resolution, StartMs, ModelTest_AdcDurationMs, &Run);
+
+        HOST_EXPECT(ModelTest_AdcDurationMs / ModelTest_AdcAlsIntervalMs == Run.Conversions[AdcChannel_Als] &&
+                    Run.Conversions[AdcChannel_Als] == Arbiter.GetConversions(AdcChannel_Als),
+                    "from %u ms: %u light conversions in %u ms at %u ms", StartMs, Run.Conversions[AdcChannel_Als],
+                    ModelTest_AdcDurationMs, ModelTest_AdcAlsIntervalMs);
+        HOST_EXPECT(ModelTest_AdcDurationMs / ModelTest_AdcProxIntervalMs == Run.Conversions[AdcChannel_Prox] &&
+                    Run.Conversions[AdcChannel_Prox] == Arbiter.GetConversions(AdcChannel_Prox),
+                    "from %u ms: %u proximity conversions in %u ms at %u ms", StartMs, Run.Conversions[AdcChannel_Prox],
+                    ModelTest_AdcDurationMs, ModelTest_AdcProxIntervalMs);
+        HOST_EXPECT(0 == Arbiter.GetMissedBeats(AdcChannel_Als) && 0 == Arbiter.GetMissedBeats(AdcChannel_Prox),
+                    "from %u ms: %u light and %u proximity beats missed", StartMs,
+                    Arbiter.GetMissedBeats(AdcChannel_Als), Arbiter.GetMissedBeats(AdcChannel_Prox));
+        HOST_EXPECT(0 == Run.Overlaps, "from %u ms: %u conversions started on a converting chip", StartMs, Run.Overlaps);
+        HOST_EXPECT(0 == Run.Misread, "from %u ms: %u conversions misread", StartMs, Run.Misread);
+    }
+
+    // At the highest resolution a conversion is longer than the proximity
+    // interval. The channels take turns and drop the beats they missed.
+    RunSharedAdc(&Model, &Arbiter, ISL29018_INT_TIME_16, 0, ModelTest_AdcDurationMs, &Run);
+
+    HOST_EXPECT(Run.Conversions[AdcChannel_Als] <= Run.Conversions[AdcChannel_Prox] + 1 &&
+                Run.Conversions[AdcChannel_Prox] <= Run.Conversions[AdcChannel_Als] + 1,
+                "%u light and %u proximity conversions, the channels did not take turns",
+                Run.Conversions[AdcChannel_Als], Run.Conversions[AdcChannel_Prox]);
+    HOST_EXPECT(Arbiter.GetMissedBeats(AdcChannel_Als) > 0 && Arbiter.GetMissedBeats(AdcChannel_Prox) > 0,
+                "%u light and %u proximity beats missed with conversions too long for the intervals",
+                Arbiter.GetMissedBeats(AdcChannel_Als), Arbiter.GetMissedBeats(AdcChannel_Prox));
+    HOST_EXPECT(0 == Run.Overlaps, "%u conversions started on a converting chip", Run.Overlaps);
+    HOST_EXPECT(0 == Run.Misread, "%u conversions misread", Run.Misread);
+}
+
+int main()
+{
+    TestWindowMath();
+    TestWindowRearm();
+    TestSchedulerPolicy();
+    TestSchedulerClosedLoop();
+    TestSchedulerFailedReads();
+    TestOneShotPolicy();
+    TestOneShotBeats();
+    TestOneShotClosedLoop();
+    TestIrCompensation();
+    TestIrInterleave();
+    TestIrPolling();
+    TestIrWindow();
+    TestArbiterPolicy();
+    TestArbiterSchedule();
+
+    return HostTestResult("ModelTest");
+}
@@ -0,0 +1,301 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host benchmark of oversampling at low light. It
+//    reads a noisy Isl29018Model under constant light through the driver's
+//    BusExecutor, built with ISL29018_BUS_MODEL, the way the driver reads an
+//    oversampled beat: the extra conversions from the data registers one
+//    conversion time apart, then the status block on the beat. SamplePipeline
+//    decimates and converts them as in the driver.
+//
+//    Every resolution and light level is run with 1 to
+//    Oversample_MaxConversions conversions per sample. For each run the tool
+//    prints one CSV row with the bus transfers per sample, the interval the
+//    conversions take, the bias and noise of the samples in counts of a
+//    single conversion and the effective bits:
+//
+//        log2(MaxCount + 1) - log2(noise * sqrt(12))
+//
+//    that is the bits of an ideal converter whose quantization noise equals
+//    the sample noise. The bias is the truncation of the chip's converter,
+//    which averaging does not remove, so it is reported but not counted.
+//
+//    Averaging N conversions gains log2(N) / 2 bits, 2 bits for
+//    Oversample_MaxConversions. The tool fails if they gain less than
+//    OversampleBench_MinGainBits over one conversion at low light.
+//
+//    Usage: OversampleBench [-samples N] [-noise R]
+//
+//    -samples    samples per run, 2000 by default
+//    -noise      relative noise of a conversion, 0.02 by default. Every
+//                conversion has OversampleBench_NoiseCounts on top.
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "BusExecutor.h"
+#include "Isl29018Model.h"
+#include "SamplePipeline.h"
+
+#define OversampleBench_Chip                (ISL29018_CHIP_29018)
+#define OversampleBench_Range               (ISL29018_RANGE_1K)
+#define OversampleBench_DefaultSamples      (2000)
+#define OversampleBench_DefaultNoise        (0.02f)
+#define OversampleBench_NoiseCounts         (0.5f)
+#define OversampleBench_MinGainBits         (1.5)
+
+// Light levels, low light at every resolution that resolves them
+static const FLOAT g_Lux[] = { 0.5f, 5.0f, 50.0f };
+
+static const char* const g_ResolutionNames[] = { "16", "12", "8", "4" };
+
+typedef struct _OVERSAMPLE_RESULT
+{
+    double      TransfersPerSample;
+    double      MeanCount;          // In counts of one conversion
+    double      Noise;              // Standard deviation of the samples, in counts
+    double      EffectiveBits;
+} OVERSAMPLE_RESULT;
+
+// The driver's oversampled beat, see AlsDevice::GetOversample and
+// AlsDevice::GetData, clocked by the model instead of the timer
+typedef class _OversampleDevice : public SamplePipeline
+{
+private:
+    PIsl29018Model          m_pModel;
+    BusExecutor             m_Bus;
+    ULONGLONG               m_Now;
+    ULONGLONG               m_ConversionTime;
+
+public:
+    NTSTATUS Initialize(
+        _In_ PIsl29018Model pModel,
+        _In_ ULONG Resolution)
+    {
+        m_pModel = pModel;
+        m_AutoRange.Reset(OversampleBench_Range, Resolution);
+        m_IrInterleave.Reset();
+        m_Filter.Reset(NoiseFilter_None);
+        m_LastRawCount = 0;
+        m_Decimator.Reset();
+        m_FirstSample = true;
+        m_CachedThresholds.LuxPct = 0.0f;
+        m_CachedThresholds.LuxAbs = 0.0f;
+        m_CachedData = 0.0f;
+        m_LastSample = 0.0f;
+
+        NTSTATUS Status = m_Bus.Initialize(NULL, nullptr);
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Connect(pModel);
+        }
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Write(ISL29018_REG_ADDR_TEST, 0x00);
+        }
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Write(ISL29018_REG_ADD_COMMAND2, GetCommand2());
+        }
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Write(ISL29018_REG_ADD_COMMAND1, ISL29018_CMD1_OPMODE_ALS_CONT << ISL29018_CMD1_OPMODE_SHIFT);
+        }
+
+        // Read halfway through each conversion, so every read finds the one
+        // completed before it
+        m_ConversionTime = pModel->GetIntegrationTime(Resolution);
+        m_Now = pModel->GetNow() + m_ConversionTime / 2;
+
+        return Status;
+    }
+
+    VOID Deinitialize()
+    {
+        m_Bus.Deinitialize();
+    }
+
+    // Take a sample of Conversions conversions and return its count
+    NTSTATUS Sample(
+        _In_ ULONG Conversions,
+        _Out_ FLOAT* pCount)
+    {
+        NTSTATUS Status = STATUS_SUCCESS;
+
+        // The extra conversions, ahead of the beat
+        m_Decimator.Reset();
+        for (ULONG i = 1; i < Conversions && NT_SUCCESS(Status); i++)
+        {
+            BYTE DataBuffer[ISL290185_DATA_SIZE_BYTES];
+
+            m_Now += m_ConversionTime;
+            m_pModel->AdvanceTo(m_Now);
+
+            Status = m_Bus.Read(ISL29018_REG_ADD_DATA_LSB, DataBuffer, sizeof(DataBuffer));
+            m_Decimator.Add((static_cast<ULONG>(DataBuffer[1]) << 8) | DataBuffer[0]);
+        }
+
+        // The beat
+        BYTE StatusBuffer[ISL29018_STATUS_SIZE_BYTES];
+
+        m_Now += m_ConversionTime;
+        m_pModel->AdvanceTo(m_Now);
+        if (NT_SUCCESS(Status))
+        {
+            Status = m_Bus.Read(ISL29018_REG_ADD_COMMAND1, StatusBuffer, sizeof(StatusBuffer));
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+
+        ConvertSample(GetStatusRawCount(StatusBuffer), 0.0f);
+        *pCount = m_CachedData / m_AutoRange.GetLuxPerCount();
+        return STATUS_SUCCESS;
+    }
+
+} OversampleDevice, *POversampleDevice;
+
+static NTSTATUS Run(
+    _In_ ULONG Resolution,
+    _In_ FLOAT Lux,
+    _In_ ULONG Conversions,
+    _In_ ULONG Samples,
+    _In_ FLOAT Noise,
+    _Out_ OVERSAMPLE_RESULT* pResult)
+{
+    static Isl29018Model Model;
+    static OversampleDevice Device;
+    ISL29018_LIGHT_POINT Light = { 0, Lux, 0.0f, 0.0f };
+
+    Model.Reset(OversampleBench_Chip);
+    Model.SetLightScript(&Light, 1, 0);
+    Model.SetNoise(Noise, OversampleBench_NoiseCounts);
+
+    NTSTATUS Status = Device.Initialize(&Model, Resolution);
+    ULONGLONG FirstTransfer = Model.GetTransfers();
+    double Sum = 0.0;
+    double SumOfSquares = 0.0;
+
+    for (ULONG i = 0; i < Samples && NT_SUCCESS(Status); i++)
+    {
+        FLOAT Count = 0.0f;
+        Status = Device.Sample(Conversions, &Count);
+        Sum += Count;
+        SumOfSquares += static_cast<double>(Count) * Count;
+    }
+
+    Device.Deinitialize();
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    double Mean = Sum / Samples;
+    double Variance = SumOfSquares / Samples - Mean * Mean;
+    double Deviation = std::sqrt((Variance > 0.0) ? Variance : 0.0);
+
+    pResult->TransfersPerSample = static_cast<double>(Model.GetTransfers() - FirstTransfer) / Samples;
+    pResult->MeanCount = Mean;
+    pResult->Noise = Deviation;
+
+    // Without any noise the sample is as good as the converter's quantization
+    pResult->EffectiveBits = std::log2(Isl29018MaxCount(Resolution) + 1.0) -
+                             ((Deviation > 0.0) ? std::log2(Deviation * std::sqrt(12.0)) : 0.0);
+    return STATUS_SUCCESS;
+}
+
+int main(
+    _In_ int argc,
+    _In_reads_(argc) char** argv)
+{
+    ULONG Samples = OversampleBench_DefaultSamples;
+    FLOAT Noise = OversampleBench_DefaultNoise;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-samples") && i + 1 < argc)
+        {
+            Samples = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (0 == strcmp(argv[i], "-noise") && i + 1 < argc)
+        {
+            Noise = strtof(argv[++i], nullptr);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: OversampleBench [-samples N] [-noise R]\n");
+            return 1;
+        }
+    }
+
+    if (Samples < 2 || Noise < 0.0f)
+    {
+        fprintf(stderr, "There must be two samples and the noise must not be negative\n");
+        return 1;
+    }
+
+    int Result = 0;
+
+    printf("resolution,lux,conversions,interval_ms,transfers_per_sample,mean_count,bias_counts,"
+           "noise_counts,effective_bits,gain_bits\n");
+
+    for (ULONG Resolution = ISL29018_INT_TIME_16; Resolution <= ISL29018_INT_TIME_4; Resolution++)
+    {
+        for (FLOAT Lux : g_Lux)
+        {
+            FLOAT TrueCount = Lux / Isl29018LuxPerCount(Resolution, OversampleBench_Range);
+            OVERSAMPLE_RESULT Single = {};
+
+            for (ULONG Conversions = 1; Conversions <= Oversample_MaxConversions; Conversions *= 2)
+            {
+                OVERSAMPLE_RESULT Oversampled;
+                NTSTATUS Status = Run(Resolution, Lux, Conversions, Samples, Noise, &Oversampled);
+                if (!NT_SUCCESS(Status))
+                {
+                    fprintf(stderr, "%s bits, %.1f lux: bus failure 0x%08x\n",
+                            g_ResolutionNames[Resolution], Lux, Status);
+                    return 1;
+                }
+
+                if (1 == Conversions)
+                {
+                    Single = Oversampled;
+                }
+
+                double Gain = Oversampled.EffectiveBits - Single.EffectiveBits;
+
+                printf("%s,%.1f,%lu,%lu,%.2f,%.3f,%.3f,%.3f,%.2f,%.2f\n",
+                       g_ResolutionNames[Resolution], Lux,
+                       static_cast<unsigned long>(Conversions),
+                       static_cast<unsigned long>(Conversions *
+                                                  Isl29018ConversionTimeMs(OversampleBench_Chip, Resolution)),
+                       Oversampled.TransfersPerSample,
+                       Oversampled.MeanCount,
+                       Oversampled.MeanCount - TrueCount,
+                       Oversampled.Noise,
+                       Oversampled.EffectiveBits,
+                       Gain);
+
+                if (Oversample_MaxConversions == Conversions &&
+                    OversampleIsLowLight(static_cast<ULONG>(TrueCount), Isl29018MaxCount(Resolution)) &&
+                    Gain < OversampleBench_MinGainBits)
+                {
+                    fprintf(stderr, "%s bits, %.1f lux: %lu conversions gain %.2f bits\n",
+                            g_ResolutionNames[Resolution], Lux,
+                            static_cast<unsigned long>(Conversions), Gain);
+                    Result = 2;
+                }
+            }
+        }
+    }
+
+    return Result;
+}
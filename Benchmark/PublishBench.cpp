@@ -0,0 +1,295 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host benchmark of the shared sample section of
+//    SamplePublisher.h. One thread publishes samples through SamplePublisher
+//    while reader threads poll them with Isl29018ReadSharedSample, as the
+//    consumers of the driver's section do. The section is a shared memory
+//    file mapped once for writing and once per reader for reading only, like
+//    the driver's section and the views of other processes.
+//
+//    Every field of a published sample is derived from its sequence number,
+//    so a reader can tell a torn copy from a good one. A sequence going
+//    backwards is counted as well. The tool prints one CSV row of read and
+//    publish rates, the readers' CPU time per read, failed reads and torn
+//    reads; it fails if a read was torn or went backwards.
+//
+//    A read fails when the writer holds the lock for all of the reader's
+//    attempts. Publishing back to back on fewer cores than threads, a writer
+//    preempted in the middle of a sample makes that common; at the driver's
+//    pace it should not happen.
+//
+//    Usage: PublishBench [-readers N] [-seconds S] [-rate R]
+//
+//    -readers    reader threads, 4 by default
+//    -seconds    length of the run, 2 by default
+//    -rate       samples published per second, 0 to publish back to back
+//                as a stress test. 1000 by default, faster than the chip.
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "SamplePublisher.h"
+
+typedef struct _READER_STATS
+{
+    ULONGLONG   Reads;
+    ULONGLONG   Failed;             // Every attempt overlapped a write
+    ULONGLONG   Torn;               // Copy whose fields belong to different samples
+    ULONGLONG   Backwards;          // Sequence older than the one read before
+    ULONGLONG   LastSequence;
+    double      CpuSeconds;         // Time the reader ran, which on a busy host is less than the run
+} READER_STATS;
+
+static double GetThreadCpuSeconds()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &Time);
+    return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+// The payload of a sample is a function of its sequence number
+static VOID MakeSample(
+    _In_ ULONGLONG Sequence,
+    _Out_ PFILETIME pTimestamp,
+    _Out_ FLOAT* pLux,
+    _Out_ PULONG pRawCount,
+    _Out_ PULONG pRange,
+    _Out_ PULONG pResolution)
+{
+    ULONGLONG Time = Sequence * 10000;
+
+    pTimestamp->dwLowDateTime = static_cast<ULONG>(Time);
+    pTimestamp->dwHighDateTime = static_cast<ULONG>(Time >> 32);
+    *pLux = static_cast<FLOAT>(Sequence & 0xFFFFF);
+    *pRawCount = static_cast<ULONG>(Sequence & 0xFFFF);
+    *pRange = static_cast<ULONG>(Sequence & 3);
+    *pResolution = static_cast<ULONG>((Sequence >> 2) & 3);
+}
+
+static bool IsConsistent(
+    _In_ const ISL29018_PUBLISHED_SAMPLE& Sample)
+{
+    FILETIME Timestamp;
+    FLOAT Lux;
+    ULONG RawCount;
+    ULONG Range;
+    ULONG Resolution;
+
+    MakeSample(Sample.Sequence, &Timestamp, &Lux, &RawCount, &Range, &Resolution);
+
+    return Sample.Timestamp.dwLowDateTime == Timestamp.dwLowDateTime &&
+           Sample.Timestamp.dwHighDateTime == Timestamp.dwHighDateTime &&
+           Sample.Lux == Lux &&
+           Sample.RawCount == RawCount &&
+           Sample.Range == Range &&
+           Sample.Resolution == Resolution;
+}
+
+static VOID Publish(
+    _Inout_ PSamplePublisher pPublisher,
+    _In_ ULONG Rate,
+    _In_ const std::atomic<bool>* pStop)
+{
+    auto Next = std::chrono::steady_clock::now();
+    auto Period = std::chrono::nanoseconds((0 != Rate) ? (1000000000ULL / Rate) : 0);
+
+    while (!pStop->load(std::memory_order_relaxed))
+    {
+        FILETIME Timestamp;
+        FLOAT Lux;
+        ULONG RawCount;
+        ULONG Range;
+        ULONG Resolution;
+
+        MakeSample(pPublisher->GetSequence() + 1, &Timestamp, &Lux, &RawCount, &Range, &Resolution);
+        pPublisher->Publish(&Timestamp, Lux, RawCount, Range, Resolution);
+
+        if (0 != Rate)
+        {
+            Next += Period;
+            std::this_thread::sleep_until(Next);
+        }
+    }
+}
+
+static VOID Read(
+    _In_ const ISL29018_SHARED_SAMPLE* pShared,
+    _In_ const std::atomic<bool>* pStop,
+    _Out_ READER_STATS* pStats)
+{
+    READER_STATS Stats = {};
+    double Start = GetThreadCpuSeconds();
+
+    while (!pStop->load(std::memory_order_relaxed))
+    {
+        ISL29018_PUBLISHED_SAMPLE Sample;
+
+        Stats.Reads++;
+        if (!Isl29018ReadSharedSample(pShared, &Sample))
+        {
+            Stats.Failed++;
+            continue;
+        }
+
+        if (!IsConsistent(Sample))
+        {
+            Stats.Torn++;
+        }
+
+        if (Sample.Sequence < Stats.LastSequence)
+        {
+            Stats.Backwards++;
+        }
+        Stats.LastSequence = Sample.Sequence;
+    }
+
+    Stats.CpuSeconds = GetThreadCpuSeconds() - Start;
+    *pStats = Stats;
+}
+
+static VOID PrintUsage()
+{
+    fprintf(stderr, "Usage: PublishBench [-readers N] [-seconds S] [-rate R]\n");
+}
+
+int main(
+    _In_ int argc,
+    _In_reads_(argc) char** argv)
+{
+    ULONG Readers = 4;
+    double Seconds = 2.0;
+    ULONG Rate = 1000;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-readers") && i + 1 < argc)
+        {
+            Readers = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (0 == strcmp(argv[i], "-seconds") && i + 1 < argc)
+        {
+            Seconds = strtod(argv[++i], nullptr);
+        }
+        else if (0 == strcmp(argv[i], "-rate") && i + 1 < argc)
+        {
+            Rate = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (0 == Readers || Seconds <= 0.0)
+    {
+        fprintf(stderr, "There must be a reader and the run must take some time\n");
+        return 1;
+    }
+
+    // The section, writable for the publisher and read-only for the readers
+    int File = memfd_create("PublishBench", 0);
+    if (File < 0 || 0 != ftruncate(File, sizeof(ISL29018_SHARED_SAMPLE)))
+    {
+        fprintf(stderr, "Cannot create the shared section\n");
+        return 1;
+    }
+
+    PVOID pWriteView = mmap(nullptr, sizeof(ISL29018_SHARED_SAMPLE), PROT_READ | PROT_WRITE, MAP_SHARED, File, 0);
+    if (MAP_FAILED == pWriteView)
+    {
+        fprintf(stderr, "Cannot map the shared section\n");
+        return 1;
+    }
+
+    static SamplePublisher Publisher;
+    Publisher.Attach(static_cast<PISL29018_SHARED_SAMPLE>(pWriteView));
+
+    std::vector<PVOID> ReadViews(Readers);
+    for (ULONG i = 0; i < Readers; i++)
+    {
+        ReadViews[i] = mmap(nullptr, sizeof(ISL29018_SHARED_SAMPLE), PROT_READ, MAP_SHARED, File, 0);
+        if (MAP_FAILED == ReadViews[i])
+        {
+            fprintf(stderr, "Cannot map the shared section\n");
+            return 1;
+        }
+    }
+    close(File);
+
+    std::atomic<bool> Stop(false);
+    std::vector<READER_STATS> Stats(Readers);
+    std::vector<std::thread> Threads;
+
+    auto Start = std::chrono::steady_clock::now();
+    for (ULONG i = 0; i < Readers; i++)
+    {
+        Threads.emplace_back(Read, static_cast<const ISL29018_SHARED_SAMPLE*>(ReadViews[i]), &Stop, &Stats[i]);
+    }
+    std::thread Writer(Publish, &Publisher, Rate, &Stop);
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(Seconds));
+    Stop.store(true);
+
+    Writer.join();
+    for (std::thread& Thread : Threads)
+    {
+        Thread.join();
+    }
+    double Wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    READER_STATS Total = {};
+    for (const READER_STATS& Reader : Stats)
+    {
+        Total.Reads += Reader.Reads;
+        Total.Failed += Reader.Failed;
+        Total.Torn += Reader.Torn;
+        Total.Backwards += Reader.Backwards;
+        Total.CpuSeconds += Reader.CpuSeconds;
+    }
+
+    ULONGLONG Published = Publisher.GetSequence();
+
+    printf("readers,rate,wall_s,published,reads,reads_per_s,ns_per_read,failed,torn,backwards\n");
+    printf("%lu,%lu,%.3f,%llu,%llu,%.0f,%.1f,%llu,%llu,%llu\n",
+           static_cast<unsigned long>(Readers),
+           static_cast<unsigned long>(Rate),
+           Wall,
+           static_cast<unsigned long long>(Published),
+           static_cast<unsigned long long>(Total.Reads),
+           Total.Reads / Wall,
+           (0 != Total.Reads) ? (Total.CpuSeconds * 1e9 / Total.Reads) : 0.0,
+           static_cast<unsigned long long>(Total.Failed),
+           static_cast<unsigned long long>(Total.Torn),
+           static_cast<unsigned long long>(Total.Backwards));
+
+    Publisher.Detach();
+    munmap(pWriteView, sizeof(ISL29018_SHARED_SAMPLE));
+    for (PVOID pView : ReadViews)
+    {
+        munmap(pView, sizeof(ISL29018_SHARED_SAMPLE));
+    }
+
+    if (0 != Total.Torn || 0 != Total.Backwards)
+    {
+        fprintf(stderr, "Readers saw torn or out of order samples\n");
+        return 2;
+    }
+
+    return 0;
+}
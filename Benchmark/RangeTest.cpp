@@ -0,0 +1,338 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host test of the lux conversion of AutoRange.h
+//    and the auto-ranging engine. It sweeps every range and resolution:
+//
+//    - isl29018_lux_per_count against isl29018_scales and the full-scale lux
+//      of the range, the run time twin of the static asserts
+//    - the conversion of SamplePipeline over the full unsigned count range,
+//      counts above 32767 included
+//    - light converted by Isl29018Model and read back, against the light
+//    - the switch points of AutoRange and where a sample lands after a switch
+//    - light from dusk to full sun, auto-ranged in a closed loop with the
+//      model until the count is inside the limits of its range
+//
+//    Usage: RangeTest
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <cmath>
+#include <cstdio>
+
+#include "HostTest.h"
+#include "Isl29018Model.h"
+#include "SamplePipeline.h"
+
+#define RangeTest_Chip                      (ISL29018_CHIP_29018)
+#define RangeTest_ResolutionCount           (4)
+
+// Conversions the closed loop may take to settle, a switch costs two
+#define RangeTest_SettleConversions         (12)
+
+// SamplePipeline's conversion, without the ring and the thresholds
+typedef class _ConversionPipeline : public SamplePipeline
+{
+public:
+    VOID Reset(
+        _In_ ULONG Range,
+        _In_ ULONG Resolution)
+    {
+        m_AutoRange.Reset(Range, Resolution);
+        m_IrInterleave.Reset();
+        m_Filter.Reset(NoiseFilter_None);
+        m_LastRawCount = 0;
+        m_Decimator.Reset();
+    }
+
+    // Lux of the count in a status block, as ProcessData converts it
+    FLOAT Convert(
+        _In_ USHORT RawCount)
+    {
+        BYTE StatusBuffer[ISL29018_STATUS_SIZE_BYTES] = {};
+        StatusBuffer[ISL29018_STATUS_DATA] = static_cast<BYTE>(RawCount);
+        StatusBuffer[ISL29018_STATUS_DATA + 1] = static_cast<BYTE>(RawCount >> 8);
+
+        ConvertSample(GetStatusRawCount(StatusBuffer), 0.0f);
+        return m_CachedData;
+    }
+
+} ConversionPipeline, *PConversionPipeline;
+
+// Light held by the model while a test converts it
+static ISL29018_LIGHT_POINT g_Light = {};
+
+// Let the model convert Lux once at a range and resolution, and read the
+// count back the way the driver does
+static ULONG ConvertOnce(
+    _Inout_ PIsl29018Model pModel,
+    _In_ ULONG Range,
+    _In_ ULONG Resolution,
+    _In_ FLOAT Lux)
+{
+    g_Light.Lux = Lux;
+    pModel->SetLightScript(&g_Light, 1, 0);
+
+    // COMMAND2 first, the conversion latches it when COMMAND1 starts it
+    BYTE Command2[] =
+    {
+        ISL29018_REG_ADD_COMMAND2,
+        static_cast<BYTE>((Resolution << ISL29018_CMD2_RESOLUTION_SHIFT) | (Range << ISL29018_CMD2_RANGE_SHIFT)),
+    };
+    BYTE Command1[] =
+    {
+        ISL29018_REG_ADD_COMMAND1,
+        ISL29018_CMD1_OPMODE_ALS_ONCE << ISL29018_CMD1_OPMODE_SHIFT,
+    };
+    pModel->Write(Command2, sizeof(Command2));
+    pModel->Write(Command1, sizeof(Command1));
+    pModel->AdvanceTo(pModel->GetNextEvent());
+
+    BYTE Register = ISL29018_REG_ADD_DATA_LSB;
+    BYTE Data[ISL290185_DATA_SIZE_BYTES] = {};
+    pModel->WriteRead(&Register, 1, Data, sizeof(Data));
+
+    return (static_cast<ULONG>(Data[1]) << 8) | Data[0];
+}
+
+static VOID TestTable()
+{
+    for (ULONG Resolution = 0; Resolution < RangeTest_ResolutionCount; Resolution++)
+    {
+        for (ULONG Range = 0; Range < ISL29018_RANGE_COUNT; Range++)
+        {
+            FLOAT LuxPerCount = Isl29018LuxPerCount(Resolution, Range);
+            FLOAT FullScale = LuxPerCount * (static_cast<FLOAT>(Isl29018MaxCount(Resolution)) + 1.0f);
+
+            HOST_EXPECT(LuxPerCount == Isl29018ScaleToLux(isl29018_scales[Resolution][Range]),
+                        "resolution %u range %u: %g lux per count, isl29018_scales has %g",
+                        Resolution, Range, LuxPerCount, Isl29018ScaleToLux(isl29018_scales[Resolution][Range]));
+
+            HOST_EXPECT(FullScale > Isl29018RangeMaximumLux(Range) * 0.999f &&
+                        FullScale <= Isl29018RangeMaximumLux(Range),
+                        "resolution %u range %u: full scale %g lux, range maximum %g",
+                        Resolution, Range, FullScale, Isl29018RangeMaximumLux(Range));
+
+            // Ranges are 4x apart and resolutions 16x, which the switch
+            // limits of AutoRange rely on
+            if (Range > 0)
+            {
+                FLOAT Ratio = LuxPerCount / Isl29018LuxPerCount(Resolution, Range - 1);
+                HOST_EXPECT(std::fabs(Ratio - 4.0f) < 0.001f,
+                            "resolution %u range %u: %g times the range below", Resolution, Range, Ratio);
+            }
+            if (Resolution > 0)
+            {
+                FLOAT Ratio = LuxPerCount / Isl29018LuxPerCount(Resolution - 1, Range);
+                HOST_EXPECT(std::fabs(Ratio - 16.0f) < 0.01f,
+                            "resolution %u range %u: %g times the resolution above", Resolution, Range, Ratio);
+            }
+        }
+    }
+}
+
+static VOID TestUnsignedConversion()
+{
+    static ConversionPipeline Pipeline;
+
+    for (ULONG Resolution = 0; Resolution < RangeTest_ResolutionCount; Resolution++)
+    {
+        for (ULONG Range = 0; Range < ISL29018_RANGE_COUNT; Range++)
+        {
+            ULONG MaxCount = Isl29018MaxCount(Resolution);
+            FLOAT LuxPerCount = Isl29018LuxPerCount(Resolution, Range);
+            FLOAT PreviousLux = -1.0f;
+            ULONG Errors = 0;
+
+            Pipeline.Reset(Range, Resolution);
+
+            // Every count at the low resolutions, a stride that still hits
+            // both sides of 32767 at the high ones
+            ULONG Stride = (MaxCount > 4096) ? 7 : 1;
+            for (ULONG Count = 0; Count <= MaxCount + Stride - 1; Count += Stride)
+            {
+                ULONG RawCount = (Count > MaxCount) ? MaxCount : Count;
+                FLOAT Lux = Pipeline.Convert(static_cast<USHORT>(RawCount));
+
+                if (Lux < PreviousLux || std::fabs(Lux - RawCount * LuxPerCount) > LuxPerCount * 0.001f)
+                {
+                    Errors++;
+                }
+                PreviousLux = Lux;
+            }
+
+            HOST_EXPECT(0 == Errors, "resolution %u range %u: %u counts convert out of order or off scale",
+                        Resolution, Range, Errors);
+
+            // The highest count is one count below the full-scale lux
+            FLOAT MaxLux = Pipeline.Convert(static_cast<USHORT>(MaxCount));
+            FLOAT RangeMaximum = Isl29018RangeMaximumLux(Range);
+            HOST_EXPECT(std::fabs(MaxLux + LuxPerCount - RangeMaximum) <= RangeMaximum * 0.001f,
+                        "resolution %u range %u: highest count is %g lux", Resolution, Range, MaxLux);
+
+            if (MaxCount > 0x7FFF)
+            {
+                HOST_EXPECT(Pipeline.Convert(0x8000) > Pipeline.Convert(0x7FFF),
+                            "resolution %u range %u: count 0x8000 converts below 0x7FFF", Resolution, Range);
+            }
+        }
+    }
+}
+
+static VOID TestModelConversion()
+{
+    static Isl29018Model Model;
+    static const FLOAT Fractions[] = { 0.0005f, 0.01f, 0.1f, 0.25f, 0.5f, 0.75f, 0.9f, 0.999f };
+
+    Model.Reset(RangeTest_Chip);
+
+    for (ULONG Resolution = 0; Resolution < RangeTest_ResolutionCount; Resolution++)
+    {
+        for (ULONG Range = 0; Range < ISL29018_RANGE_COUNT; Range++)
+        {
+            FLOAT LuxPerCount = Isl29018LuxPerCount(Resolution, Range);
+
+            for (FLOAT Fraction : Fractions)
+            {
+                FLOAT Lux = Isl29018RangeMaximumLux(Range) * Fraction;
+                ULONG RawCount = ConvertOnce(&Model, Range, Resolution, Lux);
+                FLOAT Converted = RawCount * LuxPerCount;
+
+                // The chip truncates, the count is at most one below the light
+                HOST_EXPECT(Converted <= Lux * 1.0001f && Converted > Lux - LuxPerCount * 1.0001f,
+                            "resolution %u range %u: %g lux read back as %g (count %u)",
+                            Resolution, Range, Lux, Converted, RawCount);
+            }
+
+            // Light above the range saturates at the highest count
+            ULONG Saturated = ConvertOnce(&Model, Range, Resolution, Isl29018RangeMaximumLux(Range) * 2.0f);
+            HOST_EXPECT(Saturated == Isl29018MaxCount(Resolution),
+                        "resolution %u range %u: saturated at count %u", Resolution, Range, Saturated);
+        }
+    }
+}
+
+static VOID TestSwitchPoints()
+{
+    for (ULONG Resolution = 0; Resolution < RangeTest_ResolutionCount; Resolution++)
+    {
+        for (ULONG Range = 0; Range < ISL29018_RANGE_COUNT; Range++)
+        {
+            AutoRange Engine;
+            Engine.Reset(Range, Resolution);
+            ULONG Saturation = Engine.GetSaturationCount();
+            ULONG UnderRange = Engine.GetUnderRangeCount();
+
+            HOST_EXPECT(UnderRange < Saturation && Saturation <= Isl29018MaxCount(Resolution),
+                        "resolution %u range %u: limits %u and %u", Resolution, Range, UnderRange, Saturation);
+
+            // Inside the limits the range holds
+            HOST_EXPECT(!Engine.Evaluate(Saturation - 1) && !Engine.Evaluate(UnderRange),
+                        "resolution %u range %u: switched inside the limits", Resolution, Range);
+            HOST_EXPECT(!Engine.ConsumeDiscard(),
+                        "resolution %u range %u: discard without a switch", Resolution, Range);
+
+            // At saturation the next higher range is used, and the same light
+            // lands inside its limits, so it does not switch straight back
+            bool Up = Engine.Evaluate(Saturation);
+            HOST_EXPECT(Up == (Range + 1 < ISL29018_RANGE_COUNT),
+                        "resolution %u range %u: switch up is %d", Resolution, Range, Up);
+            if (Up)
+            {
+                HOST_EXPECT(Engine.GetRange() == Range + 1 && Engine.ConsumeDiscard() && !Engine.ConsumeDiscard(),
+                            "resolution %u range %u: switch up did not take or discard once", Resolution, Range);
+
+                ULONG Landed = static_cast<ULONG>(Saturation * Isl29018LuxPerCount(Resolution, Range) /
+                                                  Isl29018LuxPerCount(Resolution, Range + 1));
+                HOST_EXPECT(Landed >= Engine.GetUnderRangeCount() && Landed < Engine.GetSaturationCount(),
+                            "resolution %u range %u: count %u after switching up is outside the limits",
+                            Resolution, Range, Landed);
+            }
+
+            // Below the under-range count the next lower range is used
+            Engine.Reset(Range, Resolution);
+            bool Down = Engine.Evaluate(UnderRange - 1);
+            HOST_EXPECT(Down == (Range > 0),
+                        "resolution %u range %u: switch down is %d", Resolution, Range, Down);
+            if (Down)
+            {
+                HOST_EXPECT(Engine.GetRange() == Range - 1 && Engine.ConsumeDiscard(),
+                            "resolution %u range %u: switch down did not take or discard", Resolution, Range);
+
+                // It may keep going down, at 4 bits only a count of 0 is
+                // under range, but never straight back up
+                ULONG Landed = static_cast<ULONG>((UnderRange - 1) * Isl29018LuxPerCount(Resolution, Range) /
+                                                  Isl29018LuxPerCount(Resolution, Range - 1));
+                HOST_EXPECT(Landed < Engine.GetSaturationCount(),
+                            "resolution %u range %u: count %u after switching down saturates",
+                            Resolution, Range, Landed);
+            }
+
+            // An interrupt window never reaches past the limits
+            Engine.Reset(Range, Resolution);
+            USHORT Low = 0;
+            USHORT High = static_cast<USHORT>(Isl29018MaxCount(Resolution));
+            Engine.ClampWindow(&Low, &High);
+            HOST_EXPECT(Low == ((Range > 0) ? UnderRange : 0) &&
+                        High == ((Range + 1 < ISL29018_RANGE_COUNT) ? Saturation : Isl29018MaxCount(Resolution)),
+                        "resolution %u range %u: window clamped to %u..%u", Resolution, Range, Low, High);
+        }
+    }
+}
+
+static VOID TestClosedLoop()
+{
+    static Isl29018Model Model;
+
+    Model.Reset(RangeTest_Chip);
+
+    for (ULONG Resolution = 0; Resolution < RangeTest_ResolutionCount; Resolution++)
+    {
+        for (FLOAT Lux = 0.05f; Lux < 60000.0f; Lux *= 1.25f)
+        {
+            AutoRange Engine;
+            Engine.Reset(ISL29018_RANGE_4K, Resolution);
+
+            ULONG RawCount = 0;
+            bool Settled = false;
+            for (ULONG i = 0; i < RangeTest_SettleConversions && !Settled; i++)
+            {
+                RawCount = ConvertOnce(&Model, Engine.GetRange(), Resolution, Lux);
+                if (Engine.ConsumeDiscard())
+                {
+                    continue;
+                }
+                Settled = !Engine.Evaluate(RawCount);
+            }
+
+            ULONG Range = Engine.GetRange();
+            HOST_EXPECT(Settled, "resolution %u: %g lux did not settle", Resolution, Lux);
+            HOST_EXPECT((RawCount >= Engine.GetUnderRangeCount() || 0 == Range) &&
+                        (RawCount < Engine.GetSaturationCount() || Range + 1 == ISL29018_RANGE_COUNT),
+                        "resolution %u: %g lux settled at count %u of range %u", Resolution, Lux, RawCount, Range);
+
+            // Away from saturation the reading is within a count of the light
+            FLOAT LuxPerCount = Engine.GetLuxPerCount();
+            if (RawCount < Isl29018MaxCount(Resolution))
+            {
+                FLOAT Converted = RawCount * LuxPerCount;
+                HOST_EXPECT(std::fabs(Converted - Lux) <= LuxPerCount * 1.001f,
+                            "resolution %u: %g lux read as %g at range %u", Resolution, Lux, Converted, Range);
+            }
+        }
+    }
+}
+
+int main()
+{
+    TestTable();
+    TestUnsignedConversion();
+    TestModelConversion();
+    TestSwitchPoints();
+    TestClosedLoop();
+
+    return HostTestResult("RangeTest");
+}
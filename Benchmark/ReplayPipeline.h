@@ -0,0 +1,256 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the replay of a raw sample recording through
+//    SamplePipeline, shared by the host tools that replay recordings. It
+//    feeds the records to the conversion, filter and threshold code the way
+//    the driver's ProcessData feeds them from the bus, and maps a recording
+//    file for reading in place.
+//
+//    Counts are converted at the range and resolution they were recorded at;
+//    where the auto-ranging engine would have switched differently, only its
+//    switch count shows it. As in the driver, the first sample after a
+//    recorded switch is dropped.
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+#include "SamplePipeline.h"
+#include "SampleRecorder.h"
+
+// Als_Initial_Lux_Threshold_Pct and _Abs
+#define Replay_Default_Lux_Pct              (1.0f)
+#define Replay_Default_Lux_Abs              (0.0f)
+
+typedef struct _REPLAY_STATS
+{
+    ULONGLONG   Records;
+    ULONGLONG   Samples;            // ALS samples read, including the dropped ones
+    ULONGLONG   Starts;             // Starts and restarts
+    ULONGLONG   ReadErrors;
+    ULONGLONG   IrSamples;
+    ULONGLONG   Oversamples;
+    ULONGLONG   Discards;           // Samples dropped after a range or resolution switch
+    ULONGLONG   Reports;
+    ULONGLONG   RecordedSwitches;   // Range or resolution switches in the recording
+} REPLAY_STATS;
+
+// The driver's ProcessData fed from a recording instead of the bus
+typedef class _ReplayPipeline : public SamplePipeline
+{
+private:
+    FLOAT               m_IrCoefficient;
+    ULONG               m_RecordedCommand2;     // Of the last ALS record, or MAXULONG before the first
+    FILE*               m_pReports;             // NULL if the reports are only counted
+    FLOAT               m_LuxSum;               // Keeps the reports from being optimized out
+    REPLAY_STATS        m_Stats;
+
+    static ULONG GetRange(_In_ ULONG Command2)
+    {
+        return (Command2 & ISL29018_CMD2_RANGE_MASK) >> ISL29018_CMD2_RANGE_SHIFT;
+    }
+
+    static ULONG GetResolution(_In_ ULONG Command2)
+    {
+        return (Command2 & ISL29018_CMD2_RESOLUTION_MASK) >> ISL29018_CMD2_RESOLUTION_SHIFT;
+    }
+
+    // Convert at the recorded range and resolution, whatever the auto-ranging
+    // engine picked after the last sample. Returns true if the sample is the
+    // first after a switch, which the driver drops.
+    bool FollowRecording(
+        _In_ BYTE Command2)
+    {
+        bool Switched = (Command2 != m_RecordedCommand2) && (MAXULONG != m_RecordedCommand2);
+
+        m_RecordedCommand2 = Command2;
+        if (GetResolution(Command2) != m_AutoRange.GetResolution())
+        {
+            m_AutoRange.SetResolution(GetResolution(Command2));
+        }
+        m_AutoRange.SetRange(GetRange(Command2));
+        m_AutoRange.ConsumeDiscard();
+
+        return Switched;
+    }
+
+    VOID ProcessAls(
+        _In_ const SAMPLE_RECORD& Record)
+    {
+        m_Stats.Samples++;
+
+        if (FollowRecording(Record.Command2))
+        {
+            m_Stats.RecordedSwitches++;
+            m_Stats.Discards++;
+            m_Decimator.Reset();
+            return;
+        }
+
+        ConvertSample(Record.RawCount, m_IrCoefficient);
+        m_AutoRange.Evaluate(Record.RawCount);
+
+        RING_SAMPLE Sample;
+        if (!TakeReport(&Record.Timestamp, Record.RawCount, &Sample))
+        {
+            return;
+        }
+
+        m_Stats.Reports++;
+        m_LuxSum += Sample.Sample.Lux;
+
+        if (nullptr != m_pReports)
+        {
+            ULONGLONG Timestamp = (static_cast<ULONGLONG>(Sample.Sample.Timestamp.dwHighDateTime) << 32) |
+                                  Sample.Sample.Timestamp.dwLowDateTime;
+            fprintf(m_pReports, "%llu,%.3f,%lu,%lu\n", static_cast<unsigned long long>(Timestamp),
+                    Sample.Sample.Lux, static_cast<unsigned long>(Sample.RawCount),
+                    static_cast<unsigned long>(Sample.Sample.IrCount));
+        }
+    }
+
+public:
+    VOID Reset(
+        _In_ FLOAT LuxPct,
+        _In_ FLOAT LuxAbs,
+        _In_ ULONG FilterType,
+        _In_ FLOAT IrCoefficient,
+        _In_opt_ FILE* pReports)
+    {
+        // See AlsDevice::Initialize
+        m_AutoRange.Reset(ISL29018_RANGE_4K, ISL29018_INT_TIME_16);
+        m_IrInterleave.Reset();
+        m_Filter.Reset(FilterType);
+        m_LastRawCount = 0;
+        m_Decimator.Reset();
+        m_FirstSample = true;
+        m_CachedThresholds.LuxPct = LuxPct;
+        m_CachedThresholds.LuxAbs = LuxAbs;
+        m_CachedData = 1.0f;
+        m_LastSample = 0.0f;
+
+        m_IrCoefficient = IrCoefficient;
+        m_RecordedCommand2 = MAXULONG;
+        m_pReports = pReports;
+        m_LuxSum = 0.0f;
+        m_Stats = {};
+    }
+
+    VOID Replay(
+        _In_reads_(Count) const SAMPLE_RECORD* pRecords,
+        _In_ ULONG Count)
+    {
+        for (ULONG i = 0; i < Count; i++)
+        {
+            const SAMPLE_RECORD& Record = pRecords[i];
+            m_Stats.Records++;
+
+            switch (Record.Kind)
+            {
+            case SampleRecord_Als:
+                ProcessAls(Record);
+                break;
+
+            case SampleRecord_ReadError:
+                m_Stats.ReadErrors++;
+                break;
+
+            case SampleRecord_Ir:
+                m_IrInterleave.OnIrSample(Record.RawCount, Isl29018LuxPerCount(GetResolution(Record.Command2),
+                                                                               GetRange(Record.Command2)));
+                m_Stats.IrSamples++;
+                break;
+
+            case SampleRecord_Oversample:
+                m_Decimator.Add(Record.RawCount);
+                m_Stats.Oversamples++;
+                break;
+
+            // See AlsDevice::OnStart and AlsDevice::RestartAcquisition
+            case SampleRecord_Start:
+                m_IrInterleave.Reset();
+                m_Filter.Reset();
+                // Fall through
+            case SampleRecord_Restart:
+                m_Decimator.Reset();
+                m_FirstSample = true;
+                m_Stats.Starts++;
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+
+    const REPLAY_STATS& GetStats() const { return m_Stats; }
+    ULONG GetRangeSwitches() const { return m_AutoRange.GetSwitchCount(); }
+    FLOAT GetLuxSum() const { return m_LuxSum; }
+
+} ReplayPipeline, *PReplayPipeline;
+
+// Map a recording for reading. Returns NULL if the file cannot be mapped;
+// the caller checks the contents with SampleRecording::Open.
+inline PVOID ReplayMapRecording(
+    _In_ const char* pPath,
+    _Out_ PULONGLONG pSize)
+{
+    int File = open(pPath, O_RDONLY);
+    struct stat FileStat;
+
+    *pSize = 0;
+    if (File < 0)
+    {
+        return nullptr;
+    }
+
+    if (0 != fstat(File, &FileStat) || 0 == FileStat.st_size)
+    {
+        close(File);
+        return nullptr;
+    }
+
+    ULONGLONG Size = static_cast<ULONGLONG>(FileStat.st_size);
+    PVOID pView = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, File, 0);
+    close(File);
+    if (MAP_FAILED == pView)
+    {
+        return nullptr;
+    }
+
+    madvise(pView, Size, MADV_SEQUENTIAL);
+
+    *pSize = Size;
+    return pView;
+}
+
+inline VOID ReplayUnmapRecording(
+    _In_ PVOID pView,
+    _In_ ULONGLONG Size)
+{
+    munmap(pView, Size);
+}
+
+// Replay every record of a recording, oldest first
+inline VOID ReplayRecording(
+    _Inout_ PReplayPipeline pPipeline,
+    _In_ const SampleRecording& Recording)
+{
+    for (ULONG Span = 0; Span < 2; Span++)
+    {
+        ULONG Count = 0;
+        const SAMPLE_RECORD* pRecords = Recording.GetSpan(Span, &Count);
+        pPipeline->Replay(pRecords, Count);
+    }
+}
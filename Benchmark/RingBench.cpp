@@ -0,0 +1,289 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host benchmark of SampleRing.h. One thread
+//    enqueues samples as the acquisition path does while another dequeues
+//    them as the delivery work item does, each on its own thread like in the
+//    driver.
+//
+//    Every field of a sample is derived from its sequence number, so the
+//    consumer can tell a torn copy from a good one and count the samples it
+//    did not see. The samples the consumer missed must be the ones the
+//    producer dropped, and the ones it saw must come in order.
+//
+//    The consumer can be slowed down to stand in for a report call that
+//    blocks. The producer must not notice: the tool prints the longest
+//    Enqueue next to the mean, and a slow consumer should only show as drops.
+//    On fewer cores than threads the longest Enqueue includes the times the
+//    producer was preempted in the middle of one.
+//
+//    The tool prints one CSV row of the producer's and the consumer's time
+//    per operation, the longest Enqueue, samples dropped and samples torn or
+//    out of order; it fails if a sample was torn, out of order or lost
+//    without being counted as a drop.
+//
+//    Usage: RingBench [-samples N] [-rate R] [-stall US]
+//
+//    -samples    samples enqueued, 1000000 by default
+//    -rate       samples enqueued per second, 0 to enqueue back to back as a
+//                stress test. 0 by default.
+//    -stall      microseconds the consumer spends on every sample, 0 by
+//                default
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "SampleRing.h"
+
+#define RingBench_DefaultSamples            (1000000)
+
+typedef struct _PRODUCER_STATS
+{
+    ULONGLONG   Enqueued;
+    double      CpuSeconds;
+    ULONGLONG   MaxEnqueueNs;       // Longest single Enqueue
+} PRODUCER_STATS;
+
+typedef struct _CONSUMER_STATS
+{
+    ULONGLONG   Dequeued;
+    ULONGLONG   Missed;             // Samples skipped between two dequeued ones
+    ULONGLONG   Torn;               // Copy whose fields belong to different samples
+    ULONGLONG   Backwards;          // Sequence not newer than the one dequeued before
+    double      CpuSeconds;
+} CONSUMER_STATS;
+
+static double GetThreadCpuSeconds()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &Time);
+    return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+// The payload of a sample is a function of its sequence number, which starts
+// at 1 and is carried in the timestamp
+static VOID MakeSample(
+    _In_ ULONGLONG Sequence,
+    _Out_ PRING_SAMPLE pSample)
+{
+    pSample->Sample.Timestamp.dwLowDateTime = static_cast<ULONG>(Sequence);
+    pSample->Sample.Timestamp.dwHighDateTime = static_cast<ULONG>(Sequence >> 32);
+    pSample->Sample.Lux = static_cast<FLOAT>(Sequence & 0xFFFFF);
+    pSample->Sample.IrCount = static_cast<ULONG>(Sequence * 7);
+    pSample->RawCount = static_cast<ULONG>(Sequence & 0xFFFF);
+    pSample->FirstSample = (1 == Sequence);
+}
+
+static ULONGLONG GetSequence(
+    _In_ const RING_SAMPLE& Sample)
+{
+    return (static_cast<ULONGLONG>(Sample.Sample.Timestamp.dwHighDateTime) << 32) |
+           Sample.Sample.Timestamp.dwLowDateTime;
+}
+
+static bool IsConsistent(
+    _In_ const RING_SAMPLE& Sample)
+{
+    RING_SAMPLE Expected;
+
+    MakeSample(GetSequence(Sample), &Expected);
+
+    return Sample.Sample.Lux == Expected.Sample.Lux &&
+           Sample.Sample.IrCount == Expected.Sample.IrCount &&
+           Sample.RawCount == Expected.RawCount &&
+           Sample.FirstSample == Expected.FirstSample;
+}
+
+static VOID Produce(
+    _Inout_ PSampleRing pRing,
+    _In_ ULONGLONG Samples,
+    _In_ ULONG Rate,
+    _Out_ PRODUCER_STATS* pStats,
+    _Out_ std::atomic<bool>* pDone)
+{
+    PRODUCER_STATS Stats = {};
+    auto Next = std::chrono::steady_clock::now();
+    auto Period = std::chrono::nanoseconds((0 != Rate) ? (1000000000ULL / Rate) : 0);
+    double Start = GetThreadCpuSeconds();
+
+    for (ULONGLONG Sequence = 1; Sequence <= Samples; Sequence++)
+    {
+        RING_SAMPLE Sample;
+        MakeSample(Sequence, &Sample);
+
+        auto Begin = std::chrono::steady_clock::now();
+        pRing->Enqueue(Sample);
+        ULONGLONG Ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Begin).count();
+
+        if (Ns > Stats.MaxEnqueueNs)
+        {
+            Stats.MaxEnqueueNs = Ns;
+        }
+        Stats.Enqueued++;
+
+        if (0 != Rate)
+        {
+            Next += Period;
+            std::this_thread::sleep_until(Next);
+        }
+    }
+
+    Stats.CpuSeconds = GetThreadCpuSeconds() - Start;
+    *pStats = Stats;
+    pDone->store(true, std::memory_order_release);
+}
+
+static VOID Consume(
+    _Inout_ PSampleRing pRing,
+    _In_ ULONG StallUs,
+    _In_ const std::atomic<bool>* pDone,
+    _Out_ CONSUMER_STATS* pStats)
+{
+    CONSUMER_STATS Stats = {};
+    ULONGLONG LastSequence = 0;
+    double Start = GetThreadCpuSeconds();
+
+    for (;;)
+    {
+        RING_SAMPLE Sample;
+
+        // The producer is done before the last look at the ring, so nothing
+        // it enqueued is left behind
+        bool Done = pDone->load(std::memory_order_acquire);
+        if (!pRing->Dequeue(&Sample))
+        {
+            if (Done)
+            {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+
+        ULONGLONG Sequence = GetSequence(Sample);
+
+        Stats.Dequeued++;
+        if (!IsConsistent(Sample))
+        {
+            Stats.Torn++;
+        }
+
+        if (Sequence <= LastSequence)
+        {
+            Stats.Backwards++;
+        }
+        else
+        {
+            Stats.Missed += Sequence - LastSequence - 1;
+            LastSequence = Sequence;
+        }
+
+        if (0 != StallUs)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(StallUs));
+        }
+    }
+
+    Stats.CpuSeconds = GetThreadCpuSeconds() - Start;
+    *pStats = Stats;
+}
+
+static VOID PrintUsage()
+{
+    fprintf(stderr, "Usage: RingBench [-samples N] [-rate R] [-stall US]\n");
+}
+
+int main(
+    _In_ int argc,
+    _In_reads_(argc) char** argv)
+{
+    ULONGLONG Samples = RingBench_DefaultSamples;
+    ULONG Rate = 0;
+    ULONG StallUs = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-samples") && i + 1 < argc)
+        {
+            Samples = strtoull(argv[++i], nullptr, 0);
+        }
+        else if (0 == strcmp(argv[i], "-rate") && i + 1 < argc)
+        {
+            Rate = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (0 == strcmp(argv[i], "-stall") && i + 1 < argc)
+        {
+            StallUs = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (0 == Samples)
+    {
+        fprintf(stderr, "There must be a sample\n");
+        return 1;
+    }
+
+    static SampleRing Ring;
+    Ring.Reset();
+
+    std::atomic<bool> Done(false);
+    PRODUCER_STATS Producer;
+    CONSUMER_STATS Consumer;
+
+    auto Start = std::chrono::steady_clock::now();
+    std::thread ConsumerThread(Consume, &Ring, StallUs, &Done, &Consumer);
+    std::thread ProducerThread(Produce, &Ring, Samples, Rate, &Producer, &Done);
+
+    ProducerThread.join();
+    ConsumerThread.join();
+    double Wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    ULONGLONG Drops = Ring.GetDrops();
+
+    printf("samples,rate,stall_us,wall_s,ns_per_enqueue,max_enqueue_ns,ns_per_dequeue,dequeued,drops,torn,backwards\n");
+    printf("%llu,%lu,%lu,%.3f,%.1f,%llu,%.1f,%llu,%llu,%llu,%llu\n",
+           static_cast<unsigned long long>(Samples),
+           static_cast<unsigned long>(Rate),
+           static_cast<unsigned long>(StallUs),
+           Wall,
+           Producer.CpuSeconds * 1e9 / Producer.Enqueued,
+           static_cast<unsigned long long>(Producer.MaxEnqueueNs),
+           (0 != Consumer.Dequeued) ? (Consumer.CpuSeconds * 1e9 / Consumer.Dequeued) : 0.0,
+           static_cast<unsigned long long>(Consumer.Dequeued),
+           static_cast<unsigned long long>(Drops),
+           static_cast<unsigned long long>(Consumer.Torn),
+           static_cast<unsigned long long>(Consumer.Backwards));
+
+    if (0 != Consumer.Torn || 0 != Consumer.Backwards)
+    {
+        fprintf(stderr, "The consumer saw torn or out of order samples\n");
+        return 2;
+    }
+
+    // Every sample is either dequeued or dropped. Samples dropped at the end
+    // of the run are not followed by one the consumer sees, so fewer can be
+    // missed than dropped but never more.
+    if (Consumer.Dequeued + Drops != Producer.Enqueued || Consumer.Missed > Drops)
+    {
+        fprintf(stderr, "Samples were lost without being dropped\n");
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,462 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host benchmark of the light sample path. It runs
+//    SamplePipeline, the conversion and threshold code the driver uses,
+//    against a model of the chip in place of the I2C target and counts the
+//    samples that reach a report sink in place of the class extension.
+//
+//    Every light profile is run with every threshold setting. For each run
+//    the tool prints one CSV row with the time, the heap allocations and the
+//    reports per sample.
+//
+//    Usage: SampleBench [-samples N] [-baseline FILE] [-tolerance PERCENT]
+//
+//    With a baseline, written by an earlier run, the tool fails if a run
+//    reports or allocates differently than in the baseline, or if it is
+//    slower by more than the tolerance.
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "HostAllocations.h"
+#include "SamplePipeline.h"
+#include "SampleCounters.h"
+
+#define ARRAYSIZE(A)                        (sizeof(A) / sizeof((A)[0]))
+
+// Range and resolution the driver starts with, see Device.h
+#define SampleBench_Initial_Range           (ISL29018_RANGE_4K)
+#define SampleBench_Initial_Resolution      (ISL29018_INT_TIME_16)
+#define SampleBench_IrCoefficient           (0.25f)
+
+#define SampleBench_DefaultSamples          (1000000)
+#define SampleBench_WarmupSamples           (10000)
+#define SampleBench_DefaultTolerance        (25.0)
+
+// Registers COMMAND1 through DATA_MSB of a chip converting a given light
+// level at the range and resolution programmed in COMMAND2
+typedef class _FakeChip
+{
+private:
+    BYTE                m_Registers[ISL29018_STATUS_SIZE_BYTES];
+
+public:
+    VOID Reset(
+        _In_ BYTE Command2)
+    {
+        memset(m_Registers, 0, sizeof(m_Registers));
+        m_Registers[ISL29018_STATUS_COMMAND1] = ISL29018_CMD1_OPMODE_ALS_CONT << ISL29018_CMD1_OPMODE_SHIFT;
+        m_Registers[ISL29018_STATUS_COMMAND2] = Command2;
+    }
+
+    VOID WriteCommand2(
+        _In_ BYTE Command2)
+    {
+        m_Registers[ISL29018_STATUS_COMMAND2] = Command2;
+    }
+
+    VOID Convert(
+        _In_ FLOAT Lux)
+    {
+        BYTE Command2 = m_Registers[ISL29018_STATUS_COMMAND2];
+        ULONG Resolution = (Command2 & ISL29018_CMD2_RESOLUTION_MASK) >> ISL29018_CMD2_RESOLUTION_SHIFT;
+        ULONG Range = (Command2 & ISL29018_CMD2_RANGE_MASK) >> ISL29018_CMD2_RANGE_SHIFT;
+
+        FLOAT Count = Lux / Isl29018LuxPerCount(Resolution, Range);
+        ULONG RawCount = (Count >= static_cast<FLOAT>(Isl29018MaxCount(Resolution))) ?
+                         Isl29018MaxCount(Resolution) :
+                         static_cast<ULONG>((Count > 0.0f) ? Count : 0.0f);
+
+        m_Registers[ISL29018_STATUS_DATA] = static_cast<BYTE>(RawCount);
+        m_Registers[ISL29018_STATUS_DATA + 1] = static_cast<BYTE>(RawCount >> 8);
+    }
+
+    // The transfer the driver makes for every sample
+    VOID ReadStatus(
+        _Out_writes_(ISL29018_STATUS_SIZE_BYTES) BYTE* pStatusBuffer) const
+    {
+        memcpy(pStatusBuffer, m_Registers, ISL29018_STATUS_SIZE_BYTES);
+    }
+
+} FakeChip, *PFakeChip;
+
+// The driver's ProcessData without the framework: range writes go to the chip
+// model and reported samples through the ring to the report sink
+typedef class _BenchPipeline : public SamplePipeline
+{
+private:
+    SampleRing          m_Ring;
+    SampleCounters      m_Counters;
+    FLOAT               m_LuxSum;       // Keeps the reports from being optimized out
+
+public:
+    VOID Reset(
+        _In_ FLOAT LuxPct,
+        _In_ FLOAT LuxAbs)
+    {
+        m_AutoRange.Reset(SampleBench_Initial_Range, SampleBench_Initial_Resolution);
+        m_IrInterleave.Reset();
+        m_Filter.Reset(NoiseFilter_None);
+        m_LastRawCount = 0;
+        m_Decimator.Reset();
+        m_FirstSample = true;
+        m_CachedThresholds.LuxPct = LuxPct;
+        m_CachedThresholds.LuxAbs = LuxAbs;
+        m_CachedData = 1.0f;
+        m_LastSample = 0.0f;
+        m_Ring.Reset();
+        m_Counters.Reset(0);
+        m_LuxSum = 0.0f;
+    }
+
+    BYTE GetCommand2() const { return SamplePipeline::GetCommand2(); }
+
+    VOID ProcessData(
+        _In_reads_(ISL29018_STATUS_SIZE_BYTES) const BYTE* pStatusBuffer,
+        _In_ const FILETIME* pCaptureTime,
+        _Inout_ PFakeChip pChip)
+    {
+        m_Counters.OnSample();
+
+        if (pStatusBuffer[ISL29018_STATUS_COMMAND2] != GetCommand2())
+        {
+            m_Counters.OnError();
+            m_Decimator.Reset();
+            pChip->WriteCommand2(GetCommand2());
+            return;
+        }
+
+        ULONG RawCount = GetStatusRawCount(pStatusBuffer);
+        if (DiscardSample())
+        {
+            return;
+        }
+
+        ConvertSample(RawCount, SampleBench_IrCoefficient);
+
+        if (m_AutoRange.Evaluate(RawCount))
+        {
+            pChip->WriteCommand2(GetCommand2());
+        }
+
+        RING_SAMPLE Sample;
+        if (TakeReport(pCaptureTime, RawCount, &Sample) && m_Ring.Enqueue(Sample))
+        {
+            // The delivery work item's side of the ring
+            RING_SAMPLE Delivered;
+            while (m_Ring.Dequeue(&Delivered))
+            {
+                m_LuxSum += Delivered.Sample.Lux;
+                m_Counters.OnReport();
+            }
+        }
+    }
+
+    // Counts since the last call. The counters run on a clock of their own
+    // here, one period passes between calls.
+    VOID TakeCounts(
+        _Out_ PSAMPLE_COUNTS pCounts)
+    {
+        m_Counters.TakeIfDue(SampleCounters_Period, pCounts);
+        m_Counters.Reset(0);
+    }
+
+    FLOAT GetLuxSum() const { return m_LuxSum; }
+
+} BenchPipeline, *PBenchPipeline;
+
+// Light profiles, the lux level at a sample
+typedef FLOAT LIGHT_PROFILE(_In_ ULONG Index);
+
+// Deterministic noise in [-1, 1)
+static FLOAT Noise(
+    _In_ ULONG Index)
+{
+    ULONG Hash = Index * 2654435761UL;
+    Hash ^= Hash >> 15;
+    return static_cast<FLOAT>(Hash & 0xFFFF) / 32768.0f - 1.0f;
+}
+
+// Office light with 1% sensor noise
+static FLOAT ProfileSteady(_In_ ULONG Index)
+{
+    return 300.0f * (1.0f + 0.01f * Noise(Index));
+}
+
+// Dusk to daylight and back, crossing every range
+static FLOAT ProfileSweep(_In_ ULONG Index)
+{
+    FLOAT Phase = static_cast<FLOAT>(Index % 2000) / 2000.0f;
+    FLOAT Decades = (Phase < 0.5f) ? (Phase * 2.0f) : ((1.0f - Phase) * 2.0f);
+    return std::pow(10.0f, 5.0f * Decades - 0.5f) * (1.0f + 0.01f * Noise(Index));
+}
+
+// Mains flicker of a fluorescent tube aliased into the sample rate
+static FLOAT ProfileFlicker(_In_ ULONG Index)
+{
+    return 500.0f * (1.0f + 0.3f * std::sin(static_cast<FLOAT>(Index) * 0.7f)) * (1.0f + 0.01f * Noise(Index));
+}
+
+// A door opening onto daylight every few hundred samples
+static FLOAT ProfileStep(_In_ ULONG Index)
+{
+    return (((Index / 300) & 1) ? 20000.0f : 50.0f) * (1.0f + 0.01f * Noise(Index));
+}
+
+// A dark room, a few counts of noise at the lowest range
+static FLOAT ProfileDark(_In_ ULONG Index)
+{
+    FLOAT Lux = 0.2f + 0.2f * Noise(Index);
+    return (Lux > 0.0f) ? Lux : 0.0f;
+}
+
+typedef struct _PROFILE
+{
+    const char*         Name;
+    LIGHT_PROFILE*      Lux;
+} PROFILE;
+
+static const PROFILE g_Profiles[] =
+{
+    { "steady", ProfileSteady },
+    { "sweep", ProfileSweep },
+    { "flicker", ProfileFlicker },
+    { "step", ProfileStep },
+    { "dark", ProfileDark },
+};
+
+typedef struct _THRESHOLDS
+{
+    const char*         Name;
+    FLOAT               LuxPct;
+    FLOAT               LuxAbs;
+} THRESHOLDS;
+
+static const THRESHOLDS g_Thresholds[] =
+{
+    { "default", 1.0f, 0.0f },          // Als_Initial_Lux_Threshold_Pct and _Abs
+    { "all", 0.0f, 0.0f },              // Every sample is reported
+    { "fine", 0.01f, 0.5f },
+    { "coarse", 0.1f, 10.0f },
+};
+
+typedef struct _RESULT
+{
+    char                Profile[32];
+    char                Thresholds[32];
+    ULONG               Samples;
+    double              NsPerSample;
+    double              AllocationsPerSample;
+    double              ReportsPerSample;
+} RESULT;
+
+#define SampleBench_MaxResults              (ARRAYSIZE(g_Profiles) * ARRAYSIZE(g_Thresholds))
+
+static VOID RunOne(
+    _In_ const PROFILE* pProfile,
+    _In_ const THRESHOLDS* pThresholds,
+    _In_ ULONG Samples,
+    _Out_ RESULT* pResult)
+{
+    static BenchPipeline Pipeline;
+    static FakeChip Chip;
+    BYTE StatusBuffer[ISL29018_STATUS_SIZE_BYTES];
+    FILETIME CaptureTime = {};
+    SAMPLE_COUNTS Counts = {};
+
+    Pipeline.Reset(pThresholds->LuxPct, pThresholds->LuxAbs);
+    Chip.Reset(Pipeline.GetCommand2());
+
+    for (ULONG i = 0; i < SampleBench_WarmupSamples; i++)
+    {
+        Chip.Convert(pProfile->Lux(i));
+        Chip.ReadStatus(StatusBuffer);
+        Pipeline.ProcessData(StatusBuffer, &CaptureTime, &Chip);
+    }
+
+    Pipeline.TakeCounts(&Counts);
+
+    LONG AllocationsBefore = GetHostAllocations();
+    auto Start = std::chrono::steady_clock::now();
+
+    for (ULONG i = 0; i < Samples; i++)
+    {
+        CaptureTime.dwLowDateTime = i;
+        Chip.Convert(pProfile->Lux(i));
+        Chip.ReadStatus(StatusBuffer);
+        Pipeline.ProcessData(StatusBuffer, &CaptureTime, &Chip);
+    }
+
+    auto End = std::chrono::steady_clock::now();
+    LONG Allocations = GetHostAllocations() - AllocationsBefore;
+
+    Pipeline.TakeCounts(&Counts);
+
+    snprintf(pResult->Profile, sizeof(pResult->Profile), "%s", pProfile->Name);
+    snprintf(pResult->Thresholds, sizeof(pResult->Thresholds), "%s", pThresholds->Name);
+    pResult->Samples = Samples;
+    pResult->NsPerSample = std::chrono::duration<double, std::nano>(End - Start).count() / Samples;
+    pResult->AllocationsPerSample = static_cast<double>(Allocations) / Samples;
+    pResult->ReportsPerSample = static_cast<double>(Counts.Reports) / Samples;
+
+    // A NaN lux would be a conversion bug, not a slow run
+    if (std::isnan(Pipeline.GetLuxSum()))
+    {
+        fprintf(stderr, "%s/%s: lux is not a number\n", pProfile->Name, pThresholds->Name);
+        exit(2);
+    }
+}
+
+static VOID PrintHeader(
+    _In_ FILE* pFile)
+{
+    fprintf(pFile, "profile,thresholds,samples,ns_per_sample,allocations_per_sample,reports_per_sample\n");
+}
+
+static VOID PrintResult(
+    _In_ FILE* pFile,
+    _In_ const RESULT* pResult)
+{
+    fprintf(pFile, "%s,%s,%lu,%.2f,%.6f,%.6f\n",
+            pResult->Profile, pResult->Thresholds, static_cast<unsigned long>(pResult->Samples),
+            pResult->NsPerSample, pResult->AllocationsPerSample, pResult->ReportsPerSample);
+}
+
+// Compare the results to a baseline written by an earlier run. Returns the
+// number of regressions; runs missing from the baseline are not compared.
+static ULONG CompareToBaseline(
+    _In_ const char* pPath,
+    _In_ double TolerancePercent,
+    _In_reads_(Count) const RESULT* pResults,
+    _In_ ULONG Count)
+{
+    FILE* pFile = fopen(pPath, "r");
+    if (nullptr == pFile)
+    {
+        fprintf(stderr, "Cannot open baseline %s\n", pPath);
+        return 1;
+    }
+
+    ULONG Regressions = 0;
+    char Line[256];
+
+    while (nullptr != fgets(Line, sizeof(Line), pFile))
+    {
+        RESULT Baseline = {};
+        unsigned long Samples = 0;
+
+        if (6 != sscanf(Line, "%31[^,],%31[^,],%lu,%lf,%lf,%lf",
+                        Baseline.Profile, Baseline.Thresholds, &Samples,
+                        &Baseline.NsPerSample, &Baseline.AllocationsPerSample, &Baseline.ReportsPerSample))
+        {
+            continue;
+        }
+
+        for (ULONG i = 0; i < Count; i++)
+        {
+            const RESULT* pResult = &pResults[i];
+            if (0 != strcmp(pResult->Profile, Baseline.Profile) ||
+                0 != strcmp(pResult->Thresholds, Baseline.Thresholds))
+            {
+                continue;
+            }
+
+            // Reports and allocations do not depend on the host, the time does
+            if (pResult->AllocationsPerSample > Baseline.AllocationsPerSample)
+            {
+                fprintf(stderr, "%s/%s: %.6f allocations per sample, baseline %.6f\n",
+                        pResult->Profile, pResult->Thresholds, pResult->AllocationsPerSample, Baseline.AllocationsPerSample);
+                Regressions++;
+            }
+
+            if (Samples == pResult->Samples &&
+                std::fabs(pResult->ReportsPerSample - Baseline.ReportsPerSample) > 1e-6)
+            {
+                fprintf(stderr, "%s/%s: %.6f reports per sample, baseline %.6f\n",
+                        pResult->Profile, pResult->Thresholds, pResult->ReportsPerSample, Baseline.ReportsPerSample);
+                Regressions++;
+            }
+
+            if (pResult->NsPerSample > Baseline.NsPerSample * (1.0 + TolerancePercent / 100.0))
+            {
+                fprintf(stderr, "%s/%s: %.2f ns per sample, baseline %.2f + %.0f%%\n",
+                        pResult->Profile, pResult->Thresholds, pResult->NsPerSample, Baseline.NsPerSample, TolerancePercent);
+                Regressions++;
+            }
+        }
+    }
+
+    fclose(pFile);
+    return Regressions;
+}
+
+int main(
+    _In_ int argc,
+    _In_reads_(argc) char** argv)
+{
+    ULONG Samples = SampleBench_DefaultSamples;
+    const char* pBaseline = nullptr;
+    double Tolerance = SampleBench_DefaultTolerance;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-samples") && i + 1 < argc)
+        {
+            Samples = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (0 == strcmp(argv[i], "-baseline") && i + 1 < argc)
+        {
+            pBaseline = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-tolerance") && i + 1 < argc)
+        {
+            Tolerance = strtod(argv[++i], nullptr);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: SampleBench [-samples N] [-baseline FILE] [-tolerance PERCENT]\n");
+            return 1;
+        }
+    }
+
+    if (Samples == 0)
+    {
+        fprintf(stderr, "The sample count must not be 0\n");
+        return 1;
+    }
+
+    static RESULT Results[SampleBench_MaxResults];
+    ULONG Count = 0;
+
+    PrintHeader(stdout);
+    for (const PROFILE& Profile : g_Profiles)
+    {
+        for (const THRESHOLDS& Thresholds : g_Thresholds)
+        {
+            RunOne(&Profile, &Thresholds, Samples, &Results[Count]);
+            PrintResult(stdout, &Results[Count]);
+            Count++;
+        }
+    }
+
+    if (nullptr != pBaseline)
+    {
+        ULONG Regressions = CompareToBaseline(pBaseline, Tolerance, Results, Count);
+        if (Regressions != 0)
+        {
+            fprintf(stderr, "%lu regressions against %s\n", static_cast<unsigned long>(Regressions), pBaseline);
+            return 1;
+        }
+    }
+
+    return 0;
+}
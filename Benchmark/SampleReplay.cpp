@@ -0,0 +1,174 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host tool that replays a raw sample recording,
+//    written by the driver's SampleRecorder or by BusSimulation -record,
+//    through SamplePipeline, the conversion, filter and threshold code the
+//    driver uses. It is meant for trying out thresholds, filters and the IR
+//    coefficient offline on samples taken in the field.
+//
+//    The recording is mapped and read in place and replayed by
+//    ReplayPipeline.h.
+//
+//    The tool prints one CSV row with the record counts, the reports and the
+//    replay speed.
+//
+//    Usage: SampleReplay FILE [-pct P] [-abs A] [-filter N] [-ir C]
+//                             [-reports FILE] [-repeat N]
+//
+//    -pct, -abs  thresholds, 1.0 and 0 by default as in the driver
+//    -filter     NOISE_FILTER_TYPE, none by default
+//    -ir         IR coefficient, the recording's by default
+//    -reports    write the reported samples to FILE as CSV
+//    -repeat     replay the recording N times, for timing short recordings
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "ReplayPipeline.h"
+
+static VOID PrintUsage()
+{
+    fprintf(stderr, "Usage: SampleReplay FILE [-pct P] [-abs A] [-filter N] [-ir C] [-reports FILE] [-repeat N]\n");
+}
+
+int main(
+    _In_ int argc,
+    _In_reads_(argc) char** argv)
+{
+    if (argc < 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    const char* pPath = argv[1];
+    FLOAT LuxPct = Replay_Default_Lux_Pct;
+    FLOAT LuxAbs = Replay_Default_Lux_Abs;
+    ULONG FilterType = NoiseFilter_None;
+    bool IrGiven = false;
+    FLOAT IrCoefficient = 0.0f;
+    const char* pReportsPath = nullptr;
+    ULONG Repeat = 1;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-pct") && i + 1 < argc)
+        {
+            LuxPct = strtof(argv[++i], nullptr);
+        }
+        else if (0 == strcmp(argv[i], "-abs") && i + 1 < argc)
+        {
+            LuxAbs = strtof(argv[++i], nullptr);
+        }
+        else if (0 == strcmp(argv[i], "-filter") && i + 1 < argc)
+        {
+            FilterType = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (0 == strcmp(argv[i], "-ir") && i + 1 < argc)
+        {
+            IrCoefficient = strtof(argv[++i], nullptr);
+            IrGiven = true;
+        }
+        else if (0 == strcmp(argv[i], "-reports") && i + 1 < argc)
+        {
+            pReportsPath = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-repeat") && i + 1 < argc)
+        {
+            Repeat = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (FilterType >= NoiseFilter_Count || 0 == Repeat)
+    {
+        fprintf(stderr, "The filter must be below %d and the repeat count must not be 0\n", NoiseFilter_Count);
+        return 1;
+    }
+
+    ULONGLONG Size = 0;
+    PVOID pView = ReplayMapRecording(pPath, &Size);
+    if (nullptr == pView)
+    {
+        fprintf(stderr, "Cannot map %s\n", pPath);
+        return 1;
+    }
+
+    SampleRecording Recording;
+    if (!Recording.Open(pView, Size))
+    {
+        fprintf(stderr, "%s is not a sample recording\n", pPath);
+        return 1;
+    }
+
+    FILE* pReports = nullptr;
+    if (nullptr != pReportsPath)
+    {
+        pReports = fopen(pReportsPath, "w");
+        if (nullptr == pReports)
+        {
+            fprintf(stderr, "Cannot create %s\n", pReportsPath);
+            return 1;
+        }
+        fprintf(pReports, "timestamp,lux,raw_count,ir_count\n");
+    }
+
+    static ReplayPipeline Pipeline;
+    double Wall = 0.0;
+
+    for (ULONG Pass = 0; Pass < Repeat; Pass++)
+    {
+        Pipeline.Reset(LuxPct, LuxAbs, FilterType, IrGiven ? IrCoefficient : Recording.GetIrCoefficient(),
+                       (0 == Pass) ? pReports : nullptr);
+
+        auto Start = std::chrono::steady_clock::now();
+        ReplayRecording(&Pipeline, Recording);
+        Wall += std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    }
+
+    if (nullptr != pReports)
+    {
+        fclose(pReports);
+    }
+
+    // A NaN lux would be a conversion bug
+    if (std::isnan(Pipeline.GetLuxSum()))
+    {
+        fprintf(stderr, "%s: lux is not a number\n", pPath);
+        return 2;
+    }
+
+    const REPLAY_STATS& Stats = Pipeline.GetStats();
+    ULONGLONG Records = Stats.Records * Repeat;
+
+    printf("records,samples,starts,read_errors,ir_samples,oversamples,discards,reports,"
+           "recorded_switches,range_switches,wall_s,records_per_s\n");
+    printf("%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%lu,%.3f,%.0f\n",
+           static_cast<unsigned long long>(Stats.Records),
+           static_cast<unsigned long long>(Stats.Samples),
+           static_cast<unsigned long long>(Stats.Starts),
+           static_cast<unsigned long long>(Stats.ReadErrors),
+           static_cast<unsigned long long>(Stats.IrSamples),
+           static_cast<unsigned long long>(Stats.Oversamples),
+           static_cast<unsigned long long>(Stats.Discards),
+           static_cast<unsigned long long>(Stats.Reports),
+           static_cast<unsigned long long>(Stats.RecordedSwitches),
+           static_cast<unsigned long>(Pipeline.GetRangeSwitches()),
+           Wall, (Wall > 0.0) ? (Records / Wall) : 0.0);
+
+    ReplayUnmapRecording(pView, Size);
+    return 0;
+}
@@ -0,0 +1,274 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a host benchmark of the hot path trace points of
+//    SensorsTrace.h. It runs SamplePipeline with the trace points where
+//    AlsDevice::ProcessData has them, see HostTrace.h, and prints one CSV row
+//    per trace session with the time and the trace records per sample.
+//
+//    The Makefile builds it twice. TraceBenchOff is built with
+//    ISL29018_HOT_PATH_TRACING 0, as a release driver is, and runs with every
+//    trace point of the session enabled: nothing may be recorded, the trace
+//    points are compiled out. TraceBenchOn is built with 1, as a debug driver
+//    is, and runs with no session, which costs the flag test of each trace
+//    point, and with every trace point enabled, which records at least the
+//    entry and exit of each sample.
+//
+//    Usage: TraceBench [-samples N]
+//
+//Environment:
+//
+//    Host build, GCC or Clang, see Makefile
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "HostTrace.h"
+#include "SamplePipeline.h"
+
+#define TraceBench_Initial_Range            (ISL29018_RANGE_4K)
+#define TraceBench_Initial_Resolution       (ISL29018_INT_TIME_16)
+#define TraceBench_IrCoefficient            (0.25f)
+
+#define TraceBench_DefaultSamples           (1000000)
+#define TraceBench_WarmupSamples            (10000)
+
+// Als_Initial_Lux_Threshold_Pct and _Abs, most samples are not reported
+#define TraceBench_LuxPct                   (1.0f)
+#define TraceBench_LuxAbs                   (0.0f)
+
+// The driver's ProcessData with its hot path trace points, reading the
+// registers of a chip that converts a given light level
+typedef class _TracedPipeline : public SamplePipeline
+{
+private:
+    BYTE                m_Registers[ISL29018_STATUS_SIZE_BYTES];
+    FLOAT               m_LuxSum;       // Keeps the reports from being optimized out
+
+public:
+    VOID Reset()
+    {
+        m_AutoRange.Reset(TraceBench_Initial_Range, TraceBench_Initial_Resolution);
+        m_IrInterleave.Reset();
+        m_Filter.Reset(NoiseFilter_None);
+        m_LastRawCount = 0;
+        m_Decimator.Reset();
+        m_FirstSample = true;
+        m_CachedThresholds.LuxPct = TraceBench_LuxPct;
+        m_CachedThresholds.LuxAbs = TraceBench_LuxAbs;
+        m_CachedData = 1.0f;
+        m_LastSample = 0.0f;
+        m_LuxSum = 0.0f;
+
+        memset(m_Registers, 0, sizeof(m_Registers));
+        m_Registers[ISL29018_STATUS_COMMAND1] = ISL29018_CMD1_OPMODE_ALS_CONT << ISL29018_CMD1_OPMODE_SHIFT;
+        m_Registers[ISL29018_STATUS_COMMAND2] = GetCommand2();
+    }
+
+    // The conversion the next status read finds
+    VOID Convert(
+        _In_ FLOAT Lux)
+    {
+        ULONG Resolution = m_AutoRange.GetResolution();
+        FLOAT Count = Lux / Isl29018LuxPerCount(Resolution, m_AutoRange.GetRange());
+        ULONG RawCount = (Count >= static_cast<FLOAT>(Isl29018MaxCount(Resolution))) ?
+                         Isl29018MaxCount(Resolution) :
+                         static_cast<ULONG>((Count > 0.0f) ? Count : 0.0f);
+
+        m_Registers[ISL29018_STATUS_DATA] = static_cast<BYTE>(RawCount);
+        m_Registers[ISL29018_STATUS_DATA + 1] = static_cast<BYTE>(RawCount >> 8);
+    }
+
+    NTSTATUS ProcessData(
+        _In_ const FILETIME* pCaptureTime)
+    {
+        NTSTATUS Status = STATUS_SUCCESS;
+        const BYTE* pStatusBuffer = m_Registers;
+
+        SENSOR_HotPathEnter();
+
+        ULONG RawCount = GetStatusRawCount(pStatusBuffer);
+        if (DiscardSample())
+        {
+            Status = STATUS_DATA_NOT_ACCEPTED;
+            TraceHotVerbose("COMBO %!FUNC! ALS Discarding first sample after a range switch");
+
+            SENSOR_HotPathExit(Status);
+            return Status;
+        }
+
+        ULONG Conversions = ConvertSample(RawCount, TraceBench_IrCoefficient);
+        if (Conversions > 1)
+        {
+            TraceHotVerbose("COMBO %!FUNC! ALS Decimated %lu conversions", Conversions);
+        }
+
+        if (m_AutoRange.Evaluate(RawCount))
+        {
+            m_Registers[ISL29018_STATUS_COMMAND2] = GetCommand2();
+        }
+
+        RING_SAMPLE Sample;
+        if (TakeReport(pCaptureTime, RawCount, &Sample))
+        {
+            m_LuxSum += Sample.Sample.Lux;
+        }
+        else
+        {
+            Status = STATUS_DATA_NOT_ACCEPTED;
+            TraceHotInformation("COMBO %!FUNC! ALS Data did NOT meet the threshold");
+        }
+
+        SENSOR_HotPathExit(Status);
+        return Status;
+    }
+
+    FLOAT GetLuxSum() const { return m_LuxSum; }
+
+} TracedPipeline, *PTracedPipeline;
+
+// Deterministic noise in [-1, 1)
+static FLOAT Noise(
+    _In_ ULONG Index)
+{
+    ULONG Hash = Index * 2654435761UL;
+    Hash ^= Hash >> 15;
+    return static_cast<FLOAT>(Hash & 0xFFFF) / 32768.0f - 1.0f;
+}
+
+// Dusk to daylight and back with 1% noise, so every trace point is reached
+static FLOAT Light(
+    _In_ ULONG Index)
+{
+    FLOAT Phase = static_cast<FLOAT>(Index % 2000) / 2000.0f;
+    FLOAT Decades = (Phase < 0.5f) ? (Phase * 2.0f) : ((1.0f - Phase) * 2.0f);
+    return std::pow(10.0f, 5.0f * Decades - 0.5f) * (1.0f + 0.01f * Noise(Index));
+}
+
+// Run the samples with the trace points of Level and below enabled, and
+// return the time per sample
+static double Run(
+    _In_ BYTE Level,
+    _In_ ULONG Samples,
+    _Out_ PULONGLONG pRecords)
+{
+    static TracedPipeline Pipeline;
+    FILETIME CaptureTime = {};
+
+    HostTraceEnable(Level);
+    Pipeline.Reset();
+
+    for (ULONG i = 0; i < TraceBench_WarmupSamples; i++)
+    {
+        Pipeline.Convert(Light(i));
+        Pipeline.ProcessData(&CaptureTime);
+    }
+
+    ULONGLONG RecordsBefore = GetHostTraceRecords();
+    auto Start = std::chrono::steady_clock::now();
+
+    for (ULONG i = 0; i < Samples; i++)
+    {
+        CaptureTime.dwLowDateTime = i;
+        Pipeline.Convert(Light(i));
+        Pipeline.ProcessData(&CaptureTime);
+    }
+
+    auto End = std::chrono::steady_clock::now();
+
+    *pRecords = GetHostTraceRecords() - RecordsBefore;
+    HostTraceEnable(TRACE_LEVEL_NONE);
+
+    // A NaN lux would be a conversion bug, not a slow run
+    if (std::isnan(Pipeline.GetLuxSum()))
+    {
+        fprintf(stderr, "lux is not a number\n");
+        exit(2);
+    }
+
+    return std::chrono::duration<double, std::nano>(End - Start).count() / Samples;
+}
+
+static VOID PrintResult(
+    _In_ const char* pSession,
+    _In_ ULONG Samples,
+    _In_ double NsPerSample,
+    _In_ ULONGLONG Records)
+{
+    printf("%s,%s,%lu,%.2f,%.3f\n",
+           ISL29018_HOT_PATH_TRACING ? "compiled_in" : "compiled_out",
+           pSession,
+           static_cast<unsigned long>(Samples),
+           NsPerSample,
+           static_cast<double>(Records) / Samples);
+}
+
+static VOID PrintUsage()
+{
+    fprintf(stderr, "Usage: TraceBench [-samples N]\n");
+}
+
+int main(
+    _In_ int argc,
+    _In_reads_(argc) char** argv)
+{
+    ULONG Samples = TraceBench_DefaultSamples;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-samples") && i + 1 < argc)
+        {
+            Samples = static_cast<ULONG>(strtoul(argv[++i], nullptr, 0));
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (0 == Samples)
+    {
+        fprintf(stderr, "There must be a sample\n");
+        return 1;
+    }
+
+    int Result = 0;
+    ULONGLONG Records = 0;
+    double Ns = 0.0;
+
+    printf("tracing,session,samples,ns_per_sample,records_per_sample\n");
+
+#if ISL29018_HOT_PATH_TRACING
+    Ns = Run(TRACE_LEVEL_NONE, Samples, &Records);
+    PrintResult("none", Samples, Ns, Records);
+    if (0 != Records)
+    {
+        fprintf(stderr, "%llu records written without a session\n", static_cast<unsigned long long>(Records));
+        Result = 2;
+    }
+
+    Ns = Run(TRACE_LEVEL_VERBOSE, Samples, &Records);
+    PrintResult("verbose", Samples, Ns, Records);
+    if (Records < 2ULL * Samples)
+    {
+        fprintf(stderr, "%llu records written for %lu samples, fewer than an entry and exit each\n",
+                static_cast<unsigned long long>(Records), static_cast<unsigned long>(Samples));
+        Result = 2;
+    }
+#else
+    Ns = Run(TRACE_LEVEL_VERBOSE, Samples, &Records);
+    PrintResult("verbose", Samples, Ns, Records);
+    if (0 != Records)
+    {
+        fprintf(stderr, "%llu records written by trace points compiled out\n", static_cast<unsigned long long>(Records));
+        Result = 2;
+    }
+#endif
+
+    return Result;
+}
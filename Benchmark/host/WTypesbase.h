@@ -0,0 +1,99 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module stands in for the Windows SDK header of the same name when
+//    the platform-independent parts of the driver are built on a non-Windows
+//    host. It provides the types, annotations and memory-ordered accessors
+//    those headers use, and nothing else.
+//
+//Environment:
+//
+//    Host build, GCC or Clang
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Out_opt_
+#define _Inout_
+#define _In_reads_(Count)
+#define _Out_writes_(Count)
+#define _In_reads_bytes_(Size)
+#define _Out_writes_bytes_(Size)
+#define _Inout_updates_bytes_(Size)
+
+#define VOID void
+#define FALSE 0
+#define TRUE 1
+
+typedef uint8_t             BYTE, *PBYTE, BOOLEAN;
+typedef uint16_t            USHORT, *PUSHORT;
+typedef int32_t             LONG, *PLONG;
+typedef uint32_t            ULONG, *PULONG;
+typedef int64_t             LONGLONG, LONG64;
+typedef uint64_t            ULONGLONG, *PULONGLONG;
+typedef float               FLOAT;
+typedef wchar_t             WCHAR;
+typedef void*               PVOID;
+
+#define MAXUCHAR                            (0xFF)
+#define MAXULONG                            (0xFFFFFFFFUL)
+
+typedef struct _FILETIME
+{
+    ULONG dwLowDateTime;
+    ULONG dwHighDateTime;
+} FILETIME, *PFILETIME;
+
+inline LONG ReadAcquire(
+    _In_ const volatile LONG* Source)
+{
+    return __atomic_load_n(Source, __ATOMIC_ACQUIRE);
+}
+
+inline VOID WriteRelease(
+    _Out_ volatile LONG* Destination,
+    _In_ LONG Value)
+{
+    __atomic_store_n(Destination, Value, __ATOMIC_RELEASE);
+}
+
+inline LONG64 ReadAcquire64(
+    _In_ const volatile LONG64* Source)
+{
+    return __atomic_load_n(Source, __ATOMIC_ACQUIRE);
+}
+
+inline VOID WriteRelease64(
+    _Out_ volatile LONG64* Destination,
+    _In_ LONG64 Value)
+{
+    __atomic_store_n(Destination, Value, __ATOMIC_RELEASE);
+}
+
+inline LONG InterlockedIncrement(
+    _Inout_ volatile LONG* Addend)
+{
+    return __atomic_add_fetch(Addend, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedExchange(
+    _Inout_ volatile LONG* Target,
+    _In_ LONG Value)
+{
+    return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedCompareExchange64(
+    _Inout_ volatile LONG64* Destination,
+    _In_ LONG64 Exchange,
+    _In_ LONG64 Comperand)
+{
+    __atomic_compare_exchange_n(Destination, &Comperand, Exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return Comperand;
+}
@@ -0,0 +1,20 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module stands in for evntrace.h on a non-Windows host, see
+//    windows.h next to it. SensorsTrace.h only needs the trace levels.
+//
+//Environment:
+//
+//    Host build, GCC or Clang
+
+#pragma once
+
+#define TRACE_LEVEL_NONE                    (0)
+#define TRACE_LEVEL_CRITICAL                (1)
+#define TRACE_LEVEL_FATAL                   (1)
+#define TRACE_LEVEL_ERROR                   (2)
+#define TRACE_LEVEL_WARNING                 (3)
+#define TRACE_LEVEL_INFORMATION             (4)
+#define TRACE_LEVEL_VERBOSE                 (5)
@@ -0,0 +1,38 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module stands in for wdf.h on a non-Windows host. It only has the
+//    handle and completion types BusExecutor declares when it is built with
+//    ISL29018_BUS_MODEL; no framework function is available.
+//
+//Environment:
+//
+//    Host build, GCC or Clang
+
+#pragma once
+
+#include "windows.h"
+
+typedef struct WDFOBJECT__*         WDFOBJECT;
+typedef struct WDFIOTARGET__*       WDFIOTARGET;
+typedef struct WDFREQUEST__*        WDFREQUEST;
+typedef struct WDFMEMORY__*         WDFMEMORY;
+typedef PVOID                       WDFCONTEXT;
+
+typedef struct _IO_STATUS_BLOCK
+{
+    NTSTATUS    Status;
+    ULONG_PTR   Information;
+} IO_STATUS_BLOCK;
+
+typedef struct _WDF_REQUEST_COMPLETION_PARAMS
+{
+    IO_STATUS_BLOCK IoStatus;
+} WDF_REQUEST_COMPLETION_PARAMS, *PWDF_REQUEST_COMPLETION_PARAMS;
+
+typedef VOID EVT_WDF_REQUEST_COMPLETION_ROUTINE(
+    _In_ WDFREQUEST Request,
+    _In_ WDFIOTARGET Target,
+    _In_ PWDF_REQUEST_COMPLETION_PARAMS Params,
+    _In_ WDFCONTEXT Context);
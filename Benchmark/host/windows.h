@@ -0,0 +1,174 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module stands in for windows.h when the platform-independent parts
+//    of the driver are built on a non-Windows host. Besides the types it has
+//    the status codes, the interlocked operations and fences, the events and
+//    the clock BusExecutor and the latency histograms use.
+//
+//Environment:
+//
+//    Host build, GCC or Clang
+
+#pragma once
+
+#include <string.h>
+#include <time.h>
+
+#include <condition_variable>
+#include <mutex>
+
+#include "WTypesbase.h"
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+#define INFINITE                            (0xFFFFFFFF)
+#define UNREFERENCED_PARAMETER(P)           ((void)(P))
+
+typedef int32_t             NTSTATUS;
+typedef uint32_t            DWORD;
+typedef int                 BOOL;
+typedef uintptr_t           ULONG_PTR;
+typedef void*               HANDLE;
+
+#define NT_SUCCESS(Status)                  (static_cast<NTSTATUS>(Status) >= 0)
+
+#define STATUS_SUCCESS                      (static_cast<NTSTATUS>(0x00000000L))
+#define STATUS_UNSUCCESSFUL                 (static_cast<NTSTATUS>(0xC0000001L))
+#define STATUS_INVALID_PARAMETER            (static_cast<NTSTATUS>(0xC000000DL))
+#define STATUS_INSUFFICIENT_RESOURCES       (static_cast<NTSTATUS>(0xC000009AL))
+#define STATUS_INVALID_DEVICE_STATE         (static_cast<NTSTATUS>(0xC0000184L))
+#define STATUS_DEVICE_PROTOCOL_ERROR        (static_cast<NTSTATUS>(0xC0000186L))
+#define STATUS_DATA_NOT_ACCEPTED            (static_cast<NTSTATUS>(0xC000021BL))
+
+inline LONG InterlockedDecrement(
+    _Inout_ volatile LONG* Addend)
+{
+    return __atomic_sub_fetch(Addend, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedCompareExchange(
+    _Inout_ volatile LONG* Destination,
+    _In_ LONG Exchange,
+    _In_ LONG Comperand)
+{
+    __atomic_compare_exchange_n(Destination, &Comperand, Exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return Comperand;
+}
+
+inline LONG64 InterlockedIncrement64(
+    _Inout_ volatile LONG64* Addend)
+{
+    return __atomic_add_fetch(Addend, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedExchangeAdd64(
+    _Inout_ volatile LONG64* Addend,
+    _In_ LONG64 Value)
+{
+    return __atomic_fetch_add(Addend, Value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedExchange64(
+    _Inout_ volatile LONG64* Target,
+    _In_ LONG64 Value)
+{
+    return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+// Full fence, as the seqlock readers of SamplePublisher.h use it
+inline VOID MemoryBarrier()
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+inline VOID YieldProcessor()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Unbiased interrupt time in 100ns
+inline VOID QueryInterruptTimePrecise(
+    _Out_ PULONGLONG lpInterruptTimePrecise)
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    *lpInterruptTimePrecise = static_cast<ULONGLONG>(Time.tv_sec) * 10000000ULL +
+                              static_cast<ULONGLONG>(Time.tv_nsec) / 100;
+}
+
+// Events, created at setup and never in the sample path
+typedef struct _HOST_EVENT
+{
+    std::mutex              Lock;
+    std::condition_variable Signaled;
+    bool                    ManualReset;
+    bool                    State;
+} HOST_EVENT, *PHOST_EVENT;
+
+inline HANDLE CreateEventW(
+    _In_opt_ PVOID EventAttributes,
+    _In_ BOOL ManualReset,
+    _In_ BOOL InitialState,
+    _In_opt_ const WCHAR* Name)
+{
+    UNREFERENCED_PARAMETER(EventAttributes);
+    UNREFERENCED_PARAMETER(Name);
+
+    PHOST_EVENT pEvent = new HOST_EVENT;
+    pEvent->ManualReset = (FALSE != ManualReset);
+    pEvent->State = (FALSE != InitialState);
+    return pEvent;
+}
+
+inline BOOL SetEvent(
+    _In_ HANDLE Event)
+{
+    PHOST_EVENT pEvent = static_cast<PHOST_EVENT>(Event);
+    {
+        std::lock_guard<std::mutex> Guard(pEvent->Lock);
+        pEvent->State = true;
+    }
+    pEvent->Signaled.notify_all();
+    return TRUE;
+}
+
+inline BOOL ResetEvent(
+    _In_ HANDLE Event)
+{
+    PHOST_EVENT pEvent = static_cast<PHOST_EVENT>(Event);
+    std::lock_guard<std::mutex> Guard(pEvent->Lock);
+    pEvent->State = false;
+    return TRUE;
+}
+
+// Only INFINITE is supported
+inline DWORD WaitForSingleObject(
+    _In_ HANDLE Handle,
+    _In_ DWORD Milliseconds)
+{
+    UNREFERENCED_PARAMETER(Milliseconds);
+
+    PHOST_EVENT pEvent = static_cast<PHOST_EVENT>(Handle);
+    std::unique_lock<std::mutex> Guard(pEvent->Lock);
+    pEvent->Signaled.wait(Guard, [pEvent] { return pEvent->State; });
+    if (!pEvent->ManualReset)
+    {
+        pEvent->State = false;
+    }
+    return 0;
+}
+
+inline BOOL CloseHandle(
+    _In_ HANDLE Handle)
+{
+    delete static_cast<PHOST_EVENT>(Handle);
+    return TRUE;
+}
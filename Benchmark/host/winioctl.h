@@ -0,0 +1,21 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module stands in for winioctl.h on a non-Windows host, see
+//    windows.h next to it.
+//
+//Environment:
+//
+//    Host build, GCC or Clang
+
+#pragma once
+
+#define CTL_CODE(DeviceType, Function, Method, Access) \
+    (((DeviceType) << 16) | ((Access) << 14) | ((Function) << 2) | (Method))
+
+#define FILE_DEVICE_UNKNOWN                 (0x00000022)
+#define METHOD_BUFFERED                     (0)
+#define FILE_ANY_ACCESS                     (0)
+#define FILE_READ_ACCESS                    (0x0001)
+#define FILE_WRITE_ACCESS                   (0x0002)
@@ -0,0 +1,167 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the policy that decides whether samples are acquired
+//    by polling on a timer or by the chip's threshold window interrupt. Time is
+//    passed in by the caller so the policy can be driven by a virtual clock.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "isl29018.h"
+
+// Interrupts are budgeted at one per data interval, measured over this many intervals.
+// Above that rate polling is cheaper, so the scheduler falls back to it.
+#define Scheduler_StormWindowIntervals      (8)
+
+// Number of consecutive polled samples that must stay inside the thresholds
+// before the scheduler goes back to interrupts
+#define Scheduler_SettleSamples             (16)
+
+// Polled samples at least this many conversion times apart are taken with
+// single conversions, so the chip powers down between samples
+#define Scheduler_OneShotIntervalFactor     (10)
+
+typedef enum
+{
+    AcquisitionMode_Polling = 0,
+    AcquisitionMode_Interrupt,
+} ACQUISITION_MODE;
+
+typedef class _AcquisitionScheduler
+{
+private:
+    ACQUISITION_MODE    m_Mode;
+    bool                m_InterruptPreferred;
+    bool                m_OneShotPreferred;
+    ULONG               m_IntervalMs;
+
+    // Interrupt rate measurement
+    ULONG               m_WindowStartMs;
+    ULONG               m_WindowInterrupts;
+
+    // Polling quiet period measurement
+    ULONG               m_QuietSamples;
+
+    // Counters
+    ULONG               m_SwitchesToPolling;
+    ULONG               m_SwitchesToInterrupt;
+
+public:
+    // Re-evaluate the preferred mode from the current settings. Counters are kept.
+    VOID Reset(
+        _In_ ULONG NowMs,                   // Current time in milliseconds
+        _In_ bool InterruptAvailable,       // An interrupt resource is connected and usable
+        _In_ ULONG IntervalMs,              // Requested data interval
+        _In_ FLOAT ThresholdPct,            // Relative lux threshold
+        _In_ FLOAT ThresholdAbs,            // Absolute lux threshold
+        _In_ ULONG ConversionTimeMs,        // Integration time at the current resolution
+        _In_ bool OneShotAllowed)           // Idle ADC time may be spent powered down
+    {
+        // Zero thresholds report every sample, and intervals shorter than a
+        // conversion at the current resolution ask for every sample too; the
+        // window would only add bus traffic.
+        m_InterruptPreferred = InterruptAvailable &&
+                               (ThresholdPct > 0.0f || ThresholdAbs > 0.0f) &&
+                               IntervalMs >= ConversionTimeMs;
+
+        m_OneShotPreferred = OneShotAllowed &&
+                             static_cast<ULONGLONG>(IntervalMs) >=
+                             static_cast<ULONGLONG>(ConversionTimeMs) * Scheduler_OneShotIntervalFactor;
+
+        m_IntervalMs = (IntervalMs == 0) ? 1 : IntervalMs;
+        m_Mode = m_InterruptPreferred ? AcquisitionMode_Interrupt : AcquisitionMode_Polling;
+        m_WindowStartMs = NowMs;
+        m_WindowInterrupts = 0;
+        m_QuietSamples = 0;
+    }
+
+    VOID ResetCounters()
+    {
+        m_SwitchesToPolling = 0;
+        m_SwitchesToInterrupt = 0;
+    }
+
+    // Account for an interrupt and return the mode to continue in
+    ACQUISITION_MODE OnInterrupt(
+        _In_ ULONG NowMs)
+    {
+        if (m_Mode != AcquisitionMode_Interrupt)
+        {
+            return m_Mode;
+        }
+
+        ULONG WindowMs = m_IntervalMs * Scheduler_StormWindowIntervals;
+        if (NowMs - m_WindowStartMs >= WindowMs)
+        {
+            m_WindowStartMs = NowMs;
+            m_WindowInterrupts = 0;
+        }
+
+        m_WindowInterrupts++;
+        if (m_WindowInterrupts > Scheduler_StormWindowIntervals)
+        {
+            m_Mode = AcquisitionMode_Polling;
+            m_QuietSamples = 0;
+            m_SwitchesToPolling++;
+        }
+
+        return m_Mode;
+    }
+
+    // Account for a polled sample and return the mode to continue in
+    ACQUISITION_MODE OnPolledSample(
+        _In_ ULONG NowMs,
+        _In_ bool Reported)                 // The sample exceeded the thresholds
+    {
+        if (m_Mode != AcquisitionMode_Polling || !m_InterruptPreferred)
+        {
+            return m_Mode;
+        }
+
+        m_QuietSamples = Reported ? 0 : m_QuietSamples + 1;
+        if (m_QuietSamples >= Scheduler_SettleSamples)
+        {
+            m_Mode = AcquisitionMode_Interrupt;
+            m_WindowStartMs = NowMs;
+            m_WindowInterrupts = 0;
+            m_SwitchesToInterrupt++;
+        }
+
+        return m_Mode;
+    }
+
+    // Account for a polled sample that was not converted and return the mode
+    // to continue in. It says nothing about the light, so the samples that
+    // must stay inside the thresholds are counted again.
+    ACQUISITION_MODE OnFailedSample()
+    {
+        m_QuietSamples = 0;
+
+        return m_Mode;
+    }
+
+    // The interrupt path failed, stay on polling until the next Reset
+    VOID DisableInterrupt()
+    {
+        if (m_Mode == AcquisitionMode_Interrupt)
+        {
+            m_SwitchesToPolling++;
+        }
+        m_InterruptPreferred = false;
+        m_Mode = AcquisitionMode_Polling;
+    }
+
+    ACQUISITION_MODE GetMode() const { return m_Mode; }
+
+    // Polled samples are taken with single conversions rather than continuous ones
+    bool UseOneShot() const { return m_Mode == AcquisitionMode_Polling && m_OneShotPreferred; }
+
+    ULONG GetSwitchesToPolling() const { return m_SwitchesToPolling; }
+    ULONG GetSwitchesToInterrupt() const { return m_SwitchesToInterrupt; }
+
+} AcquisitionScheduler, *PAcquisitionScheduler;
@@ -0,0 +1,183 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the policy that time-multiplexes the chip's single
+//    ADC between the ambient light and the proximity channel. Every conversion
+//    is a single one, so only one OPMODE write is in flight at any time. Time
+//    is passed in by the caller so the policy can be driven by a virtual clock.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "isl29018.h"
+
+typedef enum
+{
+    AdcChannel_Als = 0,
+    AdcChannel_Prox,
+    AdcChannel_Count,
+    AdcChannel_None = AdcChannel_Count,
+} ADC_CHANNEL;
+
+typedef class _AdcArbiter
+{
+private:
+    typedef struct _ADC_CHANNEL_STATE
+    {
+        bool    Active;
+        ULONG   IntervalMs;
+        ULONG   NextDueMs;      // Time the next result of the channel is due
+        ULONG   Conversions;
+        ULONG   MissedBeats;
+    } ADC_CHANNEL_STATE;
+
+    ADC_CHANNEL_STATE   m_Channels[AdcChannel_Count];
+    ADC_CHANNEL         m_InFlight;
+    ADC_CHANNEL         m_LastServed;
+
+    // Signed distance between two millisecond timestamps, robust to wrap-around
+    static LONG Distance(_In_ ULONG FromMs, _In_ ULONG ToMs)
+    {
+        return static_cast<LONG>(ToMs - FromMs);
+    }
+
+public:
+    VOID Reset()
+    {
+        for (ULONG i = 0; i < AdcChannel_Count; i++)
+        {
+            m_Channels[i] = {};
+        }
+        m_InFlight = AdcChannel_None;
+        m_LastServed = AdcChannel_None;
+    }
+
+    // Start, stop or change the interval of a channel. A started channel is due right away.
+    VOID SetChannel(
+        _In_ ADC_CHANNEL Channel,
+        _In_ bool Active,
+        _In_ ULONG IntervalMs,
+        _In_ ULONG NowMs)
+    {
+        ADC_CHANNEL_STATE* pState = &m_Channels[Channel];
+
+        if (Active && !pState->Active)
+        {
+            pState->NextDueMs = NowMs;
+            pState->Conversions = 0;
+            pState->MissedBeats = 0;
+        }
+
+        pState->Active = Active;
+        pState->IntervalMs = (IntervalMs == 0) ? 1 : IntervalMs;
+
+        if (!Active && m_InFlight == Channel)
+        {
+            m_InFlight = AdcChannel_None;
+        }
+    }
+
+    bool IsActive(_In_ ADC_CHANNEL Channel) const { return m_Channels[Channel].Active; }
+    ULONG GetIntervalMs(_In_ ADC_CHANNEL Channel) const { return m_Channels[Channel].IntervalMs; }
+
+    // Pick the channel whose next conversion has to start now to complete by
+    // its due time. The earliest due time wins, ties go to the channel that
+    // was not served last so that neither channel can starve the other.
+    ADC_CHANNEL PickNext(
+        _In_ ULONG NowMs,
+        _In_ ULONG ConversionTimeMs)
+    {
+        ADC_CHANNEL Next = AdcChannel_None;
+
+        if (m_InFlight != AdcChannel_None)
+        {
+            return AdcChannel_None;
+        }
+
+        for (ULONG i = 0; i < AdcChannel_Count; i++)
+        {
+            const ADC_CHANNEL_STATE* pState = &m_Channels[i];
+
+            if (!pState->Active || Distance(NowMs + ConversionTimeMs, pState->NextDueMs) > 0)
+            {
+                continue;
+            }
+
+            if (Next == AdcChannel_None)
+            {
+                Next = static_cast<ADC_CHANNEL>(i);
+                continue;
+            }
+
+            LONG Order = Distance(m_Channels[Next].NextDueMs, pState->NextDueMs);
+            if (Order < 0 || (Order == 0 && Next == m_LastServed))
+            {
+                Next = static_cast<ADC_CHANNEL>(i);
+            }
+        }
+
+        return Next;
+    }
+
+    VOID StartConversion(_In_ ADC_CHANNEL Channel) { m_InFlight = Channel; }
+
+    // Drop the conversion in flight, e.g. because the OPMODE register was rewritten
+    VOID CancelConversion() { m_InFlight = AdcChannel_None; }
+
+    ADC_CHANNEL GetInFlight() const { return m_InFlight; }
+
+    // Account for the completed conversion and schedule the next one of its
+    // channel one interval later. A channel that fell behind by a full beat
+    // drops the missed beats rather than catching up at the cost of the other.
+    VOID CompleteConversion(
+        _In_ ULONG NowMs)
+    {
+        if (m_InFlight == AdcChannel_None)
+        {
+            return;
+        }
+
+        ADC_CHANNEL_STATE* pState = &m_Channels[m_InFlight];
+
+        pState->Conversions++;
+        pState->NextDueMs += pState->IntervalMs;
+        if (Distance(NowMs, pState->NextDueMs) < 0)
+        {
+            pState->MissedBeats += (Distance(pState->NextDueMs, NowMs) / pState->IntervalMs) + 1;
+            pState->NextDueMs = NowMs + pState->IntervalMs;
+        }
+
+        m_LastServed = m_InFlight;
+        m_InFlight = AdcChannel_None;
+    }
+
+    // Time until the next conversion has to start, 0 if one is due already
+    ULONG GetWaitMs(
+        _In_ ULONG NowMs,
+        _In_ ULONG ConversionTimeMs) const
+    {
+        LONG WaitMs = -1;
+
+        for (ULONG i = 0; i < AdcChannel_Count; i++)
+        {
+            if (m_Channels[i].Active)
+            {
+                LONG ChannelWaitMs = Distance(NowMs + ConversionTimeMs, m_Channels[i].NextDueMs);
+                if (WaitMs < 0 || ChannelWaitMs < WaitMs)
+                {
+                    WaitMs = (ChannelWaitMs < 0) ? 0 : ChannelWaitMs;
+                }
+            }
+        }
+
+        return (WaitMs < 0) ? 0 : static_cast<ULONG>(WaitMs);
+    }
+
+    ULONG GetConversions(_In_ ADC_CHANNEL Channel) const { return m_Channels[Channel].Conversions; }
+    ULONG GetMissedBeats(_In_ ADC_CHANNEL Channel) const { return m_Channels[Channel].MissedBeats; }
+
+} AdcArbiter, *PAdcArbiter;
@@ -0,0 +1,228 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the auto-ranging state machine which walks the four
+//    COMMAND2 full-scale ranges based on raw conversion counts. It has no
+//    framework dependencies so it can be replayed against raw-count traces.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "isl29018.h"
+
+#define ISL29018_RANGE_COUNT                (4)
+
+// Switch to the next higher range above 15/16 of full scale and to the next
+// lower range below 1/16 of full scale. Ranges are 4x apart, so a sample lands
+// at about 23% of full scale after switching up and at 25% after switching down,
+// well inside both limits.
+#define AutoRange_LimitDenominator          (16)
+
+// Number of bits produced by a conversion at the given resolution
+constexpr ULONG Isl29018ResolutionBits(_In_ ULONG Resolution)
+{
+    return 16 - (4 * Resolution);
+}
+
+// Highest raw count produced by a conversion at the given resolution
+constexpr ULONG Isl29018MaxCount(_In_ ULONG Resolution)
+{
+    return (1UL << Isl29018ResolutionBits(Resolution)) - 1;
+}
+
+// Full-scale lux of a range: 1k, 4k, 16k or 64k
+constexpr FLOAT Isl29018RangeMaximumLux(_In_ ULONG Range)
+{
+    return 1000.0f * static_cast<FLOAT>(1UL << (2 * Range));
+}
+
+// Lux represented by one raw count of an isl29018_scales entry
+constexpr FLOAT Isl29018ScaleToLux(_In_ const isl29018_scale& Scale)
+{
+    return static_cast<FLOAT>(Scale.scale) + static_cast<FLOAT>(Scale.uscale) / 1000000.0f;
+}
+
+#define ISL29018_LUX_PER_COUNT_ROW(Resolution) \
+    { \
+        Isl29018ScaleToLux(isl29018_scales[Resolution][ISL29018_RANGE_1K]), \
+        Isl29018ScaleToLux(isl29018_scales[Resolution][ISL29018_RANGE_4K]), \
+        Isl29018ScaleToLux(isl29018_scales[Resolution][ISL29018_RANGE_16K]), \
+        Isl29018ScaleToLux(isl29018_scales[Resolution][ISL29018_RANGE_64K]), \
+    }
+
+// Lux per raw count indexed by [resolution][range], evaluated at compile time
+// so the conversion in GetData() is a single lookup and multiply
+static constexpr FLOAT isl29018_lux_per_count[4][ISL29018_RANGE_COUNT] = {
+    ISL29018_LUX_PER_COUNT_ROW(ISL29018_INT_TIME_16),
+    ISL29018_LUX_PER_COUNT_ROW(ISL29018_INT_TIME_12),
+    ISL29018_LUX_PER_COUNT_ROW(ISL29018_INT_TIME_8),
+    ISL29018_LUX_PER_COUNT_ROW(ISL29018_INT_TIME_4),
+};
+
+#undef ISL29018_LUX_PER_COUNT_ROW
+
+// The highest count of every resolution must map to the full-scale lux of the
+// range. isl29018_scales is truncated to micro-lux, so allow 0.1% of error.
+constexpr bool Isl29018IsFullScale(_In_ ULONG Resolution, _In_ ULONG Range)
+{
+    return isl29018_lux_per_count[Resolution][Range] * (static_cast<FLOAT>(Isl29018MaxCount(Resolution)) + 1.0f) >
+               Isl29018RangeMaximumLux(Range) * 0.999f &&
+           isl29018_lux_per_count[Resolution][Range] * (static_cast<FLOAT>(Isl29018MaxCount(Resolution)) + 1.0f) <=
+               Isl29018RangeMaximumLux(Range);
+}
+
+#define ISL29018_ASSERT_FULL_SCALE(Resolution)                                              \
+    static_assert(Isl29018IsFullScale(Resolution, ISL29018_RANGE_1K) &&                     \
+                  Isl29018IsFullScale(Resolution, ISL29018_RANGE_4K) &&                     \
+                  Isl29018IsFullScale(Resolution, ISL29018_RANGE_16K) &&                    \
+                  Isl29018IsFullScale(Resolution, ISL29018_RANGE_64K),                      \
+                  "isl29018_scales does not match the full-scale range at " #Resolution)
+
+ISL29018_ASSERT_FULL_SCALE(ISL29018_INT_TIME_16);
+ISL29018_ASSERT_FULL_SCALE(ISL29018_INT_TIME_12);
+ISL29018_ASSERT_FULL_SCALE(ISL29018_INT_TIME_8);
+ISL29018_ASSERT_FULL_SCALE(ISL29018_INT_TIME_4);
+
+#undef ISL29018_ASSERT_FULL_SCALE
+
+// Lux represented by one raw count, see isl29018_scales
+inline FLOAT Isl29018LuxPerCount(_In_ ULONG Resolution, _In_ ULONG Range)
+{
+    return isl29018_lux_per_count[Resolution][Range];
+}
+
+// Integration time of a conversion at the given resolution, see isl29018_int_utimes
+inline ULONG Isl29018ConversionTimeMs(_In_ ULONG Chip, _In_ ULONG Resolution)
+{
+    return (isl29018_int_utimes[Chip][Resolution] + 999) / 1000;
+}
+
+// Shortest data interval the chip can serve, using the fastest conversion
+inline ULONG Isl29018MinimumIntervalMs(_In_ ULONG Chip)
+{
+    return Isl29018ConversionTimeMs(Chip, ISL29018_INT_TIME_4);
+}
+
+// Highest resolution whose integration time fits into the data interval
+inline ULONG Isl29018SelectResolution(_In_ ULONG Chip, _In_ ULONG IntervalMs)
+{
+    ULONGLONG IntervalUs = static_cast<ULONGLONG>(IntervalMs) * 1000;
+
+    for (ULONG Resolution = ISL29018_INT_TIME_16; Resolution < ISL29018_INT_TIME_4; Resolution++)
+    {
+        if (isl29018_int_utimes[Chip][Resolution] <= IntervalUs)
+        {
+            return Resolution;
+        }
+    }
+
+    return ISL29018_INT_TIME_4;
+}
+
+typedef class _AutoRange
+{
+private:
+    ULONG               m_Range;
+    ULONG               m_Resolution;
+    bool                m_DiscardNext;
+    ULONG               m_SwitchCount;
+
+public:
+    VOID Reset(
+        _In_ ULONG Range,               // Range currently programmed in COMMAND2
+        _In_ ULONG Resolution)          // Resolution currently programmed in COMMAND2
+    {
+        m_Range = Range;
+        m_Resolution = Resolution;
+        m_DiscardNext = false;
+        m_SwitchCount = 0;
+    }
+
+    // Returns true when the sample was converted before the range switch took
+    // effect on the chip and must be dropped. Consumes the discard.
+    bool ConsumeDiscard()
+    {
+        bool Discard = m_DiscardNext;
+        m_DiscardNext = false;
+        return Discard;
+    }
+
+    // Evaluate a raw count converted at the current range. Returns true when the
+    // range was changed; the caller programs GetRange() into COMMAND2.
+    bool Evaluate(
+        _In_ ULONG RawCount)
+    {
+        ULONG NewRange = m_Range;
+
+        if (RawCount >= GetSaturationCount())
+        {
+            if (m_Range + 1 < ISL29018_RANGE_COUNT)
+            {
+                NewRange = m_Range + 1;
+            }
+        }
+        else if (RawCount < GetUnderRangeCount())
+        {
+            if (m_Range > 0)
+            {
+                NewRange = m_Range - 1;
+            }
+        }
+
+        if (NewRange == m_Range)
+        {
+            return false;
+        }
+
+        m_Range = NewRange;
+        m_DiscardNext = true;
+        m_SwitchCount++;
+        return true;
+    }
+
+    // Restrict an interrupt window to the counts at which Evaluate keeps the
+    // current range, so that leaving the range always raises an interrupt
+    VOID ClampWindow(
+        _Inout_ USHORT* pLowCount,
+        _Inout_ USHORT* pHighCount) const
+    {
+        if (m_Range + 1 < ISL29018_RANGE_COUNT && *pHighCount > GetSaturationCount())
+        {
+            *pHighCount = static_cast<USHORT>(GetSaturationCount());
+        }
+
+        if (m_Range > 0 && *pLowCount < GetUnderRangeCount())
+        {
+            *pLowCount = static_cast<USHORT>(GetUnderRangeCount());
+        }
+    }
+
+    // Change the resolution, the range is kept
+    VOID SetResolution(_In_ ULONG Resolution) { m_Resolution = Resolution; m_DiscardNext = true; }
+
+    VOID SetRange(_In_ ULONG Range) { m_Range = Range; }
+
+    ULONG GetRange() const { return m_Range; }
+    ULONG GetResolution() const { return m_Resolution; }
+    ULONG GetSwitchCount() const { return m_SwitchCount; }
+    FLOAT GetLuxPerCount() const { return Isl29018LuxPerCount(m_Resolution, m_Range); }
+    FLOAT GetRangeMaximumLux() const { return Isl29018RangeMaximumLux(m_Range); }
+
+    // Raw counts at and above which the next higher range is used
+    ULONG GetSaturationCount() const
+    {
+        ULONG MaxCount = Isl29018MaxCount(m_Resolution);
+        return MaxCount - (MaxCount / AutoRange_LimitDenominator);
+    }
+
+    // Raw counts below which the next lower range is used
+    ULONG GetUnderRangeCount() const
+    {
+        return (Isl29018MaxCount(m_Resolution) + 1) / AutoRange_LimitDenominator;
+    }
+
+} AutoRange, *PAutoRange;
@@ -0,0 +1,164 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the beat that paces polled samples. Time is a 64-bit
+//    monotonic count of 100ns ticks passed in by the caller, so the beat does
+//    not wrap during the life of the device and can be driven by a virtual
+//    clock. Beats are anchored at the epoch of the clock rather than at the
+//    time sampling started, which keeps the phase across interval changes and
+//    restarts, and keeps the beats of all chips of the device in step.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "isl29018.h"
+
+#define BeatScheduler_TicksPerMs            (10000ULL)
+
+// Most missed beats taken back to back under the burst policy, older ones are dropped
+#define BeatScheduler_MaxBurst              (4)
+
+// What to do with beats that passed before the previous sample was done
+typedef enum
+{
+    CatchUpPolicy_Skip = 0,     // Drop them and wait for the next beat
+    CatchUpPolicy_Coalesce,     // Take a single sample right away in place of all of them
+    CatchUpPolicy_Burst,        // Take them back to back, at most BeatScheduler_MaxBurst
+    CatchUpPolicy_Count
+} CATCH_UP_POLICY;
+
+typedef class _BeatScheduler
+{
+private:
+    CATCH_UP_POLICY     m_Policy;
+    ULONGLONG           m_Period;           // Ticks between beats
+    ULONGLONG           m_Deadline;         // Beat the next sample is due on
+
+    // Statistics
+    ULONGLONG           m_Beats;
+    ULONGLONG           m_MissedBeats;
+    LONGLONG            m_LastError;        // Ticks the previous sample was late, negative if early
+    ULONGLONG           m_ErrorSum;         // Sum of the absolute errors
+    ULONGLONG           m_MaxError;
+    ULONGLONG           m_JitterSum;        // Sum of the changes of the error from beat to beat
+    ULONGLONG           m_MaxJitter;
+
+    static ULONGLONG Magnitude(_In_ LONGLONG Value)
+    {
+        return static_cast<ULONGLONG>((Value < 0) ? -Value : Value);
+    }
+
+public:
+    // Reset the statistics, the beat itself starts with Start
+    VOID Reset(
+        _In_ ULONG Policy)
+    {
+        m_Policy = (Policy < CatchUpPolicy_Count) ? static_cast<CATCH_UP_POLICY>(Policy) : CatchUpPolicy_Coalesce;
+        m_Period = BeatScheduler_TicksPerMs;
+        m_Deadline = 0;
+
+        m_Beats = 0;
+        m_MissedBeats = 0;
+        m_LastError = 0;
+        m_ErrorSum = 0;
+        m_MaxError = 0;
+        m_JitterSum = 0;
+        m_MaxJitter = 0;
+    }
+
+    // Start, or change the interval of, the beat. The next sample is due on
+    // the first multiple of the interval after Now.
+    VOID Start(
+        _In_ ULONGLONG Now,
+        _In_ ULONG IntervalMs)
+    {
+        m_Period = ((IntervalMs == 0) ? 1 : IntervalMs) * BeatScheduler_TicksPerMs;
+        m_Deadline = Now - (Now % m_Period) + m_Period;
+    }
+
+    // Account for the sample just taken and move on to the next beat. A sample
+    // taken more than half an interval ahead of its beat, like the first one
+    // after a start, does not use up the beat.
+    VOID OnBeat(
+        _In_ ULONGLONG Now)
+    {
+        if (Now + (m_Period / 2) < m_Deadline)
+        {
+            return;
+        }
+
+        LONGLONG Error = static_cast<LONGLONG>(Now - m_Deadline);
+        ULONGLONG Jitter = (m_Beats == 0) ? 0 : Magnitude(Error - m_LastError);
+
+        m_Beats++;
+        m_ErrorSum += Magnitude(Error);
+        m_JitterSum += Jitter;
+        m_LastError = Error;
+        if (Magnitude(Error) > m_MaxError)
+        {
+            m_MaxError = Magnitude(Error);
+        }
+        if (Jitter > m_MaxJitter)
+        {
+            m_MaxJitter = Jitter;
+        }
+
+        m_Deadline += m_Period;
+        if (Now < m_Deadline)
+        {
+            return;
+        }
+
+        // The next beat passed already, and maybe more
+        ULONGLONG Missed = ((Now - m_Deadline) / m_Period) + 1;
+        ULONGLONG Dropped = 0;
+
+        switch (m_Policy)
+        {
+        case CatchUpPolicy_Skip:
+            Dropped = Missed;
+            break;
+
+        case CatchUpPolicy_Coalesce:
+            Dropped = Missed - 1;
+            break;
+
+        case CatchUpPolicy_Burst:
+        default:
+            Dropped = (Missed > BeatScheduler_MaxBurst) ? (Missed - BeatScheduler_MaxBurst) : 0;
+            break;
+        }
+
+        m_Deadline += Dropped * m_Period;
+        m_MissedBeats += Dropped;
+    }
+
+    // Ticks between Now and the beat the next sample is due on, early or late
+    ULONGLONG GetDeadlineError(
+        _In_ ULONGLONG Now) const
+    {
+        return Magnitude(static_cast<LONGLONG>(Now - m_Deadline));
+    }
+
+    // Ticks until the next sample is due, 0 if it is due already
+    ULONGLONG GetWait(
+        _In_ ULONGLONG Now) const
+    {
+        return (m_Deadline > Now) ? (m_Deadline - Now) : 0;
+    }
+
+    CATCH_UP_POLICY GetPolicy() const { return m_Policy; }
+    ULONGLONG GetBeats() const { return m_Beats; }
+    ULONGLONG GetMissedBeats() const { return m_MissedBeats; }
+
+    // Deadline error and jitter statistics, in ticks
+    ULONGLONG GetMeanError() const { return (m_Beats == 0) ? 0 : (m_ErrorSum / m_Beats); }
+    ULONGLONG GetMaxError() const { return m_MaxError; }
+    ULONGLONG GetMeanJitter() const { return (m_Beats <= 1) ? 0 : (m_JitterSum / (m_Beats - 1)); }
+    ULONGLONG GetMaxJitter() const { return m_MaxJitter; }
+
+} BeatScheduler, *PBeatScheduler;
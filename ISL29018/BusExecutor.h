@@ -0,0 +1,517 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the executor that owns the chip's I2C target. Every
+//    register access of the driver is submitted to it as a list of bus
+//    operations that runs back to back while the executor holds the bus. No
+//    driver code runs while the bus is held, so the bus is always taken last
+//    and cannot be taken twice by the same caller.
+//
+//    A register write is one I2C write of the address followed by the data. A
+//    register read is one SPB sequence: the address is written, then the data
+//    is read after a repeated start, so no other master can move the register
+//    pointer in between and the read costs one request instead of two.
+//
+//    The write and sequence requests and their buffers are allocated once when
+//    the target is connected and reused for every transfer, so sampling does
+//    not allocate. A register read may also be submitted asynchronously: the
+//    bus is then held until the read completes and released by its completion
+//    routine, which is why the bus is an event rather than a wait lock.
+//
+//    Built with ISL29018_BUS_MODEL, the executor binds to an Isl29018Model
+//    instead of an I2C target and calls no framework function, so the
+//    driver's bus access runs against the simulated chip on any host that
+//    provides the types. The model completes every transfer before the send
+//    returns.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include <windows.h>
+#include <wdf.h>
+
+#include "LatencyHistogram.h"
+
+#ifdef ISL29018_BUS_MODEL
+#include "Isl29018Model.h"
+#else
+#include <spb.h>
+#endif
+
+// Largest register block read or written by one operation
+#define BusExecutor_MaxTransfer             (8)
+
+typedef enum
+{
+    BusOperation_Read = 0,
+    BusOperation_Write,
+} BUS_OPERATION_TYPE;
+
+typedef struct _BUS_OPERATION
+{
+    BUS_OPERATION_TYPE  Type;
+    BYTE                Register;
+    BYTE*               pBuffer;
+    ULONG               Size;
+} BUS_OPERATION, *PBUS_OPERATION;
+
+// Called once an asynchronous read completed and the bus was released. The
+// callback may submit synchronous operations, but no further asynchronous read.
+typedef VOID BUS_READ_COMPLETION(_In_ PVOID Context, _In_ NTSTATUS Status);
+typedef BUS_READ_COMPLETION *PFN_BUS_READ_COMPLETION;
+
+typedef class _BusExecutor
+{
+private:
+    WDFIOTARGET         m_IoTarget;
+    HANDLE              m_BusFree;          // Auto-reset, signaled while nobody holds the bus
+    HANDLE              m_AsyncIdle;        // Manual-reset, signaled while no asynchronous read is in flight
+
+    // Preallocated requests and buffers, used by the holder of the bus. The
+    // sequence writes the address from m_WriteBuffer and reads into m_ReadBuffer.
+    WDFREQUEST          m_WriteRequest;
+    WDFREQUEST          m_SequenceRequest;
+    WDFMEMORY           m_WriteMemory;
+    WDFMEMORY           m_SequenceMemory;
+    BYTE                m_WriteBuffer[1 + BusExecutor_MaxTransfer];     // Register address, then data
+    BYTE                m_ReadBuffer[BusExecutor_MaxTransfer];
+#ifndef ISL29018_BUS_MODEL
+    SPB_TRANSFER_LIST_AND_ENTRIES(2) m_Sequence;
+#endif
+
+    // Asynchronous read in flight
+    BYTE*                   m_pAsyncBuffer;
+    ULONG                   m_AsyncSize;
+    PFN_BUS_READ_COMPLETION m_pfnAsyncCompletion;
+    PVOID                   m_AsyncContext;
+
+    // Submitters waiting for or holding the bus
+    volatile LONG       m_Depth;
+    volatile LONG       m_MaxDepth;
+
+    // Statistics, updated while the bus is held
+    ULONGLONG           m_HoldStart;
+    ULONGLONG           m_Submissions;
+    ULONGLONG           m_Failures;
+    ULONGLONG           m_HoldTime;         // 100ns
+    ULONGLONG           m_MaxHoldTime;
+    PLatencyHistogram   m_pLatency;         // Receives the hold time of every submission
+
+#ifdef ISL29018_BUS_MODEL
+    PIsl29018Model      m_pModel;           // Takes the transfers in place of m_IoTarget
+#endif
+
+    static ULONGLONG Now()
+    {
+        ULONGLONG Time = 0;
+        QueryInterruptTimePrecise(&Time);
+        return Time;
+    }
+
+    VOID Acquire()
+    {
+        LONG Depth = InterlockedIncrement(&m_Depth);
+        LONG MaxDepth = ReadAcquire(&m_MaxDepth);
+        while (Depth > MaxDepth)
+        {
+            LONG Previous = InterlockedCompareExchange(&m_MaxDepth, Depth, MaxDepth);
+            if (Previous == MaxDepth)
+            {
+                break;
+            }
+            MaxDepth = Previous;
+        }
+
+        WaitForSingleObject(m_BusFree, INFINITE);
+        m_HoldStart = Now();
+    }
+
+    VOID Release(
+        _In_ NTSTATUS Status)
+    {
+        ULONGLONG HoldTime = Now() - m_HoldStart;
+        m_Submissions++;
+        m_Failures += NT_SUCCESS(Status) ? 0 : 1;
+        m_HoldTime += HoldTime;
+        if (HoldTime > m_MaxHoldTime)
+        {
+            m_MaxHoldTime = HoldTime;
+        }
+        if (nullptr != m_pLatency)
+        {
+            m_pLatency->Record(LatencyStage_Bus, HoldTime);
+        }
+
+        SetEvent(m_BusFree);
+        InterlockedDecrement(&m_Depth);
+    }
+
+#ifndef ISL29018_BUS_MODEL
+    // Make a preallocated request ready to transfer Length bytes on the bus:
+    // the address and data for the write request, the address and the data
+    // read back for the sequence request
+    NTSTATUS Format(
+        _In_ WDFREQUEST Request,
+        _In_ ULONG Length)
+    {
+        WDF_REQUEST_REUSE_PARAMS ReuseParams;
+        WDF_REQUEST_REUSE_PARAMS_INIT(&ReuseParams, WDF_REQUEST_REUSE_NO_FLAGS, STATUS_SUCCESS);
+
+        NTSTATUS Status = WdfRequestReuse(Request, &ReuseParams);
+        if (NT_SUCCESS(Status) && Request == m_WriteRequest)
+        {
+            WDFMEMORY_OFFSET Offset = { 0, Length };
+            Status = WdfIoTargetFormatRequestForWrite(m_IoTarget, Request, m_WriteMemory, &Offset, NULL);
+        }
+        else if (NT_SUCCESS(Status))
+        {
+            m_Sequence.List.Transfers[1].Buffer.Simple.BufferCb = Length - 1;
+            Status = WdfIoTargetFormatRequestForIoctl(m_IoTarget, Request, IOCTL_SPB_EXECUTE_SEQUENCE,
+                                                      m_SequenceMemory, NULL, NULL, NULL);
+        }
+
+        return Status;
+    }
+#endif
+
+    static NTSTATUS GetTransferStatus(
+        _In_ NTSTATUS Status,
+        _In_ ULONG_PTR Transferred,
+        _In_ ULONG Length)
+    {
+        return (NT_SUCCESS(Status) && Transferred != Length) ? STATUS_DEVICE_PROTOCOL_ERROR : Status;
+    }
+
+#ifdef ISL29018_BUS_MODEL
+    // Transfer Length bytes of the request to or from the model, as Format
+    // counts them. Returns the bytes transferred.
+    ULONG SendToModel(
+        _In_ WDFREQUEST Request,
+        _In_ ULONG Length)
+    {
+        return (Request == m_WriteRequest) ?
+               m_pModel->Write(m_WriteBuffer, Length) :
+               m_pModel->WriteRead(m_WriteBuffer, 1, m_ReadBuffer, Length - 1);
+    }
+
+    NTSTATUS SendSynchronously(
+        _In_ WDFREQUEST Request,
+        _In_ ULONG Length)
+    {
+        if (nullptr == m_pModel)
+        {
+            return STATUS_INVALID_DEVICE_STATE;
+        }
+
+        return GetTransferStatus(STATUS_SUCCESS, SendToModel(Request, Length), Length);
+    }
+
+    NTSTATUS SendAsynchronously(
+        _In_ WDFREQUEST Request,
+        _In_ ULONG Length,
+        _In_ EVT_WDF_REQUEST_COMPLETION_ROUTINE* pfnCompletion)
+    {
+        if (nullptr == m_pModel)
+        {
+            return STATUS_INVALID_DEVICE_STATE;
+        }
+
+        WDF_REQUEST_COMPLETION_PARAMS Params = {};
+        Params.IoStatus.Status = STATUS_SUCCESS;
+        Params.IoStatus.Information = SendToModel(Request, Length);
+
+        pfnCompletion(Request, NULL, &Params, reinterpret_cast<WDFCONTEXT>(this));
+        return STATUS_SUCCESS;
+    }
+#else
+    NTSTATUS SendSynchronously(
+        _In_ WDFREQUEST Request,
+        _In_ ULONG Length)
+    {
+        NTSTATUS Status = Format(Request, Length);
+        if (NT_SUCCESS(Status))
+        {
+            WDF_REQUEST_SEND_OPTIONS Options;
+            WDF_REQUEST_SEND_OPTIONS_INIT(&Options, WDF_REQUEST_SEND_OPTION_SYNCHRONOUS);
+
+            WdfRequestSetCompletionRoutine(Request, NULL, NULL);
+            WdfRequestSend(Request, m_IoTarget, &Options);
+            Status = GetTransferStatus(WdfRequestGetStatus(Request), WdfRequestGetInformation(Request), Length);
+        }
+
+        return Status;
+    }
+
+    NTSTATUS SendAsynchronously(
+        _In_ WDFREQUEST Request,
+        _In_ ULONG Length,
+        _In_ EVT_WDF_REQUEST_COMPLETION_ROUTINE* pfnCompletion)
+    {
+        NTSTATUS Status = Format(Request, Length);
+        if (NT_SUCCESS(Status))
+        {
+            WdfRequestSetCompletionRoutine(Request, pfnCompletion, reinterpret_cast<WDFCONTEXT>(this));
+            if (FALSE == WdfRequestSend(Request, m_IoTarget, WDF_NO_SEND_OPTIONS))
+            {
+                Status = WdfRequestGetStatus(Request);
+            }
+        }
+
+        return Status;
+    }
+#endif
+
+    NTSTATUS Transfer(
+        _In_ const BUS_OPERATION* pOperation)
+    {
+        NTSTATUS Status = STATUS_SUCCESS;
+
+        if (pOperation->Size > BusExecutor_MaxTransfer)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        m_WriteBuffer[0] = pOperation->Register;
+
+        if (BusOperation_Write == pOperation->Type)
+        {
+            memcpy(&m_WriteBuffer[1], pOperation->pBuffer, pOperation->Size);
+            Status = SendSynchronously(m_WriteRequest, 1 + pOperation->Size);
+        }
+        else
+        {
+            Status = SendSynchronously(m_SequenceRequest, 1 + pOperation->Size);
+            if (NT_SUCCESS(Status))
+            {
+                memcpy(pOperation->pBuffer, m_ReadBuffer, pOperation->Size);
+            }
+        }
+
+        return Status;
+    }
+
+    VOID CompleteAsync(
+        _In_ NTSTATUS Status)
+    {
+        PFN_BUS_READ_COMPLETION pfnCompletion = m_pfnAsyncCompletion;
+        PVOID Context = m_AsyncContext;
+
+        Release(Status);
+        pfnCompletion(Context, Status);
+        SetEvent(m_AsyncIdle);
+    }
+
+    static VOID OnAsyncDataRead(
+        _In_ WDFREQUEST Request,
+        _In_ WDFIOTARGET Target,
+        _In_ PWDF_REQUEST_COMPLETION_PARAMS Params,
+        _In_ WDFCONTEXT Context)
+    {
+        UNREFERENCED_PARAMETER(Request);
+        UNREFERENCED_PARAMETER(Target);
+
+        _BusExecutor* pBus = reinterpret_cast<_BusExecutor*>(Context);
+        NTSTATUS Status = GetTransferStatus(Params->IoStatus.Status, Params->IoStatus.Information, 1 + pBus->m_AsyncSize);
+        if (NT_SUCCESS(Status))
+        {
+            memcpy(pBus->m_pAsyncBuffer, pBus->m_ReadBuffer, pBus->m_AsyncSize);
+        }
+
+        pBus->CompleteAsync(Status);
+    }
+
+public:
+    // Create the bus and the preallocated buffers, the requests are created
+    // once the target is connected
+    NTSTATUS Initialize(
+        _In_ WDFOBJECT Parent,
+        _In_opt_ PLatencyHistogram pLatency)
+    {
+        NTSTATUS Status = STATUS_SUCCESS;
+
+        m_IoTarget = NULL;
+        m_pLatency = pLatency;
+        m_WriteRequest = NULL;
+        m_SequenceRequest = NULL;
+        m_WriteMemory = NULL;
+        m_SequenceMemory = NULL;
+        ResetCounters();
+
+        m_BusFree = CreateEventW(NULL, FALSE, TRUE, NULL);
+        m_AsyncIdle = CreateEventW(NULL, TRUE, TRUE, NULL);
+        if (NULL == m_BusFree || NULL == m_AsyncIdle)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+#ifdef ISL29018_BUS_MODEL
+        UNREFERENCED_PARAMETER(Parent);
+        m_pModel = nullptr;
+#else
+        WDF_OBJECT_ATTRIBUTES Attributes;
+        WDF_OBJECT_ATTRIBUTES_INIT(&Attributes);
+        Attributes.ParentObject = Parent;
+
+        // The sequence's read length is set for every read by Format
+        SPB_TRANSFER_LIST_INIT(&m_Sequence.List, 2);
+        m_Sequence.List.Transfers[0] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(SpbTransferDirectionToDevice, 0, m_WriteBuffer, 1);
+        m_Sequence.List.Transfers[1] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(SpbTransferDirectionFromDevice, 0, m_ReadBuffer, 0);
+
+        Status = WdfMemoryCreatePreallocated(&Attributes, m_WriteBuffer, sizeof(m_WriteBuffer), &m_WriteMemory);
+        if (NT_SUCCESS(Status))
+        {
+            Status = WdfMemoryCreatePreallocated(&Attributes, &m_Sequence, sizeof(m_Sequence), &m_SequenceMemory);
+        }
+#endif
+
+        return Status;
+    }
+
+    VOID Deinitialize()
+    {
+        if (NULL != m_AsyncIdle)
+        {
+            WaitForAsync();
+            CloseHandle(m_AsyncIdle);
+            m_AsyncIdle = NULL;
+        }
+        if (NULL != m_BusFree)
+        {
+            CloseHandle(m_BusFree);
+            m_BusFree = NULL;
+        }
+    }
+
+#ifdef ISL29018_BUS_MODEL
+    // Send the transfers to the chip model. The requests only tell the
+    // write and the sequence apart.
+    NTSTATUS Connect(
+        _In_ PIsl29018Model pModel)
+    {
+        m_WriteRequest = reinterpret_cast<WDFREQUEST>(m_WriteBuffer);
+        m_SequenceRequest = reinterpret_cast<WDFREQUEST>(m_ReadBuffer);
+        m_pModel = pModel;
+
+        return STATUS_SUCCESS;
+    }
+#else
+    // Create the requests for the opened I2C target, they go away with it
+    NTSTATUS Connect(
+        _In_ WDFIOTARGET IoTarget)
+    {
+        NTSTATUS Status = STATUS_SUCCESS;
+        WDF_OBJECT_ATTRIBUTES Attributes;
+
+        WDF_OBJECT_ATTRIBUTES_INIT(&Attributes);
+        Attributes.ParentObject = IoTarget;
+
+        Status = WdfRequestCreate(&Attributes, IoTarget, &m_WriteRequest);
+        if (NT_SUCCESS(Status))
+        {
+            Status = WdfRequestCreate(&Attributes, IoTarget, &m_SequenceRequest);
+        }
+        if (NT_SUCCESS(Status))
+        {
+            m_IoTarget = IoTarget;
+        }
+
+        return Status;
+    }
+#endif
+
+    VOID ResetCounters()
+    {
+        m_Depth = 0;
+        m_MaxDepth = 0;
+        m_Submissions = 0;
+        m_Failures = 0;
+        m_HoldTime = 0;
+        m_MaxHoldTime = 0;
+    }
+
+    // Run the operations in order without letting another submitter in between.
+    // The list stops at the first failed operation.
+    NTSTATUS Execute(
+        _In_reads_(Count) const BUS_OPERATION* pOperations,
+        _In_ ULONG Count)
+    {
+        NTSTATUS Status = STATUS_SUCCESS;
+
+        Acquire();
+
+        for (ULONG i = 0; i < Count && NT_SUCCESS(Status); i++)
+        {
+            Status = Transfer(&pOperations[i]);
+        }
+
+        Release(Status);
+
+        return Status;
+    }
+
+    NTSTATUS Read(
+        _In_ BYTE Register,
+        _Out_writes_bytes_(Size) BYTE* pBuffer,
+        _In_ ULONG Size)
+    {
+        BUS_OPERATION Operation = { BusOperation_Read, Register, pBuffer, Size };
+        return Execute(&Operation, 1);
+    }
+
+    NTSTATUS Write(
+        _In_ BYTE Register,
+        _In_ BYTE Value)
+    {
+        BUS_OPERATION Operation = { BusOperation_Write, Register, &Value, sizeof(Value) };
+        return Execute(&Operation, 1);
+    }
+
+    // Read registers without blocking the caller for the transfer. pBuffer has
+    // to stay valid until pfnCompletion is called, which may happen before
+    // this returns if the read could not be sent.
+    VOID ReadAsync(
+        _In_ BYTE Register,
+        _Out_writes_bytes_(Size) BYTE* pBuffer,
+        _In_ ULONG Size,
+        _In_ PFN_BUS_READ_COMPLETION pfnCompletion,
+        _In_ PVOID Context)
+    {
+        NTSTATUS Status = STATUS_SUCCESS;
+
+        Acquire();
+        ResetEvent(m_AsyncIdle);
+
+        m_pAsyncBuffer = pBuffer;
+        m_AsyncSize = Size;
+        m_pfnAsyncCompletion = pfnCompletion;
+        m_AsyncContext = Context;
+
+        m_WriteBuffer[0] = Register;
+        Status = (Size > BusExecutor_MaxTransfer) ?
+                 STATUS_INVALID_PARAMETER :
+                 SendAsynchronously(m_SequenceRequest, 1 + Size, OnAsyncDataRead);
+        if (!NT_SUCCESS(Status))
+        {
+            CompleteAsync(Status);
+        }
+    }
+
+    // Wait until the asynchronous read in flight, if any, called back
+    VOID WaitForAsync()
+    {
+        WaitForSingleObject(m_AsyncIdle, INFINITE);
+    }
+
+    ULONGLONG GetSubmissions() const { return m_Submissions; }
+    ULONGLONG GetFailures() const { return m_Failures; }
+    ULONG GetMaxDepth() const { return static_cast<ULONG>(m_MaxDepth); }
+
+    // Time the bus was held per submission, in 100ns
+    ULONGLONG GetMeanHoldTime() const { return (m_Submissions == 0) ? 0 : (m_HoldTime / m_Submissions); }
+    ULONGLONG GetMaxHoldTime() const { return m_MaxHoldTime; }
+
+} BusExecutor, *PBusExecutor;
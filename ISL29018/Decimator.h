@@ -0,0 +1,79 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the oversampling policy and the box filter that
+//    decimates the extra conversions taken in the otherwise idle part of a
+//    data interval. Averaging N conversions lowers the noise by sqrt(N), half
+//    a bit per doubling. It has no framework dependencies so it can be
+//    exercised off-target.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "isl29018.h"
+
+// Most conversions averaged into one sample, 2 extra bits
+#define Oversample_MaxConversions           (16)
+
+// Readings below full scale shifted by this many bits count as low light. At
+// higher counts the quantization is already well below the chip's noise.
+#define Oversample_LowLightShift            (4)
+
+// Conversions that fit into one data interval, 1 if oversampling does not pay.
+// Every conversion costs one more bus read, so the count is bounded.
+inline ULONG OversampleConversions(
+    _In_ ULONG IntervalMs,
+    _In_ ULONG ConversionTimeMs)
+{
+    ULONG Conversions = (ConversionTimeMs == 0) ? 1 : (IntervalMs / ConversionTimeMs);
+
+    if (Conversions < 1)
+    {
+        return 1;
+    }
+
+    return (Conversions > Oversample_MaxConversions) ? Oversample_MaxConversions : Conversions;
+}
+
+// Low enough to be worth oversampling
+inline bool OversampleIsLowLight(
+    _In_ ULONG RawCount,
+    _In_ ULONG MaxCount)
+{
+    return RawCount < (MaxCount >> Oversample_LowLightShift);
+}
+
+// First order CIC, i.e. a box filter that is read out once per sample
+typedef class _Decimator
+{
+private:
+    ULONG               m_Sum;
+    ULONG               m_Count;
+
+public:
+    VOID Reset()
+    {
+        m_Sum = 0;
+        m_Count = 0;
+    }
+
+    VOID Add(
+        _In_ ULONG RawCount)
+    {
+        m_Sum += RawCount;
+        m_Count++;
+    }
+
+    ULONG GetCount() const { return m_Count; }
+
+    // Mean of the accumulated conversions, in fractional counts
+    FLOAT GetMean() const
+    {
+        return (m_Count == 0) ? 0.0f : static_cast<FLOAT>(m_Sum) / static_cast<FLOAT>(m_Count);
+    }
+
+} Decimator, *PDecimator;
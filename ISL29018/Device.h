@@ -15,6 +15,7 @@
 #include <wdf.h>
 #include <cmath>
 #include <reshub.h>
+#include <sddl.h>
 #include <strsafe.h>
 
 #include <SensorsDef.h>
@@ -23,6 +24,24 @@
 #include <SensorsDriversUtils.h>
 
 #include "isl29018.h"
+#include "BusExecutor.h"
+#include "LatencyHistogram.h"
+#include "SampleCounters.h"
+#include "DeviceLifecycle.h"
+#include "ThresholdWindow.h"
+#include "AcquisitionScheduler.h"
+#include "BeatScheduler.h"
+#include "AutoRange.h"
+#include "IrCompensation.h"
+#include "NoiseFilter.h"
+#include "Decimator.h"
+#include "AdcArbiter.h"
+#include "SampleFifo.h"
+#include "SampleRing.h"
+#include "SamplePipeline.h"
+#include "SampleRecorder.h"
+#include "SampleHistory.h"
+#include "SamplePublisher.h"
 #include "SensorsTrace.h"
 
 
@@ -44,6 +63,8 @@ typedef enum
     SENSOR_PROPERTY_MAX_DATA_FIELD_SIZE,
     SENSOR_PROPERTY_TYPE,
     SENSOR_PROPERTY_ALS_RESPONSE_CURVE,
+    SENSOR_PROPERTY_FIFO_RESERVED_SIZE,
+    SENSOR_PROPERTY_FIFO_MAX_SIZE,
     SENSOR_PROPERTIES_COUNT
 } SENSOR_PROPERTIES_INDEX;
 
@@ -66,6 +87,7 @@ typedef enum
 {
     ALS_DATA_TIMESTAMP = 0,
     ALS_DATA_LUX,
+    ALS_DATA_IR_COUNT,
     ALS_DATA_COUNT
 } ALS_DATA_INDEX;
 
@@ -100,43 +122,129 @@ const REGISTER_SETTING g_ConfigurationSettings[] =
     // Standby mode
     { ISL29018_REG_ADD_COMMAND1, 0x00 },
 
-    // 16bit resolution & 4k Lux fullscale range
-    { ISL29018_REG_ADD_COMMAND2, 0x01 },
+    // Ambient rejecting proximity scheme, 16bit resolution & 4k Lux fullscale range
+    { ISL29018_REG_ADD_COMMAND2, (ISL29018_CMD2_SCHEME_AMBIENT_REJECT << ISL29018_CMD2_SCHEME_SHIFT) |
+                                 (ISL29018_INT_TIME_16 << ISL29018_CMD2_RESOLUTION_SHIFT) |
+                                 (ISL29018_RANGE_4K << ISL29018_CMD2_RANGE_SHIFT) },
 };
 
+// Part whose integration times apply, see isl29018_int_utimes
+#define AlsDevice_Chip                            (ISL29018_CHIP_29018)
 
+// Range and resolution matching the configuration above
+#define AlsDevice_Initial_Range                   (ISL29018_RANGE_4K)
+#define AlsDevice_Initial_Resolution              (ISL29018_INT_TIME_16)
+#define AlsDevice_Minimum_Lux                     (0.0f)
 
-typedef class _AlsDevice
+// Share of the IR reading that is subtracted from the ALS reading. This depends
+// on the cover glass and ink above the sensor and should be characterized per design.
+#define AlsDevice_IrCoefficient                   (0.25f)
+
+// Chips supported under one device node. Every chip has its own I2C connection
+// resource; interrupts are assigned to the chips in the order they are listed.
+#define AlsDevice_MaxChips                        (4)
+
+typedef struct _CHIP_RESOURCES
 {
-private:
-    // Internal struct used to store thresholds
-    typedef struct _AlsThresholdData
-    {
-        FLOAT LuxPct;
-        FLOAT LuxAbs;
-    } AlsThresholdData;
+    LARGE_INTEGER                       I2CConnId;
+    PCM_PARTIAL_RESOURCE_DESCRIPTOR     InterruptRaw;           // NULL if the chip has no interrupt
+    PCM_PARTIAL_RESOURCE_DESCRIPTOR     InterruptTranslated;
+} CHIP_RESOURCES, *PCHIP_RESOURCES;
+
+// Persistent unique ID of a sensor on the given chip. The first chip keeps the
+// base ID, so single chip systems keep the ID they had before.
+inline GUID ChipUniqueId(
+    _In_ const GUID& BaseId,
+    _In_ ULONG ChipIndex)
+{
+    GUID Id = BaseId;
+    Id.Data1 += ChipIndex;
+    return Id;
+}
+
+
+
+// The proximity sensor instance, see ProxDevice.h
+typedef class _ProxDevice *PProxDevice;
+
+// The conversion and threshold state of the sample path lives in the
+// SamplePipeline base, see SamplePipeline.h
+typedef class _AlsDevice : public SamplePipeline
+{
+    // The proximity sensor instance runs on the chip owned by this one
+    friend class _ProxDevice;
 
 private:
     // WDF
     WDFDEVICE                   m_Device;
     WDFIOTARGET                 m_I2CIoTarget;
-    WDFWAITLOCK                 m_I2CWaitLock;
     WDFINTERRUPT                m_Interrupt;
     WDFTIMER                    m_Timer;
+    WDFTIMER                    m_BatchTimer;
+    WDFWAITLOCK                 m_FifoWaitLock;
+    WDFWORKITEM                 m_DeliveryWorkItem;
+
+    // Held by every callback that starts, stops or reconfigures acquisition on
+    // the chip, from either sensor, and by power transitions. The ADC schedule
+    // and the interrupt work item run under it too. The beat of the light sensor alone does not take
+    // it: a callback holding it stops the beat before it changes anything
+    // and restarts it afterwards.
+    WDFWAITLOCK                 m_ControlLock;
+
+    // Position of the chip's resources in the resource list
+    ULONG                       m_ChipIndex;
+
+    // All register accesses go through m_Bus. The beat's sample is read
+    // asynchronously into m_SampleBuffer, the interrupt's sample is read by the
+    // ISR into m_InterruptBuffer under the interrupt lock. Each is stamped
+    // with the time its read was started, and the matching 100ns tick for
+    // the latency histograms. m_InterruptPending is set while the interrupt's
+    // sample waits for the work item, which copies it out under the lock.
+    BusExecutor                 m_Bus;
+    BYTE                        m_SampleBuffer[ISL29018_STATUS_SIZE_BYTES];
+    FILETIME                    m_SampleTime;
+    ULONGLONG                   m_SampleTicks;
+    BYTE                        m_InterruptBuffer[ISL29018_STATUS_SIZE_BYTES];
+    FILETIME                    m_InterruptTime;
+    ULONGLONG                   m_InterruptTicks;
+    bool                        m_InterruptPending;
+    LatencyHistogram            m_Latency;
+    SampleCounters              m_Counters;
+
+    // The last converted samples, reported or not, for IOCTL_ISL29018_GET_HISTORY
+    SampleHistory               m_History;
 
     // Sensor Operation
-    bool                        m_PoweredOn;
-    bool                        m_Started;
+    DeviceLifecycle             m_Lifecycle;
     ULONG                       m_Interval;
     ULONG                       m_MinimumInterval;
+    BeatScheduler               m_Beat;
+
+    // Extra conversions averaged into a sample at low light
+    bool                        m_OversampleEnabled;
+    ULONG                       m_OversampleReads;      // Conversions left to read before the beat
+
+    // Samples on their way from acquisition to the delivery work item
+    SampleRing                  m_Ring;
 
-    bool                        m_FirstSample;
-    ULONG                       m_StartTime;
-    ULONGLONG                   m_SampleCount;
+    // Samples held back while the clx asked for batched reports
+    ULONG                       m_BatchLatency;
+    SampleFifo                  m_Fifo;
 
-    AlsThresholdData            m_CachedThresholds;
-    FLOAT                       m_CachedData;
-    FLOAT                       m_LastSample;
+    // Raw samples recorded to a mapped file, if the RecordFile setting is present
+    SampleRecorder              m_Recorder;
+    HANDLE                      m_RecordFile;
+    HANDLE                      m_RecordMapping;
+    PVOID                       m_pRecordView;
+
+    // The last reported sample, published for other processes to read
+    SamplePublisher             m_Publisher;
+    HANDLE                      m_SharedMapping;
+    PISL29018_SHARED_SAMPLE     m_pSharedView;
+
+    // Proximity channel sharing the ADC
+    PProxDevice                 m_pProx;
+    AdcArbiter                  m_Arbiter;
 
     SENSOROBJECT                m_SensorInstance;
 
@@ -167,33 +275,116 @@ public:
     static EVT_SENSOR_DRIVER_GET_DATA_THRESHOLDS        OnGetDataThresholds;
     static EVT_SENSOR_DRIVER_SET_DATA_THRESHOLDS        OnSetDataThresholds;
     static EVT_SENSOR_DRIVER_DEVICE_IO_CONTROL          OnIoControl;
+    static EVT_SENSOR_DRIVER_SET_BATCH_LATENCY          OnSetBatchLatency;
 
     // Interrupt callbacks
     static EVT_WDF_INTERRUPT_ISR       OnInterruptIsr;
     static EVT_WDF_INTERRUPT_WORKITEM  OnInterruptWorkItem;
     static VOID                        OnTimerExpire(_In_ WDFTIMER Timer);
+    static BUS_READ_COMPLETION         OnSampleRead;
+    static VOID                        OnBatchTimerExpire(_In_ WDFTIMER Timer);
+    static EVT_WDF_WORKITEM            OnDeliveryWorkItem;
+
+    // Find the light sensor instances, one per chip, among the sensors of the device
+    static ULONG                       GetAllFromDevice(_In_ WDFDEVICE Device,
+                                                        _Out_writes_(MaxCount) _AlsDevice** ppDevices,
+                                                        _In_ ULONG MaxCount);
+    static _AlsDevice*                 GetFromInterrupt(_In_ WDFINTERRUPT Interrupt);
 
 private:
     NTSTATUS                    GetData();
+    NTSTATUS                    ProcessData(_In_ NTSTATUS ReadStatus,
+                                            _In_reads_(ISL29018_STATUS_SIZE_BYTES) const BYTE* pStatusBuffer,
+                                            _In_ const FILETIME* pCaptureTime,
+                                            _Out_ PSAMPLE_OUTCOME pOutcome);
+    NTSTATUS                    GetIrData();
+    NTSTATUS                    GetOversample();
+    ULONG                       GetOversampleConversions() const;
     NTSTATUS                    UpdateCachedThreshold();
 
+    // Helpers to report a sample right away or batch it in m_Fifo, called
+    // by the delivery work item only
+    VOID                        QueueSample(_In_ const FIFO_SAMPLE& Sample, _In_ bool Immediate);
+    VOID                        ReportSample(_In_ const FIFO_SAMPLE& Sample);
+    VOID                        ReportCounters(_In_ ULONGLONG Now);
+    VOID                        FlushFifo();
+
+    // Helpers to switch between the polling and the interrupt acquisition path
+    VOID                        ResetScheduler();
+    NTSTATUS                    RestartAcquisition();
+    NTSTATUS                    StartPolling();
+    LONGLONG                    PrepareNextBeat(_In_ ULONGLONG Now);
+    VOID                        ScheduleNextBeat();
+    VOID                        StopSampling();
+    VOID                        FlushInterruptWork();
+    VOID                        AcquireControl();
+    VOID                        ReleaseControl();
+
+    // Helpers to time-multiplex the ADC while the proximity sensor is running
+    bool                        IsAdcShared() const { return m_Arbiter.IsActive(AdcChannel_Prox); }
+    NTSTATUS                    UpdateProximity(_In_ bool Active, _In_ ULONG IntervalMs);
+    VOID                        ServeSharedAdc();
+    NTSTATUS                    GetProximityData();
+
     // Helper function for OnPrepareHardware to initialize sensor to default properties
-    NTSTATUS                    Initialize(_In_ WDFDEVICE Device, _In_ SENSOROBJECT SensorInstance);
+    NTSTATUS                    Initialize(_In_ WDFDEVICE Device,
+                                           _In_ SENSOROBJECT SensorInstance,
+                                           _In_ ULONG ChipIndex);
     VOID                        DeInit();
 
-    // Helper function for OnPrepareHardware to get resources from ACPI and configure the I/O target
-    NTSTATUS                    ConfigureIoTarget(_In_ WDFCMRESLIST ResourceList,
-                                                  _In_ WDFCMRESLIST ResourceListTranslated);
+    // Helpers for OnPrepareHardware to get the resources of every chip from ACPI,
+    // create its sensor instances and configure its I/O target
+    static NTSTATUS             GetChipResources(_In_ WDFCMRESLIST ResourceList,
+                                                 _In_ WDFCMRESLIST ResourceListTranslated,
+                                                 _Out_writes_(AlsDevice_MaxChips) PCHIP_RESOURCES pChips,
+                                                 _Out_ PULONG pChipCount);
+    static NTSTATUS             CreateChip(_In_ WDFDEVICE Device,
+                                           _In_ ULONG ChipIndex,
+                                           _In_ const CHIP_RESOURCES* pResources);
+    NTSTATUS                    ConfigureIoTarget(_In_ const CHIP_RESOURCES* pResources);
+    NTSTATUS                    ReadConfiguration();
+
+    // Helpers to map the recording file and to record conversions read
+    // outside of ProcessData
+    NTSTATUS                    OpenRecording(_In_ PCWSTR pPath, _In_ ULONG Capacity);
+    VOID                        CloseRecording();
+    VOID                        RecordNow(_In_ SAMPLE_RECORD_KIND Kind, _In_ ULONG RawCount);
+
+    // Helpers to create and delete the section the last reported sample is
+    // published in
+    NTSTATUS                    OpenSharedSample();
+    VOID                        CloseSharedSample();
 
     // Helper function for OnD0Entry which sets up device to default configuration
     NTSTATUS                    PowerOn();
     NTSTATUS                    PowerOff();
     
+    // Helpers to program the INT_LT/INT_HT window. IsrOn arms the window around
+    // m_LastSample, IsrOff programs a window that can never be left.
     NTSTATUS                    IsrOn();
     NTSTATUS                    IsrOff();
-    
+    NTSTATUS                    WriteThresholdWindow(_In_ USHORT LowCount, _In_ USHORT HighCount);
+
+    // Helpers to select the conversion mode in COMMAND1
+    NTSTATUS                    WriteOpMode(_In_ BYTE OpMode);
+    NTSTATUS                    StartConversions();
+    NTSTATUS                    StartIrConversion();
+
+    // Helpers to apply the range and resolution chosen by m_AutoRange
+    NTSTATUS                    WriteCommand2();
+    NTSTATUS                    ApplyResolution();
+    VOID                        UpdateDataFieldProperties();
 
 } AlsDevice, *PAlsDevice;
 
 // Set up accessor function to retrieve device context
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(AlsDevice, GetAlsDeviceContextFromSensorInstance);
+
+// Context of the interrupt of a chip, so the ISR gets to its light sensor
+// without looking it up in the sensor list
+typedef struct _INTERRUPT_CONTEXT
+{
+    PAlsDevice  pDevice;
+} INTERRUPT_CONTEXT, *PINTERRUPT_CONTEXT;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(INTERRUPT_CONTEXT, GetInterruptContext);
@@ -0,0 +1,58 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the lifecycle of a sensor instance. The clx, the
+//    timer, the interrupt and the work items all look at the state, so it is
+//    only changed by atomic transitions: a callback that finds the state
+//    changed under it by another one backs off rather than acting on it.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "isl29018.h"
+
+typedef enum
+{
+    Lifecycle_Off = 0,          // The chip is powered down
+    Lifecycle_Idle,             // Powered on, not sampling
+    Lifecycle_Starting,         // Acquisition is being set up or reconfigured, callbacks keep off the chip
+    Lifecycle_Running,          // Sampling
+    Lifecycle_Stopping,         // Acquisition is being shut down
+} LIFECYCLE_STATE;
+
+typedef class _DeviceLifecycle
+{
+private:
+    volatile LONG       m_State;
+
+public:
+    VOID Reset(_In_ LIFECYCLE_STATE State) { m_State = State; }
+
+    LIFECYCLE_STATE Get() const
+    {
+        return static_cast<LIFECYCLE_STATE>(ReadAcquire(&m_State));
+    }
+
+    // Move from From to To, unless another callback moved the state away from From first
+    bool Transition(
+        _In_ LIFECYCLE_STATE From,
+        _In_ LIFECYCLE_STATE To)
+    {
+        return (From == InterlockedCompareExchange(&m_State, To, From));
+    }
+
+    // Move to To whatever the state is, and return the state that was left
+    LIFECYCLE_STATE Enter(
+        _In_ LIFECYCLE_STATE To)
+    {
+        return static_cast<LIFECYCLE_STATE>(InterlockedExchange(&m_State, To));
+    }
+
+    bool IsPoweredOn() const { return Lifecycle_Off != Get(); }
+    bool IsStarted() const { return Lifecycle_Running == Get(); }
+
+} DeviceLifecycle, *PDeviceLifecycle;
@@ -11,9 +11,14 @@
 
 #pragma once
 
+#include <TraceLoggingProvider.h>
+
 WDF_EXTERN_C_START
 
 DRIVER_INITIALIZE           DriverEntry;
 EVT_WDF_DRIVER_UNLOAD       OnDriverUnload;
 
-WDF_EXTERN_C_END
\ No newline at end of file
+WDF_EXTERN_C_END
+
+// Provider of the aggregated counter events of the sample path
+TRACELOGGING_DECLARE_PROVIDER(g_hIsl29018Provider);
\ No newline at end of file
@@ -0,0 +1,101 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the infrared compensation of the visible lux reading
+//    and the policy that interleaves IR conversions with the ALS conversions.
+//    It has no framework dependencies so it can be exercised off-target.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "isl29018.h"
+
+// IR light changes slowly compared to the visible level, so one IR conversion
+// is taken for this many ALS conversions. Between IR conversions the last IR
+// reading is reused, which keeps the extra bus traffic to a fraction of a
+// transfer per reported sample.
+#define IrInterleave_AlsSamplesPerIr        (8)
+
+// The ALS photodiode also responds to near infrared. Subtract the share of the
+// IR reading that leaks into the ALS channel, both taken at the same range.
+inline FLOAT IrCompensatedLux(
+    _In_ FLOAT AlsLux,              // ALS conversion in lux
+    _In_ FLOAT IrLux,               // IR conversion in lux
+    _In_ FLOAT Coefficient)         // Share of the IR reading seen by the ALS channel
+{
+    FLOAT Lux = AlsLux - (Coefficient * IrLux);
+    return (Lux > 0.0f) ? Lux : 0.0f;
+}
+
+// Raw ALS counts that IrCompensatedLux removes at the given resolution, used to
+// move the interrupt window from compensated lux back to raw ALS counts
+inline USHORT IrCompensationOffsetCount(
+    _In_ FLOAT IrLux,
+    _In_ FLOAT Coefficient,
+    _In_ FLOAT LuxPerCount)
+{
+    if (LuxPerCount <= 0.0f)
+    {
+        return 0;
+    }
+
+    FLOAT Offset = (Coefficient * IrLux) / LuxPerCount;
+    if (Offset <= 0.0f)
+    {
+        return 0;
+    }
+
+    return (Offset >= 65535.0f) ? 0xFFFF : static_cast<USHORT>(Offset);
+}
+
+typedef class _IrInterleave
+{
+private:
+    bool                m_HasIrSample;
+    ULONG               m_AlsSamples;
+    ULONG               m_IrCount;
+    FLOAT               m_IrLux;
+
+public:
+    // Forget the last IR reading, the next conversion is an IR one
+    VOID Reset()
+    {
+        m_HasIrSample = false;
+        m_AlsSamples = 0;
+        m_IrCount = 0;
+        m_IrLux = 0.0f;
+    }
+
+    // Account for an ALS conversion
+    VOID OnAlsSample()
+    {
+        m_AlsSamples++;
+    }
+
+    // Store an IR conversion. The lux value is kept so that the reading stays
+    // valid when the range changes before the next IR conversion.
+    VOID OnIrSample(
+        _In_ ULONG RawCount,
+        _In_ FLOAT LuxPerCount)     // Lux per count of the range the IR conversion used
+    {
+        m_HasIrSample = true;
+        m_AlsSamples = 0;
+        m_IrCount = RawCount;
+        m_IrLux = static_cast<FLOAT>(RawCount) * LuxPerCount;
+    }
+
+    // The next conversion should be an IR one
+    bool IsIrDue() const
+    {
+        return !m_HasIrSample || m_AlsSamples >= IrInterleave_AlsSamplesPerIr;
+    }
+
+    // Without an IR reading nothing is subtracted
+    ULONG GetIrCount() const { return m_IrCount; }
+    FLOAT GetIrLux() const { return m_IrLux; }
+
+} IrInterleave, *PIrInterleave;
@@ -0,0 +1,107 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the private IOCTLs of the light sensor and the
+//    layout of the data they return. It is shared by the driver and the host
+//    tools, so it only depends on the Windows headers.
+//
+//    The IOCTLs are sent to the sensor's device interface. The sensor class
+//    extension passes the codes it does not know to the driver.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF), user mode
+
+#pragma once
+
+#include <windows.h>
+#include <winioctl.h>
+
+// Returns an ISL29018_LATENCY_SNAPSHOT. Output buffer: ISL29018_LATENCY_SNAPSHOT.
+#define IOCTL_ISL29018_GET_LATENCY          CTL_CODE(FILE_DEVICE_UNKNOWN, 0x900, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+// Clears the latency histograms. No input or output buffer.
+#define IOCTL_ISL29018_RESET_LATENCY        CTL_CODE(FILE_DEVICE_UNKNOWN, 0x901, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+// Copies samples out of the sample history. Input buffer: ISL29018_HISTORY_REQUEST.
+// Output buffer: ISL29018_HISTORY_HEADER followed by as many
+// ISL29018_HISTORY_SAMPLE as fit.
+#define IOCTL_ISL29018_GET_HISTORY          CTL_CODE(FILE_DEVICE_UNKNOWN, 0x902, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+#define ISL29018_LATENCY_VERSION            (1)
+
+// Bucket 0 counts durations under 1us, bucket i durations from 2^(i-1) up to
+// 2^i us. The last bucket also counts everything longer, from about 4s on.
+#define ISL29018_LATENCY_BUCKETS            (24)
+
+typedef enum
+{
+    LatencyStage_Bus = 0,               // One submission to the I2C target, from taking the bus to releasing it
+    LatencyStage_InterruptDispatch,     // From entering the ISR to the start of its work item
+    LatencyStage_BeatError,             // Distance of a polled sample from its beat, early or late
+    LatencyStage_Sample,                // From the start of a light sample's read to the end of its processing
+    LatencyStage_DataReady,             // Time spent in SensorsCxSensorDataReady
+    LatencyStage_Count
+} ISL29018_LATENCY_STAGE;
+
+typedef struct _ISL29018_LATENCY_HISTOGRAM
+{
+    ULONGLONG   Count;
+    ULONGLONG   Sum;                    // 100ns
+    ULONGLONG   Max;                    // 100ns
+    ULONGLONG   Buckets[ISL29018_LATENCY_BUCKETS];
+} ISL29018_LATENCY_HISTOGRAM, *PISL29018_LATENCY_HISTOGRAM;
+
+typedef struct _ISL29018_LATENCY_SNAPSHOT
+{
+    ULONG       Version;                // ISL29018_LATENCY_VERSION
+    ULONG       Size;                   // sizeof(ISL29018_LATENCY_SNAPSHOT)
+    ULONG       StageCount;             // LatencyStage_Count
+    ULONG       BucketCount;            // ISL29018_LATENCY_BUCKETS
+    ULONGLONG   Elapsed;                // 100ns since the histograms were last cleared
+    ISL29018_LATENCY_HISTOGRAM Stages[LatencyStage_Count];
+} ISL29018_LATENCY_SNAPSHOT, *PISL29018_LATENCY_SNAPSHOT;
+
+#define ISL29018_HISTORY_VERSION            (1)
+
+// Samples kept in the history, about three and a half minutes at 100ms
+#define ISL29018_HISTORY_SIZE               (2048)
+
+#define ISL29018_HISTORY_FLAG_REPORTED      (0x01)  // Passed the thresholds and was reported
+#define ISL29018_HISTORY_FLAG_FIRST         (0x02)  // First sample after a start
+
+// Every converted light sample, reported or not. Samples dropped after a
+// range switch or because of a failed read are not converted and not kept.
+typedef struct _ISL29018_HISTORY_SAMPLE
+{
+    ULONGLONG   Sequence;               // Consecutive over the samples kept since the sensor was created
+    FILETIME    Timestamp;              // Time the sample's read was started
+    FLOAT       Lux;                    // Converted, IR compensated and filtered
+    USHORT      RawCount;               // ALS count the sample was converted from
+    USHORT      IrCount;                // IR count of the compensation
+    BYTE        Range;                  // Range the count was converted at
+    BYTE        Resolution;             // Resolution the count was converted at
+    BYTE        Conversions;            // Conversions averaged into the count
+    BYTE        Flags;                  // ISL29018_HISTORY_FLAG_*
+    ULONG       Reserved;
+} ISL29018_HISTORY_SAMPLE, *PISL29018_HISTORY_SAMPLE;
+
+// Samples are returned oldest first, from FirstSequence on or from the
+// oldest one kept if that is later, skipping the ones taken before
+// StartTime. Pass the NextSequence of the last answer to continue from there.
+typedef struct _ISL29018_HISTORY_REQUEST
+{
+    ULONGLONG   FirstSequence;
+    FILETIME    StartTime;              // 0 to return samples of any time
+} ISL29018_HISTORY_REQUEST, *PISL29018_HISTORY_REQUEST;
+
+typedef struct _ISL29018_HISTORY_HEADER
+{
+    ULONG       Version;                // ISL29018_HISTORY_VERSION
+    ULONG       SampleSize;             // sizeof(ISL29018_HISTORY_SAMPLE)
+    ULONG       Capacity;               // ISL29018_HISTORY_SIZE
+    ULONG       Count;                  // Samples following the header
+    ULONGLONG   OldestSequence;         // Oldest sample still kept
+    ULONGLONG   NextSequence;           // FirstSequence of the request that continues this one
+} ISL29018_HISTORY_HEADER, *PISL29018_HISTORY_HEADER;
@@ -0,0 +1,473 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a behavioral model of the ISL29018 family for
+//    off-target simulation. It behaves the way the driver assumes the chip
+//    does in isl29018.h:
+//
+//    - A register file from COMMAND1 to TEST behind an auto-incrementing
+//      register pointer, accessed through the same I2C transfers the driver
+//      makes: a write of the pointer followed by data, or by a read after a
+//      repeated start.
+//    - Conversions that take isl29018_int_utimes at the programmed
+//      resolution and scale the light by isl29018_scales at the programmed
+//      range. The range and resolution are latched when a conversion starts,
+//      so a conversion in flight across a COMMAND2 write still uses the old
+//      scale, which is why the driver drops it.
+//    - The interrupt flag in COMMAND1, set once PRST consecutive conversions
+//      fell outside INT_LT/INT_HT. Reading COMMAND1 clears it, as does
+//      writing COMMAND1 with the flag bit clear. The INT pin is asserted
+//      while the flag is set.
+//
+//    - A chip that drops off the bus, see SetOffline: no transfer is
+//      acknowledged while the conversions go on.
+//    - Optional conversion noise, gaussian with a part proportional to the
+//      light and a constant part in counts. It comes from a generator with a
+//      fixed seed, so a run is repeated exactly.
+//
+//    Time is a virtual clock in 100ns, the unit of the driver's beat, which
+//    only moves when AdvanceTo is called. The light is a script of points
+//    that is interpolated linearly and may repeat, so a day of light drives
+//    any number of simulated days. BusExecutor binds to the model in place
+//    of the I2C target when built with ISL29018_BUS_MODEL.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF), host simulation
+
+#pragma once
+
+#include "isl29018.h"
+#include "AutoRange.h"
+
+#define ISL29018_CMD1_PERSIST_SHIFT         (0)
+#define ISL29018_CMD1_PERSIST_MASK          (0x3 << ISL29018_CMD1_PERSIST_SHIFT)
+
+// Registers from COMMAND1 through TEST
+#define Isl29018Model_RegisterCount         (ISL29018_REG_ADDR_TEST + 1)
+
+// Seed of the noise generator after a reset, any value but 0
+#define Isl29018Model_NoiseSeed             (0x29018)
+
+// Light reaching the sensor at a point in time. Proximity is the lux the IR
+// LED's reflection adds to the IR channel while the LED is pulsed.
+typedef struct _ISL29018_LIGHT_POINT
+{
+    ULONGLONG   Time;               // 100ns from the start of the script
+    FLOAT       Lux;
+    FLOAT       IrLux;
+    FLOAT       ProximityLux;
+} ISL29018_LIGHT_POINT, *PISL29018_LIGHT_POINT;
+
+typedef class _Isl29018Model
+{
+private:
+    ULONG                       m_Chip;
+    BYTE                        m_Registers[Isl29018Model_RegisterCount];
+    BYTE                        m_Pointer;
+
+    // Virtual clock and the conversion in flight, m_ConversionEnd is 0 while
+    // the chip is powered down
+    ULONGLONG                   m_Now;
+    ULONGLONG                   m_ConversionEnd;
+    ULONGLONG                   m_LastConversion;   // Time the data registers were last written
+    ULONG                       m_ConversionMode;
+    ULONG                       m_ConversionRange;
+    ULONG                       m_ConversionResolution;
+    ULONG                       m_OutOfWindow;      // Consecutive conversions outside INT_LT/INT_HT
+    bool                        m_Offline;          // No transfer is acknowledged
+
+    const ISL29018_LIGHT_POINT* m_pScript;
+    ULONG                       m_ScriptLength;
+    ULONGLONG                   m_ScriptPeriod;     // 0 holds the last point
+
+    // Standard deviation of a conversion's noise, m_NoiseRelative times the
+    // count plus m_NoiseCounts. Both are 0 for noiseless conversions.
+    FLOAT                       m_NoiseRelative;
+    FLOAT                       m_NoiseCounts;
+    ULONG                       m_NoiseState;
+
+    // Counters
+    ULONGLONG                   m_Conversions;
+    ULONGLONG                   m_Interrupts;
+    ULONGLONG                   m_Transfers;
+
+    ULONG GetMode() const
+    {
+        return (m_Registers[ISL29018_REG_ADD_COMMAND1] & ISL29018_CMD1_OPMODE_MASK) >> ISL29018_CMD1_OPMODE_SHIFT;
+    }
+
+    // Conversions outside the window before the flag is set: 1, 4, 8 or 16
+    ULONG GetPersistence() const
+    {
+        ULONG Persist = (m_Registers[ISL29018_REG_ADD_COMMAND1] & ISL29018_CMD1_PERSIST_MASK) >> ISL29018_CMD1_PERSIST_SHIFT;
+        return (Persist == 0) ? 1 : (2UL << Persist);
+    }
+
+    // Xorshift, uniform in [0, 1)
+    FLOAT NextUniform()
+    {
+        m_NoiseState ^= m_NoiseState << 13;
+        m_NoiseState ^= m_NoiseState >> 17;
+        m_NoiseState ^= m_NoiseState << 5;
+        return static_cast<FLOAT>(m_NoiseState >> 8) / static_cast<FLOAT>(1UL << 24);
+    }
+
+    // Standard normal, close enough as the sum of twelve uniforms
+    FLOAT NextGaussian()
+    {
+        FLOAT Sum = 0.0f;
+        for (ULONG i = 0; i < 12; i++)
+        {
+            Sum += NextUniform();
+        }
+        return Sum - 6.0f;
+    }
+
+    USHORT GetRegister16(
+        _In_ BYTE Register) const
+    {
+        return static_cast<USHORT>(m_Registers[Register] | (m_Registers[Register + 1] << 8));
+    }
+
+    // Latch the configuration and start a conversion at the current time
+    VOID StartConversion()
+    {
+        ULONG Mode = GetMode();
+        BYTE Command2 = m_Registers[ISL29018_REG_ADD_COMMAND2];
+
+        if (Mode == ISL29018_CMD1_OPMODE_POWER_DOWN || m_Registers[ISL29018_REG_ADDR_TEST] != 0)
+        {
+            m_ConversionEnd = 0;
+            return;
+        }
+
+        m_ConversionMode = Mode;
+        m_ConversionRange = (Command2 & ISL29018_CMD2_RANGE_MASK) >> ISL29018_CMD2_RANGE_SHIFT;
+        m_ConversionResolution = (Command2 & ISL29018_CMD2_RESOLUTION_MASK) >> ISL29018_CMD2_RESOLUTION_SHIFT;
+        m_ConversionEnd = m_Now + GetIntegrationTime(m_ConversionResolution);
+    }
+
+    VOID CompleteConversion()
+    {
+        ISL29018_LIGHT_POINT Light = GetLight(m_ConversionEnd);
+        FLOAT Lux = Light.Lux;
+
+        switch (m_ConversionMode)
+        {
+            case ISL29018_CMD1_OPMODE_IR_ONCE:
+            case ISL29018_CMD1_OPMODE_IR_CONT:
+                Lux = Light.IrLux;
+                break;
+
+            case ISL29018_CMD1_OPMODE_PROX_ONCE:
+            case ISL29018_CMD1_OPMODE_PROX_CONT:
+                Lux = Light.ProximityLux;
+                break;
+        }
+
+        FLOAT Count = Lux / Isl29018LuxPerCount(m_ConversionResolution, m_ConversionRange);
+        if (0.0f != m_NoiseRelative || 0.0f != m_NoiseCounts)
+        {
+            Count += (m_NoiseRelative * Count + m_NoiseCounts) * NextGaussian();
+        }
+        ULONG MaxCount = Isl29018MaxCount(m_ConversionResolution);
+        ULONG RawCount = (Count >= static_cast<FLOAT>(MaxCount)) ? MaxCount :
+                         (Count > 0.0f) ? static_cast<ULONG>(Count) : 0;
+
+        m_Registers[ISL29018_REG_ADD_DATA_LSB] = static_cast<BYTE>(RawCount);
+        m_Registers[ISL29018_REG_ADD_DATA_MSB] = static_cast<BYTE>(RawCount >> 8);
+        m_LastConversion = m_ConversionEnd;
+        m_Conversions++;
+
+        // Every conversion is compared against the window
+        if (RawCount < GetRegister16(ISL29018_REG_ADD_INT_LT_LSB) ||
+            RawCount > GetRegister16(ISL29018_REG_ADD_INT_HT_LSB))
+        {
+            m_OutOfWindow++;
+            if (m_OutOfWindow >= GetPersistence() &&
+                (m_Registers[ISL29018_REG_ADD_COMMAND1] & ISL29018_CMD1_ISR_MASK) == 0)
+            {
+                m_Registers[ISL29018_REG_ADD_COMMAND1] |= ISL29018_CMD1_ISR_MASK;
+                m_Interrupts++;
+            }
+        }
+        else
+        {
+            m_OutOfWindow = 0;
+        }
+
+        // One-shot conversions power the chip down once they completed
+        m_Now = m_ConversionEnd;
+        if (m_ConversionMode == ISL29018_CMD1_OPMODE_ALS_ONCE ||
+            m_ConversionMode == ISL29018_CMD1_OPMODE_IR_ONCE ||
+            m_ConversionMode == ISL29018_CMD1_OPMODE_PROX_ONCE)
+        {
+            m_Registers[ISL29018_REG_ADD_COMMAND1] &= ~ISL29018_CMD1_OPMODE_MASK;
+            m_ConversionEnd = 0;
+        }
+        else
+        {
+            StartConversion();
+        }
+    }
+
+    VOID WriteRegister(
+        _In_ BYTE Register,
+        _In_ BYTE Value)
+    {
+        if (Register == ISL29018_REG_ADD_DATA_LSB || Register == ISL29018_REG_ADD_DATA_MSB)
+        {
+            return;
+        }
+
+        if (Register == ISL29018_REG_ADD_COMMAND1)
+        {
+            // The flag can only be cleared, writing the mode restarts conversions
+            Value = static_cast<BYTE>((Value & ~ISL29018_CMD1_ISR_MASK) |
+                                      (Value & m_Registers[Register] & ISL29018_CMD1_ISR_MASK));
+            m_OutOfWindow = 0;
+        }
+
+        m_Registers[Register] = Value;
+
+        if (Register == ISL29018_REG_ADD_COMMAND1 || Register == ISL29018_REG_ADDR_TEST)
+        {
+            StartConversion();
+        }
+    }
+
+    // The bytes of a write, the pointer first
+    ULONG WriteBytes(
+        _In_reads_(Length) const BYTE* pBuffer,
+        _In_ ULONG Length)
+    {
+        if (0 == Length || pBuffer[0] >= Isl29018Model_RegisterCount)
+        {
+            return 0;
+        }
+
+        m_Pointer = pBuffer[0];
+
+        ULONG Written = 1;
+        for (; Written < Length && m_Pointer < Isl29018Model_RegisterCount; Written++)
+        {
+            WriteRegister(m_Pointer++, pBuffer[Written]);
+        }
+
+        return Written;
+    }
+
+    // The bytes of a read, from the pointer on
+    ULONG ReadBytes(
+        _Out_writes_(Length) BYTE* pBuffer,
+        _In_ ULONG Length)
+    {
+        ULONG Read = 0;
+        for (; Read < Length && m_Pointer < Isl29018Model_RegisterCount; Read++)
+        {
+            pBuffer[Read] = m_Registers[m_Pointer];
+            if (m_Pointer == ISL29018_REG_ADD_COMMAND1)
+            {
+                m_Registers[m_Pointer] &= ~ISL29018_CMD1_ISR_MASK;
+            }
+            m_Pointer++;
+        }
+
+        return Read;
+    }
+
+public:
+    // Power-on state: every register cleared, powered down, clock at 0, no
+    // noise and dark until SetLightScript is called
+    VOID Reset(
+        _In_ ULONG Chip)                // One of the ISL29018_CHIP_* values
+    {
+        m_Chip = Chip;
+        m_Pointer = 0;
+        m_Now = 0;
+        m_ConversionEnd = 0;
+        m_LastConversion = 0;
+        m_ConversionMode = ISL29018_CMD1_OPMODE_POWER_DOWN;
+        m_ConversionRange = 0;
+        m_ConversionResolution = 0;
+        m_OutOfWindow = 0;
+        m_Offline = false;
+        m_Conversions = 0;
+        m_Interrupts = 0;
+        m_Transfers = 0;
+        for (ULONG i = 0; i < Isl29018Model_RegisterCount; i++)
+        {
+            m_Registers[i] = 0;
+        }
+        m_pScript = nullptr;
+        m_ScriptLength = 0;
+        m_ScriptPeriod = 0;
+        m_NoiseRelative = 0.0f;
+        m_NoiseCounts = 0.0f;
+        m_NoiseState = Isl29018Model_NoiseSeed;
+    }
+
+    // Stop acknowledging transfers, or start again. The registers and the
+    // conversion in flight are kept, as on a bus held low for a while.
+    VOID SetOffline(
+        _In_ bool Offline)
+    {
+        m_Offline = Offline;
+    }
+
+    // Lose the configuration as a brownout would, the clock keeps running
+    VOID PowerCycle()
+    {
+        for (ULONG i = 0; i < Isl29018Model_RegisterCount; i++)
+        {
+            m_Registers[i] = 0;
+        }
+        m_ConversionEnd = 0;
+        m_OutOfWindow = 0;
+    }
+
+    // The points must be sorted by time and stay valid while the model runs.
+    // With a period the script starts over every Period, otherwise the last
+    // point holds once the script ran out.
+    VOID SetLightScript(
+        _In_reads_(Count) const ISL29018_LIGHT_POINT* pPoints,
+        _In_ ULONG Count,
+        _In_ ULONGLONG Period)
+    {
+        m_pScript = pPoints;
+        m_ScriptLength = Count;
+        m_ScriptPeriod = Period;
+    }
+
+    // Noise of the following conversions: the standard deviation is Relative
+    // times the count plus Counts. Conversions stay noiseless with both 0.
+    VOID SetNoise(
+        _In_ FLOAT Relative,
+        _In_ FLOAT Counts)
+    {
+        m_NoiseRelative = Relative;
+        m_NoiseCounts = Counts;
+    }
+
+    // Light at a time of the virtual clock
+    ISL29018_LIGHT_POINT GetLight(
+        _In_ ULONGLONG Time) const
+    {
+        ISL29018_LIGHT_POINT Light = {};
+
+        if (nullptr == m_pScript || 0 == m_ScriptLength)
+        {
+            return Light;
+        }
+
+        ULONGLONG ScriptTime = (m_ScriptPeriod != 0) ? (Time % m_ScriptPeriod) : Time;
+        if (ScriptTime <= m_pScript[0].Time)
+        {
+            Light = m_pScript[0];
+        }
+        else if (ScriptTime >= m_pScript[m_ScriptLength - 1].Time)
+        {
+            Light = m_pScript[m_ScriptLength - 1];
+        }
+        else
+        {
+            ULONG Next = 1;
+            while (m_pScript[Next].Time <= ScriptTime)
+            {
+                Next++;
+            }
+
+            const ISL29018_LIGHT_POINT& From = m_pScript[Next - 1];
+            const ISL29018_LIGHT_POINT& To = m_pScript[Next];
+            FLOAT Share = static_cast<FLOAT>(ScriptTime - From.Time) / static_cast<FLOAT>(To.Time - From.Time);
+
+            Light.Lux = From.Lux + Share * (To.Lux - From.Lux);
+            Light.IrLux = From.IrLux + Share * (To.IrLux - From.IrLux);
+            Light.ProximityLux = From.ProximityLux + Share * (To.ProximityLux - From.ProximityLux);
+        }
+
+        Light.Time = Time;
+        return Light;
+    }
+
+    // Run the conversions that complete up to Now. Returns true if the INT
+    // pin is asserted afterwards.
+    bool AdvanceTo(
+        _In_ ULONGLONG Now)
+    {
+        while (0 != m_ConversionEnd && m_ConversionEnd <= Now)
+        {
+            CompleteConversion();
+        }
+
+        if (Now > m_Now)
+        {
+            m_Now = Now;
+        }
+
+        return IsInterruptAsserted();
+    }
+
+    // I2C write: the register pointer, then data written from it on. Returns
+    // the bytes acknowledged; a pointer past TEST is not.
+    ULONG Write(
+        _In_reads_(Length) const BYTE* pBuffer,
+        _In_ ULONG Length)
+    {
+        m_Transfers++;
+        return m_Offline ? 0 : WriteBytes(pBuffer, Length);
+    }
+
+    // I2C read from the register pointer on. Returns the bytes read, which
+    // stop at TEST. Reading COMMAND1 clears the interrupt flag.
+    ULONG Read(
+        _Out_writes_(Length) BYTE* pBuffer,
+        _In_ ULONG Length)
+    {
+        m_Transfers++;
+        return m_Offline ? 0 : ReadBytes(pBuffer, Length);
+    }
+
+    // A write of the register pointer and a read after a repeated start, one
+    // transfer. Returns the bytes written and read; nothing is read if the
+    // write was not acknowledged.
+    ULONG WriteRead(
+        _In_reads_(WriteLength) const BYTE* pWriteBuffer,
+        _In_ ULONG WriteLength,
+        _Out_writes_(ReadLength) BYTE* pReadBuffer,
+        _In_ ULONG ReadLength)
+    {
+        m_Transfers++;
+        if (m_Offline)
+        {
+            return 0;
+        }
+
+        ULONG Written = WriteBytes(pWriteBuffer, WriteLength);
+        return (Written != WriteLength) ? Written : (Written + ReadBytes(pReadBuffer, ReadLength));
+    }
+
+    // Integration time of a conversion, in 100ns
+    ULONGLONG GetIntegrationTime(
+        _In_ ULONG Resolution) const
+    {
+        return static_cast<ULONGLONG>(isl29018_int_utimes[m_Chip][Resolution]) * 10;
+    }
+
+    // Time the conversion in flight completes, 0 while powered down
+    ULONGLONG GetNextEvent() const { return m_ConversionEnd; }
+
+    bool IsInterruptAsserted() const
+    {
+        return (m_Registers[ISL29018_REG_ADD_COMMAND1] & ISL29018_CMD1_ISR_MASK) != 0;
+    }
+
+    ULONGLONG GetNow() const { return m_Now; }
+    ULONGLONG GetLastConversion() const { return m_LastConversion; }
+    ULONGLONG GetConversions() const { return m_Conversions; }
+    ULONGLONG GetInterrupts() const { return m_Interrupts; }
+    ULONGLONG GetTransfers() const { return m_Transfers; }
+
+} Isl29018Model, *PIsl29018Model;
@@ -0,0 +1,140 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the latency histograms of the light sensor, read
+//    and cleared through IOCTL_ISL29018_GET_LATENCY and
+//    IOCTL_ISL29018_RESET_LATENCY. They are always on: recording a duration
+//    is a few interlocked operations and never waits, so the ISR, the bus
+//    completion routines and the work items record from any thread.
+//
+//    A snapshot is not taken atomically across counters. Durations recorded
+//    while it is taken, or while the histograms are cleared, may show in some
+//    counters of their stage and not in others.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "Isl29018Ioctl.h"
+
+typedef class _LatencyHistogram
+{
+private:
+    typedef struct _STAGE
+    {
+        volatile LONG64     Count;
+        volatile LONG64     Sum;
+        volatile LONG64     Max;
+        volatile LONG64     Buckets[ISL29018_LATENCY_BUCKETS];
+    } STAGE;
+
+    STAGE               m_Stages[LatencyStage_Count];
+    volatile LONG64     m_ResetTime;
+
+    // Read a counter whole, also where 64-bit loads are not atomic
+    static ULONGLONG Load(
+        _In_ volatile LONG64* pCounter)
+    {
+        return static_cast<ULONGLONG>(InterlockedCompareExchange64(pCounter, 0, 0));
+    }
+
+    static ULONG GetBucket(
+        _In_ ULONGLONG Ticks)
+    {
+        ULONGLONG Us = Ticks / 10;
+        ULONG Bucket = 0;
+
+        while (Us != 0 && Bucket < ISL29018_LATENCY_BUCKETS - 1)
+        {
+            Us >>= 1;
+            Bucket++;
+        }
+
+        return Bucket;
+    }
+
+public:
+    // Clear the histograms, Now is in 100ns
+    VOID Reset(
+        _In_ ULONGLONG Now)
+    {
+        for (ULONG i = 0; i < LatencyStage_Count; i++)
+        {
+            InterlockedExchange64(&m_Stages[i].Count, 0);
+            InterlockedExchange64(&m_Stages[i].Sum, 0);
+            InterlockedExchange64(&m_Stages[i].Max, 0);
+            for (ULONG j = 0; j < ISL29018_LATENCY_BUCKETS; j++)
+            {
+                InterlockedExchange64(&m_Stages[i].Buckets[j], 0);
+            }
+        }
+
+        InterlockedExchange64(&m_ResetTime, static_cast<LONG64>(Now));
+    }
+
+    // Account for a duration of the stage, in 100ns
+    VOID Record(
+        _In_ ISL29018_LATENCY_STAGE Stage,
+        _In_ ULONGLONG Ticks)
+    {
+        if (Stage >= LatencyStage_Count)
+        {
+            return;
+        }
+
+        STAGE* pStage = &m_Stages[Stage];
+        LONG64 Duration = static_cast<LONG64>(Ticks);
+
+        InterlockedIncrement64(&pStage->Count);
+        InterlockedExchangeAdd64(&pStage->Sum, Duration);
+        InterlockedIncrement64(&pStage->Buckets[GetBucket(Ticks)]);
+
+        LONG64 Max = InterlockedCompareExchange64(&pStage->Max, 0, 0);
+        while (Duration > Max)
+        {
+            LONG64 Previous = InterlockedCompareExchange64(&pStage->Max, Duration, Max);
+            if (Previous == Max)
+            {
+                break;
+            }
+            Max = Previous;
+        }
+    }
+
+    // Account for the time from Start to Now, both in 100ns
+    VOID RecordSince(
+        _In_ ISL29018_LATENCY_STAGE Stage,
+        _In_ ULONGLONG Start,
+        _In_ ULONGLONG Now)
+    {
+        Record(Stage, (Now > Start) ? (Now - Start) : 0);
+    }
+
+    VOID GetSnapshot(
+        _Out_ PISL29018_LATENCY_SNAPSHOT pSnapshot,
+        _In_ ULONGLONG Now)
+    {
+        ULONGLONG ResetTime = Load(&m_ResetTime);
+
+        pSnapshot->Version = ISL29018_LATENCY_VERSION;
+        pSnapshot->Size = sizeof(*pSnapshot);
+        pSnapshot->StageCount = LatencyStage_Count;
+        pSnapshot->BucketCount = ISL29018_LATENCY_BUCKETS;
+        pSnapshot->Elapsed = (Now > ResetTime) ? (Now - ResetTime) : 0;
+
+        for (ULONG i = 0; i < LatencyStage_Count; i++)
+        {
+            pSnapshot->Stages[i].Count = Load(&m_Stages[i].Count);
+            pSnapshot->Stages[i].Sum = Load(&m_Stages[i].Sum);
+            pSnapshot->Stages[i].Max = Load(&m_Stages[i].Max);
+            for (ULONG j = 0; j < ISL29018_LATENCY_BUCKETS; j++)
+            {
+                pSnapshot->Stages[i].Buckets[j] = Load(&m_Stages[i].Buckets[j]);
+            }
+        }
+    }
+
+} LatencyHistogram, *PLatencyHistogram;
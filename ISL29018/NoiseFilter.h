@@ -0,0 +1,154 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the noise filter applied to the lux reading before
+//    it is compared against the thresholds. Sensor noise and mains flicker
+//    around a threshold boundary otherwise make the reports chatter. All
+//    state is fixed size, nothing is allocated. It has no framework
+//    dependencies so it can be exercised off-target.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "isl29018.h"
+
+// Values of the NoiseFilter registry value under the device's parameters key
+typedef enum
+{
+    NoiseFilter_None = 0,
+    NoiseFilter_Median,             // Median of the last NoiseFilter_MedianLength readings
+    NoiseFilter_Ema,                // Exponential moving average
+    NoiseFilter_Kalman,             // Scalar Kalman filter for a slowly drifting level
+    NoiseFilter_Count
+} NOISE_FILTER_TYPE;
+
+// Odd, so the median is one of the readings
+#define NoiseFilter_MedianLength            (5)
+
+// Weight of a new reading in the moving average
+#define NoiseFilter_EmaAlpha                (0.25f)
+
+// The noise of the chip and the drift of the light are proportional to the
+// level, so the Kalman variances are relative to the estimate. The floor keeps
+// the filter responsive in the dark.
+#define NoiseFilter_KalmanProcessNoise      (0.02f)     // Drift per reading, share of the level
+#define NoiseFilter_KalmanMeasurementNoise  (0.05f)     // Noise of a reading, share of the level
+#define NoiseFilter_KalmanFloorLux          (0.1f)
+
+typedef class _NoiseFilter
+{
+private:
+    NOISE_FILTER_TYPE   m_Type;
+    bool                m_HasSample;
+
+    // Median
+    FLOAT               m_History[NoiseFilter_MedianLength];
+    ULONG               m_HistoryNext;
+    ULONG               m_HistoryCount;
+
+    // Moving average and Kalman estimate
+    FLOAT               m_Estimate;
+    FLOAT               m_Variance;     // Kalman only
+
+    FLOAT ApplyMedian(_In_ FLOAT Lux)
+    {
+        FLOAT Sorted[NoiseFilter_MedianLength];
+
+        m_History[m_HistoryNext] = Lux;
+        m_HistoryNext = (m_HistoryNext + 1) % NoiseFilter_MedianLength;
+        if (m_HistoryCount < NoiseFilter_MedianLength)
+        {
+            m_HistoryCount++;
+        }
+
+        // Insertion sort, the history is only a few readings long
+        for (ULONG i = 0; i < m_HistoryCount; i++)
+        {
+            ULONG j = i;
+            for (; j > 0 && Sorted[j - 1] > m_History[i]; j--)
+            {
+                Sorted[j] = Sorted[j - 1];
+            }
+            Sorted[j] = m_History[i];
+        }
+
+        return Sorted[m_HistoryCount / 2];
+    }
+
+    FLOAT ApplyEma(_In_ FLOAT Lux)
+    {
+        m_Estimate += NoiseFilter_EmaAlpha * (Lux - m_Estimate);
+        return m_Estimate;
+    }
+
+    static FLOAT Square(_In_ FLOAT Value) { return Value * Value; }
+
+    FLOAT ApplyKalman(_In_ FLOAT Lux)
+    {
+        FLOAT Level = (m_Estimate > NoiseFilter_KalmanFloorLux) ? m_Estimate : NoiseFilter_KalmanFloorLux;
+
+        // Predict: the level stays, its uncertainty grows by the drift
+        m_Variance += Square(NoiseFilter_KalmanProcessNoise * Level);
+
+        // Update with the reading
+        FLOAT Gain = m_Variance / (m_Variance + Square(NoiseFilter_KalmanMeasurementNoise * Level));
+        m_Estimate += Gain * (Lux - m_Estimate);
+        m_Variance *= (1.0f - Gain);
+
+        return m_Estimate;
+    }
+
+public:
+    // Select the filter and forget the readings. Unknown types filter nothing.
+    VOID Reset(
+        _In_ ULONG Type)
+    {
+        m_Type = (Type < NoiseFilter_Count) ? static_cast<NOISE_FILTER_TYPE>(Type) : NoiseFilter_None;
+        Reset();
+    }
+
+    // Forget the readings, e.g. when sampling restarts
+    VOID Reset()
+    {
+        m_HasSample = false;
+        m_HistoryNext = 0;
+        m_HistoryCount = 0;
+        m_Estimate = 0.0f;
+        m_Variance = 0.0f;
+    }
+
+    // Filter a reading. The first reading after a reset passes unchanged.
+    FLOAT Apply(
+        _In_ FLOAT Lux)
+    {
+        if (!m_HasSample)
+        {
+            m_HasSample = true;
+            m_Estimate = Lux;
+            m_Variance = Square(NoiseFilter_KalmanMeasurementNoise *
+                                ((Lux > NoiseFilter_KalmanFloorLux) ? Lux : NoiseFilter_KalmanFloorLux));
+        }
+
+        switch (m_Type)
+        {
+            case NoiseFilter_Median:
+                return ApplyMedian(Lux);
+
+            case NoiseFilter_Ema:
+                return ApplyEma(Lux);
+
+            case NoiseFilter_Kalman:
+                return ApplyKalman(Lux);
+
+            default:
+                return Lux;
+        }
+    }
+
+    NOISE_FILTER_TYPE GetType() const { return m_Type; }
+
+} NoiseFilter, *PNoiseFilter;
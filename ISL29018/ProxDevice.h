@@ -0,0 +1,92 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the type definitions for the proximity sensor
+//    instance. The proximity channel shares the chip, its I2C target and
+//    its ADC with the ambient light sensor, which owns them.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "Device.h"
+
+#define SENSORV2_POOL_TAG_PROXIMITY             '2xrP'
+
+// Proximity data
+typedef enum
+{
+    PRX_DATA_TIMESTAMP = 0,
+    PRX_DATA_DETECT,
+    PRX_DATA_COUNT
+} PRX_DATA_INDEX;
+
+// Proximity thresholds, none are supported
+typedef enum
+{
+    PRX_THRESHOLD_COUNT = 0
+} PRX_THRESHOLD_INDEX;
+
+// An object is detected once the reflected IR rises above 1/8 of full scale and
+// released once it falls below 1/16, so the reading does not toggle at the edge
+#define ProxDevice_Detect_Denominator           (8)
+#define ProxDevice_Release_Denominator          (16)
+
+typedef class _ProxDevice
+{
+    // The light sensor runs the proximity conversions on the shared ADC
+    friend class _AlsDevice;
+
+private:
+    // WDF
+    WDFDEVICE                   m_Device;
+    SENSOROBJECT                m_SensorInstance;
+
+    // Owner of the chip
+    PAlsDevice                  m_pAls;
+
+    // Sensor Operation
+    DeviceLifecycle             m_Lifecycle;
+    bool                        m_FirstSample;
+    bool                        m_Detected;
+    ULONG                       m_Interval;
+    ULONG                       m_MinimumInterval;
+
+    // Sensor Specific Properties
+    PSENSOR_PROPERTY_LIST       m_pSupportedDataFields;
+    PSENSOR_COLLECTION_LIST     m_pEnumerationProperties;
+    PSENSOR_COLLECTION_LIST     m_pSensorProperties;
+    PSENSOR_COLLECTION_LIST     m_pSensorData;
+    PSENSOR_COLLECTION_LIST     m_pThresholds;
+
+public:
+    // CLX callbacks, forwarded by AlsDevice for the proximity sensor instance
+    static EVT_SENSOR_DRIVER_START_SENSOR               OnStart;
+    static EVT_SENSOR_DRIVER_STOP_SENSOR                OnStop;
+    static EVT_SENSOR_DRIVER_GET_SUPPORTED_DATA_FIELDS  OnGetSupportedDataFields;
+    static EVT_SENSOR_DRIVER_GET_PROPERTIES             OnGetProperties;
+    static EVT_SENSOR_DRIVER_GET_DATA_FIELD_PROPERTIES  OnGetDataFieldProperties;
+    static EVT_SENSOR_DRIVER_GET_DATA_INTERVAL          OnGetDataInterval;
+    static EVT_SENSOR_DRIVER_SET_DATA_INTERVAL          OnSetDataInterval;
+    static EVT_SENSOR_DRIVER_GET_DATA_THRESHOLDS        OnGetDataThresholds;
+    static EVT_SENSOR_DRIVER_SET_DATA_THRESHOLDS        OnSetDataThresholds;
+    static EVT_SENSOR_DRIVER_DEVICE_IO_CONTROL          OnIoControl;
+
+private:
+    // Helper function for OnPrepareHardware to initialize sensor to default properties
+    NTSTATUS                    Initialize(_In_ WDFDEVICE Device,
+                                           _In_ SENSOROBJECT SensorInstance,
+                                           _In_ PAlsDevice pAls);
+
+    // Called by the light sensor with the result of a proximity conversion
+    VOID                        OnSample(_In_ ULONG RawCount, _In_ ULONG MaxCount);
+
+    VOID                        SetState(_In_ ULONG State);
+
+} ProxDevice, *PProxDevice;
+
+// Set up accessor function to retrieve device context
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(ProxDevice, GetProxDeviceContextFromSensorInstance);
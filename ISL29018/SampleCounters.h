@@ -0,0 +1,79 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the counters of the sample path that are reported as
+//    one aggregated TraceLogging event per period, in place of trace points
+//    on every sample. Counting is an interlocked increment, and the caller
+//    that finds the period over claims it, so exactly one of the threads on
+//    the sample path reports each period.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "isl29018.h"
+
+// Period of the counter events, in 100ns
+#define SampleCounters_Period               (1000ULL * 10000ULL)
+
+typedef struct _SAMPLE_COUNTS
+{
+    ULONG       Samples;        // Samples read from the chip
+    ULONG       Reports;        // Samples reported to the clx
+    ULONG       Errors;         // Samples lost to a failed read or a lost configuration
+    ULONG       Interrupts;     // Interrupts raised by the chip
+    ULONGLONG   Elapsed;        // 100ns the counts were taken over
+} SAMPLE_COUNTS, *PSAMPLE_COUNTS;
+
+typedef class _SampleCounters
+{
+private:
+    volatile LONG       m_Samples;
+    volatile LONG       m_Reports;
+    volatile LONG       m_Errors;
+    volatile LONG       m_Interrupts;
+    volatile LONG64     m_PeriodStart;
+
+public:
+    VOID Reset(
+        _In_ ULONGLONG Now)
+    {
+        m_Samples = 0;
+        m_Reports = 0;
+        m_Errors = 0;
+        m_Interrupts = 0;
+        m_PeriodStart = static_cast<LONG64>(Now);
+    }
+
+    VOID OnSample() { InterlockedIncrement(&m_Samples); }
+    VOID OnReport() { InterlockedIncrement(&m_Reports); }
+    VOID OnError() { InterlockedIncrement(&m_Errors); }
+    VOID OnInterrupt() { InterlockedIncrement(&m_Interrupts); }
+
+    // Once the period is over, take the counts and start the next period.
+    // Returns false if the period is not over or another caller took it.
+    bool TakeIfDue(
+        _In_ ULONGLONG Now,
+        _Out_ PSAMPLE_COUNTS pCounts)
+    {
+        // A torn read only makes the test below wrong, the exchange catches it
+        LONG64 Start = m_PeriodStart;
+        if (Now < static_cast<ULONGLONG>(Start) + SampleCounters_Period ||
+            Start != InterlockedCompareExchange64(&m_PeriodStart, static_cast<LONG64>(Now), Start))
+        {
+            return false;
+        }
+
+        pCounts->Samples = static_cast<ULONG>(InterlockedExchange(&m_Samples, 0));
+        pCounts->Reports = static_cast<ULONG>(InterlockedExchange(&m_Reports, 0));
+        pCounts->Errors = static_cast<ULONG>(InterlockedExchange(&m_Errors, 0));
+        pCounts->Interrupts = static_cast<ULONG>(InterlockedExchange(&m_Interrupts, 0));
+        pCounts->Elapsed = Now - static_cast<ULONGLONG>(Start);
+
+        return true;
+    }
+
+} SampleCounters, *PSampleCounters;
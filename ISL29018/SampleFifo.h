@@ -0,0 +1,91 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the bounded FIFO that holds timestamped light
+//    samples while the class extension asked for batched reports. It has no
+//    framework dependencies so it can be exercised off-target.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "isl29018.h"
+
+// Samples the FIFO can hold, advertised as the FIFO size of the sensor
+#define SampleFifo_Size                     (32)
+
+// The FIFO is flushed once no more than this many slots are free, so samples
+// taken while the flush is in progress do not overflow it
+#define SampleFifo_FlushMargin              (4)
+
+typedef struct _FIFO_SAMPLE
+{
+    FILETIME    Timestamp;      // Time the interrupt was taken or the read was started
+    FLOAT       Lux;
+    ULONG       IrCount;
+} FIFO_SAMPLE, *PFIFO_SAMPLE;
+
+typedef class _SampleFifo
+{
+private:
+    FIFO_SAMPLE         m_Samples[SampleFifo_Size];
+    ULONG               m_Head;         // Oldest sample
+    ULONG               m_Count;
+
+    // Counters
+    ULONG               m_Overflows;
+
+public:
+    VOID Reset()
+    {
+        m_Head = 0;
+        m_Count = 0;
+    }
+
+    VOID ResetCounters()
+    {
+        m_Overflows = 0;
+    }
+
+    // Queue a sample. A full FIFO drops its oldest sample, the newest reading
+    // is the one that matters to the consumer.
+    VOID Push(
+        _In_ const FIFO_SAMPLE& Sample)
+    {
+        if (m_Count == SampleFifo_Size)
+        {
+            m_Head = (m_Head + 1) % SampleFifo_Size;
+            m_Count--;
+            m_Overflows++;
+        }
+
+        m_Samples[(m_Head + m_Count) % SampleFifo_Size] = Sample;
+        m_Count++;
+    }
+
+    // Dequeue the oldest sample, returns false if the FIFO is empty
+    bool Pop(
+        _Out_ PFIFO_SAMPLE pSample)
+    {
+        if (m_Count == 0)
+        {
+            return false;
+        }
+
+        *pSample = m_Samples[m_Head];
+        m_Head = (m_Head + 1) % SampleFifo_Size;
+        m_Count--;
+
+        return true;
+    }
+
+    ULONG GetCount() const { return m_Count; }
+    bool IsEmpty() const { return m_Count == 0; }
+    bool IsNearlyFull() const { return m_Count >= SampleFifo_Size - SampleFifo_FlushMargin; }
+
+    ULONG GetOverflows() const { return m_Overflows; }
+
+} SampleFifo, *PSampleFifo;
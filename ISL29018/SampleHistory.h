@@ -0,0 +1,120 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the history of the last ISL29018_HISTORY_SIZE
+//    converted light samples, read through IOCTL_ISL29018_GET_HISTORY. The
+//    acquisition path is the only writer and never waits: every slot carries
+//    a stamp that is cleared while the slot is written and set to the
+//    sample's sequence number + 1 afterwards. A reader copies a slot and
+//    keeps the copy only if the stamp was the expected one before and after,
+//    so samples overwritten during the copy are skipped, never torn.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "Isl29018Ioctl.h"
+
+static_assert((ISL29018_HISTORY_SIZE & (ISL29018_HISTORY_SIZE - 1)) == 0, "The history size must be a power of 2");
+
+typedef class _SampleHistory
+{
+private:
+    typedef struct _SLOT
+    {
+        volatile LONG64         Stamp;      // 0 while empty or being written, else Sequence + 1
+        ISL29018_HISTORY_SAMPLE Sample;
+    } SLOT;
+
+    SLOT                m_Slots[ISL29018_HISTORY_SIZE];
+    volatile LONG64     m_Next;             // Sequence of the next sample, written by the writer only
+
+    static ULONGLONG ToTime(
+        _In_ const FILETIME& Time)
+    {
+        return (static_cast<ULONGLONG>(Time.dwHighDateTime) << 32) | Time.dwLowDateTime;
+    }
+
+public:
+    // Keep a converted sample, overwriting the oldest one once the history is full
+    VOID Add(
+        _In_ const FILETIME* pTimestamp,
+        _In_ FLOAT Lux,
+        _In_ ULONG RawCount,
+        _In_ ULONG IrCount,
+        _In_ ULONG Range,
+        _In_ ULONG Resolution,
+        _In_ ULONG Conversions,
+        _In_ BYTE Flags)
+    {
+        LONG64 Sequence = m_Next;
+        SLOT* pSlot = &m_Slots[Sequence & (ISL29018_HISTORY_SIZE - 1)];
+
+        // Readers must see the slot invalid before any of it changes
+        InterlockedExchange64(&pSlot->Stamp, 0);
+
+        pSlot->Sample.Sequence = static_cast<ULONGLONG>(Sequence);
+        pSlot->Sample.Timestamp = *pTimestamp;
+        pSlot->Sample.Lux = Lux;
+        pSlot->Sample.RawCount = static_cast<USHORT>(RawCount);
+        pSlot->Sample.IrCount = static_cast<USHORT>(IrCount);
+        pSlot->Sample.Range = static_cast<BYTE>(Range);
+        pSlot->Sample.Resolution = static_cast<BYTE>(Resolution);
+        pSlot->Sample.Conversions = static_cast<BYTE>((Conversions > MAXUCHAR) ? MAXUCHAR : Conversions);
+        pSlot->Sample.Flags = Flags;
+        pSlot->Sample.Reserved = 0;
+
+        WriteRelease64(&pSlot->Stamp, Sequence + 1);
+        WriteRelease64(&m_Next, Sequence + 1);
+    }
+
+    // Copy the samples asked for by pRequest, oldest first, as many as
+    // MaxCount. Returns the number of samples copied.
+    ULONG Read(
+        _In_ const ISL29018_HISTORY_REQUEST* pRequest,
+        _Out_ PISL29018_HISTORY_HEADER pHeader,
+        _Out_writes_(MaxCount) PISL29018_HISTORY_SAMPLE pSamples,
+        _In_ ULONG MaxCount)
+    {
+        ULONGLONG Next = static_cast<ULONGLONG>(ReadAcquire64(&m_Next));
+        ULONGLONG Oldest = (Next > ISL29018_HISTORY_SIZE) ? (Next - ISL29018_HISTORY_SIZE) : 0;
+        ULONGLONG StartTime = ToTime(pRequest->StartTime);
+        ULONG Count = 0;
+        ULONGLONG Sequence = (pRequest->FirstSequence > Oldest) ? pRequest->FirstSequence : Oldest;
+
+        for (; Sequence < Next && Count < MaxCount; Sequence++)
+        {
+            SLOT* pSlot = &m_Slots[Sequence & (ISL29018_HISTORY_SIZE - 1)];
+            LONG64 Stamp = static_cast<LONG64>(Sequence + 1);
+
+            if (ReadAcquire64(&pSlot->Stamp) != Stamp)
+            {
+                continue;
+            }
+
+            pSamples[Count] = pSlot->Sample;
+
+            // The interlocked read is a full barrier, it cannot be done before the copy
+            if (InterlockedCompareExchange64(&pSlot->Stamp, 0, 0) != Stamp ||
+                ToTime(pSamples[Count].Timestamp) < StartTime)
+            {
+                continue;
+            }
+
+            Count++;
+        }
+
+        pHeader->Version = ISL29018_HISTORY_VERSION;
+        pHeader->SampleSize = sizeof(ISL29018_HISTORY_SAMPLE);
+        pHeader->Capacity = ISL29018_HISTORY_SIZE;
+        pHeader->Count = Count;
+        pHeader->OldestSequence = Oldest;
+        pHeader->NextSequence = Sequence;
+
+        return Count;
+    }
+
+} SampleHistory, *PSampleHistory;
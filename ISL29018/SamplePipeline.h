@@ -0,0 +1,303 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the part of the light sample path that neither
+//    touches the bus nor the framework: extracting the count from the status
+//    block, decimation, conversion to lux with infrared compensation, noise
+//    filtering, the threshold test and the interrupt window around the last
+//    report. It also decides the bus work of a beat of the timer and of a
+//    polled sample: single conversions, interleaved IR conversions and the
+//    hand-over to the window. The driver reads the registers, does the
+//    writes asked for and delivers the samples this produces. It has no
+//    framework dependencies so it builds and is benchmarked off-target, see
+//    Benchmark\SampleBench.cpp, and Benchmark\ModelTest.cpp runs it
+//    against the chip model.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include <cmath>
+
+#include "isl29018.h"
+#include "AcquisitionScheduler.h"
+#include "AutoRange.h"
+#include "IrCompensation.h"
+#include "NoiseFilter.h"
+#include "Decimator.h"
+#include "SampleRing.h"
+#include "ThresholdWindow.h"
+
+// What became of a status block read from the chip
+typedef enum
+{
+    SampleOutcome_Failed = 0,       // The read failed, or the configuration had to be restored
+    SampleOutcome_Discarded,        // The conversion straddled a range switch
+    SampleOutcome_Quiet,            // Converted, inside the thresholds of the last report
+    SampleOutcome_Reported,         // Converted and reported
+} SAMPLE_OUTCOME, *PSAMPLE_OUTCOME;
+
+// The bus work of a beat of the timer, see GetBeatAction
+typedef enum
+{
+    BeatAction_ReadSample = 0,      // Read the status block and process the sample
+    BeatAction_StartAls,            // Start a single ALS conversion, the next beat reads it
+    BeatAction_StartIr,             // Start a single IR conversion in place of the ALS one
+    BeatAction_ReadIr,              // Read the IR conversion, the next beat starts an ALS one
+    BeatAction_ReadIrAndResume,     // Read the IR conversion, then resume continuous ALS conversions
+} BEAT_ACTION;
+
+// The bus work that follows a polled sample, see OnPolledSample
+typedef enum
+{
+    PollAction_None = 0,
+    PollAction_StartIr,             // Start an IR conversion, the next beat reads it in place of a sample
+    PollAction_ArmWindow,           // Hand over to the threshold window
+    PollAction_ResumeAndArmWindow,  // Resume continuous conversions, then hand over to the window
+} POLL_ACTION;
+
+typedef class _SamplePipeline
+{
+protected:
+    // Internal struct used to store thresholds
+    typedef struct _AlsThresholdData
+    {
+        FLOAT LuxPct;
+        FLOAT LuxAbs;
+    } AlsThresholdData;
+
+    AutoRange                   m_AutoRange;
+    IrInterleave                m_IrInterleave;
+    NoiseFilter                 m_Filter;
+    ULONG                       m_LastRawCount;
+    Decimator                   m_Decimator;
+
+    bool                        m_FirstSample;
+
+    AlsThresholdData            m_CachedThresholds;
+    FLOAT                       m_CachedData;
+    FLOAT                       m_LastSample;
+
+    // Polling or interrupts, and the single conversion started for the next
+    // beat. An IR conversion in flight takes the place of the next ALS sample.
+    AcquisitionScheduler        m_Scheduler;
+    bool                        m_ConversionPending;
+    bool                        m_IrPending;
+
+    // The COMMAND2 value for the range and resolution selected by the auto-ranging engine
+    BYTE GetCommand2() const
+    {
+        return static_cast<BYTE>((ISL29018_CMD2_SCHEME_AMBIENT_REJECT << ISL29018_CMD2_SCHEME_SHIFT) |
+                                 (m_AutoRange.GetResolution() << ISL29018_CMD2_RESOLUTION_SHIFT) |
+                                 (m_AutoRange.GetRange() << ISL29018_CMD2_RANGE_SHIFT));
+    }
+
+    // ALS count in the data registers of a status block read from COMMAND1
+    static ULONG GetStatusRawCount(
+        _In_reads_(ISL29018_STATUS_SIZE_BYTES) const BYTE* pStatusBuffer)
+    {
+        const BYTE* pDataBuffer = &pStatusBuffer[ISL29018_STATUS_DATA];
+        return (static_cast<ULONG>(pDataBuffer[1]) << 8) | pDataBuffer[0];
+    }
+
+    // The conversion in flight when the range changed may straddle both
+    // ranges. Returns true if the sample must be dropped.
+    bool DiscardSample()
+    {
+        if (!m_AutoRange.ConsumeDiscard())
+        {
+            return false;
+        }
+
+        m_Decimator.Reset();
+        return true;
+    }
+
+    // Check and convert a status block read from COMMAND1. A block read with
+    // another COMMAND2 than the one programmed is Failed: the chip lost its
+    // configuration and COMMAND2 must be written again. A converted sample is
+    // Quiet until TakeReport says otherwise, and its count may move the
+    // range: *pRangeChanged asks for COMMAND2 to be written, RestoreRange
+    // takes the switch back if that fails.
+    SAMPLE_OUTCOME ConvertStatus(
+        _In_reads_(ISL29018_STATUS_SIZE_BYTES) const BYTE* pStatusBuffer,
+        _In_ FLOAT IrCoefficient,       // Share of the IR reading seen by the ALS channel
+        _Out_ PULONG pRawCount,
+        _Out_ PULONG pConversions,      // Conversions averaged into the sample, 0 if not converted
+        _Out_ bool* pRangeChanged)
+    {
+        *pRawCount = GetStatusRawCount(pStatusBuffer);
+        *pConversions = 0;
+        *pRangeChanged = false;
+
+        if (pStatusBuffer[ISL29018_STATUS_COMMAND2] != GetCommand2())
+        {
+            m_Decimator.Reset();
+            return SampleOutcome_Failed;
+        }
+
+        if (DiscardSample())
+        {
+            return SampleOutcome_Discarded;
+        }
+
+        *pConversions = ConvertSample(*pRawCount, IrCoefficient);
+
+        // Move to the range with the best precision for the current light level
+        *pRangeChanged = m_AutoRange.Evaluate(*pRawCount);
+
+        return SampleOutcome_Quiet;
+    }
+
+    // COMMAND2 could not be written after a range switch, the chip still
+    // converts at Range and its next sample is good
+    VOID RestoreRange(
+        _In_ ULONG Range)
+    {
+        m_AutoRange.SetRange(Range);
+        m_AutoRange.ConsumeDiscard();
+    }
+
+    // Convert a raw count into m_CachedData. Returns the number of
+    // conversions that were averaged into it.
+    ULONG ConvertSample(
+        _In_ ULONG RawCount,
+        _In_ FLOAT IrCoefficient)       // Share of the IR reading seen by the ALS channel
+    {
+        ULONG Conversions = 1;
+
+        // Average in the conversions taken earlier in the interval
+        FLOAT Count = static_cast<FLOAT>(RawCount);
+        if (m_Decimator.GetCount() > 0)
+        {
+            m_Decimator.Add(RawCount);
+            Count = m_Decimator.GetMean();
+            Conversions = m_Decimator.GetCount();
+            m_Decimator.Reset();
+        }
+        m_LastRawCount = RawCount;
+
+        // Perform data conversion, remove the infrared share of the reading and
+        // smooth out the noise before the thresholds see it
+        m_CachedData = m_Filter.Apply(IrCompensatedLux(Count * m_AutoRange.GetLuxPerCount(),
+                                                       m_IrInterleave.GetIrLux(),
+                                                       IrCoefficient));
+        m_IrInterleave.OnAlsSample();
+
+        return Conversions;
+    }
+
+    // Compare m_CachedData to the thresholds. Returns true and fills pSample if
+    // it is to be reported, the first sample after a start always is.
+    bool TakeReport(
+        _In_ const FILETIME* pCaptureTime,
+        _In_ ULONG RawCount,
+        _Out_ PRING_SAMPLE pSample)
+    {
+        // Compare the change of data to threshold, and only push the data back to
+        // clx if the change exceeds threshold. This is usually done in HW.
+        if (!m_FirstSample &&
+            // Lux thresholds needs to exceed absolute and percentage
+            !((std::abs(m_CachedData - m_LastSample) >= (m_LastSample * m_CachedThresholds.LuxPct)) &&
+                (std::abs(m_CachedData - m_LastSample) >= m_CachedThresholds.LuxAbs)))
+        {
+            return false;
+        }
+
+        // update last sample
+        m_LastSample = m_CachedData;
+
+        *pSample = {};
+        pSample->Sample.Timestamp = *pCaptureTime;
+        pSample->Sample.Lux = m_LastSample;
+        pSample->Sample.IrCount = m_IrInterleave.GetIrCount();
+        pSample->RawCount = RawCount;
+        pSample->FirstSample = m_FirstSample;
+
+        m_FirstSample = false;
+        return true;
+    }
+
+    // The INT_LT/INT_HT window around the last reported sample. The chip
+    // compares uncompensated ALS counts, so the counts the IR compensation
+    // subtracted are added back, and the window ends where the current range
+    // does so that leaving the range raises an interrupt too.
+    THRESHOLD_WINDOW GetThresholdWindow(
+        _In_ FLOAT IrCoefficient) const
+    {
+        THRESHOLD_WINDOW Window = ComputeThresholdWindow(m_LastSample,
+                                                         m_CachedThresholds.LuxPct,
+                                                         m_CachedThresholds.LuxAbs,
+                                                         m_AutoRange.GetLuxPerCount());
+
+        Window = OffsetThresholdWindow(Window, IrCompensationOffsetCount(m_IrInterleave.GetIrLux(),
+                                                                         IrCoefficient,
+                                                                         m_AutoRange.GetLuxPerCount()));
+
+        m_AutoRange.ClampWindow(&Window.LowCount, &Window.HighCount);
+        return Window;
+    }
+
+    // Pick the bus work of a beat of the timer. In one-shot mode a beat
+    // starts a single conversion, IR if one is due, and the next beat reads
+    // it. A beat whose start failed asks again with StartFailed and reads the
+    // previous conversion instead. An IR conversion in flight is read in
+    // place of an ALS sample, with continuous conversions those resume.
+    BEAT_ACTION GetBeatAction(
+        _In_ bool StartFailed)
+    {
+        if (!StartFailed && m_Scheduler.UseOneShot() && !m_ConversionPending)
+        {
+            m_ConversionPending = true;
+            return m_IrInterleave.IsIrDue() ? BeatAction_StartIr : BeatAction_StartAls;
+        }
+        m_ConversionPending = false;
+
+        if (m_IrPending)
+        {
+            m_IrPending = false;
+            return m_Scheduler.UseOneShot() ? BeatAction_ReadIr : BeatAction_ReadIrAndResume;
+        }
+
+        return BeatAction_ReadSample;
+    }
+
+    // Account for a polled sample and pick the bus work that follows it. Only
+    // converted samples tell whether the light is stable; once it is, the
+    // scheduler hands over to the window, which is only evaluated on
+    // continuous conversions. Otherwise an IR conversion is started if one
+    // is due.
+    POLL_ACTION OnPolledSample(
+        _In_ ULONG NowMs,
+        _In_ SAMPLE_OUTCOME Outcome)
+    {
+        bool WasOneShot = m_Scheduler.UseOneShot();
+        ACQUISITION_MODE Mode = (Outcome >= SampleOutcome_Quiet) ?
+                                m_Scheduler.OnPolledSample(NowMs, SampleOutcome_Reported == Outcome) :
+                                m_Scheduler.OnFailedSample();
+        if (AcquisitionMode_Interrupt == Mode)
+        {
+            return WasOneShot ? PollAction_ResumeAndArmWindow : PollAction_ArmWindow;
+        }
+
+        return GetIrAction();
+    }
+
+    // The window could not be armed, keep polling until the scheduler is reset
+    POLL_ACTION OnArmWindowFailed()
+    {
+        m_Scheduler.DisableInterrupt();
+        return GetIrAction();
+    }
+
+private:
+    // With continuous conversions the IR conversion runs until the next beat
+    POLL_ACTION GetIrAction() const
+    {
+        return (!m_Scheduler.UseOneShot() && m_IrInterleave.IsIrDue()) ? PollAction_StartIr : PollAction_None;
+    }
+
+} SamplePipeline, *PSamplePipeline;
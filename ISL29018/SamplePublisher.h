@@ -0,0 +1,159 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the layout of the shared memory section in which
+//    the driver publishes the last reported light sample of every chip, the
+//    class that publishes into it and the routine other processes read it
+//    with. Readers map the section read-only by name and read it without a
+//    system call or a lock.
+//
+//    The sample is guarded by a sequence lock: the writer makes the lock odd
+//    before it changes the sample and even again afterwards. A reader copies
+//    the sample between two reads of the lock and keeps the copy if the lock
+//    was even and did not change. The writer never waits for readers, and a
+//    reader only retries while a sample is being written, which takes a few
+//    stores.
+//
+//    The header is shared by the driver and the tools, so it only depends on
+//    the Windows headers.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF), user mode
+
+#pragma once
+
+#include <windows.h>
+
+// Name of the section of a chip, formatted with the chip's index. Chips are
+// numbered in the order of their I2C connection resources.
+#define ISL29018_SHARED_SAMPLE_NAME         L"Global\\ISL29018_Sample_%lu"
+
+// SYSTEM and the driver host's LocalService account have full access,
+// authenticated users may only read
+#define ISL29018_SHARED_SAMPLE_SDDL         L"D:P(A;;GA;;;SY)(A;;GA;;;LS)(A;;GR;;;AU)"
+
+#define ISL29018_SHARED_SAMPLE_VERSION      (1)
+
+// Times a reader tries before it gives up on a writer that keeps the lock
+#define ISL29018_SHARED_SAMPLE_ATTEMPTS     (64)
+
+typedef struct _ISL29018_PUBLISHED_SAMPLE
+{
+    ULONGLONG   Sequence;               // Samples published since the section was created, 0 before the first
+    FILETIME    Timestamp;              // Time the sample's read was started
+    FLOAT       Lux;
+    USHORT      RawCount;               // ALS count the sample was converted from
+    BYTE        Range;                  // Range the count was converted at
+    BYTE        Resolution;             // Resolution the count was converted at
+} ISL29018_PUBLISHED_SAMPLE, *PISL29018_PUBLISHED_SAMPLE;
+
+typedef struct _ISL29018_SHARED_SAMPLE
+{
+    ULONG                       Version;    // ISL29018_SHARED_SAMPLE_VERSION
+    ULONG                       Size;       // sizeof(ISL29018_SHARED_SAMPLE)
+    volatile LONG               Lock;       // Odd while Sample is being written
+    ULONG                       Reserved;
+    ISL29018_PUBLISHED_SAMPLE   Sample;
+} ISL29018_SHARED_SAMPLE, *PISL29018_SHARED_SAMPLE;
+
+// Copy the last published sample out of a mapped section. Returns false if
+// the section does not have the expected layout, or if every attempt
+// overlapped a write.
+inline bool Isl29018ReadSharedSample(
+    _In_ const ISL29018_SHARED_SAMPLE* pShared,
+    _Out_ PISL29018_PUBLISHED_SAMPLE pSample)
+{
+    if (ISL29018_SHARED_SAMPLE_VERSION != pShared->Version || sizeof(ISL29018_SHARED_SAMPLE) != pShared->Size)
+    {
+        return false;
+    }
+
+    for (ULONG Attempt = 0; Attempt < ISL29018_SHARED_SAMPLE_ATTEMPTS; Attempt++)
+    {
+        LONG Begin = ReadAcquire(&pShared->Lock);
+        if (0 != (Begin & 1))
+        {
+            YieldProcessor();
+            continue;
+        }
+
+        *pSample = pShared->Sample;
+
+        // The view is read-only, so the copy is ordered before the second
+        // read of the lock with a fence rather than an interlocked read
+        MemoryBarrier();
+
+        if (ReadAcquire(&pShared->Lock) == Begin)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Publishes samples into a mapped section. Called from the acquisition path
+// only, so there is a single writer.
+typedef class _SamplePublisher
+{
+private:
+    PISL29018_SHARED_SAMPLE     m_pShared;      // NULL while not publishing
+    ULONGLONG                   m_Sequence;
+
+public:
+    // Publish into the mapped view, which holds an ISL29018_SHARED_SAMPLE
+    VOID Attach(
+        _Inout_ PISL29018_SHARED_SAMPLE pShared)
+    {
+        m_Sequence = 0;
+
+        pShared->Lock = 0;
+        pShared->Reserved = 0;
+        pShared->Sample = {};
+        pShared->Size = sizeof(ISL29018_SHARED_SAMPLE);
+
+        // A reader that sees the version sees an initialized section
+        WriteRelease(reinterpret_cast<volatile LONG*>(&pShared->Version), ISL29018_SHARED_SAMPLE_VERSION);
+
+        m_pShared = pShared;
+    }
+
+    // Stop publishing. The caller unmaps the view afterwards.
+    VOID Detach()
+    {
+        m_pShared = nullptr;
+    }
+
+    bool IsPublishing() const { return nullptr != m_pShared; }
+
+    VOID Publish(
+        _In_ const FILETIME* pTimestamp,
+        _In_ FLOAT Lux,
+        _In_ ULONG RawCount,
+        _In_ ULONG Range,
+        _In_ ULONG Resolution)
+    {
+        if (nullptr == m_pShared)
+        {
+            return;
+        }
+
+        // The interlocked increment is a full barrier, readers see the lock
+        // odd before any of the sample changes
+        LONG Lock = InterlockedIncrement(&m_pShared->Lock);
+
+        m_pShared->Sample.Sequence = ++m_Sequence;
+        m_pShared->Sample.Timestamp = *pTimestamp;
+        m_pShared->Sample.Lux = Lux;
+        m_pShared->Sample.RawCount = static_cast<USHORT>(RawCount);
+        m_pShared->Sample.Range = static_cast<BYTE>(Range);
+        m_pShared->Sample.Resolution = static_cast<BYTE>(Resolution);
+
+        WriteRelease(&m_pShared->Lock, Lock + 1);
+    }
+
+    ULONGLONG GetSequence() const { return m_Sequence; }
+
+} SamplePublisher, *PSamplePublisher;
@@ -0,0 +1,243 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the format of the raw sample recordings and the
+//    classes that write and read them. A recording is a header followed by
+//    fixed size records, each holding the raw count, the range and resolution
+//    it was converted at and the time its read was started. The records form
+//    a ring, once it is full the oldest ones are overwritten.
+//
+//    The driver maps the recording file and SampleRecorder appends to the
+//    mapping, so recording a sample is a store to memory and the file is
+//    written back by the memory manager. SampleRecording reads a mapped
+//    recording, oldest record first, for the replay tool, see
+//    Benchmark\SampleReplay.cpp. Neither has framework dependencies.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "isl29018.h"
+
+#define SampleRecord_Magic                  (0x52393249)    // "I29R"
+#define SampleRecord_Version                (1)
+
+// Records kept by default, a little over a day of 100ms samples
+#define SampleRecord_DefaultCapacity        (1024 * 1024)
+
+typedef enum
+{
+    SampleRecord_Als = 0,       // Status block of an ALS sample, as read
+    SampleRecord_ReadError,     // Failed read of an ALS sample, no count
+    SampleRecord_Ir,            // IR conversion, kept for the compensation
+    SampleRecord_Oversample,    // Conversion averaged into the next ALS sample
+    SampleRecord_Start,         // Sensor started, the filter and the IR reading are reset
+    SampleRecord_Restart,       // Acquisition restarted, the next sample is a first sample
+    SampleRecord_KindCount
+} SAMPLE_RECORD_KIND;
+
+typedef struct _SAMPLE_RECORD
+{
+    FILETIME    Timestamp;      // Time the read was started
+    USHORT      RawCount;       // DATA_MSB:DATA_LSB
+    BYTE        Command2;       // Range and resolution the conversion was taken at
+    BYTE        Kind;           // SAMPLE_RECORD_KIND
+} SAMPLE_RECORD, *PSAMPLE_RECORD;
+
+static_assert(sizeof(SAMPLE_RECORD) == 12, "Recordings are read back on other hosts");
+
+typedef struct _SAMPLE_RECORD_HEADER
+{
+    ULONG           Magic;          // SampleRecord_Magic
+    ULONG           Version;        // SampleRecord_Version
+    ULONG           HeaderSize;     // sizeof(SAMPLE_RECORD_HEADER)
+    ULONG           RecordSize;     // sizeof(SAMPLE_RECORD)
+    ULONG           Capacity;       // Records following the header
+    FLOAT           IrCoefficient;  // AlsDevice_IrCoefficient of the recording driver
+    volatile LONG64 Written;        // Records appended since the file was created
+} SAMPLE_RECORD_HEADER, *PSAMPLE_RECORD_HEADER;
+
+static_assert(sizeof(SAMPLE_RECORD_HEADER) == 32, "Recordings are read back on other hosts");
+
+// Bytes of a recording holding Capacity records
+inline ULONGLONG SampleRecordFileSize(
+    _In_ ULONG Capacity)
+{
+    return sizeof(SAMPLE_RECORD_HEADER) + static_cast<ULONGLONG>(Capacity) * sizeof(SAMPLE_RECORD);
+}
+
+// Returns true if the header describes a recording that fits in Size bytes
+inline bool SampleRecordIsValid(
+    _In_ const SAMPLE_RECORD_HEADER* pHeader,
+    _In_ ULONGLONG Size)
+{
+    return Size >= sizeof(SAMPLE_RECORD_HEADER) &&
+           SampleRecord_Magic == pHeader->Magic &&
+           SampleRecord_Version == pHeader->Version &&
+           sizeof(SAMPLE_RECORD_HEADER) == pHeader->HeaderSize &&
+           sizeof(SAMPLE_RECORD) == pHeader->RecordSize &&
+           0 != pHeader->Capacity &&
+           SampleRecordFileSize(pHeader->Capacity) <= Size;
+}
+
+// Appends records to a mapped recording. Called from the acquisition path
+// only, so there is a single writer. Readers of a live recording see the
+// records up to the header's Written count.
+typedef class _SampleRecorder
+{
+private:
+    PSAMPLE_RECORD_HEADER   m_pHeader;      // NULL while not recording
+    PSAMPLE_RECORD          m_pRecords;
+    ULONG                   m_Next;         // Slot of the next record
+    LONG64                  m_Written;
+
+public:
+    // Record into the mapped view. A recording already in the view is
+    // continued if it has the same layout, otherwise a new one is started.
+    // Returns false if the view cannot hold a single record.
+    bool Attach(
+        _Inout_updates_bytes_(Size) PVOID pView,
+        _In_ ULONGLONG Size,
+        _In_ FLOAT IrCoefficient)
+    {
+        PSAMPLE_RECORD_HEADER pHeader = static_cast<PSAMPLE_RECORD_HEADER>(pView);
+
+        m_pHeader = nullptr;
+        if (Size < SampleRecordFileSize(1))
+        {
+            return false;
+        }
+
+        ULONGLONG Capacity = (Size - sizeof(SAMPLE_RECORD_HEADER)) / sizeof(SAMPLE_RECORD);
+        if (Capacity > MAXULONG)
+        {
+            Capacity = MAXULONG;
+        }
+
+        if (!SampleRecordIsValid(pHeader, Size) ||
+            pHeader->Capacity != Capacity ||
+            pHeader->IrCoefficient != IrCoefficient ||
+            pHeader->Written < 0)
+        {
+            pHeader->Magic = SampleRecord_Magic;
+            pHeader->Version = SampleRecord_Version;
+            pHeader->HeaderSize = sizeof(SAMPLE_RECORD_HEADER);
+            pHeader->RecordSize = sizeof(SAMPLE_RECORD);
+            pHeader->Capacity = static_cast<ULONG>(Capacity);
+            pHeader->IrCoefficient = IrCoefficient;
+            pHeader->Written = 0;
+        }
+
+        m_pRecords = reinterpret_cast<PSAMPLE_RECORD>(pHeader + 1);
+        m_Written = pHeader->Written;
+        m_Next = static_cast<ULONG>(static_cast<ULONGLONG>(m_Written) % pHeader->Capacity);
+        m_pHeader = pHeader;
+        return true;
+    }
+
+    // Stop recording. The caller unmaps the view afterwards.
+    VOID Detach()
+    {
+        m_pHeader = nullptr;
+    }
+
+    bool IsRecording() const { return nullptr != m_pHeader; }
+
+    VOID Append(
+        _In_ SAMPLE_RECORD_KIND Kind,
+        _In_ const FILETIME* pTimestamp,
+        _In_ ULONG RawCount,
+        _In_ BYTE Command2)
+    {
+        if (nullptr == m_pHeader)
+        {
+            return;
+        }
+
+        PSAMPLE_RECORD pRecord = &m_pRecords[m_Next];
+        pRecord->Timestamp = *pTimestamp;
+        pRecord->RawCount = static_cast<USHORT>(RawCount);
+        pRecord->Command2 = Command2;
+        pRecord->Kind = static_cast<BYTE>(Kind);
+
+        if (++m_Next == m_pHeader->Capacity)
+        {
+            m_Next = 0;
+        }
+
+        // The record must be visible before a reader counts it
+        WriteRelease64(&m_pHeader->Written, ++m_Written);
+    }
+
+    LONG64 GetWritten() const { return m_Written; }
+
+} SampleRecorder, *PSampleRecorder;
+
+// Reads a mapped recording, oldest record first
+typedef class _SampleRecording
+{
+private:
+    const SAMPLE_RECORD*    m_pRecords;
+    ULONG                   m_Capacity;
+    ULONG                   m_First;        // Slot of the oldest record
+    ULONG                   m_Count;
+    FLOAT                   m_IrCoefficient;
+
+public:
+    // Returns false if the view does not hold a recording
+    bool Open(
+        _In_reads_bytes_(Size) const VOID* pView,
+        _In_ ULONGLONG Size)
+    {
+        const SAMPLE_RECORD_HEADER* pHeader = static_cast<const SAMPLE_RECORD_HEADER*>(pView);
+
+        m_Count = 0;
+        if (!SampleRecordIsValid(pHeader, Size) || pHeader->Written < 0)
+        {
+            return false;
+        }
+
+        ULONGLONG Written = static_cast<ULONGLONG>(ReadAcquire64(&pHeader->Written));
+
+        m_pRecords = reinterpret_cast<const SAMPLE_RECORD*>(pHeader + 1);
+        m_Capacity = pHeader->Capacity;
+        m_IrCoefficient = pHeader->IrCoefficient;
+
+        // Once the ring wrapped the oldest record is the next one to be overwritten
+        if (Written > m_Capacity)
+        {
+            m_First = static_cast<ULONG>(Written % m_Capacity);
+            m_Count = m_Capacity;
+        }
+        else
+        {
+            m_First = 0;
+            m_Count = static_cast<ULONG>(Written);
+        }
+
+        return true;
+    }
+
+    ULONG GetCount() const { return m_Count; }
+    FLOAT GetIrCoefficient() const { return m_IrCoefficient; }
+
+    // The records in order are the slots from m_First up to the end of the
+    // ring, then the slots from the start of the ring up to m_First
+    const SAMPLE_RECORD* GetSpan(
+        _In_ ULONG Span,            // 0 or 1
+        _Out_ PULONG pCount) const
+    {
+        ULONG Tail = m_Capacity - m_First;
+        if (m_Count < Tail)
+        {
+            Tail = m_Count;
+        }
+
+        *pCount = (0 == Span) ? Tail : (m_Count - Tail);
+        return (0 == Span) ? &m_pRecords[m_First] : m_pRecords;
+    }
+
+} SampleRecording, *PSampleRecording;
@@ -0,0 +1,99 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains the lock-free single producer, single consumer ring
+//    that hands acquired light samples from the acquisition path to the
+//    delivery work item. Neither side ever waits for the other; a full ring
+//    drops the new sample rather than delaying the next bus read. It has no
+//    framework dependencies so it can be exercised off-target.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "SampleFifo.h"
+
+// Samples in flight between acquisition and delivery, must be a power of two
+#define SampleRing_Size                     (16)
+
+static_assert((SampleRing_Size & (SampleRing_Size - 1)) == 0, "SampleRing_Size must be a power of two");
+
+typedef struct _RING_SAMPLE
+{
+    FIFO_SAMPLE Sample;         // Converted sample and the time it was read
+    ULONG       RawCount;       // ALS count the sample was converted from
+    bool        FirstSample;    // First sample after start, reported without batching
+} RING_SAMPLE, *PRING_SAMPLE;
+
+typedef class _SampleRing
+{
+private:
+    RING_SAMPLE         m_Samples[SampleRing_Size];
+
+    // Free running counters, the slot is the counter modulo the ring size.
+    // m_Head is only written by the producer and m_Tail only by the consumer.
+    volatile LONG       m_Head;
+    volatile LONG       m_Tail;
+
+    // Counters, only written by the producer
+    ULONG               m_Drops;
+
+    static LONG Next(_In_ LONG Index)
+    {
+        return static_cast<LONG>(static_cast<ULONG>(Index) + 1);
+    }
+
+public:
+    // Only call while neither side runs
+    VOID Reset()
+    {
+        m_Head = 0;
+        m_Tail = 0;
+        m_Drops = 0;
+    }
+
+    // Producer side. Returns false and drops the sample if the ring is full.
+    bool Enqueue(
+        _In_ const RING_SAMPLE& Sample)
+    {
+        LONG Head = m_Head;
+        LONG Tail = ReadAcquire(&m_Tail);
+
+        if (static_cast<ULONG>(Head) - static_cast<ULONG>(Tail) >= SampleRing_Size)
+        {
+            m_Drops++;
+            return false;
+        }
+
+        m_Samples[static_cast<ULONG>(Head) & (SampleRing_Size - 1)] = Sample;
+
+        // Publish the slot only after it was written
+        WriteRelease(&m_Head, Next(Head));
+        return true;
+    }
+
+    // Consumer side. Returns false if the ring is empty.
+    bool Dequeue(
+        _Out_ PRING_SAMPLE pSample)
+    {
+        LONG Tail = m_Tail;
+        LONG Head = ReadAcquire(&m_Head);
+
+        if (Head == Tail)
+        {
+            return false;
+        }
+
+        *pSample = m_Samples[static_cast<ULONG>(Tail) & (SampleRing_Size - 1)];
+
+        // Hand the slot back only after it was read
+        WriteRelease(&m_Tail, Next(Tail));
+        return true;
+    }
+
+    ULONG GetDrops() const { return m_Drops; }
+
+} SampleRing, *PSampleRing;
@@ -95,12 +95,63 @@ extern "C" {
 
 
 
+// HOT PATH ----------------------------------------------------------------------------------------------
+//
+// Trace points that run for every sample. Their enable condition is the
+// constant ISL29018_HOT_PATH_TRACING, so when it is 0 the compiler drops them
+// and the sample path pays nothing for them, not even the flag test. It is 1
+// by default in debug builds only; define it on the command line to override.
+// The aggregated counter events of the TraceLogging provider cover the sample
+// path when it is 0.
+
+#ifndef ISL29018_HOT_PATH_TRACING
+#if DBG
+#define ISL29018_HOT_PATH_TRACING   1
+#else
+#define ISL29018_HOT_PATH_TRACING   0
+#endif
+#endif
+
+//begin_wpp config
+//FUNC TraceHotVerbose{HOTPATH=ON,LEVEL=TRACE_LEVEL_VERBOSE,FLAGS=Verbose}(MSG,...);
+//FUNC TraceHotInformation{HOTPATH=ON,LEVEL=TRACE_LEVEL_INFORMATION,FLAGS=Information}(MSG,...);
+//end_wpp
+#define WPP_HOTPATH_LEVEL_FLAGS_ENABLED(HOTPATH, LEVEL, FLAGS)      (ISL29018_HOT_PATH_TRACING && WPP_LEVEL_FLAGS_ENABLED(LEVEL, FLAGS))
+#define WPP_HOTPATH_LEVEL_FLAGS_LOGGER(HOTPATH, LEVEL, FLAGS)       WPP_LEVEL_FLAGS_LOGGER(LEVEL, FLAGS)
+
+//MACRO: SENSOR_HotPathEnter
+//
+//begin_wpp config
+//USEPREFIX (SENSOR_HotPathEnter, "%!STDPREFIX! SENSOR %!FUNC! FunctionEnter");
+//FUNC SENSOR_HotPathEnter{HOTPATH=ON,LEVEL=TRACE_LEVEL_VERBOSE,FLAGS=EntryExit}(...);
+//end_wpp
+
+//MACRO: SENSOR_HotPathExit
+//
+//begin_wpp config
+//USEPREFIX (SENSOR_HotPathExit, "%!STDPREFIX! SENSOR %!FUNC! FunctionExit: %!STATUS!", __status);
+//FUNC SENSOR_HotPathExit{HOTPATH=ON,LEVEL=TRACE_LEVEL_VERBOSE,FLAGS=EntryExit}(SENSOREXIT);
+//end_wpp
+#define WPP_HOTPATH_LEVEL_FLAGS_SENSOREXIT_ENABLED(HOTPATH, LEVEL, FLAGS, status)   WPP_HOTPATH_LEVEL_FLAGS_ENABLED(HOTPATH, LEVEL, FLAGS)
+#define WPP_HOTPATH_LEVEL_FLAGS_SENSOREXIT_LOGGER(HOTPATH, LEVEL, FLAGS, status)    WPP_LEVEL_FLAGS_LOGGER(LEVEL, FLAGS)
+
+#define WPP_HOTPATH_LEVEL_FLAGS_SENSOREXIT_PRE(HOTPATH, LEVEL, FLAGS, status)       {                                    \
+                                                                                    NTSTATUS __status = status;
+#define WPP_HOTPATH_LEVEL_FLAGS_SENSOREXIT_POST(HOTPATH, LEVEL, FLAGS, status)          /*TraceMessage()*/;              \
+                                                                                }
+
+
+
 // WPP Recorder -------------------------------------------------------------------------------------------
 //
 // The following two macros are required to enable WPP Recorder functionality for clients of the Sensor Class Extension
 //
 #define WPP_RECORDER_LEVEL_FLAGS_SENSOREXIT_FILTER(LEVEL, FLAGS, status)   WPP_RECORDER_LEVEL_FLAGS_FILTER(LEVEL, FLAGS)
 #define WPP_RECORDER_LEVEL_FLAGS_SENSOREXIT_ARGS(LEVEL, FLAGS, status)     WPP_RECORDER_LEVEL_FLAGS_ARGS(LEVEL, FLAGS)
+#define WPP_RECORDER_HOTPATH_LEVEL_FLAGS_FILTER(HOTPATH, LEVEL, FLAGS)               (ISL29018_HOT_PATH_TRACING && WPP_RECORDER_LEVEL_FLAGS_FILTER(LEVEL, FLAGS))
+#define WPP_RECORDER_HOTPATH_LEVEL_FLAGS_ARGS(HOTPATH, LEVEL, FLAGS)                 WPP_RECORDER_LEVEL_FLAGS_ARGS(LEVEL, FLAGS)
+#define WPP_RECORDER_HOTPATH_LEVEL_FLAGS_SENSOREXIT_FILTER(HOTPATH, LEVEL, FLAGS, status)    WPP_RECORDER_HOTPATH_LEVEL_FLAGS_FILTER(HOTPATH, LEVEL, FLAGS)
+#define WPP_RECORDER_HOTPATH_LEVEL_FLAGS_SENSOREXIT_ARGS(HOTPATH, LEVEL, FLAGS, status)      WPP_RECORDER_LEVEL_FLAGS_ARGS(LEVEL, FLAGS)
 
 
 #ifdef __cplusplus
@@ -0,0 +1,86 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module converts the lux change thresholds requested by the clx into
+//    the raw-count window programmed into the INT_LT/INT_HT registers. It has
+//    no framework dependencies so it can be exercised off-target.
+//
+//Environment:
+//
+//    Windows User-Mode Driver Framework (UMDF)
+
+#pragma once
+
+#include "isl29018.h"
+
+#define ISL29018_MAX_COUNT          (0xFFFF)
+
+typedef struct _THRESHOLD_WINDOW
+{
+    USHORT LowCount;
+    USHORT HighCount;
+} THRESHOLD_WINDOW, *PTHRESHOLD_WINDOW;
+
+// The chip raises an interrupt when a conversion falls below INT_LT or above
+// INT_HT. GetData() reports a sample once it moved away from the last reported
+// one by at least both the percentage and the absolute threshold, so the window
+// is centered on the last sample and is as wide as the larger of the two.
+// The bounds are rounded outwards; GetData() still applies the exact test.
+inline THRESHOLD_WINDOW ComputeThresholdWindow(
+    _In_ FLOAT LastSampleLux,       // Last lux value pushed to the clx
+    _In_ FLOAT ThresholdPct,        // Relative threshold, 1.0 = 100%
+    _In_ FLOAT ThresholdAbs,        // Absolute threshold in lux
+    _In_ FLOAT ResolutionLux)       // Lux per raw count in the current configuration
+{
+    THRESHOLD_WINDOW Window = { 0, ISL29018_MAX_COUNT };
+
+    if (ResolutionLux <= 0.0f)
+    {
+        return Window;
+    }
+
+    FLOAT Delta = LastSampleLux * ThresholdPct;
+    if (Delta < ThresholdAbs)
+    {
+        Delta = ThresholdAbs;
+    }
+
+    FLOAT Low = (LastSampleLux - Delta) / ResolutionLux;
+    FLOAT High = (LastSampleLux + Delta) / ResolutionLux;
+
+    if (Low > 0.0f)
+    {
+        Window.LowCount = (Low >= ISL29018_MAX_COUNT) ? ISL29018_MAX_COUNT : static_cast<USHORT>(Low);
+    }
+
+    if (High < ISL29018_MAX_COUNT)
+    {
+        USHORT HighCount = static_cast<USHORT>(High);
+        if (static_cast<FLOAT>(HighCount) < High)
+        {
+            HighCount++;
+        }
+        Window.HighCount = (High <= 0.0f) ? 0 : HighCount;
+    }
+
+    return Window;
+}
+
+// Move a window up by OffsetCount, from counts of the IR compensated light to
+// the raw ALS counts the chip compares. A LowCount of 0 is kept, the window
+// has no low bound then, and the bounds stop at ISL29018_MAX_COUNT.
+inline THRESHOLD_WINDOW OffsetThresholdWindow(
+    _In_ THRESHOLD_WINDOW Window,
+    _In_ USHORT OffsetCount)
+{
+    if (Window.LowCount > 0)
+    {
+        Window.LowCount = (Window.LowCount > ISL29018_MAX_COUNT - OffsetCount) ?
+                          ISL29018_MAX_COUNT : static_cast<USHORT>(Window.LowCount + OffsetCount);
+    }
+    Window.HighCount = (Window.HighCount > ISL29018_MAX_COUNT - OffsetCount) ?
+                       ISL29018_MAX_COUNT : static_cast<USHORT>(Window.HighCount + OffsetCount);
+
+    return Window;
+}
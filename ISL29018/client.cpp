@@ -10,6 +10,8 @@
 //   Windows User-Mode Driver Framework (UMDF)
 
 #include "Device.h"
+#include "Driver.h"
+#include "ProxDevice.h"
 #include "isl29018.h"
 
 #include <timeapi.h>
@@ -19,23 +21,31 @@
 
 #define SENSORV2_POOL_TAG_AMBIENT_LIGHT           '2LmA'
 
-#define Als_Initial_MinDataInterval_Ms            (90)          // 12Hz
+#define Als_Initial_DataInterval_Ms               (ISL29018_CONV_TIME_MS)   // 10Hz, 16 bit data
 #define Als_Initial_Lux_Threshold_Pct             (1.0f)        // Percent threshold: 100%
 #define Als_Initial_Lux_Threshold_Abs             (0.0f)        // Absolute threshold: 0 lux
 
-#define AlsDevice_Minimum_Lux                     (0.0f)
-#define AlsDevice_Maximum_Lux                     (4000.0f)
-#define AlsDevice_Precision                       (65536.0f)    // 65536 = 2^16, 16 bit data
-#define AlsDevice_Range_Lux                       (AlsDevice_Maximum_Lux - AlsDevice_Minimum_Lux)
-#define AlsDevice_Resolution_Lux                  (AlsDevice_Range_Lux / AlsDevice_Precision)
-
 // Ambient Light Sensor Unique ID
 // {2D2A4524-51E3-4E68-9B0F-5CAEDFB12C02}
 DEFINE_GUID(GUID_AlsDevice_UniqueID,
     0x2d2a4524, 0x51e3, 0x4e68, 0x9b, 0xf, 0x5c, 0xae, 0xdf, 0xb1, 0x2c, 0x2);
 
+// Raw count of the last IR conversion, VT_UI4
+// {6B1B2E7E-3C55-4F1A-A0D4-5D0B6E8B9A31}
+DEFINE_PROPERTYKEY(PKEY_SensorData_Isl29018_IrCount,
+    0x6b1b2e7e, 0x3c55, 0x4f1a, 0xa0, 0xd4, 0x5d, 0xb, 0x6e, 0x8b, 0x9a, 0x31, 2);
+
 static const UINT SYSTEM_TICK_COUNT_1MS = 1; // 1ms
 
+// Time of the sampling beat, in 100ns ticks since boot. Unlike the millisecond
+// count of GetPerformanceTime it does not wrap while the device runs.
+static ULONGLONG GetBeatTime()
+{
+    ULONGLONG Now = 0;
+    QueryInterruptTimePrecise(&Now);
+    return Now;
+}
+
 //------------------------------------------------------------------------------
 // Function: Initialize
 //
@@ -44,6 +54,7 @@ static const UINT SYSTEM_TICK_COUNT_1MS = 1; // 1ms
 // Arguments:
 //       Device: IN: WDFDEVICE object
 //       SensorInstance: IN: SENSOROBJECT for each sensor instance
+//       ChipIndex: IN: position of the chip's resources in the resource list
 //
 // Return Value:
 //      NTSTATUS code
@@ -51,7 +62,8 @@ static const UINT SYSTEM_TICK_COUNT_1MS = 1; // 1ms
 NTSTATUS
 AlsDevice::Initialize(
     _In_ WDFDEVICE Device,
-    _In_ SENSOROBJECT SensorInstance
+    _In_ SENSOROBJECT SensorInstance,
+    _In_ ULONG ChipIndex
 )
 {
     NTSTATUS Status = STATUS_SUCCESS;
@@ -63,12 +75,44 @@ AlsDevice::Initialize(
     //
     m_Device = Device;
     m_SensorInstance = SensorInstance;
-    m_Started = FALSE;
+    m_ChipIndex = ChipIndex;
+    m_Lifecycle.Reset(Lifecycle_Off);
+    m_Interrupt = NULL;
+    m_InterruptPending = false;
+    m_IrPending = false;
+    m_IrInterleave.Reset();
+    m_Filter.Reset(NoiseFilter_None);
+    m_OversampleEnabled = false;
+    m_OversampleReads = 0;
+    m_LastRawCount = 0;
+    m_Decimator.Reset();
+    m_pProx = nullptr;
+    m_Arbiter.Reset();
+    m_Ring.Reset();
+    m_BatchLatency = 0;
+    m_Fifo.Reset();
+    m_Fifo.ResetCounters();
+    m_Latency.Reset(GetBeatTime());
+    m_Counters.Reset(GetBeatTime());
 
     //
-    // Create Lock
+    // Create the bus executor, it is connected once the I2C target is opened
     //
-    Status = WdfWaitLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &m_I2CWaitLock);
+    Status = m_Bus.Initialize(m_SensorInstance, &m_Latency);
+    if (!NT_SUCCESS(Status))
+    {
+        TraceError("COMBO %!FUNC! ALS Failed to create the bus executor %!STATUS!", Status);
+        goto Exit;
+    }
+
+    Status = WdfWaitLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &m_FifoWaitLock);
+    if (!NT_SUCCESS(Status))
+    {
+        TraceError("COMBO %!FUNC! ALS WdfWaitLockCreate failed %!STATUS!", Status);
+        goto Exit;
+    }
+
+    Status = WdfWaitLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &m_ControlLock);
     if (!NT_SUCCESS(Status))
     {
         TraceError("COMBO %!FUNC! ALS WdfWaitLockCreate failed %!STATUS!", Status);
@@ -95,6 +139,45 @@ AlsDevice::Initialize(
         }
     }
 
+    //
+    // Create timer object for flushing batched samples
+    //
+    {
+        WDF_OBJECT_ATTRIBUTES TimerAttributes;
+        WDF_TIMER_CONFIG TimerConfig;
+
+        WDF_TIMER_CONFIG_INIT(&TimerConfig, AlsDevice::OnBatchTimerExpire);
+        WDF_OBJECT_ATTRIBUTES_INIT(&TimerAttributes);
+        TimerAttributes.ParentObject = SensorInstance;
+        TimerAttributes.ExecutionLevel = WdfExecutionLevelPassive;
+
+        Status = WdfTimerCreate(&TimerConfig, &TimerAttributes, &m_BatchTimer);
+        if (!NT_SUCCESS(Status))
+        {
+            TraceError("COMBO %!FUNC! ALS WdfTimerCreate failed %!STATUS!", Status);
+            goto Exit;
+        }
+    }
+
+    //
+    // Create work item object for delivering samples to the clx
+    //
+    {
+        WDF_OBJECT_ATTRIBUTES WorkItemAttributes;
+        WDF_WORKITEM_CONFIG WorkItemConfig;
+
+        WDF_WORKITEM_CONFIG_INIT(&WorkItemConfig, AlsDevice::OnDeliveryWorkItem);
+        WDF_OBJECT_ATTRIBUTES_INIT(&WorkItemAttributes);
+        WorkItemAttributes.ParentObject = SensorInstance;
+
+        Status = WdfWorkItemCreate(&WorkItemConfig, &WorkItemAttributes, &m_DeliveryWorkItem);
+        if (!NT_SUCCESS(Status))
+        {
+            TraceError("COMBO %!FUNC! ALS WdfWorkItemCreate failed %!STATUS!", Status);
+            goto Exit;
+        }
+    }
+
     //
     // Sensor Enumeration Properties
     //
@@ -139,15 +222,16 @@ AlsDevice::Initialize(
             &(m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_CONNECTION_TYPE].Value));
 
         m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_PERSISTENT_UNIQUE_ID].Key = DEVPKEY_Sensor_PersistentUniqueId;
-        InitPropVariantFromCLSID(GUID_AlsDevice_UniqueID,
+        InitPropVariantFromCLSID(ChipUniqueId(GUID_AlsDevice_UniqueID, ChipIndex),
             &(m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_PERSISTENT_UNIQUE_ID].Value));
 
         m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_CATEGORY].Key = DEVPKEY_Sensor_Category;
         InitPropVariantFromCLSID(GUID_SensorCategory_Light,
             &(m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_CATEGORY].Value));
 
+        // Only the light sensor of the first chip is the primary one
         m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_ISPRIMARY].Key = DEVPKEY_Sensor_IsPrimary;
-        InitPropVariantFromBoolean(TRUE,
+        InitPropVariantFromBoolean(0 == ChipIndex,
             &(m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_ISPRIMARY].Value));
     }
 
@@ -179,6 +263,7 @@ AlsDevice::Initialize(
 
         m_pSupportedDataFields->List[ALS_DATA_TIMESTAMP] = PKEY_SensorData_Timestamp;
         m_pSupportedDataFields->List[ALS_DATA_LUX] = PKEY_SensorData_LightLevel_Lux;
+        m_pSupportedDataFields->List[ALS_DATA_IR_COUNT] = PKEY_SensorData_Isl29018_IrCount;
     }
 
     //
@@ -215,6 +300,9 @@ AlsDevice::Initialize(
         m_pSensorData->List[ALS_DATA_LUX].Key = PKEY_SensorData_LightLevel_Lux;
         InitPropVariantFromFloat(0.0f, &(m_pSensorData->List[ALS_DATA_LUX].Value));
 
+        m_pSensorData->List[ALS_DATA_IR_COUNT].Key = PKEY_SensorData_Isl29018_IrCount;
+        InitPropVariantFromUInt32(0, &(m_pSensorData->List[ALS_DATA_IR_COUNT].Value));
+
         m_CachedData = 1.0f; // Lux
         m_LastSample = 0.0f; // Lux
     }
@@ -250,10 +338,11 @@ AlsDevice::Initialize(
             &(m_pSensorProperties->List[SENSOR_PROPERTY_STATE].Value));
 
         m_pSensorProperties->List[SENSOR_PROPERTY_MIN_DATA_INTERVAL].Key = PKEY_Sensor_MinimumDataInterval_Ms;
-        InitPropVariantFromUInt32(Als_Initial_MinDataInterval_Ms,
+        // The resolution drops with the interval, down to the fastest conversion
+        m_Interval = Als_Initial_DataInterval_Ms;
+        m_MinimumInterval = Isl29018MinimumIntervalMs(AlsDevice_Chip);
+        InitPropVariantFromUInt32(m_MinimumInterval,
             &(m_pSensorProperties->List[SENSOR_PROPERTY_MIN_DATA_INTERVAL].Value));
-        m_Interval = Als_Initial_MinDataInterval_Ms;
-        m_MinimumInterval = Als_Initial_MinDataInterval_Ms;
 
         m_pSensorProperties->List[SENSOR_PROPERTY_MAX_DATA_FIELD_SIZE].Key = PKEY_Sensor_MaximumDataFieldSize_Bytes;
         InitPropVariantFromUInt32(CollectionsListGetMarshalledSize(m_pSensorData),
@@ -285,6 +374,15 @@ AlsDevice::Initialize(
         InitPropVariantFromUInt32Vector(responseCurve,
             10,
             &(m_pSensorProperties->List[SENSOR_PROPERTY_ALS_RESPONSE_CURVE].Value));
+
+        // The FIFO is not shared with other sensors, all of it is reserved
+        m_pSensorProperties->List[SENSOR_PROPERTY_FIFO_RESERVED_SIZE].Key = PKEY_Sensor_FifoReservedSize_Samples;
+        InitPropVariantFromUInt32(SampleFifo_Size,
+            &(m_pSensorProperties->List[SENSOR_PROPERTY_FIFO_RESERVED_SIZE].Value));
+
+        m_pSensorProperties->List[SENSOR_PROPERTY_FIFO_MAX_SIZE].Key = PKEY_Sensor_FifoMaxSize_Samples;
+        InitPropVariantFromUInt32(SampleFifo_Size,
+            &(m_pSensorProperties->List[SENSOR_PROPERTY_FIFO_MAX_SIZE].Value));
     }
 
     //
@@ -314,16 +412,14 @@ AlsDevice::Initialize(
         m_pDataFieldProperties->Count = SENSOR_DATA_FIELD_PROPERTIES_COUNT;
 
         m_pDataFieldProperties->List[SENSOR_DATA_FIELD_PROPERTY_RESOLUTION].Key = PKEY_SensorDataField_Resolution;
-        InitPropVariantFromFloat(AlsDevice_Resolution_Lux,
-            &(m_pDataFieldProperties->List[SENSOR_DATA_FIELD_PROPERTY_RESOLUTION].Value));
-
         m_pDataFieldProperties->List[SENSOR_DATA_FIELD_PROPERTY_RANGE_MIN].Key = PKEY_SensorDataField_RangeMinimum;
         InitPropVariantFromFloat(AlsDevice_Minimum_Lux,
             &(m_pDataFieldProperties->List[SENSOR_DATA_FIELD_PROPERTY_RANGE_MIN].Value));
-
         m_pDataFieldProperties->List[SENSOR_DATA_FIELD_PROPERTY_RANGE_MAX].Key = PKEY_SensorDataField_RangeMaximum;
-        InitPropVariantFromFloat(AlsDevice_Maximum_Lux,
-            &(m_pDataFieldProperties->List[SENSOR_DATA_FIELD_PROPERTY_RANGE_MAX].Value));
+
+        // Resolution and maximum follow the range picked by the auto-ranging engine
+        m_AutoRange.Reset(AlsDevice_Initial_Range, AlsDevice_Initial_Resolution);
+        UpdateDataFieldProperties();
     }
 
     //
@@ -374,13 +470,23 @@ Exit:
 VOID 
 AlsDevice::DeInit()
 {
-    // Delete lock
-    if (NULL != m_I2CWaitLock)
+    // Delete the proximity sensor instance first, it samples through this
+    // sensor's bus
+    if (nullptr != m_pProx)
     {
-        WdfObjectDelete(m_I2CWaitLock);
-        m_I2CWaitLock = NULL;
+        if (NULL != m_pProx->m_SensorInstance)
+        {
+            WdfObjectDelete(m_pProx->m_SensorInstance);
+        }
+        m_pProx = nullptr;
     }
 
+    // Delete the bus lock
+    m_Bus.Deinitialize();
+
+    CloseRecording();
+    CloseSharedSample();
+
     // Delete sensor instance
     if (NULL != m_SensorInstance)
     {
@@ -405,241 +511,1370 @@ NTSTATUS
 AlsDevice::GetData(
 )
 {
-    BOOLEAN DataReady = FALSE;
-    FILETIME TimeStamp = { 0 };
-    NTSTATUS Status = STATUS_SUCCESS;
+    BYTE StatusBuffer[ISL29018_STATUS_SIZE_BYTES];
+    FILETIME CaptureTime;
+    SAMPLE_OUTCOME Outcome;
+    ULONGLONG Start = GetBeatTime();
 
-    SENSOR_FunctionEnter();
+    GetSystemTimePreciseAsFileTime(&CaptureTime);
+    NTSTATUS Status = m_Bus.Read(ISL29018_REG_ADD_COMMAND1, &StatusBuffer[0], sizeof(StatusBuffer));
 
-    // Read the device data
-    BYTE DataBuffer[ISL290185_DATA_SIZE_BYTES];
-    WdfWaitLockAcquire(m_I2CWaitLock, NULL);
-    Status = I2CSensorReadRegister(m_I2CIoTarget, ISL29018_REG_ADD_DATA_LSB, &DataBuffer[0], sizeof(DataBuffer));
-    WdfWaitLockRelease(m_I2CWaitLock);
-    if (!NT_SUCCESS(Status))
-    {
-        TraceError("ACC %!FUNC! I2CSensorReadRegister from 0x%02x failed! %!STATUS!", ISL29018_REG_ADD_DATA_LSB, Status);
-    }
-    else
-    {
-       // bool DataReady = false;
+    Status = ProcessData(Status, StatusBuffer, &CaptureTime, &Outcome);
+    m_Latency.RecordSince(LatencyStage_Sample, Start, GetBeatTime());
+
+    return Status;
+}
 
-        // Perform data conversion
-        SHORT luxRaw = static_cast<SHORT>((DataBuffer[1] << 8) | DataBuffer[0]);
+//------------------------------------------------------------------------------
+// Function: ProcessData
+//
+// This routine turns the registers read by GetData, by the asynchronous beat
+// read or by the ISR into a sample, compares it to the thresholds and hands it
+// over for delivery. The configuration read along with the data is checked
+// against the one the driver programmed, so a chip that reset itself does not
+// report counts of an unknown range. The conversion and the threshold test are
+// done by SamplePipeline, the bus writes and the hand-over here.
+//
+// Arguments:
+//       ReadStatus: IN: outcome of the register read
+//       pStatusBuffer: IN: COMMAND1 through DATA_MSB
+//       pCaptureTime: IN: time the sample was taken, reported as its timestamp
+//       pOutcome: OUT: whether the sample was converted, and reported
+//
+// Return Value:
+//      NTSTATUS code
+//------------------------------------------------------------------------------
+NTSTATUS
+AlsDevice::ProcessData(
+    _In_ NTSTATUS ReadStatus,
+    _In_reads_(ISL29018_STATUS_SIZE_BYTES) const BYTE* pStatusBuffer,
+    _In_ const FILETIME* pCaptureTime,
+    _Out_ PSAMPLE_OUTCOME pOutcome
+)
+{
+    NTSTATUS Status = ReadStatus;
 
-        m_CachedData = static_cast<float>(luxRaw * AlsDevice_Resolution_Lux);
-    }
+    ULONG RawCount = 0;
+    ULONG Conversions = 0;
+    ULONG ConvertedRange = 0;
+    bool RangeChanged = false;
 
-    // new sample?
-    if (m_FirstSample != FALSE)
-    {
-        Status = GetPerformanceTime(&m_StartTime);
-        if (!NT_SUCCESS(Status))
-        {
-            m_StartTime = 0;
-            TraceError("COMBO %!FUNC! ALS GetPerformanceTime %!STATUS!", Status);
-        }
+    SENSOR_HotPathEnter();
 
-        m_SampleCount = 0;
+    *pOutcome = SampleOutcome_Failed;
 
-        DataReady = TRUE;
-    }
-    else
+    m_Counters.OnSample();
+    ReportCounters(GetBeatTime());
+
+    // Record the registers as read, before anything is decided on them
+    if (m_Recorder.IsRecording())
     {
-        // Compare the change of data to threshold, and only push the data back to
-        // clx if the change exceeds threshold. This is usually done in HW.
-        if (            
-            // Lux thresholds needs to exceed absolute and percentage
-            ((abs(m_CachedData - m_LastSample) >= (m_LastSample * m_CachedThresholds.LuxPct)) &&
-                (abs(m_CachedData - m_LastSample) >= m_CachedThresholds.LuxAbs)))
+        if (NT_SUCCESS(Status))
         {
-            DataReady = TRUE;
+            m_Recorder.Append(SampleRecord_Als, pCaptureTime, GetStatusRawCount(pStatusBuffer),
+                              pStatusBuffer[ISL29018_STATUS_COMMAND2]);
+        }
+        else
+        {
+            m_Recorder.Append(SampleRecord_ReadError, pCaptureTime, 0, GetCommand2());
         }
     }
 
-    if (DataReady != FALSE)
+    if (!NT_SUCCESS(Status))
     {
-        // update last sample
-        m_LastSample = m_CachedData;
+        m_Counters.OnError();
+        TraceError("ACC %!FUNC! BusExecutor Read/ReadAsync from 0x%02x failed! %!STATUS!", ISL29018_REG_ADD_COMMAND1, Status);
 
-        // push to clx
-        InitPropVariantFromFloat(m_LastSample, &(m_pSensorData->List[ALS_DATA_LUX].Value));
+        // Nothing was converted, the last reported sample must not be sent again
+        SENSOR_HotPathExit(Status);
+        return Status;
+    }
+
+    ConvertedRange = m_AutoRange.GetRange();
+    *pOutcome = ConvertStatus(pStatusBuffer, AlsDevice_IrCoefficient, &RawCount, &Conversions, &RangeChanged);
+    if (SampleOutcome_Failed == *pOutcome)
+    {
+        m_Counters.OnError();
+        TraceError("COMBO %!FUNC! ALS COMMAND2 reads 0x%02x instead of 0x%02x, restoring it",
+                   pStatusBuffer[ISL29018_STATUS_COMMAND2], GetCommand2());
 
-        GetSystemTimePreciseAsFileTime(&TimeStamp);
-        InitPropVariantFromFileTime(&TimeStamp, &(m_pSensorData->List[ALS_DATA_TIMESTAMP].Value));
+        Status = WriteCommand2();
+        if (NT_SUCCESS(Status))
+        {
+            Status = STATUS_DATA_NOT_ACCEPTED;
+        }
 
-        SensorsCxSensorDataReady(m_SensorInstance, m_pSensorData);
-        m_FirstSample = FALSE;
+        SENSOR_HotPathExit(Status);
+        return Status;
     }
-    else
+
+    // The conversion in flight when the range changed may straddle both ranges
+    if (SampleOutcome_Discarded == *pOutcome)
     {
         Status = STATUS_DATA_NOT_ACCEPTED;
-        TraceInformation("COMBO %!FUNC! ALS Data did NOT meet the threshold");
-    }
-
-    SENSOR_FunctionExit(Status);
-    return Status;
-}
+        TraceHotVerbose("COMBO %!FUNC! ALS Discarding first sample after a range switch");
 
-// Called by Sensor CLX to begin continously sampling the sensor.
-NTSTATUS AlsDevice::OnStart(
-    _In_ SENSOROBJECT SensorInstance)    // Sensor device object
-{
-    NTSTATUS Status = STATUS_SUCCESS;
-    REGISTER_SETTING setting;
+        SENSOR_HotPathExit(Status);
+        return Status;
+    }
 
-    SENSOR_FunctionEnter();
+    if (Conversions > 1)
+    {
+        TraceHotVerbose("COMBO %!FUNC! ALS Decimated %lu conversions", Conversions);
+    }
 
-    // Get the device context
-    PAlsDevice pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
-    if (nullptr == pDevice)
+    if (RangeChanged)
     {
-        Status = STATUS_INVALID_PARAMETER;
-        TraceError("ACC %!FUNC! Sensor(0x%p) parameter is invalid %!STATUS!", SensorInstance, Status);
+        if (!NT_SUCCESS(WriteCommand2()))
+        {
+            RestoreRange(ConvertedRange);
+        }
+        else
+        {
+            TraceInformation("COMBO %!FUNC! ALS Switched from range %lu to %lu", ConvertedRange, m_AutoRange.GetRange());
+            UpdateDataFieldProperties();
+        }
     }
-    else if (!pDevice->m_PoweredOn)
+
+    // new sample?
+    if (m_FirstSample != FALSE)
     {
-        Status = STATUS_INVALID_PARAMETER;
-        TraceError("ACC %!FUNC! Sensor is not powered on! %!STATUS!", Status);
+        m_Beat.Start(GetBeatTime(), m_Interval);
     }
-    else
+
+    RING_SAMPLE Sample;
+    BYTE HistoryFlags = (m_FirstSample != FALSE) ? ISL29018_HISTORY_FLAG_FIRST : 0;
+    if (TakeReport(pCaptureTime, RawCount, &Sample))
     {
-        WdfWaitLockAcquire(pDevice->m_I2CWaitLock, NULL);
+        *pOutcome = SampleOutcome_Reported;
+        HistoryFlags |= ISL29018_HISTORY_FLAG_REPORTED;
 
-        // Set accelerometer to measurement mode
-        setting = { ISL29018_REG_ADD_COMMAND1, ISL29018_CMD1_OPMODE_ALS_CONT << ISL29018_CMD1_OPMODE_SHIFT };
-        Status = I2CSensorWriteRegister(pDevice->m_I2CIoTarget, setting.Register, &setting.Value, sizeof(setting.Value));
-        if (!NT_SUCCESS(Status))
-        {
-            WdfWaitLockRelease(pDevice->m_I2CWaitLock);
-            TraceError("ACC %!FUNC! I2CSensorWriteRegister to 0x%02x failed! %!STATUS!", setting.Register, Status);
-        }
+        // Readers of the shared section see the reported sample right away,
+        // before it is delivered to the clx
+        m_Publisher.Publish(&Sample.Sample.Timestamp, Sample.Sample.Lux, Sample.RawCount,
+                            ConvertedRange, m_AutoRange.GetResolution());
 
-        // Enable interrupts
-        else // if (NT_SUCCESS(Status))
+        // Hand the sample to the delivery work item, reporting it to the clx
+        // must not hold up the next bus read
+        if (m_Ring.Enqueue(Sample))
         {
-            /*
-            // Enable Interrupts
-            Status = IsrOn();
-            if (!NT_SUCCESS(Status))
-            {
-                TraceError("ACC %!FUNC! Failed to enable interrupts. %!STATUS!", Status);
-            }
-            */
+            WdfWorkItemEnqueue(m_DeliveryWorkItem);
         }
-
-        if (NT_SUCCESS(Status))
+        else
         {
-            pDevice->m_FirstSample = true;
-            pDevice->m_Started = true;
-
-            InitPropVariantFromUInt32(SensorState_Active, &(pDevice->m_pSensorProperties->List[SENSOR_PROPERTY_STATE].Value));
-
-            // Start polling
-            WdfTimerStart(pDevice->m_Timer, WDF_REL_TIMEOUT_IN_MS(pDevice->m_MinimumInterval));
+            TraceError("COMBO %!FUNC! ALS Delivery is behind, sample dropped (%lu so far)", m_Ring.GetDrops());
         }
     }
+    else
+    {
+        *pOutcome = SampleOutcome_Quiet;
+        Status = STATUS_DATA_NOT_ACCEPTED;
+        TraceHotInformation("COMBO %!FUNC! ALS Data did NOT meet the threshold");
+    }
 
-    SENSOR_FunctionExit(Status);
+    m_History.Add(pCaptureTime, m_CachedData, RawCount, m_IrInterleave.GetIrCount(),
+                  ConvertedRange, m_AutoRange.GetResolution(), Conversions, HistoryFlags);
+
+    SENSOR_HotPathExit(Status);
     return Status;
 }
 
-// Called by Sensor CLX to stop continously sampling the sensor.
-NTSTATUS AlsDevice::OnStop(
-    _In_ SENSOROBJECT SensorInstance)   // Sensor device object
+//------------------------------------------------------------------------------
+// Function: GetOversample
+//
+// This routine reads one of the extra conversions taken ahead of the beat and
+// accumulates it for GetData. An IR conversion still running from the last
+// beat is read in its place and ALS conversions are resumed.
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      NTSTATUS code
+//------------------------------------------------------------------------------
+NTSTATUS
+AlsDevice::GetOversample(
+)
 {
     NTSTATUS Status = STATUS_SUCCESS;
-    REGISTER_SETTING setting;
-
-    SENSOR_FunctionEnter();
 
-    // Get the device context
-    PAlsDevice pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
-    if (nullptr == pDevice)
-    {
-        Status = STATUS_INVALID_PARAMETER;
-        TraceError("ACC %!FUNC! Sensor(0x%p) parameter is invalid %!STATUS!", SensorInstance, Status);
-    }
-    else
+    if (m_IrPending)
     {
-        pDevice->m_Started = false;
+        m_IrPending = false;
 
-        /*
-        // Disable Interrupts
-        Status = IsrOff();
-        if (!NT_SUCCESS(Status))
-        {
-            TraceError("ACC %!FUNC! Failed to disable interrupts. %!STATUS!", Status);
-        }
-        // Clear any stale interrupts
-        else
+        Status = GetIrData();
+        if (NT_SUCCESS(Status))
         {
-            RegisterSetting = { ISL29018_REG_ADD_COMMAND1, 0 };
-            Status = I2CSensorWriteRegister(pDevice->m_I2CIoTarget, RegisterSetting.Register, &RegisterSetting.Value, sizeof(RegisterSetting.Value));
-            if (!NT_SUCCESS(Status))
-            {
-                TraceError("ACC %!FUNC! I2CSensorReadRegister from 0x%02x failed! %!STATUS!", RegisterSetting.Register, Status);
-            }
+            Status = WriteOpMode(ISL29018_CMD1_OPMODE_ALS_CONT);
         }
-        */
 
-        // Stop polling
+        return Status;
+    }
 
-        WdfTimerStop(pDevice->m_Timer, TRUE);
+    BYTE DataBuffer[ISL290185_DATA_SIZE_BYTES];
+    Status = m_Bus.Read(ISL29018_REG_ADD_DATA_LSB, &DataBuffer[0], sizeof(DataBuffer));
+    if (!NT_SUCCESS(Status))
+    {
+        TraceError("ACC %!FUNC! BusExecutor Read from 0x%02x failed! %!STATUS!", ISL29018_REG_ADD_DATA_LSB, Status);
+    }
+    else
+    {
+        ULONG RawCount = (static_cast<ULONG>(DataBuffer[1]) << 8) | DataBuffer[0];
+        m_Decimator.Add(RawCount);
+        RecordNow(SampleRecord_Oversample, RawCount);
+    }
 
-        // Set sensor to standby
-        setting = { ISL29018_REG_ADD_COMMAND1, ISL29018_CMD1_OPMODE_POWER_DOWN << ISL29018_CMD1_OPMODE_SHIFT};
-        Status = I2CSensorWriteRegister(pDevice->m_I2CIoTarget, setting.Register, &setting.Value, sizeof(setting.Value));
-        WdfWaitLockRelease(pDevice->m_I2CWaitLock);
-        if (!NT_SUCCESS(Status))
-        {
-            TraceError("ACC %!FUNC! I2CSensorWriteRegister to 0x%02x failed! %!STATUS!", setting.Register, Status);
-        }
-        else
-        {
-            InitPropVariantFromUInt32(SensorState_Idle, &(pDevice->m_pSensorProperties->List[SENSOR_PROPERTY_STATE].Value));
+    return Status;
+}
 
-            //
-            // Restoring system time resolution
-            //
-            if (TIMERR_NOERROR != timeEndPeriod(SYSTEM_TICK_COUNT_1MS))
-            {
-                // not a failure, just log message
-                Status = STATUS_UNSUCCESSFUL;
-                TraceWarning("COMBO %!FUNC! timeEndPeriod failed to restore timer resolution! %!STATUS!", Status);
-            }
-        }
+//------------------------------------------------------------------------------
+// Function: GetOversampleConversions
+//
+// This routine returns how many conversions the next sample averages. Only
+// polled continuous conversions are oversampled, and only at low light where
+// a few counts make up the reading.
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      Number of conversions, 1 if the next sample is not oversampled
+//------------------------------------------------------------------------------
+ULONG
+AlsDevice::GetOversampleConversions(
+) const
+{
+    if (!m_OversampleEnabled ||
+        IsAdcShared() ||
+        m_Scheduler.UseOneShot() ||
+        AcquisitionMode_Polling != m_Scheduler.GetMode() ||
+        !OversampleIsLowLight(m_LastRawCount, Isl29018MaxCount(m_AutoRange.GetResolution())))
+    {
+        return 1;
     }
 
-    SENSOR_FunctionExit(Status);
-    return Status;
+    return OversampleConversions(m_Interval, Isl29018ConversionTimeMs(AlsDevice_Chip, m_AutoRange.GetResolution()));
 }
 
-// Called by Sensor CLX to get supported data fields. The typical usage is to call
-// this function once with buffer pointer as NULL to acquire the required size 
-// for the buffer, allocate buffer, then call the function again to retrieve 
-// sensor information.
-NTSTATUS AlsDevice::OnGetSupportedDataFields(
-    _In_ SENSOROBJECT SensorInstance,          // Sensor device object
-    _Inout_opt_ PSENSOR_PROPERTY_LIST pFields, // Pointer to a list of supported properties
-    _Out_ PULONG pSize)                        // Number of bytes for the list of supported properties
+//------------------------------------------------------------------------------
+// Function: QueueSample
+//
+// This routine reports a sample to the clx right away, or queues it in the
+// FIFO while a batch latency is set. The FIFO is flushed once the oldest
+// sample waited for the batch latency or the FIFO is nearly full.
+//
+// Arguments:
+//       Sample: IN: sample that passed the thresholds
+//       Immediate: IN: report the sample without batching
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::QueueSample(
+    _In_ const FIFO_SAMPLE& Sample,
+    _In_ bool Immediate
+)
 {
-    NTSTATUS Status = STATUS_SUCCESS;
+    bool Flush = false;
 
-    SENSOR_FunctionEnter();
+    // The first sample after start is reported right away so the clients
+    // have a reading without waiting for the batch
+    if (0 == m_BatchLatency || Immediate)
+    {
+        FlushFifo();
+        ReportSample(Sample);
+        return;
+    }
 
-    if (nullptr == pSize)
+    WdfWaitLockAcquire(m_FifoWaitLock, NULL);
+
+    m_Fifo.Push(Sample);
+    if (m_Fifo.IsNearlyFull())
     {
-        Status = STATUS_INVALID_PARAMETER;
-        TraceError("ACC %!FUNC! pSize: Invalid parameter! %!STATUS!", Status);
+        Flush = true;
     }
-    else
+    else if (1 == m_Fifo.GetCount())
     {
-        *pSize = 0;
+        WdfTimerStart(m_BatchTimer, WDF_REL_TIMEOUT_IN_MS(m_BatchLatency));
+    }
 
-        // Get the device context
-        PAlsDevice pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
-        if (nullptr == pDevice)
+    WdfWaitLockRelease(m_FifoWaitLock);
+
+    if (Flush)
+    {
+        FlushFifo();
+    }
+}
+
+//------------------------------------------------------------------------------
+// Function: ReportSample
+//
+// This routine pushes a sample to the clx
+//
+// Arguments:
+//       Sample: IN: sample to push
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::ReportSample(
+    _In_ const FIFO_SAMPLE& Sample
+)
+{
+    InitPropVariantFromFloat(Sample.Lux, &(m_pSensorData->List[ALS_DATA_LUX].Value));
+    InitPropVariantFromUInt32(Sample.IrCount, &(m_pSensorData->List[ALS_DATA_IR_COUNT].Value));
+    InitPropVariantFromFileTime(&Sample.Timestamp, &(m_pSensorData->List[ALS_DATA_TIMESTAMP].Value));
+
+    ULONGLONG Start = GetBeatTime();
+    SensorsCxSensorDataReady(m_SensorInstance, m_pSensorData);
+    m_Latency.RecordSince(LatencyStage_DataReady, Start, GetBeatTime());
+    m_Counters.OnReport();
+}
+
+//------------------------------------------------------------------------------
+// Function: ReportCounters
+//
+// This routine writes the counters of the sample path as one TraceLogging
+// event once per period, the sample path has no trace points of its own
+// unless ISL29018_HOT_PATH_TRACING is set
+//
+// Arguments:
+//       Now: IN: current time, in 100ns
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::ReportCounters(
+    _In_ ULONGLONG Now
+)
+{
+    SAMPLE_COUNTS Counts;
+
+    if (!m_Counters.TakeIfDue(Now, &Counts))
+    {
+        return;
+    }
+
+    FLOAT Seconds = static_cast<FLOAT>(Counts.Elapsed) / 10000000.0f;
+
+    TraceLoggingWrite(g_hIsl29018Provider,
+                      "SampleCounters",
+                      TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+                      TraceLoggingUInt32(m_ChipIndex, "Chip"),
+                      TraceLoggingFloat32(Counts.Samples / Seconds, "SamplesPerSecond"),
+                      TraceLoggingFloat32(Counts.Reports / Seconds, "ReportsPerSecond"),
+                      TraceLoggingUInt32(Counts.Samples, "Samples"),
+                      TraceLoggingUInt32(Counts.Reports, "Reports"),
+                      TraceLoggingUInt32(Counts.Errors, "Errors"),
+                      TraceLoggingUInt32(Counts.Interrupts, "Interrupts"),
+                      TraceLoggingUInt32(m_Ring.GetDrops(), "DroppedTotal"),
+                      TraceLoggingUInt64(Counts.Elapsed, "Elapsed100ns"));
+}
+
+//------------------------------------------------------------------------------
+// Function: FlushFifo
+//
+// This routine pushes the batched samples to the clx, oldest first, with
+// the time each of them was taken
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::FlushFifo(
+)
+{
+    FIFO_SAMPLE Sample;
+    ULONG Count = 0;
+
+    // The timer may be waiting for the lock to flush, do not wait for it
+    WdfTimerStop(m_BatchTimer, FALSE);
+
+    WdfWaitLockAcquire(m_FifoWaitLock, NULL);
+    while (m_Fifo.Pop(&Sample))
+    {
+        ReportSample(Sample);
+        Count++;
+    }
+    WdfWaitLockRelease(m_FifoWaitLock);
+
+    if (Count > 0)
+    {
+        TraceHotVerbose("COMBO %!FUNC! ALS Flushed %lu samples, %lu dropped so far", Count, m_Fifo.GetOverflows());
+    }
+}
+
+//------------------------------------------------------------------------------
+// Function: GetIrData
+//
+// This routine reads the result of an IR conversion started by StartIrConversion
+// and keeps it for the compensation of the following ALS samples
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      NTSTATUS code
+//------------------------------------------------------------------------------
+NTSTATUS
+AlsDevice::GetIrData(
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_HotPathEnter();
+
+    BYTE DataBuffer[ISL290185_DATA_SIZE_BYTES];
+    Status = m_Bus.Read(ISL29018_REG_ADD_DATA_LSB, &DataBuffer[0], sizeof(DataBuffer));
+    if (!NT_SUCCESS(Status))
+    {
+        TraceError("ACC %!FUNC! BusExecutor Read from 0x%02x failed! %!STATUS!", ISL29018_REG_ADD_DATA_LSB, Status);
+    }
+    else
+    {
+        ULONG RawCount = (static_cast<ULONG>(DataBuffer[1]) << 8) | DataBuffer[0];
+        m_IrInterleave.OnIrSample(RawCount, m_AutoRange.GetLuxPerCount());
+        RecordNow(SampleRecord_Ir, RawCount);
+
+        TraceHotVerbose("COMBO %!FUNC! ALS IR count %lu", RawCount);
+    }
+
+    SENSOR_HotPathExit(Status);
+    return Status;
+}
+
+//------------------------------------------------------------------------------
+// Function: RecordNow
+//
+// This routine records a conversion that is not read through ProcessData, or
+// a start of the acquisition, stamped with the current time. The range and
+// resolution are the ones currently programmed.
+//
+// Arguments:
+//       Kind: IN: what is recorded
+//       RawCount: IN: the conversion's count, 0 for a start
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::RecordNow(
+    _In_ SAMPLE_RECORD_KIND Kind,
+    _In_ ULONG RawCount
+)
+{
+    if (m_Recorder.IsRecording())
+    {
+        FILETIME Now;
+        GetSystemTimePreciseAsFileTime(&Now);
+        m_Recorder.Append(Kind, &Now, RawCount, GetCommand2());
+    }
+}
+
+//------------------------------------------------------------------------------
+// Function: UpdateDataFieldProperties
+//
+// This routine publishes the resolution and the maximum of the current range
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::UpdateDataFieldProperties(
+)
+{
+    InitPropVariantFromFloat(m_AutoRange.GetLuxPerCount(),
+        &(m_pDataFieldProperties->List[SENSOR_DATA_FIELD_PROPERTY_RESOLUTION].Value));
+
+    InitPropVariantFromFloat(m_AutoRange.GetRangeMaximumLux(),
+        &(m_pDataFieldProperties->List[SENSOR_DATA_FIELD_PROPERTY_RANGE_MAX].Value));
+}
+
+//------------------------------------------------------------------------------
+// Function: ApplyResolution
+//
+// This routine programs the highest resolution whose integration time fits
+// into the current data interval
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      NTSTATUS code
+//------------------------------------------------------------------------------
+NTSTATUS
+AlsDevice::ApplyResolution(
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG PreviousResolution = m_AutoRange.GetResolution();
+    ULONG IntervalMs = m_Interval;
+
+    // While the proximity channel shares the ADC, a conversion of each channel
+    // has to fit into the shorter of the two intervals
+    if (IsAdcShared())
+    {
+        ULONG ProxIntervalMs = m_Arbiter.GetIntervalMs(AdcChannel_Prox);
+        if (!m_Arbiter.IsActive(AdcChannel_Als))
+        {
+            IntervalMs = ProxIntervalMs;
+        }
+        else
+        {
+            IntervalMs = ((ProxIntervalMs < IntervalMs) ? ProxIntervalMs : IntervalMs) / AdcChannel_Count;
+        }
+    }
+
+    ULONG Resolution = Isl29018SelectResolution(AlsDevice_Chip, IntervalMs);
+
+    if (Resolution != PreviousResolution)
+    {
+        m_AutoRange.SetResolution(Resolution);
+
+        Status = WriteCommand2();
+        if (!NT_SUCCESS(Status))
+        {
+            TraceError("COMBO %!FUNC! Failed to set %lu bit resolution %!STATUS!", Isl29018ResolutionBits(Resolution), Status);
+            m_AutoRange.SetResolution(PreviousResolution);
+        }
+        else
+        {
+            TraceInformation("COMBO %!FUNC! %lu ms interval, using %lu bit resolution", IntervalMs, Isl29018ResolutionBits(Resolution));
+        }
+    }
+
+    UpdateDataFieldProperties();
+
+    return Status;
+}
+
+//------------------------------------------------------------------------------
+// Function: ResetScheduler
+//
+// This routine lets the acquisition scheduler pick the mode matching the
+// current interval and thresholds, and starts the beat at the new interval
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::ResetScheduler(
+)
+{
+    ULONG NowMs = 0;
+
+    if (!NT_SUCCESS(GetPerformanceTime(&NowMs)))
+    {
+        NowMs = 0;
+    }
+
+    // The threshold window needs continuous conversions, which the proximity
+    // channel does not leave room for
+    m_Scheduler.Reset(NowMs,
+                      NULL != m_Interrupt && !IsAdcShared(),
+                      m_Interval,
+                      m_CachedThresholds.LuxPct,
+                      m_CachedThresholds.LuxAbs,
+                      Isl29018ConversionTimeMs(AlsDevice_Chip, m_AutoRange.GetResolution()),
+                      !m_OversampleEnabled);
+
+    // The first sample starts the beat again, but a first read that fails
+    // must not leave it on the deadline of the previous session
+    m_Beat.Start(GetBeatTime(), m_Interval);
+}
+
+//------------------------------------------------------------------------------
+// Function: RestartAcquisition
+//
+// This routine restarts sampling after the interval or the thresholds changed.
+// Sampling is stopped before the resolution for the interval is applied. The
+// timer reads the next sample once a conversion in the newly picked mode
+// completed and pushes it to the clx unconditionally. The caller holds
+// m_ControlLock.
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      NTSTATUS code
+//------------------------------------------------------------------------------
+NTSTATUS
+AlsDevice::RestartAcquisition(
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    // Keep the timer and the interrupt path off the chip while it is set up.
+    // OnStart calls in already in the starting state.
+    if (!m_Lifecycle.Transition(Lifecycle_Running, Lifecycle_Starting) &&
+        Lifecycle_Starting != m_Lifecycle.Get())
+    {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        TraceError("COMBO %!FUNC! Sensor is not started %!STATUS!", Status);
+        return Status;
+    }
+
+    StopSampling();
+
+    // Close the interrupt window in either mode and drop the sample an
+    // interrupt raised before it closed
+    bool InterruptOff = true;
+    if (NULL != m_Interrupt)
+    {
+        Status = IsrOff();
+        if (!NT_SUCCESS(Status))
+        {
+            TraceError("COMBO %!FUNC! Failed to disable interrupts, polling only %!STATUS!", Status);
+            InterruptOff = false;
+        }
+        FlushInterruptWork();
+    }
+
+    // The light channel joins the shared schedule before the resolution is
+    // picked, its conversions then have to fit next to the proximity's
+    if (IsAdcShared())
+    {
+        ULONG NowMs = 0;
+        GetPerformanceTime(&NowMs);
+
+        m_Arbiter.SetChannel(AdcChannel_Als, true, m_Interval, NowMs);
+    }
+
+    // Nothing samples while the resolution changes, and the scheduler below
+    // sees the conversion time of the new one
+    Status = ApplyResolution();
+
+    m_OversampleReads = 0;
+    m_Decimator.Reset();
+    ResetScheduler();
+    if (!InterruptOff)
+    {
+        m_Scheduler.DisableInterrupt();
+    }
+
+    // The ADC schedule starts over once the caller releases m_ControlLock
+    if (IsAdcShared())
+    {
+        m_FirstSample = TRUE;
+        RecordNow(SampleRecord_Restart, 0);
+        m_Lifecycle.Transition(Lifecycle_Starting, Lifecycle_Running);
+
+        return Status;
+    }
+
+    Status = StartConversions();
+    if (!NT_SUCCESS(Status))
+    {
+        TraceError("COMBO %!FUNC! StartConversions failed %!STATUS!", Status);
+    }
+
+    m_FirstSample = TRUE;
+    RecordNow(SampleRecord_Restart, 0);
+    m_Lifecycle.Transition(Lifecycle_Starting, Lifecycle_Running);
+    WdfTimerStart(m_Timer, WDF_REL_TIMEOUT_IN_MS(Isl29018ConversionTimeMs(AlsDevice_Chip, m_AutoRange.GetResolution())));
+
+    return Status;
+}
+
+//------------------------------------------------------------------------------
+// Function: StartPolling
+//
+// This routine closes the interrupt window and hands sampling over to the timer
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      NTSTATUS code
+//------------------------------------------------------------------------------
+NTSTATUS
+AlsDevice::StartPolling(
+)
+{
+    NTSTATUS Status = IsrOff();
+    if (!NT_SUCCESS(Status))
+    {
+        TraceError("COMBO %!FUNC! Failed to disable interrupts %!STATUS!", Status);
+    }
+
+    // Restart the beat from now, the timer must not try to catch up on the
+    // time spent in interrupt mode
+    ULONGLONG Now = GetBeatTime();
+    m_Beat.Start(Now, m_Interval);
+
+    // The chip keeps converting continuously until the first beat starts a
+    // single conversion, if the scheduler picked one-shot mode
+    m_ConversionPending = false;
+    m_IrPending = false;
+    WdfTimerStart(m_Timer, PrepareNextBeat(Now));
+
+    return Status;
+}
+
+//------------------------------------------------------------------------------
+// Function: PrepareNextBeat
+//
+// This routine computes when the timer has to wake up for the next polled
+// sample. Conversions that have to complete before the beat are started
+// early enough for the sample to be read on the beat.
+//
+// Arguments:
+//       Now: IN: current time of the beat clock
+//
+// Return Value:
+//      Relative WDF timeout, in 100ns units
+//------------------------------------------------------------------------------
+LONGLONG
+AlsDevice::PrepareNextBeat(
+    _In_ ULONGLONG Now
+)
+{
+    ULONGLONG Wait = m_Beat.GetWait(Now);
+    ULONGLONG ConversionTime = Isl29018ConversionTimeMs(AlsDevice_Chip, m_AutoRange.GetResolution()) *
+                               BeatScheduler_TicksPerMs;
+
+    // Start the single conversion early enough for the sample to be ready
+    // on the beat
+    if (m_Scheduler.UseOneShot())
+    {
+        Wait = (Wait > ConversionTime) ? (Wait - ConversionTime) : 0;
+    }
+
+    // Start reading the extra conversions early enough for the last one to
+    // be read on the beat
+    else
+    {
+        ULONG Conversions = GetOversampleConversions();
+        if (Conversions > 1)
+        {
+            ULONGLONG Lead = (Conversions - 1) * ConversionTime;
+            Wait = (Wait > Lead) ? (Wait - Lead) : 0;
+            m_OversampleReads = Conversions - 1;
+            m_Decimator.Reset();
+        }
+    }
+
+    // Negative WDF timeouts are relative
+    return -static_cast<LONGLONG>(Wait);
+}
+
+//------------------------------------------------------------------------------
+// Function: ScheduleNextBeat
+//
+// This routine accounts for the beat just sampled and starts the timer for
+// the next one, unless the sensor stopped in the meantime
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::ScheduleNextBeat(
+)
+{
+    if (m_MinimumInterval <= m_Interval &&
+        m_Lifecycle.IsStarted())
+    {
+        ULONGLONG Now = GetBeatTime();
+
+        m_Beat.OnBeat(Now);
+        WdfTimerStart(m_Timer, PrepareNextBeat(Now));
+    }
+}
+
+//------------------------------------------------------------------------------
+// Function: StopSampling
+//
+// This routine stops the timer and waits for the beat read in flight. The
+// read's completion may have restarted the timer before the sensor left the
+// running state, so the timer is stopped once more afterwards. The interrupt
+// work item is flushed first, it may restart the timer when it falls back to
+// polling.
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::StopSampling(
+)
+{
+    FlushInterruptWork();
+    WdfTimerStop(m_Timer, TRUE);
+    m_Bus.WaitForAsync();
+    WdfTimerStop(m_Timer, TRUE);
+}
+
+//------------------------------------------------------------------------------
+// Function: FlushInterruptWork
+//
+// This routine drops the sample the ISR left for the interrupt work item. The
+// caller holds m_ControlLock, which the work item processes the sample
+// under, so none is running. A work item that runs once the lock is released
+// finds nothing to do, or a sample raised after the window was armed again.
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::FlushInterruptWork(
+)
+{
+    if (NULL == m_Interrupt)
+    {
+        return;
+    }
+
+    WdfInterruptAcquireLock(m_Interrupt);
+    m_InterruptPending = false;
+    WdfInterruptReleaseLock(m_Interrupt);
+}
+
+//------------------------------------------------------------------------------
+// Function: AcquireControl
+//
+// This routine waits until no other callback starts, stops or reconfigures
+// acquisition on the chip and takes over. The ADC schedule skips its turns
+// until ReleaseControl.
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::AcquireControl(
+)
+{
+    WdfWaitLockAcquire(m_ControlLock, NULL);
+}
+
+//------------------------------------------------------------------------------
+// Function: ReleaseControl
+//
+// This routine hands the chip back. While the proximity sensor runs on a
+// powered chip, the ADC schedule is started over: its turns were skipped
+// while the lock was held.
+// The timer is started only once the lock is free, a turn taken before that
+// would be skipped too and end the schedule.
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::ReleaseControl(
+)
+{
+    bool Shared = IsAdcShared() && m_Lifecycle.IsPoweredOn();
+
+    if (Shared)
+    {
+        m_Arbiter.CancelConversion();
+        m_ConversionPending = false;
+        m_IrPending = false;
+    }
+
+    WdfWaitLockRelease(m_ControlLock);
+
+    if (Shared)
+    {
+        WdfTimerStart(m_Timer, WDF_REL_TIMEOUT_IN_MS(0));
+    }
+}
+
+//------------------------------------------------------------------------------
+// Function: UpdateProximity
+//
+// This routine is called by the proximity sensor when it starts, stops or
+// changes its interval. While it runs, both channels take turns on the ADC
+// with single conversions scheduled by m_Arbiter. It holds m_ControlLock, so
+// it does not overlap a start, stop or reconfiguration of the light sensor.
+//
+// Arguments:
+//       Active: IN: the proximity sensor is started
+//       IntervalMs: IN: data interval of the proximity sensor
+//
+// Return Value:
+//      NTSTATUS code
+//------------------------------------------------------------------------------
+NTSTATUS
+AlsDevice::UpdateProximity(
+    _In_ bool Active,
+    _In_ ULONG IntervalMs
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG NowMs = 0;
+
+    AcquireControl();
+
+    if (Active && !m_Lifecycle.IsPoweredOn())
+    {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        TraceError("COMBO %!FUNC! Chip is not powered on %!STATUS!", Status);
+
+        ReleaseControl();
+        return Status;
+    }
+
+    // Hold the light sensor's beat while the schedule changes, RestartAcquisition resumes it
+    bool Started = m_Lifecycle.Transition(Lifecycle_Running, Lifecycle_Starting);
+    StopSampling();
+    GetPerformanceTime(&NowMs);
+
+    m_Arbiter.SetChannel(AdcChannel_Prox, Active, IntervalMs, NowMs);
+
+    if (Started)
+    {
+        // Joins or leaves the shared schedule. RestartAcquisition applies
+        // the resolution matching the shorter interval.
+        m_Arbiter.SetChannel(AdcChannel_Als, Active, m_Interval, NowMs);
+        Status = RestartAcquisition();
+    }
+    else if (Active)
+    {
+        Status = ApplyResolution();
+    }
+    else
+    {
+        // Neither channel is running anymore
+        m_Arbiter.CancelConversion();
+        ApplyResolution();
+        Status = WriteOpMode(ISL29018_CMD1_OPMODE_POWER_DOWN);
+
+        TraceInformation("COMBO %!FUNC! Shared ADC conversions: %lu light (%lu missed), %lu proximity (%lu missed)",
+            m_Arbiter.GetConversions(AdcChannel_Als),
+            m_Arbiter.GetMissedBeats(AdcChannel_Als),
+            m_Arbiter.GetConversions(AdcChannel_Prox),
+            m_Arbiter.GetMissedBeats(AdcChannel_Prox));
+    }
+
+    // Starts the ADC schedule over if the proximity channel is active
+    ReleaseControl();
+
+    return Status;
+}
+
+//------------------------------------------------------------------------------
+// Function: ServeSharedAdc
+//
+// This routine is called by the timer while the ADC is shared. It reads the
+// conversion that just completed, starts the conversion of the channel that is
+// due next and sleeps until that one completed or the next one is due. Only
+// single conversions are used, so the two channels never overwrite each
+// other's OPMODE.
+//
+// The turn is taken under m_ControlLock, but never waits for it: the callback
+// holding it may be waiting for this timer to stop. The turn is skipped
+// instead, and ReleaseControl starts the schedule over.
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+AlsDevice::ServeSharedAdc(
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG NowMs = 0;
+    ULONG ConversionTimeMs = 0;
+    ULONG WaitMs = 0;
+    LONGLONG NoWait = 0;
+
+    if (STATUS_TIMEOUT == WdfWaitLockAcquire(m_ControlLock, &NoWait))
+    {
+        return;
+    }
+
+    // The proximity sensor stopped or the chip was powered down while this
+    // turn waited to run
+    if (!IsAdcShared() || !m_Lifecycle.IsPoweredOn())
+    {
+        WdfWaitLockRelease(m_ControlLock);
+        return;
+    }
+
+    ConversionTimeMs = Isl29018ConversionTimeMs(AlsDevice_Chip, m_AutoRange.GetResolution());
+    GetPerformanceTime(&NowMs);
+
+    // Read the completed conversion
+    switch (m_Arbiter.GetInFlight())
+    {
+        case AdcChannel_Als:
+            if (m_IrPending)
+            {
+                m_IrPending = false;
+                Status = GetIrData();
+            }
+            else
+            {
+                Status = GetData();
+            }
+            if (!NT_SUCCESS(Status) && Status != STATUS_DATA_NOT_ACCEPTED)
+            {
+                TraceError("COMBO %!FUNC! Reading the light channel failed %!STATUS!", Status);
+            }
+            m_Arbiter.CompleteConversion(NowMs);
+            break;
+
+        case AdcChannel_Prox:
+            Status = GetProximityData();
+            if (!NT_SUCCESS(Status))
+            {
+                TraceError("COMBO %!FUNC! GetProximityData failed %!STATUS!", Status);
+            }
+            m_Arbiter.CompleteConversion(NowMs);
+            break;
+
+        default:
+            break;
+    }
+
+    // Start the conversion of the channel that is due next
+    ADC_CHANNEL Channel = m_Arbiter.PickNext(NowMs, ConversionTimeMs);
+    if (Channel != AdcChannel_None)
+    {
+        if (Channel == AdcChannel_Prox)
+        {
+            Status = WriteOpMode(ISL29018_CMD1_OPMODE_PROX_ONCE);
+        }
+        else if (m_IrInterleave.IsIrDue())
+        {
+            Status = StartIrConversion();
+        }
+        else
+        {
+            Status = WriteOpMode(ISL29018_CMD1_OPMODE_ALS_ONCE);
+        }
+
+        m_Arbiter.StartConversion(Channel);
+        if (NT_SUCCESS(Status))
+        {
+            WaitMs = ConversionTimeMs;
+        }
+        else
+        {
+            // Skip the beat rather than retrying in a tight loop
+            TraceError("COMBO %!FUNC! Failed to start a conversion on channel %d %!STATUS!", Channel, Status);
+            m_Arbiter.CompleteConversion(NowMs);
+            Channel = AdcChannel_None;
+        }
+    }
+
+    if (Channel == AdcChannel_None)
+    {
+        WaitMs = m_Arbiter.GetWaitMs(NowMs, ConversionTimeMs);
+    }
+
+    // Started only once the lock is free, or the next turn could find it held
+    WdfWaitLockRelease(m_ControlLock);
+    WdfTimerStart(m_Timer, WDF_REL_TIMEOUT_IN_MS(WaitMs));
+}
+
+//------------------------------------------------------------------------------
+// Function: GetProximityData
+//
+// This routine reads the result of a proximity conversion and hands it to the
+// proximity sensor
+//
+// Arguments:
+//       None
+//
+// Return Value:
+//      NTSTATUS code
+//------------------------------------------------------------------------------
+NTSTATUS
+AlsDevice::GetProximityData(
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_HotPathEnter();
+
+    BYTE DataBuffer[ISL290185_DATA_SIZE_BYTES];
+    Status = m_Bus.Read(ISL29018_REG_ADD_DATA_LSB, &DataBuffer[0], sizeof(DataBuffer));
+    if (!NT_SUCCESS(Status))
+    {
+        TraceError("ACC %!FUNC! BusExecutor Read from 0x%02x failed! %!STATUS!", ISL29018_REG_ADD_DATA_LSB, Status);
+    }
+    else if (nullptr != m_pProx)
+    {
+        ULONG RawCount = (static_cast<ULONG>(DataBuffer[1]) << 8) | DataBuffer[0];
+        m_pProx->OnSample(RawCount, Isl29018MaxCount(m_AutoRange.GetResolution()));
+    }
+
+    SENSOR_HotPathExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to begin continously sampling the sensor.
+NTSTATUS AlsDevice::OnStart(
+    _In_ SENSOROBJECT SensorInstance)    // Sensor device object
+{
+    if (nullptr != GetProxDeviceContextFromSensorInstance(SensorInstance))
+    {
+        return ProxDevice::OnStart(SensorInstance);
+    }
+
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    // Get the device context
+    PAlsDevice pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
+    if (nullptr == pDevice)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("ACC %!FUNC! Sensor(0x%p) parameter is invalid %!STATUS!", SensorInstance, Status);
+
+        SENSOR_FunctionExit(Status);
+        return Status;
+    }
+
+    // A start, stop or reconfiguration of either sensor finishes first
+    pDevice->AcquireControl();
+
+    if (!pDevice->m_Lifecycle.Transition(Lifecycle_Idle, Lifecycle_Starting))
+    {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        TraceError("ACC %!FUNC! Sensor is not powered on or not stopped! %!STATUS!", Status);
+    }
+    else
+    {
+        pDevice->m_Scheduler.ResetCounters();
+        pDevice->ResetScheduler();
+        pDevice->m_IrInterleave.Reset();
+        pDevice->m_Filter.Reset();
+        pDevice->m_OversampleReads = 0;
+        pDevice->m_Decimator.Reset();
+        pDevice->RecordNow(SampleRecord_Start, 0);
+
+        // Set sensor to continuous ALS conversions, or start a single one. While
+        // the proximity sensor runs, the ADC schedule takes the light channel in.
+        Status = pDevice->IsAdcShared() ? pDevice->RestartAcquisition() : pDevice->StartConversions();
+        if (!NT_SUCCESS(Status))
+        {
+            TraceError("ACC %!FUNC! Failed to start conversions! %!STATUS!", Status);
+        }
+
+        // The window stays closed until the timer has read the first sample
+        // and the scheduler decided to arm it
+        else if (NULL != pDevice->m_Interrupt && !pDevice->IsAdcShared())
+        {
+            Status = pDevice->IsrOff();
+            if (!NT_SUCCESS(Status))
+            {
+                TraceError("ACC %!FUNC! Failed to disable interrupts. %!STATUS!", Status);
+            }
+        }
+
+        if (NT_SUCCESS(Status))
+        {
+            pDevice->m_FirstSample = true;
+            pDevice->m_Lifecycle.Transition(Lifecycle_Starting, Lifecycle_Running);
+
+            InitPropVariantFromUInt32(SensorState_Active, &(pDevice->m_pSensorProperties->List[SENSOR_PROPERTY_STATE].Value));
+
+            // Read the first sample once a conversion has completed
+            if (!pDevice->IsAdcShared())
+            {
+                WdfTimerStart(pDevice->m_Timer, WDF_REL_TIMEOUT_IN_MS(
+                    Isl29018ConversionTimeMs(AlsDevice_Chip, pDevice->m_AutoRange.GetResolution())));
+            }
+        }
+        else
+        {
+            pDevice->m_Lifecycle.Transition(Lifecycle_Starting, Lifecycle_Idle);
+        }
+    }
+
+    pDevice->ReleaseControl();
+
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to stop continously sampling the sensor.
+NTSTATUS AlsDevice::OnStop(
+    _In_ SENSOROBJECT SensorInstance)   // Sensor device object
+{
+    if (nullptr != GetProxDeviceContextFromSensorInstance(SensorInstance))
+    {
+        return ProxDevice::OnStop(SensorInstance);
+    }
+
+    NTSTATUS Status = STATUS_SUCCESS;
+    REGISTER_SETTING setting;
+
+    SENSOR_FunctionEnter();
+
+    // Get the device context
+    PAlsDevice pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
+    if (nullptr == pDevice)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("ACC %!FUNC! Sensor(0x%p) parameter is invalid %!STATUS!", SensorInstance, Status);
+    }
+    else
+    {
+        // A start, stop or reconfiguration of either sensor finishes first.
+        // The timer, the interrupt and the work items leave the chip alone
+        // from here on.
+        pDevice->AcquireControl();
+
+        if (!pDevice->m_Lifecycle.Transition(Lifecycle_Running, Lifecycle_Stopping))
+        {
+            Status = STATUS_INVALID_DEVICE_STATE;
+            TraceError("ACC %!FUNC! Sensor is not started %!STATUS!", Status);
+
+            pDevice->ReleaseControl();
+
+            SENSOR_FunctionExit(Status);
+            return Status;
+        }
+
+        // Stop polling
+        pDevice->StopSampling();
+
+        // Close the interrupt window and drop the sample an interrupt raised
+        // before it closed. Stale interrupts are cleared by the power down
+        // write below.
+        if (NULL != pDevice->m_Interrupt)
+        {
+            Status = pDevice->IsrOff();
+            if (!NT_SUCCESS(Status))
+            {
+                TraceError("ACC %!FUNC! Failed to disable interrupts. %!STATUS!", Status);
+            }
+            pDevice->FlushInterruptWork();
+        }
+
+        // Deliver the samples in flight and the batched ones before the
+        // sensor goes idle
+        WdfWorkItemFlush(pDevice->m_DeliveryWorkItem);
+        WdfTimerStop(pDevice->m_BatchTimer, TRUE);
+        pDevice->FlushFifo();
+
+        // The proximity sensor keeps the chip running on its own, its
+        // schedule starts over once the lock is released
+        if (pDevice->IsAdcShared())
+        {
+            ULONG NowMs = 0;
+            GetPerformanceTime(&NowMs);
+
+            pDevice->m_Arbiter.SetChannel(AdcChannel_Als, false, pDevice->m_Interval, NowMs);
+            pDevice->ApplyResolution();
+
+            InitPropVariantFromUInt32(SensorState_Idle, &(pDevice->m_pSensorProperties->List[SENSOR_PROPERTY_STATE].Value));
+            pDevice->m_Lifecycle.Transition(Lifecycle_Stopping, Lifecycle_Idle);
+            pDevice->ReleaseControl();
+
+            SENSOR_FunctionExit(Status);
+            return Status;
+        }
+
+        TraceInformation("ACC %!FUNC! Mode switches: %lu to polling, %lu to interrupt",
+            pDevice->m_Scheduler.GetSwitchesToPolling(),
+            pDevice->m_Scheduler.GetSwitchesToInterrupt());
+        TraceInformation("ACC %!FUNC! Beats: %llu, %llu missed, deadline error mean %llu max %llu, jitter mean %llu max %llu (100ns)",
+            pDevice->m_Beat.GetBeats(),
+            pDevice->m_Beat.GetMissedBeats(),
+            pDevice->m_Beat.GetMeanError(),
+            pDevice->m_Beat.GetMaxError(),
+            pDevice->m_Beat.GetMeanJitter(),
+            pDevice->m_Beat.GetMaxJitter());
+        TraceInformation("ACC %!FUNC! Bus: %llu submissions, %llu failed, hold time mean %llu max %llu (100ns), queue depth max %lu",
+            pDevice->m_Bus.GetSubmissions(),
+            pDevice->m_Bus.GetFailures(),
+            pDevice->m_Bus.GetMeanHoldTime(),
+            pDevice->m_Bus.GetMaxHoldTime(),
+            pDevice->m_Bus.GetMaxDepth());
+
+        // Set sensor to standby
+        setting = { ISL29018_REG_ADD_COMMAND1, ISL29018_CMD1_OPMODE_POWER_DOWN << ISL29018_CMD1_OPMODE_SHIFT};
+        Status = pDevice->m_Bus.Write(setting.Register, setting.Value);
+        pDevice->m_Lifecycle.Transition(Lifecycle_Stopping, Lifecycle_Idle);
+        pDevice->ReleaseControl();
+        if (!NT_SUCCESS(Status))
+        {
+            TraceError("ACC %!FUNC! BusExecutor Write to 0x%02x failed! %!STATUS!", setting.Register, Status);
+        }
+        else
+        {
+            InitPropVariantFromUInt32(SensorState_Idle, &(pDevice->m_pSensorProperties->List[SENSOR_PROPERTY_STATE].Value));
+
+            //
+            // Restoring system time resolution
+            //
+            if (TIMERR_NOERROR != timeEndPeriod(SYSTEM_TICK_COUNT_1MS))
+            {
+                // not a failure, just log message
+                Status = STATUS_UNSUCCESSFUL;
+                TraceWarning("COMBO %!FUNC! timeEndPeriod failed to restore timer resolution! %!STATUS!", Status);
+            }
+        }
+    }
+
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to get supported data fields. The typical usage is to call
+// this function once with buffer pointer as NULL to acquire the required size 
+// for the buffer, allocate buffer, then call the function again to retrieve 
+// sensor information.
+NTSTATUS AlsDevice::OnGetSupportedDataFields(
+    _In_ SENSOROBJECT SensorInstance,          // Sensor device object
+    _Inout_opt_ PSENSOR_PROPERTY_LIST pFields, // Pointer to a list of supported properties
+    _Out_ PULONG pSize)                        // Number of bytes for the list of supported properties
+{
+    if (nullptr != GetProxDeviceContextFromSensorInstance(SensorInstance))
+    {
+        return ProxDevice::OnGetSupportedDataFields(SensorInstance, pFields, pSize);
+    }
+
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    if (nullptr == pSize)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("ACC %!FUNC! pSize: Invalid parameter! %!STATUS!", Status);
+    }
+    else
+    {
+        *pSize = 0;
+
+        // Get the device context
+        PAlsDevice pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
+        if (nullptr == pDevice)
         {
             Status = STATUS_INVALID_PARAMETER;
             TraceError("ACC %!FUNC! Invalid parameters! %!STATUS!", Status);
@@ -699,6 +1934,11 @@ AlsDevice::OnGetProperties(
     _Out_ PULONG pSize
 )
 {
+    if (nullptr != GetProxDeviceContextFromSensorInstance(SensorInstance))
+    {
+        return ProxDevice::OnGetProperties(SensorInstance, pProperties, pSize);
+    }
+
     PAlsDevice pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
     NTSTATUS Status = STATUS_SUCCESS;
 
@@ -771,6 +2011,11 @@ AlsDevice::OnGetDataFieldProperties(
     _Out_ PULONG pSize
 )
 {
+    if (nullptr != GetProxDeviceContextFromSensorInstance(SensorInstance))
+    {
+        return ProxDevice::OnGetDataFieldProperties(SensorInstance, DataField, pProperties, pSize);
+    }
+
     PAlsDevice pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
     NTSTATUS Status = STATUS_SUCCESS;
 
@@ -804,41 +2049,122 @@ AlsDevice::OnGetDataFieldProperties(
             Status = CollectionsListCopyAndMarshall(pProperties, pDevice->m_pDataFieldProperties);
             if (!NT_SUCCESS(Status))
             {
-                TraceError("COMBO %!FUNC! CollectionsListCopyAndMarshall failed %!STATUS!", Status);
-                goto Exit;
+                TraceError("COMBO %!FUNC! CollectionsListCopyAndMarshall failed %!STATUS!", Status);
+                goto Exit;
+            }
+
+            *pSize = CollectionsListGetMarshalledSize(pDevice->m_pDataFieldProperties);
+        }
+    }
+    else
+    {
+        Status = STATUS_NOT_SUPPORTED;
+        TraceError("COMBO %!FUNC! Sensor does NOT have properties for this data field. Failed %!STATUS!", Status);
+        goto Exit;
+    }
+
+Exit:
+    if (!NT_SUCCESS(Status))
+    {
+        *pSize = 0;
+    }
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to handle IOCTLs that clx does not support. The
+// driver's own IOCTLs, see Isl29018Ioctl.h, are completed here with their
+// own status.
+NTSTATUS AlsDevice::OnIoControl(
+    _In_ SENSOROBJECT SensorInstance,     // WDF queue object
+    _In_ WDFREQUEST Request,              // WDF request object
+    _In_ size_t OutputBufferLength,       // number of bytes to retrieve from output buffer
+    _In_ size_t InputBufferLength,        // number of bytes to retrieve from input buffer
+    _In_ ULONG IoControlCode)             // IOCTL control code
+{
+    if (nullptr != GetProxDeviceContextFromSensorInstance(SensorInstance))
+    {
+        return ProxDevice::OnIoControl(SensorInstance, Request, OutputBufferLength, InputBufferLength, IoControlCode);
+    }
+
+    NTSTATUS Status = STATUS_SUCCESS;
+    NTSTATUS RequestStatus = STATUS_SUCCESS;
+    ULONG_PTR Information = 0;
+
+    SENSOR_FunctionEnter();
+
+    PAlsDevice pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
+    if (nullptr == pDevice)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("ACC %!FUNC! Invalid parameters! %!STATUS!", Status);
+        goto Exit;
+    }
+
+    switch (IoControlCode)
+    {
+        case IOCTL_ISL29018_GET_LATENCY:
+        {
+            PISL29018_LATENCY_SNAPSHOT pSnapshot = nullptr;
+            RequestStatus = WdfRequestRetrieveOutputBuffer(Request, sizeof(*pSnapshot), reinterpret_cast<PVOID*>(&pSnapshot), nullptr);
+            if (!NT_SUCCESS(RequestStatus))
+            {
+                TraceError("COMBO %!FUNC! ALS %Iu byte output buffer is too small for the latency snapshot %!STATUS!",
+                           OutputBufferLength, RequestStatus);
+                break;
+            }
+
+            pDevice->m_Latency.GetSnapshot(pSnapshot, GetBeatTime());
+            Information = sizeof(*pSnapshot);
+            break;
+        }
+
+        case IOCTL_ISL29018_RESET_LATENCY:
+            pDevice->m_Latency.Reset(GetBeatTime());
+            TraceInformation("COMBO %!FUNC! ALS Latency histograms cleared");
+            break;
+
+        case IOCTL_ISL29018_GET_HISTORY:
+        {
+            PISL29018_HISTORY_REQUEST pRequest = nullptr;
+            PISL29018_HISTORY_HEADER pHeader = nullptr;
+            size_t OutputSize = 0;
+
+            RequestStatus = WdfRequestRetrieveInputBuffer(Request, sizeof(*pRequest), reinterpret_cast<PVOID*>(&pRequest), nullptr);
+            if (!NT_SUCCESS(RequestStatus))
+            {
+                TraceError("COMBO %!FUNC! ALS %Iu byte input buffer is too small for the history request %!STATUS!",
+                           InputBufferLength, RequestStatus);
+                break;
+            }
+
+            RequestStatus = WdfRequestRetrieveOutputBuffer(Request, sizeof(*pHeader), reinterpret_cast<PVOID*>(&pHeader), &OutputSize);
+            if (!NT_SUCCESS(RequestStatus))
+            {
+                TraceError("COMBO %!FUNC! ALS %Iu byte output buffer is too small for the history header %!STATUS!",
+                           OutputBufferLength, RequestStatus);
+                break;
             }
 
-            *pSize = CollectionsListGetMarshalledSize(pDevice->m_pDataFieldProperties);
+            // The input and the output share the system buffer, so the
+            // request is copied before the answer overwrites it
+            ISL29018_HISTORY_REQUEST HistoryRequest = *pRequest;
+            ULONG MaxCount = static_cast<ULONG>((OutputSize - sizeof(*pHeader)) / sizeof(ISL29018_HISTORY_SAMPLE));
+            ULONG Count = pDevice->m_History.Read(&HistoryRequest, pHeader,
+                                                  reinterpret_cast<PISL29018_HISTORY_SAMPLE>(pHeader + 1), MaxCount);
+
+            Information = sizeof(*pHeader) + Count * sizeof(ISL29018_HISTORY_SAMPLE);
+            break;
         }
-    }
-    else
-    {
-        Status = STATUS_NOT_SUPPORTED;
-        TraceError("COMBO %!FUNC! Sensor does NOT have properties for this data field. Failed %!STATUS!", Status);
-        goto Exit;
-    }
 
-Exit:
-    if (!NT_SUCCESS(Status))
-    {
-        *pSize = 0;
+        default:
+            Status = STATUS_NOT_SUPPORTED;
+            goto Exit;
     }
-    SENSOR_FunctionExit(Status);
-    return Status;
-}
 
-// Called by Sensor CLX to handle IOCTLs that clx does not support
-NTSTATUS AlsDevice::OnIoControl(
-    _In_ SENSOROBJECT /*SensorInstance*/, // WDF queue object
-    _In_ WDFREQUEST /*Request*/,          // WDF request object
-    _In_ size_t /*OutputBufferLength*/,   // number of bytes to retrieve from output buffer
-    _In_ size_t /*InputBufferLength*/,    // number of bytes to retrieve from input buffer
-    _In_ ULONG /*IoControlCode*/)         // IOCTL control code
-{
-    NTSTATUS Status = STATUS_NOT_SUPPORTED;
-
-    SENSOR_FunctionEnter();
+    WdfRequestCompleteWithInformation(Request, RequestStatus, Information);
 
+Exit:
     SENSOR_FunctionExit(Status);
     return Status;
 }
@@ -848,6 +2174,11 @@ NTSTATUS AlsDevice::OnGetDataInterval(
     _In_ SENSOROBJECT SensorInstance,   // Sensor device object
     _Out_ PULONG pDataRateMs)           // Sampling rate in milliseconds
 {
+    if (nullptr != GetProxDeviceContextFromSensorInstance(SensorInstance))
+    {
+        return ProxDevice::OnGetDataInterval(SensorInstance, pDataRateMs);
+    }
+
     NTSTATUS Status = STATUS_SUCCESS;
 
     SENSOR_FunctionEnter();
@@ -889,6 +2220,11 @@ NTSTATUS AlsDevice::OnSetDataInterval(
     _In_ SENSOROBJECT SensorInstance, // Sensor device object
     _In_ ULONG DataRateMs)            // Sampling rate in milliseconds
 {
+    if (nullptr != GetProxDeviceContextFromSensorInstance(SensorInstance))
+    {
+        return ProxDevice::OnSetDataInterval(SensorInstance, DataRateMs);
+    }
+
     NTSTATUS Status = STATUS_SUCCESS;
 
     SENSOR_FunctionEnter();
@@ -905,18 +2241,77 @@ NTSTATUS AlsDevice::OnSetDataInterval(
 
     if (NT_SUCCESS(Status))
     {
+        pDevice->AcquireControl();
+
         pDevice->m_Interval = DataRateMs;
 
-        // reschedule sample to return as soon as possible if it's started
-        if (FALSE != pDevice->m_Started)
+        // Trade precision for speed. A running sensor is stopped first and
+        // gets the resolution from RestartAcquisition, which also reschedules
+        // the sample to return as soon as possible. PowerOn applies it to a
+        // chip that is powered down.
+        if (pDevice->m_Lifecycle.IsStarted())
         {
-            pDevice->m_Started = FALSE;
-            WdfTimerStop(pDevice->m_Timer, TRUE);
+            Status = pDevice->RestartAcquisition();
+        }
+        else if (pDevice->m_Lifecycle.IsPoweredOn())
+        {
+            Status = pDevice->ApplyResolution();
+        }
+
+        pDevice->ReleaseControl();
+    }
+
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+//------------------------------------------------------------------------------
+// Function: OnSetBatchLatency
+//
+// Called by Sensor CLX to set the time samples may be held back in the FIFO
+// before they are reported. Zero reports every sample right away.
+//
+// Arguments:
+//      SensorInstance: IN: sensor device object
+//      BatchLatencyMs: IN: batch latency in ms
+//
+// Return Value:
+//      NTSTATUS code
+//------------------------------------------------------------------------------
+NTSTATUS AlsDevice::OnSetBatchLatency(
+    _In_ SENSOROBJECT SensorInstance, // Sensor device object
+    _In_ ULONG BatchLatencyMs)        // Batch latency in milliseconds
+{
+    // Proximity events are reported right away, there is no FIFO to batch them in
+    if (nullptr != GetProxDeviceContextFromSensorInstance(SensorInstance))
+    {
+        return STATUS_SUCCESS;
+    }
+
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    // Get the device context
+    PAlsDevice pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
+    if (pDevice == nullptr)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("COMBO %!FUNC! Invalid parameter!");
+    }
+    else
+    {
+        bool Shorter = (BatchLatencyMs < pDevice->m_BatchLatency);
+
+        pDevice->m_BatchLatency = BatchLatencyMs;
 
-            pDevice->m_Started = TRUE;
-            pDevice->m_FirstSample = TRUE;
-            WdfTimerStart(pDevice->m_Timer, WDF_REL_TIMEOUT_IN_MS(pDevice->m_MinimumInterval));
+        // Samples queued under a longer latency are due by now
+        if (Shorter)
+        {
+            pDevice->FlushFifo();
         }
+
+        TraceInformation("COMBO %!FUNC! ALS Batch latency set to %lu ms", BatchLatencyMs);
     }
 
     SENSOR_FunctionExit(Status);
@@ -944,6 +2339,11 @@ NTSTATUS AlsDevice::OnGetDataThresholds(
     _Inout_opt_ PSENSOR_COLLECTION_LIST pThresholds,    // Pointer to a list of sensor thresholds
     _Out_ PULONG pSize)                                 // Number of bytes for the list of sensor thresholds
 {
+    if (nullptr != GetProxDeviceContextFromSensorInstance(SensorInstance))
+    {
+        return ProxDevice::OnGetDataThresholds(SensorInstance, pThresholds, pSize);
+    }
+
 
     NTSTATUS Status = STATUS_SUCCESS;
 
@@ -1001,6 +2401,11 @@ NTSTATUS AlsDevice::OnSetDataThresholds(
     _In_ SENSOROBJECT SensorInstance,           // Sensor Device Object
     _In_ PSENSOR_COLLECTION_LIST pThresholds)   // Pointer to a list of sensor thresholds
 {
+    if (nullptr != GetProxDeviceContextFromSensorInstance(SensorInstance))
+    {
+        return ProxDevice::OnSetDataThresholds(SensorInstance, pThresholds);
+    }
+
     NTSTATUS Status = STATUS_SUCCESS;
 
     SENSOR_FunctionEnter();
@@ -1029,14 +2434,30 @@ NTSTATUS AlsDevice::OnSetDataThresholds(
     // Update cached threshholds
     if (NT_SUCCESS(Status))
     {
+        pDevice->AcquireControl();
+
         Status = pDevice->UpdateCachedThreshold();
         if (!NT_SUCCESS(Status))
         {
             TraceError("COMBO %!FUNC! UpdateCachedThreshold failed! %!STATUS!", Status);
 
+            pDevice->ReleaseControl();
+
             SENSOR_FunctionExit(Status);
             return Status;
         }
+
+        // The thresholds decide between polling and interrupts, start over
+        if (pDevice->m_Lifecycle.IsStarted())
+        {
+            Status = pDevice->RestartAcquisition();
+            if (!NT_SUCCESS(Status))
+            {
+                TraceError("COMBO %!FUNC! RestartAcquisition failed! %!STATUS!", Status);
+            }
+        }
+
+        pDevice->ReleaseControl();
     }
 
     SENSOR_FunctionExit(Status);
@@ -1094,56 +2515,51 @@ BOOLEAN AlsDevice::OnInterruptIsr(
                                         // device's hardware interrupt message. Otherwise, this value is 0.
 {
     BOOLEAN InterruptRecognized = FALSE;
-    PAlsDevice pDevice = nullptr;
+    BYTE StatusBuffer[ISL29018_STATUS_SIZE_BYTES];
+    FILETIME CaptureTime;
 
-    SENSOR_FunctionEnter();
+    // The ISR only does what it takes to tell whether the chip raised the
+    // interrupt, everything else is left to the work item. Stamp the sample
+    // before the bus read delays it.
+    ULONGLONG CaptureTicks = GetBeatTime();
+    GetSystemTimePreciseAsFileTime(&CaptureTime);
 
-    // Get the sensor instance
-    ULONG SensorInstanceCount = 1;
-    SENSOROBJECT SensorInstance = NULL;
-    NTSTATUS Status = SensorsCxDeviceGetSensorList(WdfInterruptGetDevice(Interrupt), &SensorInstance, &SensorInstanceCount);
-    if (!NT_SUCCESS(Status) || 0 == SensorInstanceCount || NULL == SensorInstance)
+    // The light sensor whose chip raised the interrupt is cached in the interrupt's context
+    PAlsDevice pDevice = GetFromInterrupt(Interrupt);
+    if (nullptr == pDevice)
     {
-        Status = STATUS_INVALID_PARAMETER;
-        TraceError("ACC %!FUNC! SensorsCxDeviceGetSensorList failed %!STATUS!", Status);
+        TraceError("ACC %!FUNC! GetFromInterrupt failed %!STATUS!", STATUS_INVALID_PARAMETER);
+        return FALSE;
     }
 
-    // Get the device context
-    else // if (NT_SUCCESS(Status))
+    // Read the interrupt source together with the data that raised it, the
+    // work item processes the data without going back to the chip. The read
+    // also clears the level-triggered interrupt, so it cannot be left to the
+    // work item. It is the only transfer under the interrupt lock: nothing
+    // that holds the bus waits for the lock, the work item only takes it to
+    // take the sample over.
+    NTSTATUS Status = pDevice->m_Bus.Read(ISL29018_REG_ADD_COMMAND1, StatusBuffer, sizeof(StatusBuffer));
+    if (!NT_SUCCESS(Status))
     {
-        pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
-        if (nullptr == pDevice)
-        {
-            Status = STATUS_INVALID_PARAMETER;
-            TraceError("ACC %!FUNC! GetAlsDeviceContextFromSensorInstance failed %!STATUS!", Status);
-        }
+        TraceError("ACC %!FUNC! BusExecutor Read from 0x%02x failed! %!STATUS!", ISL29018_REG_ADD_COMMAND1, Status);
     }
-
-    // Read the interrupt source
-    if (NT_SUCCESS(Status))
+    else if ((StatusBuffer[ISL29018_STATUS_COMMAND1] & ISL29018_CMD1_ISR_MASK) == 0)
     {
-        BYTE IntSrcBuffer = 0;
-        WdfWaitLockAcquire(pDevice->m_I2CWaitLock, NULL);
-        Status = I2CSensorReadRegister(pDevice->m_I2CIoTarget, ISL29018_REG_ADD_COMMAND1, &IntSrcBuffer, sizeof(IntSrcBuffer));
-        WdfWaitLockRelease(pDevice->m_I2CWaitLock);
-
-        if (!NT_SUCCESS(Status))
-        {
-            TraceError("ACC %!FUNC! I2CSensorReadRegister from 0x%02x failed! %!STATUS!", ISL29018_REG_ADD_COMMAND1, Status);
-        }
-        else if ((IntSrcBuffer & ISL29018_CMD1_ISR_MASK) == 0)
-        {
-            TraceError("%!FUNC! Interrupt source not recognized");
-        }
-        else
-        {
-            InterruptRecognized = TRUE;
-            BOOLEAN WorkItemQueued = WdfInterruptQueueWorkItemForIsr(Interrupt);
-            TraceVerbose("%!FUNC! Work item %s queued for interrupt", WorkItemQueued ? "" : " already");
-        }
+        TraceError("%!FUNC! Interrupt source not recognized");
+    }
+    else
+    {
+        // Hand the sample to the work item, a sample it has not processed yet is replaced
+        memcpy(pDevice->m_InterruptBuffer, StatusBuffer, sizeof(StatusBuffer));
+        pDevice->m_InterruptTime = CaptureTime;
+        pDevice->m_InterruptTicks = CaptureTicks;
+        pDevice->m_InterruptPending = true;
+
+        InterruptRecognized = TRUE;
+        pDevice->m_Counters.OnInterrupt();
+        WdfInterruptQueueWorkItemForIsr(Interrupt);
     }
 
-    SENSOR_FunctionExit(Status);
     return InterruptRecognized;
 }
 
@@ -1155,42 +2571,81 @@ VOID AlsDevice::OnInterruptWorkItem(
 {
     PAlsDevice pDevice = nullptr;
 
-    SENSOR_FunctionEnter();
+    SENSOR_HotPathEnter();
 
-    // Get the sensor instance
-    ULONG SensorInstanceCount = 1;
-    SENSOROBJECT SensorInstance = NULL;
-    NTSTATUS Status = SensorsCxDeviceGetSensorList(WdfInterruptGetDevice(Interrupt), &SensorInstance, &SensorInstanceCount);
-    if (!NT_SUCCESS(Status) || 0 == SensorInstanceCount || NULL == SensorInstance)
+    // Get the device context of the light sensor whose chip raised the interrupt
+    NTSTATUS Status = STATUS_SUCCESS;
+    pDevice = GetFromInterrupt(Interrupt);
+    if (nullptr == pDevice)
     {
         Status = STATUS_INVALID_PARAMETER;
-        TraceError("ACC %!FUNC! SensorsCxDeviceGetSensorList failed %!STATUS!", Status);
-    }
-
-    // Get the device context
-    else //if (NT_SUCCESS(Status))
-    {
-        pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
-        if (nullptr == pDevice)
-        {
-            Status = STATUS_INVALID_PARAMETER;
-            TraceError("ACC %!FUNC! GetAlsDeviceContextFromSensorInstance failed %!STATUS!", Status);
-        }
+        TraceError("ACC %!FUNC! GetFromInterrupt failed %!STATUS!", Status);
     }
 
-    // Read the device data
+    // Process the data the ISR read, a later interrupt may have replaced it
+    // with newer data in the meantime. The sample is dropped if the sensor
+    // left interrupt mode after the ISR ran: the timer is then the only
+    // producer. The work item runs under the control lock, so a stop or
+    // restart does not see a report or a register write once it holds the
+    // lock. Only taking the sample over from the ISR is done under the
+    // interrupt lock, see FlushInterruptWork.
     if (NT_SUCCESS(Status))
     {
+        BYTE StatusBuffer[ISL29018_STATUS_SIZE_BYTES];
+        FILETIME CaptureTime;
+        ULONGLONG CaptureTicks;
+
+        pDevice->AcquireControl();
+
         WdfInterruptAcquireLock(Interrupt);
-        Status = pDevice->GetData();
+
+        bool Pending = pDevice->m_InterruptPending;
+        pDevice->m_InterruptPending = false;
+        memcpy(StatusBuffer, pDevice->m_InterruptBuffer, sizeof(StatusBuffer));
+        CaptureTime = pDevice->m_InterruptTime;
+        CaptureTicks = pDevice->m_InterruptTicks;
+
         WdfInterruptReleaseLock(Interrupt);
-        if (!NT_SUCCESS(Status) && STATUS_DATA_NOT_ACCEPTED != Status)
+
+        if (Pending &&
+            pDevice->m_Lifecycle.IsStarted() &&
+            AcquisitionMode_Interrupt == pDevice->m_Scheduler.GetMode())
         {
-            TraceError("ACC %!FUNC! GetData failed %!STATUS!", Status);
+            pDevice->m_Latency.RecordSince(LatencyStage_InterruptDispatch, CaptureTicks, GetBeatTime());
+            SAMPLE_OUTCOME Outcome;
+            Status = pDevice->ProcessData(STATUS_SUCCESS, StatusBuffer, &CaptureTime, &Outcome);
+            pDevice->m_Latency.RecordSince(LatencyStage_Sample, CaptureTicks, GetBeatTime());
+            if (!NT_SUCCESS(Status) && STATUS_DATA_NOT_ACCEPTED != Status)
+            {
+                TraceError("ACC %!FUNC! ProcessData failed %!STATUS!", Status);
+            }
+            else
+            {
+                ULONG NowMs = 0;
+                GetPerformanceTime(&NowMs);
+
+                // Re-arm the window around the last reported sample, unless the light
+                // flickers around its edge faster than the interrupt budget allows
+                if (AcquisitionMode_Interrupt == pDevice->m_Scheduler.OnInterrupt(NowMs))
+                {
+                    Status = pDevice->IsrOn();
+                    if (!NT_SUCCESS(Status))
+                    {
+                        TraceError("ACC %!FUNC! Failed to re-arm interrupts. %!STATUS!", Status);
+                    }
+                }
+                else
+                {
+                    TraceInformation("ACC %!FUNC! Interrupt rate over budget, falling back to polling");
+                    Status = pDevice->StartPolling();
+                }
+            }
         }
+
+        pDevice->ReleaseControl();
     }
 
-    SENSOR_FunctionExit(Status);
+    SENSOR_HotPathExit(Status);
 }
 
 //------------------------------------------------------------------------------
@@ -1212,8 +2667,9 @@ VOID AlsDevice::OnTimerExpire(
 {
     PAlsDevice pDevice = nullptr;
     NTSTATUS Status = STATUS_SUCCESS;
+    BEAT_ACTION Action = BeatAction_ReadSample;
 
-    SENSOR_FunctionEnter();
+    SENSOR_HotPathEnter();
 
     pDevice = GetAlsDeviceContextFromSensorInstance(WdfTimerGetParentObject(Timer));
     if (pDevice == nullptr)
@@ -1223,61 +2679,227 @@ VOID AlsDevice::OnTimerExpire(
         goto Exit;
     }
 
-    // Get data and push to clx
-    WdfWaitLockAcquire(pDevice->m_I2CWaitLock, NULL);
-    Status = pDevice->GetData();
-    if (!NT_SUCCESS(Status) && Status != STATUS_DATA_NOT_ACCEPTED)
+    // The proximity channel takes turns with the light channel
+    if (pDevice->IsAdcShared())
     {
-        TraceError("COMBO %!FUNC! GetData Failed %!STATUS!", Status);
+        pDevice->ServeSharedAdc();
+        goto Exit;
+    }
+
+    // The timer may have been restarted by a beat read that completed while
+    // the sensor was being stopped or reconfigured
+    if (!pDevice->m_Lifecycle.IsStarted())
+    {
+        goto Exit;
     }
-    WdfWaitLockRelease(pDevice->m_I2CWaitLock);
 
-    // Schedule next wake up time
-    if (pDevice->m_MinimumInterval <= pDevice->m_Interval &&
-        FALSE != pDevice->m_PoweredOn &&
-        FALSE != pDevice->m_Started)
+    // Extra conversions ahead of the beat are read one conversion time apart
+    if (pDevice->m_OversampleReads > 0 && pDevice->m_Lifecycle.IsStarted())
     {
-        LONGLONG WaitTime = 0;  // in unit of 100ns
+        pDevice->m_OversampleReads--;
 
-        if (pDevice->m_StartTime == 0)
+        Status = pDevice->GetOversample();
+        if (!NT_SUCCESS(Status))
         {
-            // in case we fail to get sensor start time, use static wait time
-            WaitTime = WDF_REL_TIMEOUT_IN_MS(pDevice->m_Interval);
+            TraceError("COMBO %!FUNC! GetOversample Failed %!STATUS!", Status);
         }
-        else
+
+        WdfTimerStart(pDevice->m_Timer, WDF_REL_TIMEOUT_IN_MS(
+            Isl29018ConversionTimeMs(AlsDevice_Chip, pDevice->m_AutoRange.GetResolution())));
+        goto Exit;
+    }
+
+    // In one-shot mode every beat first starts a single conversion and the
+    // sample is read once the integration time elapsed. The chip powers itself
+    // down after the conversion.
+    Action = pDevice->GetBeatAction(false);
+    if (BeatAction_StartAls == Action || BeatAction_StartIr == Action)
+    {
+        Status = (BeatAction_StartIr == Action) ?
+                 pDevice->StartIrConversion() :
+                 pDevice->WriteOpMode(ISL29018_CMD1_OPMODE_ALS_ONCE);
+        if (NT_SUCCESS(Status))
+        {
+            WdfTimerStart(pDevice->m_Timer, WDF_REL_TIMEOUT_IN_MS(
+                Isl29018ConversionTimeMs(AlsDevice_Chip, pDevice->m_AutoRange.GetResolution())));
+            goto Exit;
+        }
+
+        TraceError("COMBO %!FUNC! Failed to start a conversion, reading the previous one %!STATUS!", Status);
+        Action = pDevice->GetBeatAction(true);
+    }
+
+    // An IR conversion took the place of this beat's ALS conversion. Store it
+    // and resume ALS conversions; in one-shot mode the next beat starts one.
+    if (BeatAction_ReadIr == Action || BeatAction_ReadIrAndResume == Action)
+    {
+        Status = pDevice->GetIrData();
+        if (!NT_SUCCESS(Status))
         {
-            ULONG CurrentTimeMs = 0;
+            TraceError("COMBO %!FUNC! GetIrData Failed %!STATUS!", Status);
+        }
 
-            // dynamically calculate wait time to avoid jitter
-            Status = GetPerformanceTime(&CurrentTimeMs);
+        if (BeatAction_ReadIrAndResume == Action)
+        {
+            Status = pDevice->WriteOpMode(ISL29018_CMD1_OPMODE_ALS_CONT);
             if (!NT_SUCCESS(Status))
             {
-                TraceError("COMBO %!FUNC! GetPerformanceTime %!STATUS!", Status);
-                WaitTime = WDF_REL_TIMEOUT_IN_MS(pDevice->m_Interval);
+                TraceError("COMBO %!FUNC! Failed to resume ALS conversions %!STATUS!", Status);
             }
-            else
-            {
-                pDevice->m_SampleCount++;
-                if (CurrentTimeMs > (pDevice->m_StartTime + (pDevice->m_Interval * (pDevice->m_SampleCount + 1))))
-                {
-                    // If we skipped two or more beats, reschedule the timer with a zero due time to catch up on missing samples
-                    WaitTime = 0;
-                }
-                else
-                {
-                    // Else, just compute the remaining time
-                    WaitTime = (pDevice->m_StartTime +
-                        (pDevice->m_Interval * (pDevice->m_SampleCount + 1))) - CurrentTimeMs;
-                }
+        }
+
+        pDevice->ScheduleNextBeat();
+        goto Exit;
+    }
+
+    // Read the sample, along with the configuration it was taken with, without
+    // holding up this thread for the transfer. OnSampleRead finishes the beat.
+    pDevice->m_SampleTicks = GetBeatTime();
+    pDevice->m_Latency.Record(LatencyStage_BeatError, pDevice->m_Beat.GetDeadlineError(pDevice->m_SampleTicks));
+    GetSystemTimePreciseAsFileTime(&pDevice->m_SampleTime);
+    pDevice->m_Bus.ReadAsync(ISL29018_REG_ADD_COMMAND1,
+                             pDevice->m_SampleBuffer,
+                             sizeof(pDevice->m_SampleBuffer),
+                             OnSampleRead,
+                             pDevice);
+
+Exit:
+
+    SENSOR_HotPathExit(Status);
+}
+
+//------------------------------------------------------------------------------
+// Function: OnSampleRead
+//
+// This callback is called by the bus executor once the beat's registers
+// were read. It pushes the sample to the CLX framework, lets the scheduler
+// decide between polling and interrupts, and schedules the next wake up time.
+//
+// Arguments:
+//      Context: IN: the light sensor the read was submitted for
+//      ReadStatus: IN: outcome of the read
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID AlsDevice::OnSampleRead(
+    _In_ PVOID Context,
+    _In_ NTSTATUS ReadStatus
+)
+{
+    PAlsDevice pDevice = static_cast<PAlsDevice>(Context);
+    NTSTATUS Status = STATUS_SUCCESS;
+    SAMPLE_OUTCOME Outcome;
+
+    SENSOR_HotPathEnter();
+
+    // Push the data to clx
+    Status = pDevice->ProcessData(ReadStatus, pDevice->m_SampleBuffer, &pDevice->m_SampleTime, &Outcome);
+    pDevice->m_Latency.RecordSince(LatencyStage_Sample, pDevice->m_SampleTicks, GetBeatTime());
+    if (!NT_SUCCESS(Status) && Status != STATUS_DATA_NOT_ACCEPTED)
+    {
+        TraceError("COMBO %!FUNC! GetData Failed %!STATUS!", Status);
+    }
+
+    // Once the light is stable the scheduler hands over to the threshold window
+    // and the chip signals further changes, so the timer is not rescheduled
+    if (pDevice->m_Lifecycle.IsStarted())
+    {
+        ULONG NowMs = 0;
+        GetPerformanceTime(&NowMs);
 
-                WaitTime = WDF_REL_TIMEOUT_IN_MS(WaitTime);
+        POLL_ACTION Action = pDevice->OnPolledSample(NowMs, Outcome);
+        if (PollAction_ArmWindow == Action || PollAction_ResumeAndArmWindow == Action)
+        {
+            // The window is only evaluated on continuous conversions
+            Status = (PollAction_ResumeAndArmWindow == Action) ?
+                     pDevice->WriteOpMode(ISL29018_CMD1_OPMODE_ALS_CONT) : STATUS_SUCCESS;
+            if (NT_SUCCESS(Status))
+            {
+                Status = pDevice->IsrOn();
+            }
+            if (NT_SUCCESS(Status))
+            {
+                goto Exit;
             }
+
+            // Keep sampling by polling rather than going silent
+            TraceError("COMBO %!FUNC! Failed to arm interrupts, polling instead %!STATUS!", Status);
+            Action = pDevice->OnArmWindowFailed();
         }
 
-        WdfTimerStart(pDevice->m_Timer, WaitTime);
+        // With continuous conversions the IR conversion runs until the next
+        // beat, which reads it in place of an ALS sample
+        if (PollAction_StartIr == Action)
+        {
+            Status = pDevice->StartIrConversion();
+            if (!NT_SUCCESS(Status))
+            {
+                TraceError("COMBO %!FUNC! StartIrConversion Failed %!STATUS!", Status);
+            }
+        }
     }
 
+
+    pDevice->ScheduleNextBeat();
+
 Exit:
 
+    SENSOR_HotPathExit(Status);
+}
+
+// Called when the oldest batched sample waited for the batch latency
+VOID AlsDevice::OnBatchTimerExpire(
+    _In_ WDFTIMER Timer
+)
+{
+    PAlsDevice pDevice = nullptr;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    pDevice = GetAlsDeviceContextFromSensorInstance(WdfTimerGetParentObject(Timer));
+    if (pDevice == nullptr)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        TraceError("COMBO %!FUNC! GetContextFromSensorInstance failed %!STATUS!", Status);
+    }
+    else
+    {
+        pDevice->FlushFifo();
+    }
+
     SENSOR_FunctionExit(Status);
 }
+
+// Drains the samples the acquisition path handed over and reports them to the
+// clx. This is the only consumer of m_Ring.
+VOID AlsDevice::OnDeliveryWorkItem(
+    _In_ WDFWORKITEM WorkItem
+)
+{
+    PAlsDevice pDevice = nullptr;
+    NTSTATUS Status = STATUS_SUCCESS;
+    RING_SAMPLE Sample;
+
+    SENSOR_HotPathEnter();
+
+    pDevice = GetAlsDeviceContextFromSensorInstance(WdfWorkItemGetParentObject(WorkItem));
+    if (pDevice == nullptr)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        TraceError("COMBO %!FUNC! GetContextFromSensorInstance failed %!STATUS!", Status);
+    }
+    else
+    {
+        // A sample enqueued after the ring was found empty queues the work
+        // item again, so none is left behind
+        while (pDevice->m_Ring.Dequeue(&Sample))
+        {
+            TraceHotVerbose("COMBO %!FUNC! ALS Delivering %f lux from count %lu", Sample.Sample.Lux, Sample.RawCount);
+            pDevice->QueueSample(Sample.Sample, Sample.FirstSample);
+        }
+    }
+
+    SENSOR_HotPathExit(Status);
+}
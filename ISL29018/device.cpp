@@ -10,6 +10,7 @@
 //   Windows User-Mode Driver Framework (UMDF)
 
 #include "Device.h"
+#include "ProxDevice.h"
 
 #include "Device.tmh"
 
@@ -79,6 +80,7 @@ NTSTATUS AlsDevice::OnDeviceAdd(
     config.EvtSensorSetDataThresholds = AlsDevice::OnSetDataThresholds;
     config.EvtSensorGetProperties = AlsDevice::OnGetProperties;
     config.EvtSensorDeviceIoControl = AlsDevice::OnIoControl;
+    config.EvtSensorSetBatchLatency = AlsDevice::OnSetBatchLatency;
     
     // Initialize the sensor device with the Sensor CLX
     // This lets the CLX call the above callbacks when
@@ -122,70 +124,34 @@ NTSTATUS AlsDevice::OnPrepareHardware(
                                             // (system-physical) hardware resources that have been assigned to the
                                             // device. The resources appear from the CPU's point of view.
 {
-    PAlsDevice pDevice = nullptr;
     NTSTATUS status;
-    SENSOROBJECT SensorInstance = NULL;
-    SENSOR_CONFIG SensorConfig;
-    
-    SENSOR_FunctionEnter();
+    CHIP_RESOURCES Chips[AlsDevice_MaxChips] = {};
+    ULONG ChipCount = 0;
 
-    // Create WDFOBJECT for the sensor
-    WDF_OBJECT_ATTRIBUTES sensorAttributes;
-    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&sensorAttributes, AlsDevice);
+    SENSOR_FunctionEnter();
 
-    // Register sensor instance with clx
-    
-    status = SensorsCxSensorCreate(Device, &sensorAttributes, &SensorInstance);
+    // ACPI lists one I2C connection per chip
+    status = GetChipResources(ResourcesRaw, ResourcesTranslated, Chips, &ChipCount);
     if (!NT_SUCCESS(status))
     {
-        TraceError("ACC %!FUNC! SensorsCxSensorCreate failed %!STATUS!", status);
-
-        SENSOR_FunctionExit(status);
-        return status;
-    }
- 
-    pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
-    if (nullptr == pDevice)
-    {
-        status = STATUS_INSUFFICIENT_RESOURCES;
-        TraceError("ACC %!FUNC! SensorsCxSensorCreate failed %!STATUS!", status);
-
         SENSOR_FunctionExit(status);
         return status;
     }
 
-    // Fill out sensor context
-    status = pDevice->Initialize(Device, SensorInstance);
-    if (!NT_SUCCESS(status))
+    // Every chip gets its own light and proximity sensor instances
+    for (ULONG i = 0; i < ChipCount; i++)
     {
-        TraceError("ACC %!FUNC! Initialize device object failed %!STATUS!", status);
-
-        SENSOR_FunctionExit(status);
-        return status;
-    }
-
-    // Initialize sensor instance with clx    
-    SENSOR_CONFIG_INIT(&SensorConfig);
-    SensorConfig.pEnumerationList = pDevice->m_pEnumerationProperties;
-    status = SensorsCxSensorInitialize(SensorInstance, &SensorConfig);
-    if (!NT_SUCCESS(status))
-    {
-        TraceError("ACC %!FUNC! SensorsCxSensorInitialize failed %!STATUS!", status);
+        status = CreateChip(Device, i, &Chips[i]);
+        if (!NT_SUCCESS(status))
+        {
+            TraceError("ACC %!FUNC! Failed to set up chip %lu %!STATUS!", i, status);
 
-        SENSOR_FunctionExit(status);
-        return status;
+            SENSOR_FunctionExit(status);
+            return status;
+        }
     }
-    
-    
-    // ACPI and IoTarget configuration
-    status = pDevice->ConfigureIoTarget(ResourcesRaw, ResourcesTranslated);
-    if (!NT_SUCCESS(status))
-    {
-        TraceError("ACC %!FUNC! Failed to configure IoTarget %!STATUS!", status);
 
-        SENSOR_FunctionExit(status);
-        return status;
-    }    
+    TraceInformation("ACC %!FUNC! %lu chip(s) found", ChipCount);
 
     SENSOR_FunctionExit(status);
     return status;
@@ -205,36 +171,27 @@ NTSTATUS AlsDevice::OnReleaseHardware(
                                                 // (system-physical) hardware resources that have been assigned to the
                                                 // device. The resources appear from the CPU's point of view.
 {
-    PAlsDevice pDevice = nullptr;
-    NTSTATUS status;
-    ULONG SensorInstanceCount = 1;
-    SENSOROBJECT SensorInstance = NULL;
+    PAlsDevice pDevices[AlsDevice_MaxChips] = {};
+    NTSTATUS status = STATUS_SUCCESS;
 
     SENSOR_FunctionEnter();
 
-    // Get the sensor instance
-    status = SensorsCxDeviceGetSensorList(Device, &SensorInstance, &SensorInstanceCount);
-    if (!NT_SUCCESS(status) || 0 == SensorInstanceCount || NULL == SensorInstance)
+    // Get the light sensor instances, which own the chips
+    ULONG ChipCount = GetAllFromDevice(Device, pDevices, ARRAYSIZE(pDevices));
+    if (0 == ChipCount)
     {
         status = STATUS_INVALID_PARAMETER;
-        TraceError("ACC %!FUNC! SensorsCxDeviceGetSensorList failed %!STATUS!", status);
+        TraceError("ACC %!FUNC! GetAllFromDevice failed %!STATUS!", status);
 
         SENSOR_FunctionExit(status);
         return status;
     }
 
-    pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
-    if (nullptr == pDevice)
+    for (ULONG i = 0; i < ChipCount; i++)
     {
-        status = STATUS_INVALID_PARAMETER;
-        TraceError("ACC %!FUNC! GetAlsDeviceContextFromSensorInstance failed %!STATUS!", status);
-
-        SENSOR_FunctionExit(status);
-        return status;
+        pDevices[i]->DeInit();
     }
 
-    pDevice->DeInit();
-
     SENSOR_FunctionExit(status);
     return status;
 }
@@ -249,37 +206,30 @@ NTSTATUS AlsDevice::OnD0Entry(
     _In_  WDF_POWER_DEVICE_STATE /*PreviousState*/) // WDF_POWER_DEVICE_STATE-typed enumerator that identifies
                                                     // the device power state that the device was in before this transition to D0
 {
-    PAlsDevice pDevice = nullptr;
-    NTSTATUS status;
-    ULONG SensorInstanceCount = 1;
-    SENSOROBJECT SensorInstance = NULL;
+    PAlsDevice pDevices[AlsDevice_MaxChips] = {};
+    NTSTATUS status = STATUS_SUCCESS;
 
     SENSOR_FunctionEnter();
 
-    // Get the sensor instance    
-    status = SensorsCxDeviceGetSensorList(Device, &SensorInstance, &SensorInstanceCount);
-    if (!NT_SUCCESS(status) || 0 == SensorInstanceCount || NULL == SensorInstance)
+    // Get the device contexts of the light sensors, which own the chips
+    ULONG ChipCount = GetAllFromDevice(Device, pDevices, ARRAYSIZE(pDevices));
+    if (0 == ChipCount)
     {
         status = STATUS_INVALID_PARAMETER;
-        TraceError("ACC %!FUNC! SensorsCxDeviceGetSensorList failed %!STATUS!", status);
+        TraceError("ACC %!FUNC! GetAllFromDevice failed %!STATUS!", status);
 
         SENSOR_FunctionExit(status);
         return status;
     }
 
-    // Get the device context
-    pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
-    if (nullptr == pDevice)
+    // A proximity sensor left running across the power cycle resumes its
+    // schedule once the control lock is released
+    for (ULONG i = 0; i < ChipCount && NT_SUCCESS(status); i++)
     {
-        status = STATUS_INVALID_PARAMETER;
-        TraceError("ACC %!FUNC! GetAlsDeviceContextFromSensorInstance failed %!STATUS!", status);
-
-        SENSOR_FunctionExit(status);
-        return status;
+        pDevices[i]->AcquireControl();
+        status = pDevices[i]->PowerOn();
+        pDevices[i]->ReleaseControl();
     }
-    
-
-    status = pDevice->PowerOn();
 
     SENSOR_FunctionExit(status);
     return status;
@@ -297,61 +247,107 @@ NTSTATUS AlsDevice::OnD0Exit(
     _In_ WDF_POWER_DEVICE_STATE)/*TargetState*/ // Supplies the device power state which the device will be put
                                                 // in once the callback is complete
 {
-    PAlsDevice pDevice = nullptr;
-    NTSTATUS status;
-    ULONG SensorInstanceCount = 1;
-    SENSOROBJECT SensorInstance = NULL;
+    PAlsDevice pDevices[AlsDevice_MaxChips] = {};
+    NTSTATUS status = STATUS_SUCCESS;
 
     SENSOR_FunctionEnter();
 
-    // Get the sensor instance
-    status = SensorsCxDeviceGetSensorList(Device, &SensorInstance, &SensorInstanceCount);
-    if (!NT_SUCCESS(status) || 0 == SensorInstanceCount || NULL == SensorInstance)
+    // Get the device contexts of the light sensors, which own the chips
+    ULONG ChipCount = GetAllFromDevice(Device, pDevices, ARRAYSIZE(pDevices));
+    if (0 == ChipCount)
     {
         status = STATUS_INVALID_PARAMETER;
-        TraceError("ACC %!FUNC! SensorsCxDeviceGetSensorList failed %!STATUS!", status);
+        TraceError("ACC %!FUNC! GetAllFromDevice failed %!STATUS!", status);
 
         SENSOR_FunctionExit(status);
         return status;
     }
 
-    // Get the device context   
-    pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
-    if (nullptr == pDevice)
+    // Put every chip into standby even if one of them fails
+    for (ULONG i = 0; i < ChipCount; i++)
     {
-        status = STATUS_INVALID_PARAMETER;
-        TraceError("ACC %!FUNC! GetAlsDeviceContextFromSensorInstance failed %!STATUS!", status);
-
-        SENSOR_FunctionExit(status);
-        return status;
+        pDevices[i]->AcquireControl();
+        NTSTATUS ChipStatus = pDevices[i]->PowerOff();
+        pDevices[i]->ReleaseControl();
+        if (NT_SUCCESS(status))
+        {
+            status = ChipStatus;
+        }
     }
 
-    status = pDevice->PowerOff();
-
     SENSOR_FunctionExit(status);
     return status;
 }
 
-// Get the HW resource from the ACPI, then configure and store the IoTarget
-NTSTATUS AlsDevice::ConfigureIoTarget(
+// Find the light sensors among the sensor instances of the device, in chip
+// order. The proximity sensor instances share the device, so not every
+// instance owns a chip. Returns the number of light sensors found.
+ULONG AlsDevice::GetAllFromDevice(
+    _In_ WDFDEVICE Device,                          // Supplies a handle to the framework device object
+    _Out_writes_(MaxCount) PAlsDevice* ppDevices,   // Receives the light sensors
+    _In_ ULONG MaxCount)                            // Size of ppDevices
+{
+    NTSTATUS status;
+    SENSOROBJECT SensorInstances[AlsDevice_MaxChips * AdcChannel_Count] = {};
+    ULONG SensorInstanceCount = ARRAYSIZE(SensorInstances);
+    ULONG Count = 0;
+
+    status = SensorsCxDeviceGetSensorList(Device, SensorInstances, &SensorInstanceCount);
+    if (!NT_SUCCESS(status))
+    {
+        TraceError("ACC %!FUNC! SensorsCxDeviceGetSensorList failed %!STATUS!", status);
+        return 0;
+    }
+
+    for (ULONG i = 0; i < SensorInstanceCount && i < ARRAYSIZE(SensorInstances); i++)
+    {
+        if (NULL == SensorInstances[i])
+        {
+            continue;
+        }
+
+        PAlsDevice pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstances[i]);
+        if (nullptr != pDevice && pDevice->m_ChipIndex < MaxCount)
+        {
+            ppDevices[pDevice->m_ChipIndex] = pDevice;
+            Count++;
+        }
+    }
+
+    return Count;
+}
+
+// Get the light sensor of the chip that is wired to the given interrupt, as
+// stored in the interrupt's context by ConfigureIoTarget
+PAlsDevice AlsDevice::GetFromInterrupt(
+    _In_ WDFINTERRUPT Interrupt)    // Handle to a framework interrupt object
+{
+    PINTERRUPT_CONTEXT pContext = GetInterruptContext(Interrupt);
+
+    return (nullptr != pContext) ? pContext->pDevice : nullptr;
+}
+
+// Get the HW resources from the ACPI. Every I2C connection is a chip, the
+// interrupts are handed to the chips in the same order.
+NTSTATUS AlsDevice::GetChipResources(
     _In_ WDFCMRESLIST ResourcesRaw,         // Supplies a handle to a collection of framework resource
                                             // objects. This collection identifies the raw (bus-relative) hardware
                                             // resources that have been assigned to the device.
-    _In_ WDFCMRESLIST ResourcesTranslated)  // Supplies a handle to a collection of framework
+    _In_ WDFCMRESLIST ResourcesTranslated,  // Supplies a handle to a collection of framework
                                             // resource objects. This collection identifies the translated
                                             // (system-physical) hardware resources that have been assigned to the
                                             // device. The resources appear from the CPU's point of view.
+    _Out_writes_(AlsDevice_MaxChips) PCHIP_RESOURCES pChips,    // Receives the resources of every chip
+    _Out_ PULONG pChipCount)                // Receives the number of chips
 {
-    NTSTATUS status;
+    NTSTATUS status = STATUS_SUCCESS;
     ULONG I2CConnectionResourceCount = 0;
-    LARGE_INTEGER I2CConnId = {};
-    WDF_IO_TARGET_OPEN_PARAMS OpenParams;
-
-    DECLARE_UNICODE_STRING_SIZE(deviceName, RESOURCE_HUB_PATH_SIZE);
+    ULONG InterruptResourceCount = 0;
 
     SENSOR_FunctionEnter();
 
-    // Get hardware resource from ACPI and set up IO target
+    *pChipCount = 0;
+
     ULONG ResourceCount = WdfCmResourceListGetCount(ResourcesTranslated);
     for (ULONG i = 0; i < ResourceCount; i++)
     {
@@ -365,35 +361,24 @@ NTSTATUS AlsDevice::ConfigureIoTarget(
                 if (Descriptor->u.Connection.Class == CM_RESOURCE_CONNECTION_CLASS_SERIAL &&
                     Descriptor->u.Connection.Type == CM_RESOURCE_CONNECTION_TYPE_SERIAL_I2C) 
                 {
-                    I2CConnId.LowPart = Descriptor->u.Connection.IdLowPart;
-                    I2CConnId.HighPart = Descriptor->u.Connection.IdHighPart;
+                    if (I2CConnectionResourceCount < AlsDevice_MaxChips)
+                    {
+                        pChips[I2CConnectionResourceCount].I2CConnId.LowPart = Descriptor->u.Connection.IdLowPart;
+                        pChips[I2CConnectionResourceCount].I2CConnId.HighPart = Descriptor->u.Connection.IdHighPart;
+                    }
                     I2CConnectionResourceCount++;
                 }
                 break;
     
-            // Check we have an interrupt assigned in ACPI and create interrupt
+            // Check we have an interrupt assigned in ACPI
             case CmResourceTypeInterrupt:
                 TraceInformation("ACC %!FUNC! GPIO interrupt resource found.");
-
-                WDF_INTERRUPT_CONFIG InterruptConfig;
-
-                WDF_INTERRUPT_CONFIG_INIT(&InterruptConfig, OnInterruptIsr, NULL);
-                InterruptConfig.InterruptRaw = DescriptorRaw;
-                InterruptConfig.InterruptTranslated = Descriptor;
-
-                // Configure an interrupt work item which runs at IRQL = PASSIVE_LEVEL
-                // Note: to configure to run at IRQL = DISPATCH_LEVEL, set up an InterruptDpc instead of an InterruptWorkItem
-                InterruptConfig.EvtInterruptWorkItem = OnInterruptWorkItem;
-                InterruptConfig.PassiveHandling = true;
-
-                status = WdfInterruptCreate(m_Device, &InterruptConfig, WDF_NO_OBJECT_ATTRIBUTES, &m_Interrupt);
-                if (!NT_SUCCESS(status))
+                if (InterruptResourceCount < AlsDevice_MaxChips)
                 {
-                    TraceError("ACC %!FUNC! WdfInterruptCreate failed %!STATUS!", status);
-
-                    SENSOR_FunctionExit(status);
-                    return status;
+                    pChips[InterruptResourceCount].InterruptRaw = DescriptorRaw;
+                    pChips[InterruptResourceCount].InterruptTranslated = Descriptor;
                 }
+                InterruptResourceCount++;
                 break;
 
             default:
@@ -401,15 +386,376 @@ NTSTATUS AlsDevice::ConfigureIoTarget(
         }
     }
 
-    if (I2CConnectionResourceCount != 1)
+    if (I2CConnectionResourceCount == 0 || I2CConnectionResourceCount > AlsDevice_MaxChips)
     {
         status = STATUS_UNSUCCESSFUL;
-        TraceError("ACC %!FUNC! Did not find I2C resource! %!STATUS!", status);
+        TraceError("ACC %!FUNC! Found %lu I2C resources, 1 to %d are supported! %!STATUS!",
+            I2CConnectionResourceCount, AlsDevice_MaxChips, status);
+
+        SENSOR_FunctionExit(status);
+        return status;
+    }
+
+    // An interrupt without a chip cannot be serviced
+    if (InterruptResourceCount > I2CConnectionResourceCount)
+    {
+        TraceError("ACC %!FUNC! Ignoring %lu interrupt resource(s) without an I2C resource",
+            InterruptResourceCount - I2CConnectionResourceCount);
+    }
+
+    *pChipCount = I2CConnectionResourceCount;
+
+    SENSOR_FunctionExit(status);
+    return status;
+}
+
+// Create and register the light and proximity sensor instances of a chip,
+// then connect them to the chip
+NTSTATUS AlsDevice::CreateChip(
+    _In_ WDFDEVICE Device,                      // Supplies a handle to the framework device object
+    _In_ ULONG ChipIndex,                       // Position of the chip's resources in the resource list
+    _In_ const CHIP_RESOURCES* pResources)      // Resources of the chip
+{
+    PAlsDevice pDevice = nullptr;
+    NTSTATUS status;
+    SENSOROBJECT SensorInstance = NULL;
+    PProxDevice pProx = nullptr;
+    SENSOROBJECT ProxInstance = NULL;
+    SENSOR_CONFIG SensorConfig;
+
+    SENSOR_FunctionEnter();
+
+    // Create WDFOBJECT for the sensor
+    WDF_OBJECT_ATTRIBUTES sensorAttributes;
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&sensorAttributes, AlsDevice);
+
+    // Register sensor instance with clx
+    
+    status = SensorsCxSensorCreate(Device, &sensorAttributes, &SensorInstance);
+    if (!NT_SUCCESS(status))
+    {
+        TraceError("ACC %!FUNC! SensorsCxSensorCreate failed %!STATUS!", status);
+
+        SENSOR_FunctionExit(status);
+        return status;
+    }
+ 
+    pDevice = GetAlsDeviceContextFromSensorInstance(SensorInstance);
+    if (nullptr == pDevice)
+    {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        TraceError("ACC %!FUNC! SensorsCxSensorCreate failed %!STATUS!", status);
+
+        SENSOR_FunctionExit(status);
+        return status;
+    }
+
+    // Fill out sensor context
+    status = pDevice->Initialize(Device, SensorInstance, ChipIndex);
+    if (!NT_SUCCESS(status))
+    {
+        TraceError("ACC %!FUNC! Initialize device object failed %!STATUS!", status);
+
+        SENSOR_FunctionExit(status);
+        return status;
+    }
+
+    // Initialize sensor instance with clx    
+    SENSOR_CONFIG_INIT(&SensorConfig);
+    SensorConfig.pEnumerationList = pDevice->m_pEnumerationProperties;
+    status = SensorsCxSensorInitialize(SensorInstance, &SensorConfig);
+    if (!NT_SUCCESS(status))
+    {
+        TraceError("ACC %!FUNC! SensorsCxSensorInitialize failed %!STATUS!", status);
+
+        SENSOR_FunctionExit(status);
+        return status;
+    }
+
+    // Create the proximity sensor instance on the same chip
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&sensorAttributes, ProxDevice);
+
+    status = SensorsCxSensorCreate(Device, &sensorAttributes, &ProxInstance);
+    if (!NT_SUCCESS(status))
+    {
+        TraceError("PRX %!FUNC! SensorsCxSensorCreate failed %!STATUS!", status);
+
+        SENSOR_FunctionExit(status);
+        return status;
+    }
+
+    pProx = GetProxDeviceContextFromSensorInstance(ProxInstance);
+    if (nullptr == pProx)
+    {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        TraceError("PRX %!FUNC! SensorsCxSensorCreate failed %!STATUS!", status);
+
+        SENSOR_FunctionExit(status);
+        return status;
+    }
+
+    status = pProx->Initialize(Device, ProxInstance, pDevice);
+    if (!NT_SUCCESS(status))
+    {
+        TraceError("PRX %!FUNC! Initialize device object failed %!STATUS!", status);
 
         SENSOR_FunctionExit(status);
         return status;
     }
 
+    pDevice->m_pProx = pProx;
+
+    SENSOR_CONFIG_INIT(&SensorConfig);
+    SensorConfig.pEnumerationList = pProx->m_pEnumerationProperties;
+    status = SensorsCxSensorInitialize(ProxInstance, &SensorConfig);
+    if (!NT_SUCCESS(status))
+    {
+        TraceError("PRX %!FUNC! SensorsCxSensorInitialize failed %!STATUS!", status);
+
+        SENSOR_FunctionExit(status);
+        return status;
+    }
+    
+    
+    // Optional settings from the registry
+    status = pDevice->ReadConfiguration();
+    if (!NT_SUCCESS(status))
+    {
+        TraceError("ACC %!FUNC! Failed to read the configuration %!STATUS!", status);
+
+        SENSOR_FunctionExit(status);
+        return status;
+    }
+
+    // Readers of the shared sample are optional, the sensor works without them
+    if (!NT_SUCCESS(pDevice->OpenSharedSample()))
+    {
+        TraceError("ACC %!FUNC! Failed to create the shared sample section, not publishing");
+    }
+
+    // ACPI and IoTarget configuration
+    status = pDevice->ConfigureIoTarget(pResources);
+    if (!NT_SUCCESS(status))
+    {
+        TraceError("ACC %!FUNC! Failed to configure IoTarget %!STATUS!", status);
+
+        SENSOR_FunctionExit(status);
+        return status;
+    }    
+
+    SENSOR_FunctionExit(status);
+    return status;
+}
+
+// Map the recording file and attach the recorder to it. The file is created
+// or grown to hold Capacity records; a recording already in it is continued.
+NTSTATUS AlsDevice::OpenRecording(
+    _In_ PCWSTR pPath,          // Recording file
+    _In_ ULONG Capacity)        // Records kept before the oldest are overwritten
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    ULARGE_INTEGER Size;
+
+    SENSOR_FunctionEnter();
+
+    Size.QuadPart = SampleRecordFileSize(Capacity);
+
+    // Others may read the recording while the driver is writing it
+    m_RecordFile = CreateFileW(pPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                               OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == m_RecordFile)
+    {
+        m_RecordFile = NULL;
+        status = NTSTATUS_FROM_WIN32(GetLastError());
+        TraceError("ACC %!FUNC! CreateFileW failed %!STATUS!", status);
+        goto Exit;
+    }
+
+    m_RecordMapping = CreateFileMappingW(m_RecordFile, NULL, PAGE_READWRITE, Size.HighPart, Size.LowPart, NULL);
+    if (NULL == m_RecordMapping)
+    {
+        status = NTSTATUS_FROM_WIN32(GetLastError());
+        TraceError("ACC %!FUNC! CreateFileMappingW failed %!STATUS!", status);
+        goto Exit;
+    }
+
+    m_pRecordView = MapViewOfFile(m_RecordMapping, FILE_MAP_WRITE, 0, 0, static_cast<SIZE_T>(Size.QuadPart));
+    if (NULL == m_pRecordView)
+    {
+        status = NTSTATUS_FROM_WIN32(GetLastError());
+        TraceError("ACC %!FUNC! MapViewOfFile failed %!STATUS!", status);
+        goto Exit;
+    }
+
+    if (!m_Recorder.Attach(m_pRecordView, Size.QuadPart, AlsDevice_IrCoefficient))
+    {
+        status = STATUS_INVALID_PARAMETER;
+        TraceError("ACC %!FUNC! Recording cannot hold %lu records %!STATUS!", Capacity, status);
+    }
+
+Exit:
+    if (!NT_SUCCESS(status))
+    {
+        CloseRecording();
+    }
+
+    SENSOR_FunctionExit(status);
+    return status;
+}
+
+// Stop recording and unmap the recording file. The records written so far
+// are flushed to the file.
+VOID AlsDevice::CloseRecording()
+{
+    m_Recorder.Detach();
+
+    if (NULL != m_pRecordView)
+    {
+        FlushViewOfFile(m_pRecordView, 0);
+        UnmapViewOfFile(m_pRecordView);
+        m_pRecordView = NULL;
+    }
+
+    if (NULL != m_RecordMapping)
+    {
+        CloseHandle(m_RecordMapping);
+        m_RecordMapping = NULL;
+    }
+
+    if (NULL != m_RecordFile)
+    {
+        CloseHandle(m_RecordFile);
+        m_RecordFile = NULL;
+    }
+}
+
+// Create the section the last reported sample of the chip is published in.
+// Other processes may open it by name and map it for reading only.
+NTSTATUS AlsDevice::OpenSharedSample()
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    SECURITY_ATTRIBUTES SecurityAttributes = {};
+    PSECURITY_DESCRIPTOR pSecurityDescriptor = NULL;
+    WCHAR Name[64];
+
+    SENSOR_FunctionEnter();
+
+    HRESULT hr = StringCchPrintfW(Name, ARRAYSIZE(Name), ISL29018_SHARED_SAMPLE_NAME, m_ChipIndex);
+    if (FAILED(hr))
+    {
+        status = STATUS_INVALID_PARAMETER;
+        TraceError("ACC %!FUNC! StringCchPrintfW failed %!STATUS!", status);
+        goto Exit;
+    }
+
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(ISL29018_SHARED_SAMPLE_SDDL, SDDL_REVISION_1,
+                                                              &pSecurityDescriptor, NULL))
+    {
+        status = NTSTATUS_FROM_WIN32(GetLastError());
+        TraceError("ACC %!FUNC! ConvertStringSecurityDescriptorToSecurityDescriptorW failed %!STATUS!", status);
+        goto Exit;
+    }
+
+    SecurityAttributes.nLength = sizeof(SecurityAttributes);
+    SecurityAttributes.lpSecurityDescriptor = pSecurityDescriptor;
+    SecurityAttributes.bInheritHandle = FALSE;
+
+    m_SharedMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, &SecurityAttributes, PAGE_READWRITE,
+                                         0, sizeof(ISL29018_SHARED_SAMPLE), Name);
+    if (NULL == m_SharedMapping)
+    {
+        status = NTSTATUS_FROM_WIN32(GetLastError());
+        TraceError("ACC %!FUNC! CreateFileMappingW failed %!STATUS!", status);
+        goto Exit;
+    }
+
+    m_pSharedView = static_cast<PISL29018_SHARED_SAMPLE>(
+        MapViewOfFile(m_SharedMapping, FILE_MAP_WRITE, 0, 0, sizeof(ISL29018_SHARED_SAMPLE)));
+    if (NULL == m_pSharedView)
+    {
+        status = NTSTATUS_FROM_WIN32(GetLastError());
+        TraceError("ACC %!FUNC! MapViewOfFile failed %!STATUS!", status);
+        goto Exit;
+    }
+
+    m_Publisher.Attach(m_pSharedView);
+
+Exit:
+    if (NULL != pSecurityDescriptor)
+    {
+        LocalFree(pSecurityDescriptor);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        CloseSharedSample();
+    }
+
+    SENSOR_FunctionExit(status);
+    return status;
+}
+
+// Stop publishing and delete the section. Readers that still have it mapped
+// keep the last sample.
+VOID AlsDevice::CloseSharedSample()
+{
+    m_Publisher.Detach();
+
+    if (NULL != m_pSharedView)
+    {
+        UnmapViewOfFile(m_pSharedView);
+        m_pSharedView = NULL;
+    }
+
+    if (NULL != m_SharedMapping)
+    {
+        CloseHandle(m_SharedMapping);
+        m_SharedMapping = NULL;
+    }
+}
+
+// Create the interrupt of the chip, if it has one, then configure and store the IoTarget
+NTSTATUS AlsDevice::ConfigureIoTarget(
+    _In_ const CHIP_RESOURCES* pResources)  // Resources of the chip found by GetChipResources
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    WDF_IO_TARGET_OPEN_PARAMS OpenParams;
+
+    DECLARE_UNICODE_STRING_SIZE(deviceName, RESOURCE_HUB_PATH_SIZE);
+
+    SENSOR_FunctionEnter();
+
+    // Create the interrupt assigned to this chip in ACPI
+    if (NULL != pResources->InterruptTranslated)
+    {
+        WDF_INTERRUPT_CONFIG InterruptConfig;
+        WDF_OBJECT_ATTRIBUTES InterruptAttributes;
+
+        WDF_INTERRUPT_CONFIG_INIT(&InterruptConfig, OnInterruptIsr, NULL);
+        InterruptConfig.InterruptRaw = pResources->InterruptRaw;
+        InterruptConfig.InterruptTranslated = pResources->InterruptTranslated;
+
+        // Configure an interrupt work item which runs at IRQL = PASSIVE_LEVEL
+        // Note: to configure to run at IRQL = DISPATCH_LEVEL, set up an InterruptDpc instead of an InterruptWorkItem
+        InterruptConfig.EvtInterruptWorkItem = OnInterruptWorkItem;
+        InterruptConfig.PassiveHandling = true;
+
+        // The interrupt carries its light sensor, it is connected only once
+        // the device enters D0 so the context is set before the ISR can run
+        WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&InterruptAttributes, INTERRUPT_CONTEXT);
+
+        status = WdfInterruptCreate(m_Device, &InterruptConfig, &InterruptAttributes, &m_Interrupt);
+        if (!NT_SUCCESS(status))
+        {
+            TraceError("ACC %!FUNC! WdfInterruptCreate failed %!STATUS!", status);
+
+            SENSOR_FunctionExit(status);
+            return status;
+        }
+
+        GetInterruptContext(m_Interrupt)->pDevice = this;
+    }
+
     // Set up I2C I/O target. Issued with I2C R/W transfers
     m_I2CIoTarget = NULL;
     status = WdfIoTargetCreate(m_Device, WDF_NO_OBJECT_ATTRIBUTES, &m_I2CIoTarget);
@@ -425,7 +771,7 @@ NTSTATUS AlsDevice::ConfigureIoTarget(
 
     // Setup Target string (\\\\.\\RESOURCE_HUB\\<ConnID from ResHub>
     status = StringCbPrintfW(deviceName.Buffer, RESOURCE_HUB_PATH_SIZE, L"%s\\%0*I64x",
-        RESOURCE_HUB_DEVICE_NAME, static_cast<unsigned int>(sizeof(LARGE_INTEGER) * 2), I2CConnId.QuadPart);
+        RESOURCE_HUB_DEVICE_NAME, static_cast<unsigned int>(sizeof(LARGE_INTEGER) * 2), pResources->I2CConnId.QuadPart);
     deviceName.Length = _countof(deviceName_buffer);
     
     if (!NT_SUCCESS(status))
@@ -448,6 +794,166 @@ NTSTATUS AlsDevice::ConfigureIoTarget(
         return status;
     }    
 
+    // Preallocate the bus requests for the target
+    status = m_Bus.Connect(m_I2CIoTarget);
+    if (!NT_SUCCESS(status))
+    {
+        TraceError("ACC %!FUNC! WdfRequestCreate failed! %!STATUS!", status);
+
+        SENSOR_FunctionExit(status);
+        return status;
+    }
+
+    SENSOR_FunctionExit(status);
+    return status;
+}
+
+// Read the optional settings from the device's parameters key. Settings that
+// are not present keep their defaults.
+NTSTATUS AlsDevice::ReadConfiguration()
+{
+    NTSTATUS status;
+    WDFKEY Key = NULL;
+    ULONG FilterType = NoiseFilter_None;
+
+    ULONG Oversample = 0;
+    ULONG CatchUpPolicy = CatchUpPolicy_Coalesce;
+    ULONG RecordCapacity = SampleRecord_DefaultCapacity;
+    WCHAR RecordPath[MAX_PATH] = {};
+
+    DECLARE_CONST_UNICODE_STRING(NoiseFilterValueName, L"NoiseFilter");
+    DECLARE_CONST_UNICODE_STRING(OversampleValueName, L"Oversample");
+    DECLARE_CONST_UNICODE_STRING(CatchUpPolicyValueName, L"CatchUpPolicy");
+    DECLARE_CONST_UNICODE_STRING(RecordFileValueName, L"RecordFile");
+    DECLARE_CONST_UNICODE_STRING(RecordCapacityValueName, L"RecordCapacity");
+    DECLARE_UNICODE_STRING_SIZE(RecordFile, MAX_PATH);
+
+    SENSOR_FunctionEnter();
+
+    status = WdfDeviceOpenRegistryKey(m_Device, PLUGPLAY_REGKEY_DEVICE, KEY_READ, WDF_NO_OBJECT_ATTRIBUTES, &Key);
+    if (!NT_SUCCESS(status))
+    {
+        TraceError("ACC %!FUNC! WdfDeviceOpenRegistryKey failed %!STATUS!", status);
+
+        SENSOR_FunctionExit(status);
+        return status;
+    }
+
+    status = WdfRegistryQueryULong(Key, &NoiseFilterValueName, &FilterType);
+    if (STATUS_OBJECT_NAME_NOT_FOUND == status)
+    {
+        FilterType = NoiseFilter_None;
+        status = STATUS_SUCCESS;
+    }
+    else if (!NT_SUCCESS(status))
+    {
+        TraceError("ACC %!FUNC! WdfRegistryQueryULong failed %!STATUS!", status);
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        status = WdfRegistryQueryULong(Key, &OversampleValueName, &Oversample);
+        if (STATUS_OBJECT_NAME_NOT_FOUND == status)
+        {
+            Oversample = 0;
+            status = STATUS_SUCCESS;
+        }
+        else if (!NT_SUCCESS(status))
+        {
+            TraceError("ACC %!FUNC! WdfRegistryQueryULong failed %!STATUS!", status);
+        }
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        status = WdfRegistryQueryULong(Key, &CatchUpPolicyValueName, &CatchUpPolicy);
+        if (STATUS_OBJECT_NAME_NOT_FOUND == status)
+        {
+            CatchUpPolicy = CatchUpPolicy_Coalesce;
+            status = STATUS_SUCCESS;
+        }
+        else if (!NT_SUCCESS(status))
+        {
+            TraceError("ACC %!FUNC! WdfRegistryQueryULong failed %!STATUS!", status);
+        }
+    }
+
+    // Raw sample recording is off unless a file is named. The string is not
+    // terminated, so one character is kept free for the terminator.
+    if (NT_SUCCESS(status))
+    {
+        RecordFile.MaximumLength -= sizeof(WCHAR);
+        status = WdfRegistryQueryUnicodeString(Key, &RecordFileValueName, NULL, &RecordFile);
+        if (STATUS_OBJECT_NAME_NOT_FOUND == status)
+        {
+            RecordFile.Length = 0;
+            status = STATUS_SUCCESS;
+        }
+        else if (!NT_SUCCESS(status))
+        {
+            TraceError("ACC %!FUNC! WdfRegistryQueryUnicodeString failed %!STATUS!", status);
+        }
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        status = WdfRegistryQueryULong(Key, &RecordCapacityValueName, &RecordCapacity);
+        if (STATUS_OBJECT_NAME_NOT_FOUND == status)
+        {
+            RecordCapacity = SampleRecord_DefaultCapacity;
+            status = STATUS_SUCCESS;
+        }
+        else if (!NT_SUCCESS(status))
+        {
+            TraceError("ACC %!FUNC! WdfRegistryQueryULong failed %!STATUS!", status);
+        }
+    }
+
+    WdfRegistryClose(Key);
+
+    if (NT_SUCCESS(status))
+    {
+        if (FilterType >= NoiseFilter_Count)
+        {
+            TraceError("ACC %!FUNC! Unknown noise filter %lu, not filtering", FilterType);
+        }
+
+        if (CatchUpPolicy >= CatchUpPolicy_Count)
+        {
+            TraceError("ACC %!FUNC! Unknown catch-up policy %lu, coalescing missed beats", CatchUpPolicy);
+        }
+
+        m_Filter.Reset(FilterType);
+        m_OversampleEnabled = (0 != Oversample);
+        m_Beat.Reset(CatchUpPolicy);
+        TraceInformation("ACC %!FUNC! Using noise filter %d, oversampling %s, catch-up policy %d",
+            m_Filter.GetType(), m_OversampleEnabled ? "on" : "off", m_Beat.GetPolicy());
+    }
+
+    // Every chip records to a file of its own, the chips after the first one
+    // append their index to the name. A recording that cannot be opened only
+    // costs the recording.
+    if (NT_SUCCESS(status) && 0 != RecordFile.Length)
+    {
+        RecordFile.Buffer[RecordFile.Length / sizeof(WCHAR)] = L'\0';
+
+        HRESULT hr = (0 == m_ChipIndex) ?
+                     StringCchCopyW(RecordPath, ARRAYSIZE(RecordPath), RecordFile.Buffer) :
+                     StringCchPrintfW(RecordPath, ARRAYSIZE(RecordPath), L"%s.%lu", RecordFile.Buffer, m_ChipIndex);
+        if (FAILED(hr))
+        {
+            TraceError("ACC %!FUNC! Recording file name is too long, not recording");
+        }
+        else if (0 == RecordCapacity || !NT_SUCCESS(OpenRecording(RecordPath, RecordCapacity)))
+        {
+            TraceError("ACC %!FUNC! Failed to open the recording with %lu records, not recording", RecordCapacity);
+        }
+        else
+        {
+            TraceInformation("ACC %!FUNC! Recording raw samples, %lld recorded so far", m_Recorder.GetWritten());
+        }
+    }
+
     SENSOR_FunctionExit(status);
     return status;
 }
@@ -456,28 +962,39 @@ NTSTATUS AlsDevice::ConfigureIoTarget(
 NTSTATUS AlsDevice::PowerOn()
 {
     NTSTATUS status = STATUS_SUCCESS;
+    REGISTER_SETTING settings[ARRAYSIZE(g_ConfigurationSettings)];
+    BUS_OPERATION operations[ARRAYSIZE(g_ConfigurationSettings)];
 
-    WdfWaitLockAcquire(m_I2CWaitLock, NULL);
-    
     for (DWORD i = 0; i < ARRAYSIZE(g_ConfigurationSettings); i++)
     {
-        REGISTER_SETTING setting = g_ConfigurationSettings[i];
-        status = I2CSensorWriteRegister(m_I2CIoTarget, setting.Register, &setting.Value, sizeof(setting.Value));
+        settings[i] = g_ConfigurationSettings[i];
+        operations[i] = { BusOperation_Write, settings[i].Register, &settings[i].Value, sizeof(settings[i].Value) };
+    }
 
-        if (!NT_SUCCESS(status))
-        {
-            TraceError("ACC %!FUNC! I2CSensorReadRegister from 0x%02x failed! %!STATUS!", setting.Register, status);
-            WdfWaitLockRelease(m_I2CWaitLock);
+    status = m_Bus.Execute(operations, ARRAYSIZE(operations));
+    if (!NT_SUCCESS(status))
+    {
+        TraceError("ACC %!FUNC! Failed to write the default configuration %!STATUS!", status);
 
-            return status;
-        }
+        return status;
     }
 
-    WdfWaitLockRelease(m_I2CWaitLock);
+    // The configuration above selects the initial range and resolution, then
+    // the resolution is adjusted to the current data interval
+    m_AutoRange.Reset(AlsDevice_Initial_Range, AlsDevice_Initial_Resolution);
+    status = ApplyResolution();
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
 
     InitPropVariantFromUInt32(SensorState_Idle, &(m_pSensorProperties->List[SENSOR_PROPERTY_STATE].Value));
+    if (nullptr != m_pProx)
+    {
+        m_pProx->SetState(SensorState_Idle);
+    }
 
-    m_PoweredOn = true;
+    m_Lifecycle.Transition(Lifecycle_Off, Lifecycle_Idle);
     return status;
 }
 
@@ -485,94 +1002,134 @@ NTSTATUS AlsDevice::PowerOff()
 {
     NTSTATUS status;
     REGISTER_SETTING setting = { ISL29018_REG_ADD_COMMAND1, ISL29018_CMD1_OPMODE_POWER_DOWN << ISL29018_CMD1_OPMODE_SHIFT };
-    
-    WdfWaitLockAcquire(m_I2CWaitLock, NULL);
-    status = I2CSensorWriteRegister(m_I2CIoTarget, setting.Register, &setting.Value, sizeof(setting.Value));
-    WdfWaitLockRelease(m_I2CWaitLock);
-        
+
+    // The timer and the work items leave the chip alone from here on, even if
+    // the write below fails. PowerOn configures it again before it is used.
+    m_Lifecycle.Enter(Lifecycle_Off);
+    StopSampling();
+
+    status = m_Bus.Write(setting.Register, setting.Value);
     if (!NT_SUCCESS(status))
     {
         TraceError("ACC %!FUNC! Failed to put device into standby %!STATUS!", status);
-
-        return status;
     }
 
-    m_PoweredOn = false;
     return status;
 }
 
 
-// Write the default device configuration to the device
+// Arm the interrupt window around the last reported sample so that the chip
+// only interrupts once the light changed by more than the current thresholds
 NTSTATUS AlsDevice::IsrOn()
+{
+    // Around the last sample in uncompensated counts, and inside the range
+    THRESHOLD_WINDOW Window = GetThresholdWindow(AlsDevice_IrCoefficient);
+
+    TraceVerbose("ACC %!FUNC! Arming window [%u, %u]", Window.LowCount, Window.HighCount);
+
+    return WriteThresholdWindow(Window.LowCount, Window.HighCount);
+}
+
+// Program a window that no conversion can leave, so no interrupt is raised
+NTSTATUS AlsDevice::IsrOff()
+{
+    return WriteThresholdWindow(0, ISL29018_MAX_COUNT);
+}
+
+// Write the interrupt thresholds. The chip interrupts when a conversion is
+// lower than LowCount or higher than HighCount.
+NTSTATUS AlsDevice::WriteThresholdWindow(
+    _In_ USHORT LowCount,   // Raw count of the low threshold
+    _In_ USHORT HighCount)  // Raw count of the high threshold
 {
     NTSTATUS status = STATUS_SUCCESS;
     REGISTER_SETTING settings[] =
     {
-        { ISL29018_REG_ADD_INT_LT_LSB, 0xFF },
-        { ISL29018_REG_ADD_INT_LT_MSB, 0xFF },
-        { ISL29018_REG_ADD_INT_HT_LSB, 0x00 },
-        { ISL29018_REG_ADD_INT_HT_MSB, 0x00 },
+        { ISL29018_REG_ADD_INT_LT_LSB, static_cast<BYTE>(LowCount & 0xFF) },
+        { ISL29018_REG_ADD_INT_LT_MSB, static_cast<BYTE>(LowCount >> 8) },
+        { ISL29018_REG_ADD_INT_HT_LSB, static_cast<BYTE>(HighCount & 0xFF) },
+        { ISL29018_REG_ADD_INT_HT_MSB, static_cast<BYTE>(HighCount >> 8) },
     };
 
-    WdfWaitLockAcquire(m_I2CWaitLock, NULL);
+    BUS_OPERATION operations[ARRAYSIZE(settings)];
+
     for (DWORD i = 0; i < ARRAYSIZE(settings); i++)
     {
-        REGISTER_SETTING setting = settings[i];
-        status = I2CSensorWriteRegister(m_I2CIoTarget, setting.Register, &setting.Value, sizeof(setting.Value));
-
-        if (!NT_SUCCESS(status))
-        {
-            TraceError("ACC %!FUNC! I2CSensorReadRegister from 0x%02x failed! %!STATUS!", setting.Register, status);
-            WdfWaitLockRelease(m_I2CWaitLock);
-
-            return status;
-        }
+        operations[i] = { BusOperation_Write, settings[i].Register, &settings[i].Value, sizeof(settings[i].Value) };
     }
-    WdfWaitLockRelease(m_I2CWaitLock);
 
+    // One submission, so no other access gets in between the four writes
+    status = m_Bus.Execute(operations, ARRAYSIZE(operations));
     if (!NT_SUCCESS(status))
     {
-        TraceError("ACC %!FUNC! Failed to put device into standby %!STATUS!", status);
-
-        return status;
+        TraceError("ACC %!FUNC! Failed to write the threshold window %!STATUS!", status);
     }
 
     return status;
 }
 
-NTSTATUS AlsDevice::IsrOff()
+// Write the range and resolution selected by the auto-ranging engine
+NTSTATUS AlsDevice::WriteCommand2()
 {
-    NTSTATUS status = STATUS_SUCCESS;
-    REGISTER_SETTING settings[] =
-    {        
-        { ISL29018_REG_ADD_INT_LT_LSB, 0x00 },
-        { ISL29018_REG_ADD_INT_LT_MSB, 0x00 },
-        { ISL29018_REG_ADD_INT_HT_LSB, 0xFF },
-        { ISL29018_REG_ADD_INT_HT_MSB, 0xFF },       
-    };
+    NTSTATUS status;
+    REGISTER_SETTING setting = { ISL29018_REG_ADD_COMMAND2, GetCommand2() };
 
-    WdfWaitLockAcquire(m_I2CWaitLock, NULL);
-    for (DWORD i = 0; i < ARRAYSIZE(settings); i++)
+    status = m_Bus.Write(setting.Register, setting.Value);
+
+    if (!NT_SUCCESS(status))
     {
-        REGISTER_SETTING setting = settings[i];
-        status = I2CSensorWriteRegister(m_I2CIoTarget, setting.Register, &setting.Value, sizeof(setting.Value));
+        TraceError("ACC %!FUNC! BusExecutor Write to 0x%02x failed! %!STATUS!", setting.Register, status);
+    }
 
-        if (!NT_SUCCESS(status))
-        {
-            TraceError("ACC %!FUNC! I2CSensorReadRegister from 0x%02x failed! %!STATUS!", setting.Register, status);
-            WdfWaitLockRelease(m_I2CWaitLock);
+    return status;
+}
 
-            return status;
-        }
-    }
-    WdfWaitLockRelease(m_I2CWaitLock);
+// Write the operation mode to COMMAND1. This also clears the interrupt flag.
+NTSTATUS AlsDevice::WriteOpMode(
+    _In_ BYTE OpMode)   // One of the ISL29018_CMD1_OPMODE_* values
+{
+    NTSTATUS status;
+    REGISTER_SETTING setting = { ISL29018_REG_ADD_COMMAND1, static_cast<BYTE>(OpMode << ISL29018_CMD1_OPMODE_SHIFT) };
+
+    status = m_Bus.Write(setting.Register, setting.Value);
 
     if (!NT_SUCCESS(status))
     {
-        TraceError("ACC %!FUNC! Failed to put device into standby %!STATUS!", status);
+        TraceError("ACC %!FUNC! BusExecutor Write to 0x%02x failed! %!STATUS!", setting.Register, status);
+    }
 
-        return status;
+    return status;
+}
+
+// Start converting in the mode picked by the scheduler. In one-shot mode a
+// single conversion is started and the chip powers down once it completes.
+NTSTATUS AlsDevice::StartConversions()
+{
+    NTSTATUS status;
+
+    m_IrPending = false;
+
+    if (m_Scheduler.UseOneShot())
+    {
+        status = WriteOpMode(ISL29018_CMD1_OPMODE_ALS_ONCE);
+        m_ConversionPending = NT_SUCCESS(status);
     }
+    else
+    {
+        status = WriteOpMode(ISL29018_CMD1_OPMODE_ALS_CONT);
+        m_ConversionPending = false;
+    }
+
+    return status;
+}
+
+// Start a single IR conversion in place of the next ALS conversion. The chip
+// powers down once it completes, continuous ALS conversions are restarted
+// after the IR result was read.
+NTSTATUS AlsDevice::StartIrConversion()
+{
+    NTSTATUS status = WriteOpMode(ISL29018_CMD1_OPMODE_IR_ONCE);
+    m_IrPending = NT_SUCCESS(status);
 
     return status;
 }
@@ -14,6 +14,11 @@
 
 #include "Driver.tmh"
 
+// Isl29018.Als {DCD96905-6DA7-44E6-9EA5-13F12DECC36A}
+TRACELOGGING_DEFINE_PROVIDER(g_hIsl29018Provider,
+    "Isl29018.Als",
+    (0xdcd96905, 0x6da7, 0x44e6, 0x9e, 0xa5, 0x13, 0xf1, 0x2d, 0xec, 0xc3, 0x6a));
+
 // This routine is the driver initialization entry point.
 NTSTATUS DriverEntry(
     _In_ PDRIVER_OBJECT  DriverObject,
@@ -24,6 +29,7 @@ NTSTATUS DriverEntry(
 
     // Initialize WPP Tracing
     WPP_INIT_TRACING(DriverObject, NULL);
+    TraceLoggingRegister(g_hIsl29018Provider);
 
     SENSOR_FunctionEnter();
 
@@ -39,6 +45,7 @@ NTSTATUS DriverEntry(
     if (!NT_SUCCESS(status))
     {
         TraceError("WdfDriverCreate failed %!STATUS!", status);
+        TraceLoggingUnregister(g_hIsl29018Provider);
     }
 
     SENSOR_FunctionExit(status);
@@ -53,6 +60,8 @@ VOID OnDriverUnload(
 
     SENSOR_FunctionExit(STATUS_SUCCESS);
 
+    TraceLoggingUnregister(g_hIsl29018Provider);
+
     // WPP_CLEANUP doesn't actually use the Driver parameter so we need to set it as unreferenced.
     UNREFERENCED_PARAMETER(Driver);
     WPP_CLEANUP(WdfDriverWdmGetDriverObject(Driver));
@@ -34,11 +34,19 @@
 
 #define ISL29018_CMD2_SCHEME_SHIFT	7
 #define ISL29018_CMD2_SCHEME_MASK	(0x1 << ISL29018_CMD2_SCHEME_SHIFT)
+#define ISL29018_CMD2_SCHEME_AMBIENT_REJECT	1
 
 #define ISL29018_REG_ADD_DATA_LSB	0x02
 #define ISL29018_REG_ADD_DATA_MSB	0x03
 #define ISL290185_DATA_SIZE_BYTES   2
 
+// COMMAND1 through DATA_MSB are contiguous, so the interrupt flag, the
+// configuration and the data are read in a single transfer
+#define ISL29018_STATUS_SIZE_BYTES	4
+#define ISL29018_STATUS_COMMAND1	(ISL29018_REG_ADD_COMMAND1 - ISL29018_REG_ADD_COMMAND1)
+#define ISL29018_STATUS_COMMAND2	(ISL29018_REG_ADD_COMMAND2 - ISL29018_REG_ADD_COMMAND1)
+#define ISL29018_STATUS_DATA		(ISL29018_REG_ADD_DATA_LSB - ISL29018_REG_ADD_COMMAND1)
+
 #define ISL29018_REG_ADD_INT_LT_LSB	0x04
 #define ISL29018_REG_ADD_INT_LT_MSB	0x05
 #define ISL29018_REG_ADD_INT_HT_LSB	0x06
@@ -55,13 +63,26 @@ enum isl29018_int_time {
 	ISL29018_INT_TIME_4,
 };
 
-static const unsigned int isl29018_int_utimes[3][4] = {
+enum isl29018_range {
+	ISL29018_RANGE_1K,
+	ISL29018_RANGE_4K,
+	ISL29018_RANGE_16K,
+	ISL29018_RANGE_64K,
+};
+
+enum isl29018_chip {
+	ISL29018_CHIP_29018,
+	ISL29018_CHIP_29023,
+	ISL29018_CHIP_29035,
+};
+
+static constexpr unsigned int isl29018_int_utimes[3][4] = {
 	{90000, 5630, 351, 21},
 	{90000, 5600, 352, 22},
 	{105000, 6500, 410, 25},
 };
 
-static const struct isl29018_scale {
+static constexpr struct isl29018_scale {
 	unsigned int scale;
 	unsigned int uscale;
 } isl29018_scales[4][4] = {
@@ -71,9 +92,9 @@ static const struct isl29018_scale {
 	{ {62, 500000}, {250, 0}, {1000, 0}, {4000, 0} }
 };
 
-const unsigned short SENSOR_ALS_NAME[] = L"Ambient Light Sensor";
-const unsigned short SENSOR_ALS_DESCRIPTION[] = L"Ambient Light Sensor";
-const unsigned short SENSOR_ALS_ID[] = L"ISL29018";
-const unsigned short SENSOR_ALS_MANUFACTURER[] = L"Intersil";
-const unsigned short SENSOR_ALS_MODEL[] = L"ISL29018";
-const unsigned short SENSOR_ALS_SERIAL_NUMBER[] = L"0123456789=0123456789";
+const WCHAR SENSOR_ALS_NAME[] = L"Ambient Light Sensor";
+const WCHAR SENSOR_ALS_DESCRIPTION[] = L"Ambient Light Sensor";
+const WCHAR SENSOR_ALS_ID[] = L"ISL29018";
+const WCHAR SENSOR_ALS_MANUFACTURER[] = L"Intersil";
+const WCHAR SENSOR_ALS_MODEL[] = L"ISL29018";
+const WCHAR SENSOR_ALS_SERIAL_NUMBER[] = L"0123456789=0123456789";
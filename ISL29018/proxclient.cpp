@@ -0,0 +1,692 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved.
+//
+//Abstract:
+//
+//    This module contains the implementation of driver callback functions
+//    from clx to the ISL29018 proximity channel.
+//
+//Environment:
+//
+//   Windows User-Mode Driver Framework (UMDF)
+
+#include "ProxDevice.h"
+#include "isl29018.h"
+
+#include "ProxClient.tmh"
+
+
+#define Prx_Initial_DataInterval_Ms               (ISL29018_CONV_TIME_MS)
+
+// Proximity Sensor Unique ID
+// {8A3D6C1B-2F4E-4B7A-9C15-0E6D2B4F7A93}
+DEFINE_GUID(GUID_PrxDevice_UniqueID,
+    0x8a3d6c1b, 0x2f4e, 0x4b7a, 0x9c, 0x15, 0xe, 0x6d, 0x2b, 0x4f, 0x7a, 0x93);
+
+//------------------------------------------------------------------------------
+// Function: Initialize
+//
+// This routine initializes the proximity sensor to its default properties
+//
+// Arguments:
+//       Device: IN: WDFDEVICE object
+//       SensorInstance: IN: SENSOROBJECT for each sensor instance
+//       pAls: IN: light sensor instance which owns the chip
+//
+// Return Value:
+//      NTSTATUS code
+//------------------------------------------------------------------------------
+NTSTATUS
+ProxDevice::Initialize(
+    _In_ WDFDEVICE Device,
+    _In_ SENSOROBJECT SensorInstance,
+    _In_ PAlsDevice pAls
+)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    //
+    // Store device and instance
+    //
+    m_Device = Device;
+    m_SensorInstance = SensorInstance;
+    m_pAls = pAls;
+    m_Lifecycle.Reset(Lifecycle_Idle);
+    m_FirstSample = true;
+    m_Detected = false;
+
+    //
+    // Sensor Enumeration Properties
+    //
+    {
+        WDF_OBJECT_ATTRIBUTES MemoryAttributes;
+        WDFMEMORY MemoryHandle = NULL;
+        ULONG Size = SENSOR_COLLECTION_LIST_SIZE(SENSOR_ENUMERATION_PROPERTIES_COUNT);
+
+        MemoryHandle = NULL;
+        WDF_OBJECT_ATTRIBUTES_INIT(&MemoryAttributes);
+        MemoryAttributes.ParentObject = SensorInstance;
+        Status = WdfMemoryCreate(&MemoryAttributes,
+            PagedPool,
+            SENSORV2_POOL_TAG_PROXIMITY,
+            Size,
+            &MemoryHandle,
+            (PVOID*)&m_pEnumerationProperties);
+        if (!NT_SUCCESS(Status) || m_pEnumerationProperties == nullptr)
+        {
+            TraceError("COMBO %!FUNC! PRX WdfMemoryCreate failed %!STATUS!", Status);
+            goto Exit;
+        }
+
+        SENSOR_COLLECTION_LIST_INIT(m_pEnumerationProperties, Size);
+        m_pEnumerationProperties->Count = SENSOR_ENUMERATION_PROPERTIES_COUNT;
+
+        m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_TYPE].Key = DEVPKEY_Sensor_Type;
+        InitPropVariantFromCLSID(GUID_SensorType_Proximity,
+            &(m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_TYPE].Value));
+
+        m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_MANUFACTURER].Key = DEVPKEY_Sensor_Manufacturer;
+        InitPropVariantFromString(SENSOR_ALS_MANUFACTURER,
+            &(m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_MANUFACTURER].Value));
+
+        m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_MODEL].Key = DEVPKEY_Sensor_Model;
+        InitPropVariantFromString(SENSOR_ALS_MODEL,
+            &(m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_MODEL].Value));
+
+        m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_CONNECTION_TYPE].Key = DEVPKEY_Sensor_ConnectionType;
+        // The DEVPKEY_Sensor_ConnectionType values match the SensorConnectionType enumeration
+        InitPropVariantFromUInt32(static_cast<ULONG>(SensorConnectionType::Integrated),
+            &(m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_CONNECTION_TYPE].Value));
+
+        m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_PERSISTENT_UNIQUE_ID].Key = DEVPKEY_Sensor_PersistentUniqueId;
+        InitPropVariantFromCLSID(ChipUniqueId(GUID_PrxDevice_UniqueID, pAls->m_ChipIndex),
+            &(m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_PERSISTENT_UNIQUE_ID].Value));
+
+        m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_CATEGORY].Key = DEVPKEY_Sensor_Category;
+        InitPropVariantFromCLSID(GUID_SensorCategory_Biometric,
+            &(m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_CATEGORY].Value));
+
+        // Only the proximity sensor of the first chip is the primary one
+        m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_ISPRIMARY].Key = DEVPKEY_Sensor_IsPrimary;
+        InitPropVariantFromBoolean(0 == pAls->m_ChipIndex,
+            &(m_pEnumerationProperties->List[SENSOR_ENUMERATION_PROPERTY_ISPRIMARY].Value));
+    }
+
+    //
+    // Supported Data-Fields
+    //
+    {
+        WDF_OBJECT_ATTRIBUTES MemoryAttributes;
+        WDFMEMORY MemoryHandle = NULL;
+        ULONG Size = SENSOR_PROPERTY_LIST_SIZE(PRX_DATA_COUNT);
+
+        MemoryHandle = NULL;
+        WDF_OBJECT_ATTRIBUTES_INIT(&MemoryAttributes);
+        MemoryAttributes.ParentObject = SensorInstance;
+        Status = WdfMemoryCreate(&MemoryAttributes,
+            PagedPool,
+            SENSORV2_POOL_TAG_PROXIMITY,
+            Size,
+            &MemoryHandle,
+            (PVOID*)&m_pSupportedDataFields);
+        if (!NT_SUCCESS(Status) || m_pSupportedDataFields == nullptr)
+        {
+            TraceError("COMBO %!FUNC! PRX WdfMemoryCreate failed %!STATUS!", Status);
+            goto Exit;
+        }
+
+        SENSOR_PROPERTY_LIST_INIT(m_pSupportedDataFields, Size);
+        m_pSupportedDataFields->Count = PRX_DATA_COUNT;
+
+        m_pSupportedDataFields->List[PRX_DATA_TIMESTAMP] = PKEY_SensorData_Timestamp;
+        m_pSupportedDataFields->List[PRX_DATA_DETECT] = PKEY_SensorData_ProximityDetection;
+    }
+
+    //
+    // Data
+    //
+    {
+        WDF_OBJECT_ATTRIBUTES MemoryAttributes;
+        WDFMEMORY MemoryHandle = NULL;
+        ULONG Size = SENSOR_COLLECTION_LIST_SIZE(PRX_DATA_COUNT);
+        FILETIME Time = { 0 };
+
+        MemoryHandle = NULL;
+        WDF_OBJECT_ATTRIBUTES_INIT(&MemoryAttributes);
+        MemoryAttributes.ParentObject = SensorInstance;
+        Status = WdfMemoryCreate(&MemoryAttributes,
+            PagedPool,
+            SENSORV2_POOL_TAG_PROXIMITY,
+            Size,
+            &MemoryHandle,
+            (PVOID*)&m_pSensorData);
+        if (!NT_SUCCESS(Status) || m_pSensorData == nullptr)
+        {
+            TraceError("COMBO %!FUNC! PRX WdfMemoryCreate failed %!STATUS!", Status);
+            goto Exit;
+        }
+
+        SENSOR_COLLECTION_LIST_INIT(m_pSensorData, Size);
+        m_pSensorData->Count = PRX_DATA_COUNT;
+
+        m_pSensorData->List[PRX_DATA_TIMESTAMP].Key = PKEY_SensorData_Timestamp;
+        GetSystemTimePreciseAsFileTime(&Time);
+        InitPropVariantFromFileTime(&Time, &(m_pSensorData->List[PRX_DATA_TIMESTAMP].Value));
+
+        m_pSensorData->List[PRX_DATA_DETECT].Key = PKEY_SensorData_ProximityDetection;
+        InitPropVariantFromBoolean(FALSE, &(m_pSensorData->List[PRX_DATA_DETECT].Value));
+    }
+
+    //
+    // Sensor Properties
+    //
+    {
+        WDF_OBJECT_ATTRIBUTES MemoryAttributes;
+        WDFMEMORY MemoryHandle = NULL;
+        ULONG Size = SENSOR_COLLECTION_LIST_SIZE(SENSOR_PROPERTY_TYPE + 1);
+
+        MemoryHandle = NULL;
+        WDF_OBJECT_ATTRIBUTES_INIT(&MemoryAttributes);
+        MemoryAttributes.ParentObject = SensorInstance;
+        Status = WdfMemoryCreate(&MemoryAttributes,
+            PagedPool,
+            SENSORV2_POOL_TAG_PROXIMITY,
+            Size,
+            &MemoryHandle,
+            (PVOID*)&m_pSensorProperties);
+        if (!NT_SUCCESS(Status) || m_pSensorProperties == nullptr)
+        {
+            TraceError("COMBO %!FUNC! PRX WdfMemoryCreate failed %!STATUS!", Status);
+            goto Exit;
+        }
+
+        // Same properties as the light sensor, without the response curve
+        SENSOR_COLLECTION_LIST_INIT(m_pSensorProperties, Size);
+        m_pSensorProperties->Count = SENSOR_PROPERTY_TYPE + 1;
+
+        m_pSensorProperties->List[SENSOR_PROPERTY_STATE].Key = PKEY_Sensor_State;
+        InitPropVariantFromUInt32(SensorState_Initializing,
+            &(m_pSensorProperties->List[SENSOR_PROPERTY_STATE].Value));
+
+        m_pSensorProperties->List[SENSOR_PROPERTY_MIN_DATA_INTERVAL].Key = PKEY_Sensor_MinimumDataInterval_Ms;
+        m_Interval = Prx_Initial_DataInterval_Ms;
+        m_MinimumInterval = Isl29018MinimumIntervalMs(AlsDevice_Chip);
+        InitPropVariantFromUInt32(m_MinimumInterval,
+            &(m_pSensorProperties->List[SENSOR_PROPERTY_MIN_DATA_INTERVAL].Value));
+
+        m_pSensorProperties->List[SENSOR_PROPERTY_MAX_DATA_FIELD_SIZE].Key = PKEY_Sensor_MaximumDataFieldSize_Bytes;
+        InitPropVariantFromUInt32(CollectionsListGetMarshalledSize(m_pSensorData),
+            &(m_pSensorProperties->List[SENSOR_PROPERTY_MAX_DATA_FIELD_SIZE].Value));
+
+        m_pSensorProperties->List[SENSOR_PROPERTY_TYPE].Key = PKEY_Sensor_Type;
+        InitPropVariantFromCLSID(GUID_SensorType_Proximity,
+            &(m_pSensorProperties->List[SENSOR_PROPERTY_TYPE].Value));
+    }
+
+    //
+    // Thresholds, detection changes are always reported
+    //
+    {
+        WDF_OBJECT_ATTRIBUTES MemoryAttributes;
+        WDFMEMORY MemoryHandle = NULL;
+        ULONG Size = SENSOR_COLLECTION_LIST_SIZE(PRX_THRESHOLD_COUNT);
+
+        MemoryHandle = NULL;
+        WDF_OBJECT_ATTRIBUTES_INIT(&MemoryAttributes);
+        MemoryAttributes.ParentObject = SensorInstance;
+        Status = WdfMemoryCreate(&MemoryAttributes,
+            PagedPool,
+            SENSORV2_POOL_TAG_PROXIMITY,
+            Size,
+            &MemoryHandle,
+            (PVOID*)&m_pThresholds);
+        if (!NT_SUCCESS(Status) || m_pThresholds == nullptr)
+        {
+            TraceError("COMBO %!FUNC! PRX WdfMemoryCreate failed %!STATUS!", Status);
+            goto Exit;
+        }
+
+        SENSOR_COLLECTION_LIST_INIT(m_pThresholds, Size);
+        m_pThresholds->Count = PRX_THRESHOLD_COUNT;
+    }
+
+Exit:
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+//------------------------------------------------------------------------------
+// Function: OnSample
+//
+// This routine is called by the light sensor once a proximity conversion
+// completed. It applies the detection hysteresis and pushes detection changes
+// to the clx.
+//
+// Arguments:
+//       RawCount: IN: result of the proximity conversion
+//       MaxCount: IN: highest count at the current resolution
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+ProxDevice::OnSample(
+    _In_ ULONG RawCount,
+    _In_ ULONG MaxCount
+)
+{
+    FILETIME TimeStamp = { 0 };
+    bool Detected = m_Detected;
+
+    SENSOR_HotPathEnter();
+
+    if (RawCount > (MaxCount / ProxDevice_Detect_Denominator))
+    {
+        Detected = true;
+    }
+    else if (RawCount < (MaxCount / ProxDevice_Release_Denominator))
+    {
+        Detected = false;
+    }
+
+    if (m_Lifecycle.IsStarted() && (m_FirstSample || Detected != m_Detected))
+    {
+        m_Detected = Detected;
+        m_FirstSample = false;
+
+        InitPropVariantFromBoolean(m_Detected ? TRUE : FALSE, &(m_pSensorData->List[PRX_DATA_DETECT].Value));
+
+        GetSystemTimePreciseAsFileTime(&TimeStamp);
+        InitPropVariantFromFileTime(&TimeStamp, &(m_pSensorData->List[PRX_DATA_TIMESTAMP].Value));
+
+        ULONGLONG Start = 0;
+        ULONGLONG End = 0;
+        QueryInterruptTimePrecise(&Start);
+        SensorsCxSensorDataReady(m_SensorInstance, m_pSensorData);
+        QueryInterruptTimePrecise(&End);
+        m_pAls->m_Latency.RecordSince(LatencyStage_DataReady, Start, End);
+    }
+
+    SENSOR_HotPathExit(STATUS_SUCCESS);
+}
+
+//------------------------------------------------------------------------------
+// Function: SetState
+//
+// This routine publishes the sensor state
+//
+// Arguments:
+//       State: IN: one of the SensorState values
+//
+// Return Value:
+//      None
+//------------------------------------------------------------------------------
+VOID
+ProxDevice::SetState(
+    _In_ ULONG State
+)
+{
+    InitPropVariantFromUInt32(State, &(m_pSensorProperties->List[SENSOR_PROPERTY_STATE].Value));
+}
+
+// Called by Sensor CLX to begin continously sampling the sensor.
+NTSTATUS ProxDevice::OnStart(
+    _In_ SENSOROBJECT SensorInstance)    // Sensor device object
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    // Get the device context
+    PProxDevice pDevice = GetProxDeviceContextFromSensorInstance(SensorInstance);
+    if (nullptr == pDevice)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("PRX %!FUNC! Sensor(0x%p) parameter is invalid %!STATUS!", SensorInstance, Status);
+    }
+    else if (!pDevice->m_pAls->m_Lifecycle.IsPoweredOn())
+    {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        TraceError("PRX %!FUNC! Sensor is not powered on! %!STATUS!", Status);
+    }
+    else if (!pDevice->m_Lifecycle.Transition(Lifecycle_Idle, Lifecycle_Starting))
+    {
+        Status = STATUS_INVALID_DEVICE_STATE;
+        TraceError("PRX %!FUNC! Sensor is not stopped! %!STATUS!", Status);
+    }
+    else
+    {
+        pDevice->m_FirstSample = true;
+
+        // The light sensor slots the proximity conversions into its ADC schedule
+        Status = pDevice->m_pAls->UpdateProximity(true, pDevice->m_Interval);
+        if (!NT_SUCCESS(Status))
+        {
+            TraceError("PRX %!FUNC! Failed to start proximity conversions! %!STATUS!", Status);
+            pDevice->m_Lifecycle.Transition(Lifecycle_Starting, Lifecycle_Idle);
+        }
+        else
+        {
+            pDevice->m_Lifecycle.Transition(Lifecycle_Starting, Lifecycle_Running);
+            pDevice->SetState(SensorState_Active);
+        }
+    }
+
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to stop continously sampling the sensor.
+NTSTATUS ProxDevice::OnStop(
+    _In_ SENSOROBJECT SensorInstance)   // Sensor device object
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    // Get the device context
+    PProxDevice pDevice = GetProxDeviceContextFromSensorInstance(SensorInstance);
+    if (nullptr == pDevice)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("PRX %!FUNC! Sensor(0x%p) parameter is invalid %!STATUS!", SensorInstance, Status);
+    }
+    else
+    {
+        pDevice->m_Lifecycle.Transition(Lifecycle_Running, Lifecycle_Stopping);
+
+        Status = pDevice->m_pAls->UpdateProximity(false, pDevice->m_Interval);
+        if (!NT_SUCCESS(Status))
+        {
+            TraceError("PRX %!FUNC! Failed to stop proximity conversions! %!STATUS!", Status);
+        }
+
+        pDevice->SetState(SensorState_Idle);
+        pDevice->m_Lifecycle.Transition(Lifecycle_Stopping, Lifecycle_Idle);
+    }
+
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to get supported data fields.
+NTSTATUS ProxDevice::OnGetSupportedDataFields(
+    _In_ SENSOROBJECT SensorInstance,          // Sensor device object
+    _Inout_opt_ PSENSOR_PROPERTY_LIST pFields, // Pointer to a list of supported properties
+    _Out_ PULONG pSize)                        // Number of bytes for the list of supported properties
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    if (nullptr == pSize)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("PRX %!FUNC! pSize: Invalid parameter! %!STATUS!", Status);
+    }
+    else
+    {
+        *pSize = 0;
+
+        // Get the device context
+        PProxDevice pDevice = GetProxDeviceContextFromSensorInstance(SensorInstance);
+        if (nullptr == pDevice)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            TraceError("PRX %!FUNC! Invalid parameters! %!STATUS!", Status);
+        }
+        else if (nullptr == pFields)
+        {
+            // Just return size
+            *pSize = pDevice->m_pSupportedDataFields->AllocatedSizeInBytes;
+        }
+        else
+        {
+            if (pFields->AllocatedSizeInBytes < pDevice->m_pSupportedDataFields->AllocatedSizeInBytes)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                TraceError("PRX %!FUNC! Buffer is too small. Failed %!STATUS!", Status);
+            }
+            else
+            {
+                // Fill out data
+                Status = PropertiesListCopy(pFields, pDevice->m_pSupportedDataFields);
+                if (!NT_SUCCESS(Status))
+                {
+                    TraceError("PRX %!FUNC! PropertiesListCopy failed %!STATUS!", Status);
+                }
+                else
+                {
+                    *pSize = pDevice->m_pSupportedDataFields->AllocatedSizeInBytes;
+                }
+            }
+        }
+    }
+
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to get sensor properties.
+NTSTATUS ProxDevice::OnGetProperties(
+    _In_ SENSOROBJECT SensorInstance,                   // Sensor device object
+    _Inout_opt_ PSENSOR_COLLECTION_LIST pProperties,    // Pointer to a list of sensor properties
+    _Out_ PULONG pSize)                                 // Number of bytes for the list of sensor properties
+{
+    PProxDevice pDevice = GetProxDeviceContextFromSensorInstance(SensorInstance);
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    if (nullptr == pDevice || nullptr == pSize)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("PRX %!FUNC! Invalid parameters! %!STATUS!", Status);
+        goto Exit;
+    }
+
+    if (nullptr == pProperties)
+    {
+        // Just return size
+        *pSize = CollectionsListGetMarshalledSize(pDevice->m_pSensorProperties);
+    }
+    else
+    {
+        if (pProperties->AllocatedSizeInBytes <
+            CollectionsListGetMarshalledSize(pDevice->m_pSensorProperties))
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            TraceError("PRX %!FUNC! Buffer is too small. Failed %!STATUS!", Status);
+            goto Exit;
+        }
+
+        // Fill out all data
+        Status = CollectionsListCopyAndMarshall(pProperties, pDevice->m_pSensorProperties);
+        if (!NT_SUCCESS(Status))
+        {
+            TraceError("PRX %!FUNC! CollectionsListCopyAndMarshall failed %!STATUS!", Status);
+            goto Exit;
+        }
+
+        *pSize = CollectionsListGetMarshalledSize(pDevice->m_pSensorProperties);
+    }
+
+Exit:
+    if (nullptr != pSize && !NT_SUCCESS(Status))
+    {
+        *pSize = 0;
+    }
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to get data field properties. The detection is a
+// boolean, so it has no resolution or range.
+NTSTATUS ProxDevice::OnGetDataFieldProperties(
+    _In_ SENSOROBJECT /*SensorInstance*/,               // Sensor device object
+    _In_ const PROPERTYKEY* /*DataField*/,              // Pointer to the propertykey of requested property
+    _Inout_opt_ PSENSOR_COLLECTION_LIST /*pProperties*/,// Pointer to a list of sensor properties
+    _Out_ PULONG pSize)                                 // Number of bytes for the list of sensor properties
+{
+    NTSTATUS Status = STATUS_NOT_SUPPORTED;
+
+    SENSOR_FunctionEnter();
+
+    if (nullptr != pSize)
+    {
+        *pSize = 0;
+    }
+
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to get sampling rate of the sensor.
+NTSTATUS ProxDevice::OnGetDataInterval(
+    _In_ SENSOROBJECT SensorInstance,   // Sensor device object
+    _Out_ PULONG pDataRateMs)           // Sampling rate in milliseconds
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    PProxDevice pDevice = GetProxDeviceContextFromSensorInstance(SensorInstance);
+    if (nullptr == pDevice || nullptr == pDataRateMs)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("PRX %!FUNC! Invalid parameters! %!STATUS!", Status);
+    }
+    else
+    {
+        *pDataRateMs = pDevice->m_Interval;
+        TraceInformation("%!FUNC! giving data rate %lu", *pDataRateMs);
+    }
+
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to set sampling rate of the sensor.
+NTSTATUS ProxDevice::OnSetDataInterval(
+    _In_ SENSOROBJECT SensorInstance, // Sensor device object
+    _In_ ULONG DataRateMs)            // Sampling rate in milliseconds
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    PProxDevice pDevice = GetProxDeviceContextFromSensorInstance(SensorInstance);
+    if (nullptr == pDevice || DataRateMs < pDevice->m_MinimumInterval)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("PRX %!FUNC! Invalid parameter!");
+    }
+    else
+    {
+        pDevice->m_Interval = DataRateMs;
+
+        if (pDevice->m_Lifecycle.IsStarted())
+        {
+            Status = pDevice->m_pAls->UpdateProximity(true, pDevice->m_Interval);
+        }
+    }
+
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to get data thresholds.
+NTSTATUS ProxDevice::OnGetDataThresholds(
+    _In_ SENSOROBJECT SensorInstance,                   // Sensor Device Object
+    _Inout_opt_ PSENSOR_COLLECTION_LIST pThresholds,    // Pointer to a list of sensor thresholds
+    _Out_ PULONG pSize)                                 // Number of bytes for the list of sensor thresholds
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    if (nullptr == pSize)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("PRX %!FUNC! pSize: Invalid parameter! %!STATUS!", Status);
+    }
+    else
+    {
+        *pSize = 0;
+
+        PProxDevice pDevice = GetProxDeviceContextFromSensorInstance(SensorInstance);
+        if (nullptr == pDevice)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            TraceError("PRX %!FUNC! Invalid parameters! %!STATUS!", Status);
+        }
+        else if (nullptr == pThresholds)
+        {
+            // Just return size
+            *pSize = CollectionsListGetMarshalledSize(pDevice->m_pThresholds);
+        }
+        else if (pThresholds->AllocatedSizeInBytes < CollectionsListGetMarshalledSize(pDevice->m_pThresholds))
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            TraceError("PRX %!FUNC! Buffer is too small. Failed %!STATUS!", Status);
+        }
+        else
+        {
+            Status = CollectionsListCopyAndMarshall(pThresholds, pDevice->m_pThresholds);
+            if (!NT_SUCCESS(Status))
+            {
+                TraceError("PRX %!FUNC! CollectionsListCopyAndMarshall failed %!STATUS!", Status);
+            }
+            else
+            {
+                *pSize = CollectionsListGetMarshalledSize(pDevice->m_pThresholds);
+            }
+        }
+    }
+
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to set data thresholds. Detection changes are always
+// reported, so any threshold is rejected.
+NTSTATUS ProxDevice::OnSetDataThresholds(
+    _In_ SENSOROBJECT SensorInstance,           // Sensor Device Object
+    _In_ PSENSOR_COLLECTION_LIST pThresholds)   // Pointer to a list of sensor thresholds
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    SENSOR_FunctionEnter();
+
+    PProxDevice pDevice = GetProxDeviceContextFromSensorInstance(SensorInstance);
+    if (nullptr == pDevice || nullptr == pThresholds)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("PRX %!FUNC! Sensor(0x%p) parameter is invalid %!STATUS!", SensorInstance, Status);
+    }
+    else if (pThresholds->Count != 0)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        TraceError("PRX %!FUNC! Sensor does NOT have threshold for this data field. Failed %!STATUS!", Status);
+    }
+
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
+
+// Called by Sensor CLX to handle IOCTLs that clx does not support
+NTSTATUS ProxDevice::OnIoControl(
+    _In_ SENSOROBJECT /*SensorInstance*/, // WDF queue object
+    _In_ WDFREQUEST /*Request*/,          // WDF request object
+    _In_ size_t /*OutputBufferLength*/,   // number of bytes to retrieve from output buffer
+    _In_ size_t /*InputBufferLength*/,    // number of bytes to retrieve from input buffer
+    _In_ ULONG /*IoControlCode*/)         // IOCTL control code
+{
+    NTSTATUS Status = STATUS_NOT_SUPPORTED;
+
+    SENSOR_FunctionEnter();
+
+    SENSOR_FunctionExit(Status);
+    return Status;
+}
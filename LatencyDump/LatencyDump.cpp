@@ -0,0 +1,263 @@
+//Copyright (C) Microsoft Corporation, All Rights Reserved
+//
+//Abstract:
+//
+//    This module contains a console tool that reads the latency histograms of
+//    the ISL29018 light sensors through IOCTL_ISL29018_GET_LATENCY and prints
+//    them, or clears them through IOCTL_ISL29018_RESET_LATENCY.
+//
+//    Usage: LatencyDump [-reset] [interface path]
+//
+//    Without a path every sensor interface is tried; the sensors of other
+//    drivers reject the IOCTL and are skipped.
+//
+//Environment:
+//
+//    Windows user mode
+
+#include <windows.h>
+#include <initguid.h>
+#include <sensors.h>
+#include <setupapi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+#include "Isl29018Ioctl.h"
+
+#define LatencyDump_BarWidth                (40)
+
+static const PCWSTR g_StageNames[LatencyStage_Count] =
+{
+    L"I2C transaction",
+    L"Interrupt to work item",
+    L"Beat deadline error",
+    L"Sample read and processing",
+    L"SensorsCxSensorDataReady",
+};
+
+// Print a duration given in 100ns ticks
+static VOID PrintDuration(
+    _In_ ULONGLONG Ticks)
+{
+    if (Ticks < 10 * 1000)
+    {
+        wprintf(L"%8.1f us", Ticks / 10.0);
+    }
+    else
+    {
+        wprintf(L"%8.2f ms", Ticks / 10000.0);
+    }
+}
+
+// Upper bound of the bucket holding the given share of the durations, in us
+static ULONGLONG GetPercentile(
+    _In_ const ISL29018_LATENCY_HISTOGRAM* pStage,
+    _In_ ULONG Percent)
+{
+    ULONGLONG Total = 0;
+    for (ULONG i = 0; i < ISL29018_LATENCY_BUCKETS; i++)
+    {
+        Total += pStage->Buckets[i];
+    }
+
+    ULONGLONG Target = (Total * Percent + 99) / 100;
+    ULONGLONG Seen = 0;
+    for (ULONG i = 0; i < ISL29018_LATENCY_BUCKETS; i++)
+    {
+        Seen += pStage->Buckets[i];
+        if (Seen >= Target && Seen != 0)
+        {
+            return 1ULL << i;
+        }
+    }
+
+    return 0;
+}
+
+static VOID PrintStage(
+    _In_ ULONG Stage,
+    _In_ const ISL29018_LATENCY_HISTOGRAM* pStage)
+{
+    wprintf(L"\n  %s: %llu\n", g_StageNames[Stage], pStage->Count);
+    if (pStage->Count == 0)
+    {
+        return;
+    }
+
+    wprintf(L"    mean ");
+    PrintDuration(pStage->Sum / pStage->Count);
+    wprintf(L"   max ");
+    PrintDuration(pStage->Max);
+    wprintf(L"   p50 <= %llu us   p99 <= %llu us\n", GetPercentile(pStage, 50), GetPercentile(pStage, 99));
+
+    ULONGLONG Largest = 0;
+    for (ULONG i = 0; i < ISL29018_LATENCY_BUCKETS; i++)
+    {
+        Largest = (pStage->Buckets[i] > Largest) ? pStage->Buckets[i] : Largest;
+    }
+
+    for (ULONG i = 0; i < ISL29018_LATENCY_BUCKETS; i++)
+    {
+        if (pStage->Buckets[i] == 0)
+        {
+            continue;
+        }
+
+        ULONGLONG Low = (i == 0) ? 0 : (1ULL << (i - 1));
+        ULONG Width = static_cast<ULONG>((pStage->Buckets[i] * LatencyDump_BarWidth + Largest - 1) / Largest);
+
+        if (i == ISL29018_LATENCY_BUCKETS - 1)
+        {
+            wprintf(L"    %10llu us and up  %10llu ", Low, pStage->Buckets[i]);
+        }
+        else
+        {
+            wprintf(L"    %10llu-%-10llu us %10llu ", Low, 1ULL << i, pStage->Buckets[i]);
+        }
+        for (ULONG j = 0; j < Width; j++)
+        {
+            wprintf(L"#");
+        }
+        wprintf(L"\n");
+    }
+}
+
+// Read or clear the histograms of one interface. Returns FALSE if the
+// interface does not belong to the driver.
+static BOOL DumpInterface(
+    _In_ PCWSTR Path,
+    _In_ BOOL Reset)
+{
+    HANDLE Device = CreateFileW(Path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    if (INVALID_HANDLE_VALUE == Device)
+    {
+        return FALSE;
+    }
+
+    BOOL Result = FALSE;
+    DWORD Returned = 0;
+
+    if (Reset)
+    {
+        Result = DeviceIoControl(Device, IOCTL_ISL29018_RESET_LATENCY, NULL, 0, NULL, 0, &Returned, NULL);
+        if (Result)
+        {
+            wprintf(L"%s: cleared\n", Path);
+        }
+    }
+    else
+    {
+        ISL29018_LATENCY_SNAPSHOT Snapshot = {};
+
+        Result = DeviceIoControl(Device, IOCTL_ISL29018_GET_LATENCY, NULL, 0, &Snapshot, sizeof(Snapshot), &Returned, NULL);
+        if (Result)
+        {
+            if (Returned < sizeof(Snapshot) ||
+                Snapshot.Version != ISL29018_LATENCY_VERSION ||
+                Snapshot.Size != sizeof(Snapshot) ||
+                Snapshot.StageCount != LatencyStage_Count ||
+                Snapshot.BucketCount != ISL29018_LATENCY_BUCKETS)
+            {
+                wprintf(L"%s: snapshot version %lu of %lu bytes does not match this tool\n", Path, Snapshot.Version, Returned);
+            }
+            else
+            {
+                wprintf(L"%s: %.1f s since cleared\n", Path, Snapshot.Elapsed / 10000000.0);
+                for (ULONG i = 0; i < LatencyStage_Count; i++)
+                {
+                    PrintStage(i, &Snapshot.Stages[i]);
+                }
+                wprintf(L"\n");
+            }
+        }
+    }
+
+    CloseHandle(Device);
+    return Result;
+}
+
+static ULONG DumpAllInterfaces(
+    _In_ BOOL Reset)
+{
+    ULONG Found = 0;
+    HDEVINFO DevInfo = SetupDiGetClassDevsW(&GUID_DEVINTERFACE_SENSOR, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+    if (INVALID_HANDLE_VALUE == DevInfo)
+    {
+        return 0;
+    }
+
+    SP_DEVICE_INTERFACE_DATA InterfaceData = {};
+    InterfaceData.cbSize = sizeof(InterfaceData);
+
+    for (DWORD Index = 0; SetupDiEnumDeviceInterfaces(DevInfo, NULL, &GUID_DEVINTERFACE_SENSOR, Index, &InterfaceData); Index++)
+    {
+        DWORD Size = 0;
+        SetupDiGetDeviceInterfaceDetailW(DevInfo, &InterfaceData, NULL, 0, &Size, NULL);
+        if (Size == 0)
+        {
+            continue;
+        }
+
+        PSP_DEVICE_INTERFACE_DETAIL_DATA_W pDetail = static_cast<PSP_DEVICE_INTERFACE_DETAIL_DATA_W>(malloc(Size));
+        if (nullptr == pDetail)
+        {
+            break;
+        }
+
+        pDetail->cbSize = sizeof(*pDetail);
+        if (SetupDiGetDeviceInterfaceDetailW(DevInfo, &InterfaceData, pDetail, Size, NULL, NULL) &&
+            DumpInterface(pDetail->DevicePath, Reset))
+        {
+            Found++;
+        }
+
+        free(pDetail);
+    }
+
+    SetupDiDestroyDeviceInfoList(DevInfo);
+    return Found;
+}
+
+int __cdecl wmain(
+    _In_ int argc,
+    _In_reads_(argc) wchar_t** argv)
+{
+    BOOL Reset = FALSE;
+    PCWSTR Path = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == _wcsicmp(argv[i], L"-reset"))
+        {
+            Reset = TRUE;
+        }
+        else if (argv[i][0] == L'-' || nullptr != Path)
+        {
+            wprintf(L"Usage: LatencyDump [-reset] [interface path]\n");
+            return 1;
+        }
+        else
+        {
+            Path = argv[i];
+        }
+    }
+
+    if (nullptr != Path)
+    {
+        if (!DumpInterface(Path, Reset))
+        {
+            wprintf(L"%s: IOCTL failed, error %lu\n", Path, GetLastError());
+            return 1;
+        }
+        return 0;
+    }
+
+    if (0 == DumpAllInterfaces(Reset))
+    {
+        wprintf(L"No ISL29018 light sensor found\n");
+        return 1;
+    }
+
+    return 0;
+}